@@ -2,6 +2,7 @@
 #define CLIENT_H
 
 #include "../../common/headers/common.h"
+#include "../../common/headers/log.h"
 
 /*
  * Used as client for connection to inet address
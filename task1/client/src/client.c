@@ -48,10 +48,16 @@ void run_client(struct client* client) {
  */
 void process_input(struct client* client) {
   char buffer[BUFFER_SIZE];
+  char serv_ip[INET_ADDRSTRLEN];
+
+  inet_ntop(AF_INET, &client->serv.sin_addr, serv_ip, sizeof(serv_ip));
   
   /* Wait for user input */
   while (1) {
+    /* Prompt goes after everything logged so far */
+    flush_log();
     printf("Enter message: ");
+    fflush(stdout);
     
     /* Read user input */
     if (fgets(buffer, sizeof(buffer), stdin) == NULL)
@@ -68,10 +74,10 @@ void process_input(struct client* client) {
       break;
     }
 
-    printf("SERVER: Server %s:%d send response: %s\n", 
-           inet_ntoa(client->serv.sin_addr), 
-           ntohs(client->serv.sin_port), 
-           message);
+    log_message(LOG_LEVEL_INFO, "SERVER: Server %s:%d send response: %s\n", 
+                serv_ip,
+                ntohs(client->serv.sin_port), 
+                message);
     free(message);
   }
 }
@@ -83,6 +89,7 @@ void process_input(struct client* client) {
  */
 void send_message(struct client* client, char buffer[BUFFER_SIZE]) {
   ssize_t bytes_send;
+  char serv_ip[INET_ADDRSTRLEN];
   
   /* Send message to server */
   bytes_send = send(client->sfd, buffer, strlen(buffer), 0);
@@ -90,10 +97,11 @@ void send_message(struct client* client, char buffer[BUFFER_SIZE]) {
   if (bytes_send == -1)
     print_error("sendto");
 
-  printf("CLIENT: Send message to %s:%d: %s\n", 
-         inet_ntoa(client->serv.sin_addr), 
-         ntohs(client->serv.sin_port), 
-         buffer);
+  inet_ntop(AF_INET, &client->serv.sin_addr, serv_ip, sizeof(serv_ip));
+  log_message(LOG_LEVEL_INFO, "CLIENT: Send message to %s:%d: %s\n", 
+              serv_ip,
+              ntohs(client->serv.sin_port), 
+              buffer);
 }
 
 /*
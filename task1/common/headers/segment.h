@@ -0,0 +1,122 @@
+#ifndef SEGMENT_H
+#define SEGMENT_H
+
+#include <stdint.h>
+
+/*
+ * Segment of packet store is three files sharing one name:
+ *   NAME.rec - fixed-width records, appended in capture order
+ *   NAME.dat - stored packet bytes, record points into it
+ *   NAME.idx - time and flow index, written once segment is sealed
+ * Segment without index is still being written and can only
+ * be scanned.
+ */
+#define SEGMENT_PREFIX "segment"
+#define SEGMENT_RECORDS ".rec"
+#define SEGMENT_DATA ".dat"
+#define SEGMENT_INDEX ".idx"
+
+#define SEGMENT_MAGIC 0x58444953u
+#define SEGMENT_VERSION 1
+
+/* Records covered by one entry of time index */
+#define SEGMENT_STRIDE 256
+
+/*
+ * Used as fixed-width record of one packet. Addresses and
+ * ports are in network byte order, ports are 0 when packet
+ * is not TCP or UDP or is not the first fragment.
+ */
+struct segment_record {
+  /* Capture time in ns */
+  uint64_t timestamp;
+
+  /* Offset of packet bytes in data file */
+  uint32_t offset;
+
+  /* Stored and original length of packet */
+  uint16_t caplen;
+  uint16_t wire_length;
+
+  uint32_t src;
+  uint32_t dst;
+  uint16_t sport;
+  uint16_t dport;
+  uint8_t proto;
+  uint8_t pad[3];
+};
+
+/*
+ * Used as header of index file. Header is followed by
+ * blocks of time index, flows sorted by key and postings.
+ */
+struct segment_header {
+  uint32_t magic;
+  uint16_t version;
+
+  /* Records per time index block */
+  uint16_t stride;
+
+  /* Amount of records, flows and time index blocks */
+  uint32_t records;
+  uint32_t flows;
+  uint32_t blocks;
+  uint32_t pad;
+
+  /* Earliest and latest capture time of segment in ns */
+  uint64_t first;
+  uint64_t last;
+
+  /* Size of data file */
+  uint64_t data_length;
+};
+
+/*
+ * Used as sparse time index entry. Block i covers records
+ * [i * stride, (i + 1) * stride), capture times of several
+ * queues are not strictly ordered, so both bounds are kept.
+ */
+struct segment_block {
+  uint64_t first;
+  uint64_t last;
+};
+
+/*
+ * Used as entry of per-segment flow index. Records of flow
+ * are postings[first .. first + count), in record order.
+ */
+struct segment_flow {
+  uint32_t src;
+  uint32_t dst;
+  uint16_t sport;
+  uint16_t dport;
+  uint8_t proto;
+  uint8_t pad[3];
+  uint32_t first;
+  uint32_t count;
+};
+
+/*
+ * compare_segment_flows - used to order flows of index
+ * by 5-tuple.
+ * @a - pointer to first flow
+ * @b - pointer to second flow
+ *
+ * Return: negative, zero or positive like memcmp
+ */
+static inline int compare_segment_flows(const struct segment_flow* a,
+                                        const struct segment_flow* b) {
+  if (a->src != b->src)
+    return a->src < b->src ? -1 : 1;
+  if (a->dst != b->dst)
+    return a->dst < b->dst ? -1 : 1;
+  if (a->sport != b->sport)
+    return a->sport < b->sport ? -1 : 1;
+  if (a->dport != b->dport)
+    return a->dport < b->dport ? -1 : 1;
+  if (a->proto != b->proto)
+    return a->proto < b->proto ? -1 : 1;
+  return 0;
+}
+
+#endif // !SEGMENT_H
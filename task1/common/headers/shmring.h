@@ -0,0 +1,99 @@
+#ifndef SHMRING_H
+#define SHMRING_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Shared-memory capture ring is POSIX shared memory object
+ * with header followed by fixed-size slots. Publisher writes
+ * packet with sequence n into slot n % slot_count, so readers
+ * never need lock and never slow publisher down. Every slot is
+ * seqlock: its sequence is odd while it is written and
+ * 2 * (n + 1) once packet n is complete. Reader copies packet
+ * out and checks that sequence did not change meanwhile,
+ * otherwise packet was overwritten and reader was overrun.
+ */
+#define SHM_RING_MAGIC 0x474E5253u
+#define SHM_RING_VERSION 1
+#define SHM_RING_SLOTS 8192
+
+/* Slot keeps headers and start of payload, full packets are opt-in */
+#define SHM_RING_SLOT_SIZE 128
+
+/*
+ * Used as header of ring. Head lives on its own cache
+ * line, so readers polling it do not share line with
+ * fields they read once.
+ */
+struct shm_ring_header {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t header_size;
+
+  /* Slot count is power of two, slot size multiple of 64 */
+  uint32_t slot_count;
+  uint32_t slot_size;
+
+  /* Maximum bytes of packet in slot */
+  uint32_t snaplen;
+
+  /* pcap link type of packets */
+  uint32_t linktype;
+
+  /* Set by publisher when it stops */
+  uint32_t closed;
+
+  /* Sequence of next packet to be published */
+  uint64_t head __attribute__((aligned(64)));
+} __attribute__((aligned(64)));
+
+/* Used as header of slot, packet bytes follow */
+struct shm_slot {
+  /* Odd while written, 2 * (sequence + 1) when complete */
+  uint64_t sequence;
+
+  /* Capture time in ns */
+  uint64_t timestamp;
+
+  uint32_t caplen;
+  uint32_t wire_length;
+};
+
+/* Used to describe packet copied out of ring */
+struct shm_packet {
+  uint64_t sequence;
+  uint64_t timestamp;
+  uint32_t caplen;
+  uint32_t wire_length;
+};
+
+/*
+ * Used as independent reader of ring. Every reader has
+ * own position and counts packets it missed.
+ */
+struct shm_reader {
+  int fd;
+
+  /* Mapping of whole ring */
+  const struct shm_ring_header* header;
+  const uint8_t* slots;
+  size_t size;
+  uint64_t mask;
+
+  /* Sequence of next packet to read */
+  uint64_t cursor;
+
+  /* Statistics */
+  uint64_t packets;
+  uint64_t lost;
+};
+
+struct shm_reader* open_shm_reader(const char* name);
+
+int read_shm_packet(struct shm_reader* reader, struct shm_packet* packet,
+                    void* buffer, size_t size);
+
+void close_shm_reader(struct shm_reader* reader);
+
+#endif // !SHMRING_H
@@ -0,0 +1,372 @@
+#include "../headers/log.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/uio.h>
+
+/* Minimum level of messages that are logged */
+static volatile int log_threshold = LOG_LEVEL_INFO;
+
+/* File descriptor log is written to */
+static int log_fd = STDOUT_FILENO;
+
+/* Ring of the calling thread */
+static __thread struct log_ring* thread_ring;
+
+/* List of all rings, appended under lock */
+static struct log_ring* rings;
+
+/* Protects ring list and flusher state */
+static pthread_mutex_t log_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wake_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t drained_cond = PTHREAD_COND_INITIALIZER;
+
+/* Flusher thread */
+static pthread_t flusher;
+static int running;
+static int stopping;
+static int wake;
+
+/*
+ * get_ring - used to get ring of the calling thread.
+ * Ring is allocated and registered on first use.
+ *
+ * Return: pointer to ring, NULL if it can not be allocated
+ */
+static struct log_ring* get_ring(void) {
+  struct log_ring* ring = thread_ring;
+
+  if (ring)
+    return ring;
+
+  ring = (struct log_ring*) calloc(1, sizeof(struct log_ring));
+  if (!ring)
+    return NULL;
+
+  pthread_mutex_lock(&log_lock);
+  ring->next = rings;
+  rings = ring;
+  pthread_mutex_unlock(&log_lock);
+
+  thread_ring = ring;
+  return ring;
+}
+
+/*
+ * write_direct - used to write message straight to log
+ * when flusher is not running.
+ * @data - bytes to write
+ * @length - amount of bytes
+ */
+static void write_direct(const void* data, size_t length) {
+  const char* ptr = (const char*) data;
+  ssize_t result;
+
+  while (length > 0) {
+    result = write(log_fd, ptr, length);
+    if (result == -1 && errno == EINTR)
+      continue;
+    if (result == -1)
+      return;
+    ptr += result;
+    length -= result;
+  }
+}
+
+/*
+ * drain_ring - used by flusher to write everything
+ * published in ring and release space to producer.
+ * @ring - pointer to an object of log_ring struct
+ *
+ * Return: amount of bytes written
+ */
+static size_t drain_ring(struct log_ring* ring) {
+  uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+  uint64_t tail = ring->tail;
+  size_t start, length, first;
+  struct iovec iov[2];
+  ssize_t result;
+  int count;
+
+  if (head == tail)
+    return 0;
+
+  /* Published bytes may wrap around end of ring */
+  start = tail & (LOG_RING_SIZE - 1);
+  length = head - tail;
+  first = LOG_RING_SIZE - start < length ? LOG_RING_SIZE - start : length;
+  iov[0].iov_base = ring->data + start;
+  iov[0].iov_len = first;
+  iov[1].iov_base = ring->data;
+  iov[1].iov_len = length - first;
+  count = iov[1].iov_len ? 2 : 1;
+
+  result = writev(log_fd, iov, count);
+  if (result == -1 && errno != EINTR)
+    result = length;
+  if (result < 0)
+    result = 0;
+
+  __atomic_store_n(&ring->tail, tail + result, __ATOMIC_RELEASE);
+  return result;
+}
+
+/*
+ * flusher_main - used as thread routine of flusher. Drains
+ * all rings, then sleeps until woken or flush interval passes.
+ * @arg - unused
+ *
+ * Return: NULL
+ */
+static void* flusher_main(void* arg) {
+  struct log_ring* ring;
+  struct timespec deadline;
+  size_t written;
+  int stop;
+
+  (void) arg;
+
+  while (1) {
+    pthread_mutex_lock(&log_lock);
+    ring = rings;
+    stop = stopping;
+    pthread_mutex_unlock(&log_lock);
+
+    written = 0;
+    for (; ring; ring = ring->next)
+      written += drain_ring(ring);
+
+    pthread_mutex_lock(&log_lock);
+    pthread_cond_broadcast(&drained_cond);
+    if (stop && written == 0) {
+      pthread_mutex_unlock(&log_lock);
+      break;
+    }
+
+    /* Sleep only when there was nothing to write */
+    if (written == 0 && !wake && !stopping) {
+      clock_gettime(CLOCK_REALTIME, &deadline);
+      deadline.tv_nsec += LOG_FLUSH_INTERVAL * 1000000L;
+      if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+      }
+      pthread_cond_timedwait(&wake_cond, &log_lock, &deadline);
+    }
+    wake = 0;
+    pthread_mutex_unlock(&log_lock);
+  }
+
+  return NULL;
+}
+
+/*
+ * init_log - used to start background flusher. Initial level
+ * is taken from LOG_LEVEL environment variable (debug, info,
+ * warn, error). Remaining messages are flushed at exit.
+ * @fd - file descriptor log is written to
+ */
+void init_log(int fd) {
+  enum log_level level;
+  const char* name = getenv("LOG_LEVEL");
+  int result;
+
+  if (running)
+    return;
+
+  log_fd = fd;
+  if (name && parse_log_level(name, &level) == 0)
+    set_log_level(level);
+
+  result = pthread_create(&flusher, NULL, flusher_main, NULL);
+  if (result != 0) {
+    errno = result;
+    perror("pthread_create");
+    exit(EXIT_FAILURE);
+  }
+
+  running = 1;
+  atexit(free_log);
+}
+
+/*
+ * set_log_level - used to change minimum level of logged
+ * messages at runtime. Safe to call from signal handler.
+ * @level - new minimum level
+ */
+void set_log_level(enum log_level level) {
+  log_threshold = level;
+}
+
+/*
+ * parse_log_level - used to convert name of level to value.
+ * @name - name of the level
+ * @level - pointer to result
+ *
+ * Return: 0 if successful, -1 if name is unknown
+ */
+int parse_log_level(const char* name, enum log_level* level) {
+  if (strcasecmp(name, "debug") == 0)
+    *level = LOG_LEVEL_DEBUG;
+  else if (strcasecmp(name, "info") == 0)
+    *level = LOG_LEVEL_INFO;
+  else if (strcasecmp(name, "warn") == 0)
+    *level = LOG_LEVEL_WARN;
+  else if (strcasecmp(name, "error") == 0)
+    *level = LOG_LEVEL_ERROR;
+  else
+    return -1;
+  return 0;
+}
+
+/*
+ * log_message - used to format message and queue it for
+ * flusher. Message longer than line size is truncated and
+ * still ends with newline, so next message starts own line.
+ * @level - severity of message
+ * @format - printf format
+ */
+void log_message(enum log_level level, const char* format, ...) {
+  char line[LOG_LINE_SIZE];
+  va_list args;
+  int length;
+
+  if ((int) level < log_threshold)
+    return;
+
+  va_start(args, format);
+  length = vsnprintf(line, sizeof(line), format, args);
+  va_end(args);
+
+  if (length < 0)
+    return;
+  if (length >= (int) sizeof(line)) {
+    length = sizeof(line) - 1;
+    line[length - 1] = '\n';
+  }
+
+  log_write(level, line, length);
+}
+
+/*
+ * log_write - used to queue raw bytes for flusher. Bytes are
+ * published at once or dropped when ring has no space, so
+ * messages are never torn and producer never waits.
+ * @level - severity of message
+ * @data - bytes to log
+ * @length - amount of bytes
+ */
+void log_write(enum log_level level, const void* data, size_t length) {
+  struct log_ring* ring;
+  uint64_t head, tail;
+  size_t start, first;
+
+  if ((int) level < log_threshold || length == 0)
+    return;
+
+  ring = running ? get_ring() : NULL;
+  if (!ring) {
+    write_direct(data, length);
+    return;
+  }
+
+  head = ring->head;
+  tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+  if (length > LOG_RING_SIZE - (head - tail)) {
+    __atomic_fetch_add(&ring->dropped, 1, __ATOMIC_RELAXED);
+    return;
+  }
+
+  /* Copy with wrap around end of ring */
+  start = head & (LOG_RING_SIZE - 1);
+  first = LOG_RING_SIZE - start < length ? LOG_RING_SIZE - start : length;
+  memcpy(ring->data + start, data, first);
+  memcpy(ring->data, (const char*) data + first, length - first);
+
+  __atomic_store_n(&ring->head, head + length, __ATOMIC_RELEASE);
+}
+
+/*
+ * flush_log - used to wait until flusher writes everything
+ * queued by all threads so far. Used before interactive
+ * prompts and reports that are printed directly.
+ */
+void flush_log(void) {
+  struct log_ring* ring;
+  int empty;
+
+  if (!running)
+    return;
+
+  pthread_mutex_lock(&log_lock);
+  while (1) {
+    empty = 1;
+    for (ring = rings; ring; ring = ring->next) {
+      if (__atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) !=
+          __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE))
+        empty = 0;
+    }
+    if (empty || !running)
+      break;
+
+    wake = 1;
+    pthread_cond_signal(&wake_cond);
+    pthread_cond_wait(&drained_cond, &log_lock);
+  }
+  pthread_mutex_unlock(&log_lock);
+}
+
+/*
+ * get_log_dropped - used to get amount of messages dropped
+ * because ring of their thread was full.
+ *
+ * Return: amount of dropped messages
+ */
+uint64_t get_log_dropped(void) {
+  struct log_ring* ring;
+  uint64_t dropped = 0;
+
+  pthread_mutex_lock(&log_lock);
+  for (ring = rings; ring; ring = ring->next)
+    dropped += __atomic_load_n(&ring->dropped, __ATOMIC_RELAXED);
+  pthread_mutex_unlock(&log_lock);
+
+  return dropped;
+}
+
+/*
+ * free_log - used to flush remaining messages, stop flusher
+ * and free all rings. Registered with atexit by init_log.
+ */
+void free_log(void) {
+  struct log_ring* ring;
+  struct log_ring* next;
+  uint64_t dropped;
+
+  if (!running)
+    return;
+
+  pthread_mutex_lock(&log_lock);
+  stopping = 1;
+  pthread_cond_signal(&wake_cond);
+  pthread_mutex_unlock(&log_lock);
+  pthread_join(flusher, NULL);
+
+  dropped = get_log_dropped();
+  if (dropped)
+    fprintf(stderr, "log: %lu messages dropped\n", (unsigned long) dropped);
+
+  running = 0;
+  thread_ring = NULL;
+  for (ring = rings; ring; ring = next) {
+    next = ring->next;
+    free(ring);
+  }
+  rings = NULL;
+}
@@ -0,0 +1,569 @@
+#include "../headers/packet.h"
+#include <string.h>
+#include <arpa/inet.h>
+
+/* Returned by dissectors of last layer, stops dispatch */
+#define DISSECT_END PACKET_PROTOCOLS
+
+/*
+ * Used as dissector of one layer. Layer is taken from
+ * the front of payload slice, the rest is left in it.
+ *
+ * Return: protocol of next layer, DISSECT_END after last
+ * layer, -1 if layer is malformed
+ */
+typedef int (*dissector)(struct packet_view* view);
+
+/*
+ * Used as entry of EtherType table. Entry also selects
+ * next header table of the network layer.
+ */
+struct link_dissector {
+  uint16_t type;
+  dissector dissect;
+  const dissector* next;
+};
+
+/* Slot of EtherType in link table, unique for known types */
+#define LINK_SLOT(type) ((((type) >> 8) ^ (type)) & 0xFF)
+
+/*
+ * take_layer - used to move first bytes of payload
+ * slice into slice of a layer.
+ * @view - pointer to an object of packet_view struct
+ * @layer - slice of the layer
+ * @length - length of the layer
+ */
+static inline void take_layer(struct packet_view* view, struct packet_slice* layer, 
+                              size_t length) {
+  layer->data = view->payload.data;
+  layer->length = length;
+  view->payload.data += length;
+  view->payload.length -= length;
+}
+
+/*
+ * cut_payload - used to drop trailing link layer padding
+ * when length from header is shorter than captured length.
+ * Truncated capture keeps what was captured and is marked,
+ * inner layer overrides mark of outer one.
+ * @view - pointer to an object of packet_view struct
+ * @length - length of payload from header
+ */
+static inline void cut_payload(struct packet_view* view, size_t length) {
+  view->truncated = length > view->payload.length;
+  if (length < view->payload.length)
+    view->payload.length = length;
+}
+
+/*
+ * take_ext - used to move IPv6 extension header from
+ * payload slice to the end of extension headers slice.
+ * @view - pointer to an object of packet_view struct
+ * @length - length of extension header
+ */
+static inline void take_ext(struct packet_view* view, size_t length) {
+  if (!view->ext.data)
+    view->ext.data = view->payload.data;
+  view->ext.length += length;
+  view->payload.data += length;
+  view->payload.length -= length;
+}
+
+/*
+ * sum_header - used to add IPv4 header to one's complement
+ * sum in 32-bit words while dissector has it in cache, so
+ * verify_packet only folds the sum.
+ * @data - pointer to IPv4 header
+ * @length - length of header, multiple of 4
+ *
+ * Return: unfolded sum
+ */
+static inline uint64_t sum_header(const uint8_t* data, size_t length) {
+  uint64_t sum = 0;
+  uint32_t word;
+  size_t i;
+
+  for (i = 0; i < length; i += sizeof(word)) {
+    memcpy(&word, data + i, sizeof(word));
+    sum += word;
+  }
+  return sum;
+}
+
+/*
+ * dissect_ip - used to check IPv4 header with options and
+ * sum it for checksum verification. Fragments after the
+ * first one stop at network layer.
+ * @view - pointer to an object of packet_view struct
+ *
+ * Return: protocol of IPv4 payload, -1 if header is invalid
+ */
+static int dissect_ip(struct packet_view* view) {
+  const struct iphdr* ip = (const struct iphdr*) view->payload.data;
+  size_t iphdr_length, total_length;
+
+  if (view->payload.length < sizeof(struct iphdr) || ip->version != 4)
+    return -1;
+
+  iphdr_length = ip->ihl * 4;
+  total_length = ntohs(ip->tot_len);
+  if (iphdr_length < sizeof(struct iphdr) || iphdr_length > view->payload.length)
+    return -1;
+  if (total_length >= iphdr_length)
+    cut_payload(view, total_length);
+
+  view->ip_sum = sum_header(view->payload.data, iphdr_length);
+  take_layer(view, &view->ip, iphdr_length);
+  view->network = ETHERTYPE_IP;
+  view->proto = ip->protocol;
+  view->fragment = (ntohs(ip->frag_off) & (IP_MF | IP_OFFMASK)) != 0;
+
+  if (ntohs(ip->frag_off) & IP_OFFMASK)
+    return DISSECT_END;
+  return ip->protocol;
+}
+
+/*
+ * dissect_ip6 - used to check IPv6 fixed header.
+ * Jumbograms keep captured length and are marked as
+ * truncated, their length is not in fixed header.
+ * @view - pointer to an object of packet_view struct
+ *
+ * Return: next header, -1 if header is invalid
+ */
+static int dissect_ip6(struct packet_view* view) {
+  const struct ip6_hdr* ip6 = (const struct ip6_hdr*) view->payload.data;
+  size_t payload_length;
+
+  if (view->payload.length < sizeof(struct ip6_hdr) || (view->payload.data[0] >> 4) != 6)
+    return -1;
+
+  take_layer(view, &view->ip, sizeof(struct ip6_hdr));
+  payload_length = ntohs(ip6->ip6_plen);
+  if (payload_length)
+    cut_payload(view, payload_length);
+  else
+    view->truncated = 1;
+
+  view->network = ETHERTYPE_IPV6;
+  return ip6->ip6_nxt;
+}
+
+/*
+ * dissect_ext - used to skip IPv6 hop-by-hop, routing or
+ * destination options header. Header length counts 8-byte
+ * units after the first 8 bytes.
+ * @view - pointer to an object of packet_view struct
+ *
+ * Return: next header, -1 if header is truncated
+ */
+static int dissect_ext(struct packet_view* view) {
+  const uint8_t* ext = view->payload.data;
+  size_t length;
+
+  if (view->payload.length < 8)
+    return -1;
+  length = (ext[1] + 1) * 8;
+  if (length > view->payload.length)
+    return -1;
+
+  take_ext(view, length);
+  return ext[0];
+}
+
+/*
+ * dissect_auth - used to skip IPv6 authentication header.
+ * Its length counts 4-byte units minus 2.
+ * @view - pointer to an object of packet_view struct
+ *
+ * Return: next header, -1 if header is truncated
+ */
+static int dissect_auth(struct packet_view* view) {
+  const uint8_t* ext = view->payload.data;
+  size_t length;
+
+  if (view->payload.length < 8)
+    return -1;
+  length = (ext[1] + 2) * 4;
+  if (length > view->payload.length)
+    return -1;
+
+  take_ext(view, length);
+  return ext[0];
+}
+
+/*
+ * dissect_frag - used to skip IPv6 fragment header.
+ * Fragments after the first one stop here.
+ * @view - pointer to an object of packet_view struct
+ *
+ * Return: next header, -1 if header is truncated
+ */
+static int dissect_frag(struct packet_view* view) {
+  const struct ip6_frag* frag = (const struct ip6_frag*) view->payload.data;
+
+  if (view->payload.length < sizeof(struct ip6_frag))
+    return -1;
+
+  take_ext(view, sizeof(struct ip6_frag));
+  view->fragment = 1;
+
+  if (frag->ip6f_offlg & IP6F_OFF_MASK) {
+    view->proto = frag->ip6f_nxt;
+    return DISSECT_END;
+  }
+  return frag->ip6f_nxt;
+}
+
+/*
+ * dissect_udp - used to split UDP header from its payload.
+ * Payload is bounded by both UDP length and captured length.
+ * @view - pointer to an object of packet_view struct
+ *
+ * Return: DISSECT_END, -1 if header is invalid
+ */
+static int dissect_udp(struct packet_view* view) {
+  const struct udphdr* udp = (const struct udphdr*) view->payload.data;
+  size_t udp_length;
+
+  if (view->payload.length < sizeof(struct udphdr))
+    return -1;
+  udp_length = ntohs(udp->len);
+  if (udp_length < sizeof(struct udphdr))
+    return -1;
+
+  take_layer(view, &view->transport, sizeof(struct udphdr));
+  cut_payload(view, udp_length - sizeof(struct udphdr));
+  return DISSECT_END;
+}
+
+/*
+ * dissect_tcp - used to split TCP header with options
+ * from its payload.
+ * @view - pointer to an object of packet_view struct
+ *
+ * Return: DISSECT_END, -1 if header is invalid
+ */
+static int dissect_tcp(struct packet_view* view) {
+  const struct tcphdr* tcp = (const struct tcphdr*) view->payload.data;
+  size_t length;
+
+  if (view->payload.length < sizeof(struct tcphdr))
+    return -1;
+  length = tcp->doff * 4;
+  if (length < sizeof(struct tcphdr) || length > view->payload.length)
+    return -1;
+
+  take_layer(view, &view->transport, length);
+  return DISSECT_END;
+}
+
+/*
+ * dissect_icmp - used to split ICMP or ICMPv6 header from
+ * its body. Both headers are 8 bytes long.
+ * @view - pointer to an object of packet_view struct
+ *
+ * Return: DISSECT_END, -1 if header is truncated
+ */
+static int dissect_icmp(struct packet_view* view) {
+  if (view->payload.length < sizeof(struct icmphdr))
+    return -1;
+
+  take_layer(view, &view->transport, sizeof(struct icmphdr));
+  return DISSECT_END;
+}
+
+/* Next header tables, protocols without dissector end the walk */
+static const dissector ip_table[PACKET_PROTOCOLS] = {
+  [IPPROTO_ICMP] = dissect_icmp,
+  [IPPROTO_TCP] = dissect_tcp,
+  [IPPROTO_UDP] = dissect_udp
+};
+
+static const dissector ip6_table[PACKET_PROTOCOLS] = {
+  [IPPROTO_HOPOPTS] = dissect_ext,
+  [IPPROTO_TCP] = dissect_tcp,
+  [IPPROTO_UDP] = dissect_udp,
+  [IPPROTO_ROUTING] = dissect_ext,
+  [IPPROTO_FRAGMENT] = dissect_frag,
+  [IPPROTO_AH] = dissect_auth,
+  [IPPROTO_ICMPV6] = dissect_icmp,
+  [IPPROTO_DSTOPTS] = dissect_ext
+};
+
+/* EtherType table, indexed by LINK_SLOT */
+static const struct link_dissector link_table[256] = {
+  [LINK_SLOT(ETHERTYPE_IP)] = {ETHERTYPE_IP, dissect_ip, ip_table},
+  [LINK_SLOT(ETHERTYPE_IPV6)] = {ETHERTYPE_IPV6, dissect_ip6, ip6_table}
+};
+
+/*
+ * parse_link - used to parse Ethernet header and up to two
+ * 802.1Q or 802.1ad tags that follow it. Network layer is
+ * left in payload slice.
+ * @view - pointer to an object of packet_view struct
+ * @data - pointer to Ethernet header
+ * @length - amount of captured bytes
+ *
+ * Return: EtherType of network layer, -1 if frame is truncated
+ */
+int parse_link(struct packet_view* view, const void* data, size_t length) {
+  const uint8_t* ptr = (const uint8_t*) data;
+  size_t offset = ETHER_ADDR_LEN * 2;
+  uint16_t type, tci;
+
+  memset(view, 0, sizeof(struct packet_view));
+  if (length < sizeof(struct ether_header))
+    return -1;
+
+  while (1) {
+    memcpy(&type, ptr + offset, sizeof(type));
+    type = ntohs(type);
+    offset += sizeof(type);
+
+    if (type != ETHERTYPE_8021Q && type != ETHERTYPE_8021AD)
+      break;
+
+    /* Tag is TCI followed by EtherType of next layer */
+    if (view->vlan_count == PACKET_MAX_VLANS || offset + 4 > length)
+      return -1;
+    memcpy(&tci, ptr + offset, sizeof(tci));
+    view->vlan_tci[view->vlan_count++] = ntohs(tci);
+    offset += sizeof(tci);
+  }
+
+  view->eth.data = ptr;
+  view->eth.length = offset;
+  view->payload.data = ptr + offset;
+  view->payload.length = length - offset;
+  return type;
+}
+
+/* Two 64-bit lanes, each sums 32-bit halves of its 8 bytes */
+typedef uint64_t checksum_lanes __attribute__((vector_size(16)));
+
+/*
+ * add_words - used to add bytes to one's complement sum.
+ * 32 bytes are summed per iteration in vector lanes, 32-bit
+ * words are added into 64-bit lanes, so carries are never
+ * lost and are folded only once at the end. Odd length is
+ * padded with zero byte. Sum is kept in host byte order of
+ * 16-bit words, which folds to the same checksum as network
+ * order.
+ * @data - bytes to add, starts at even offset of checksummed data
+ * @length - amount of bytes
+ * @sum - sum of previous parts
+ *
+ * Return: unfolded sum
+ */
+static inline uint64_t add_words(const void* data, size_t length, uint64_t sum) {
+  const uint8_t* ptr = (const uint8_t*) data;
+  const checksum_lanes low = {0xFFFFFFFFull, 0xFFFFFFFFull};
+  checksum_lanes first = {0, 0}, second = {0, 0}, a, b;
+  uint64_t word;
+  uint32_t half;
+  uint16_t quarter = 0;
+
+  if (length >= 32) {
+    for (; length >= 32; ptr += 32, length -= 32) {
+      memcpy(&a, ptr, sizeof(a));
+      memcpy(&b, ptr + 16, sizeof(b));
+      first += (a & low) + (a >> 32);
+      second += (b & low) + (b >> 32);
+    }
+    first += second;
+    sum += first[0] + first[1];
+  }
+
+  /* Tail is summed in fixed-size words, so nothing calls memcpy */
+  for (; length >= 8; ptr += 8, length -= 8) {
+    memcpy(&word, ptr, sizeof(word));
+    sum += (word & 0xFFFFFFFFull) + (word >> 32);
+  }
+  if (length & 4) {
+    memcpy(&half, ptr, sizeof(half));
+    sum += half;
+    ptr += 4;
+  }
+  if (length & 2) {
+    memcpy(&quarter, ptr, sizeof(quarter));
+    sum += quarter;
+    ptr += 2;
+  }
+  if (length & 1) {
+    quarter = 0;
+    memcpy(&quarter, ptr, 1);
+    sum += quarter;
+  }
+  return sum;
+}
+
+/*
+ * fold_words - used to fold sum into 16 bits. Last step
+ * adds 32-bit sum rotated by 16 bits to itself, so high
+ * half gets sum of both halves with carry of low half.
+ * @sum - unfolded sum
+ *
+ * Return: folded sum
+ */
+static inline uint16_t fold_words(uint64_t sum) {
+  uint32_t folded;
+
+  sum = (sum & 0xFFFFFFFFull) + (sum >> 32);
+  sum = (sum & 0xFFFFFFFFull) + (sum >> 32);
+  folded = sum;
+  folded += (folded >> 16) | (folded << 16);
+  return folded >> 16;
+}
+
+/*
+ * checksum_add - used to add bytes to one's complement sum.
+ * @data - bytes to add, starts at even offset of checksummed data
+ * @length - amount of bytes
+ * @sum - sum of previous parts
+ *
+ * Return: unfolded sum
+ */
+uint64_t checksum_add(const void* data, size_t length, uint64_t sum) {
+  return add_words(data, length, sum);
+}
+
+/*
+ * checksum_fold - used to fold sum into 16 bits with
+ * end-around carry.
+ * @sum - unfolded sum
+ *
+ * Return: folded sum, 0xFFFF if checksummed data is valid
+ */
+uint16_t checksum_fold(uint64_t sum) {
+  return fold_words(sum);
+}
+
+/*
+ * pseudo_header - used to sum pseudo header of transport
+ * checksum. ICMP over IPv4 has none.
+ * @view - pointer to dissected packet
+ * @length - length of transport header with payload
+ *
+ * Return: unfolded sum of pseudo header
+ */
+static inline uint64_t pseudo_header(const struct packet_view* view, uint32_t length) {
+  uint64_t sum = htons(view->proto);
+
+  if (view->network == ETHERTYPE_IP) {
+    if (view->proto == IPPROTO_ICMP)
+      return 0;
+    sum += htons(length);
+    return add_words(&view_ip(view)->saddr, 2 * sizeof(uint32_t), sum);
+  }
+
+  sum += htonl(length);
+  return add_words(&view_ip6(view)->ip6_src, 2 * sizeof(struct in6_addr), sum);
+}
+
+/*
+ * verify_packet - used to verify IPv4 header checksum and
+ * checksum of TCP, UDP, ICMP or ICMPv6. Transport checksum
+ * is skipped when kernel reports it verified or not yet
+ * filled, for replayed packets, which may have been sent
+ * by capturing host, for fragments and for truncated
+ * capture, since it covers bytes that are not there. UDP
+ * over IPv4 may carry no checksum.
+ * @view - pointer to dissected packet
+ * @state - checksum state reported by kernel
+ *
+ * Return: VERDICT_VALID if nothing is wrong, layer with
+ * bad checksum otherwise
+ */
+enum packet_verdict verify_packet(const struct packet_view* view, 
+                                  enum packet_checksum state) {
+  size_t length;
+
+  /* Header was summed by dissector */
+  if (view->network == ETHERTYPE_IP && fold_words(view->ip_sum) != 0xFFFF)
+    return VERDICT_BAD_IP;
+
+  if (state != CHECKSUM_UNKNOWN || !view->transport.data || view->fragment || 
+      view->truncated)
+    return VERDICT_VALID;
+  if (view->proto == IPPROTO_UDP && view->network == ETHERTYPE_IP && 
+      view_udp(view)->check == 0)
+    return VERDICT_VALID;
+
+  length = view->transport.length + view->payload.length;
+  if (fold_words(add_words(view->transport.data, length, 
+                           pseudo_header(view, length))) != 0xFFFF)
+    return VERDICT_BAD_TRANSPORT;
+  return VERDICT_VALID;
+}
+
+/*
+ * dissect_packet - used to build zero-copy view of IP packet
+ * in one pass. Network layer is looked up by EtherType,
+ * then every next header is looked up in the table of the
+ * network layer until transport layer or a protocol without
+ * dissector, so unknown protocol costs one lookup. Layers
+ * that were parsed before an error are left in view, the
+ * others are empty.
+ * @view - pointer to an object of packet_view struct
+ * @data - pointer to captured packet
+ * @length - amount of captured bytes
+ * @first - layer at the start of data
+ *
+ * Return: 0 if network layer is IPv4 or IPv6 and every
+ * known layer is valid, -1 otherwise
+ */
+int dissect_packet(struct packet_view* view, const void* data, size_t length,
+                   enum packet_layer first) {
+  const struct link_dissector* link;
+  int type, next;
+
+  if (first == LAYER_ETH) {
+    if ((type = parse_link(view, data, length)) == -1)
+      return -1;
+  }
+  else {
+    memset(view, 0, sizeof(struct packet_view));
+    if (length == 0)
+      return -1;
+    type = (*(const uint8_t*) data >> 4) == 6 ? ETHERTYPE_IPV6 : ETHERTYPE_IP;
+    view->payload.data = (const uint8_t*) data;
+    view->payload.length = length;
+  }
+
+  link = &link_table[LINK_SLOT(type)];
+  if (link->type != type || !link->dissect)
+    return -1;
+
+  next = link->dissect(view);
+  while (next >= 0 && next < PACKET_PROTOCOLS) {
+    view->proto = next;
+    if (!link->next[next])
+      break;
+    next = link->next[next](view);
+  }
+
+  return next == -1 ? -1 : 0;
+}
+
+/*
+ * parse_packet - used to build zero-copy view of UDP packet.
+ * Every layer is checked against captured length before
+ * it is read. Layers that were parsed before an error are
+ * left in view, the others are empty.
+ * @view - pointer to an object of packet_view struct
+ * @data - pointer to captured packet
+ * @length - amount of captured bytes
+ * @first - layer at the start of data
+ *
+ * Return: 0 if packet is a valid IPv4 UDP packet, -1 otherwise
+ */
+int parse_packet(struct packet_view* view, const void* data, size_t length, 
+                 enum packet_layer first) {
+  if (dissect_packet(view, data, length, first) == -1 || 
+      view->network != ETHERTYPE_IP || view->proto != IPPROTO_UDP || 
+      !view->transport.data)
+    return -1;
+  return 0;
+}
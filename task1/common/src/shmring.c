@@ -0,0 +1,138 @@
+#include "../headers/shmring.h"
+#include "../headers/common.h"
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/*
+ * open_shm_reader - used to map ring of publisher for
+ * reading. Reader starts at newest packet, packets
+ * published before it was opened are not read.
+ * @name - name of shared memory object, e.g. "/sniffer-0"
+ *
+ * Return: pointer to an object of shm_reader struct,
+ * NULL with errno set if ring does not exist or is not valid
+ */
+struct shm_reader* open_shm_reader(const char* name) {
+  const struct shm_ring_header* header;
+  struct shm_reader* reader;
+  struct stat st;
+  void* map;
+  int fd;
+
+  fd = shm_open(name, O_RDONLY, 0);
+  if (fd == -1)
+    return NULL;
+
+  if (fstat(fd, &st) == -1 || (size_t) st.st_size < sizeof(struct shm_ring_header)) {
+    close(fd);
+    errno = EINVAL;
+    return NULL;
+  }
+
+  map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  if (map == MAP_FAILED)
+    print_error("mmap");
+
+  /* Slots must fit into object, slot count is power of two */
+  header = (const struct shm_ring_header*) map;
+  if (header->magic != SHM_RING_MAGIC || header->version != SHM_RING_VERSION ||
+      header->slot_count == 0 || (header->slot_count & (header->slot_count - 1)) ||
+      header->slot_size < sizeof(struct shm_slot) + header->snaplen ||
+      header->header_size + (uint64_t) header->slot_count * header->slot_size >
+      (uint64_t) st.st_size) {
+    munmap(map, st.st_size);
+    close(fd);
+    errno = EINVAL;
+    return NULL;
+  }
+
+  reader = (struct shm_reader*) calloc(1, sizeof(struct shm_reader));
+  if (!reader)
+    print_error("calloc");
+
+  reader->fd = fd;
+  reader->header = header;
+  reader->slots = (const uint8_t*) map + header->header_size;
+  reader->size = st.st_size;
+  reader->mask = header->slot_count - 1;
+  reader->cursor = __atomic_load_n(&header->head, __ATOMIC_ACQUIRE);
+  return reader;
+}
+
+/*
+ * read_shm_packet - used to copy next packet out of ring.
+ * Reader that fell more than ring behind jumps to oldest
+ * packet still in ring. Packet overwritten while it was
+ * copied is skipped. Both are counted as lost.
+ * @reader - pointer to an object of shm_reader struct
+ * @packet - filled with metadata of packet
+ * @buffer - where packet bytes are copied
+ * @size - size of buffer, longer packets are cut
+ *
+ * Return: 1 if packet was read, 0 if there is none yet,
+ * -1 if publisher stopped and every packet was read
+ */
+int read_shm_packet(struct shm_reader* reader, struct shm_packet* packet,
+                    void* buffer, size_t size) {
+  const struct shm_slot* slot;
+  uint64_t head, begin, expected;
+  uint32_t caplen;
+
+  while (1) {
+    head = __atomic_load_n(&reader->header->head, __ATOMIC_ACQUIRE);
+    if (reader->cursor >= head)
+      return __atomic_load_n(&reader->header->closed, __ATOMIC_ACQUIRE) ? -1 : 0;
+
+    if (head - reader->cursor > reader->header->slot_count) {
+      reader->lost += head - reader->header->slot_count - reader->cursor;
+      reader->cursor = head - reader->header->slot_count;
+    }
+
+    slot = (const struct shm_slot*) (reader->slots +
+                                     (reader->cursor & reader->mask) * reader->header->slot_size);
+    expected = 2 * reader->cursor + 2;
+
+    /* Slot already holds newer packet or is being rewritten */
+    begin = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+    if (begin != expected) {
+      reader->lost++;
+      reader->cursor++;
+      continue;
+    }
+
+    caplen = slot->caplen;
+    if (caplen > reader->header->snaplen)
+      caplen = reader->header->snaplen;
+    if (caplen > size)
+      caplen = size;
+
+    packet->sequence = reader->cursor;
+    packet->timestamp = slot->timestamp;
+    packet->caplen = caplen;
+    packet->wire_length = slot->wire_length;
+    memcpy(buffer, slot + 1, caplen);
+
+    /* Copy is valid only if publisher did not touch slot meanwhile */
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    reader->cursor++;
+    if (__atomic_load_n(&slot->sequence, __ATOMIC_RELAXED) != begin) {
+      reader->lost++;
+      continue;
+    }
+
+    reader->packets++;
+    return 1;
+  }
+}
+
+/*
+ * close_shm_reader - used to unmap ring and free reader.
+ * @reader - pointer to an object of shm_reader struct
+ */
+void close_shm_reader(struct shm_reader* reader) {
+  munmap((void*) reader->header, reader->size);
+  close(reader->fd);
+  free(reader);
+}
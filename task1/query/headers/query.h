@@ -0,0 +1,104 @@
+#ifndef QUERY_H
+#define QUERY_H
+
+#include "../../common/headers/common.h"
+#include "../../common/headers/segment.h"
+#include <limits.h>
+
+/* Fields of 5-tuple set in filter */
+#define QUERY_SRC 0x01
+#define QUERY_DST 0x02
+#define QUERY_SPORT 0x04
+#define QUERY_DPORT 0x08
+#define QUERY_PROTO 0x10
+#define QUERY_FLOW (QUERY_SRC | QUERY_DST | QUERY_SPORT | QUERY_DPORT | QUERY_PROTO)
+
+/*
+ * Used to describe packets selected by query. Fields
+ * not set in mask match anything.
+ */
+struct query_filter {
+  /* Capture time range in ns, both ends included */
+  uint64_t from;
+  uint64_t until;
+
+  /* 5-tuple in network byte order */
+  uint32_t src;
+  uint32_t dst;
+  uint16_t sport;
+  uint16_t dport;
+  uint8_t proto;
+
+  /* Fields that are set, QUERY_* bits */
+  unsigned int fields;
+
+  /* Match reversed 5-tuple too */
+  int both;
+};
+
+/*
+ * Used as memory-mapped segment of packet store. Index
+ * is NULL while segment is still being written.
+ */
+struct segment {
+  char path[PATH_MAX];
+
+  /* Records and packet bytes */
+  const struct segment_record* records;
+  uint32_t count;
+  const uint8_t* data;
+  size_t data_length;
+
+  /* Index and its parts */
+  const struct segment_header* header;
+  size_t index_length;
+  const struct segment_block* blocks;
+  const struct segment_flow* flows;
+  const uint32_t* postings;
+};
+
+/*
+ * Used as packet selected by query.
+ */
+struct query_match {
+  uint64_t timestamp;
+  uint32_t segment;
+  uint32_t record;
+};
+
+/*
+ * Used to answer queries on segments of packet store.
+ * Sealed segments are narrowed by their time range, flows
+ * by flow index and records by sparse time index, so only
+ * records that can match are read. Segments without index
+ * are scanned.
+ */
+struct query {
+  struct query_filter filter;
+
+  /* Segments of store, ordered by name */
+  struct segment* segments;
+  unsigned int segment_count;
+
+  /* Selected packets */
+  struct query_match* matches;
+  size_t match_count;
+  size_t match_capacity;
+
+  /* Segments skipped by time range, scanned without index */
+  unsigned int skipped;
+  unsigned int scanned;
+
+  /* Records read */
+  uint64_t records_read;
+};
+
+struct query* create_query(const char* dir, const struct query_filter* filter);
+
+void run_query(struct query* query);
+
+void print_query(const struct query* query, int hex);
+
+void free_query(struct query* query);
+
+#endif // !QUERY_H
@@ -0,0 +1,218 @@
+#include "../headers/query.h"
+#include <getopt.h>
+#include <errno.h>
+#include <strings.h>
+
+void parse_args(int argc, char** argv, struct query_filter* filter, int* hex,
+                int* count, int* verbose, const char** dir);
+
+void usage(const char* name);
+
+int main(int argc, char** argv) {
+  struct query_filter filter;
+  struct query* query;
+  const char* dir;
+  int hex = 0, count = 0, verbose = 0;
+
+  parse_args(argc, argv, &filter, &hex, &count, &verbose, &dir);
+
+  query = create_query(dir, &filter);
+  run_query(query);
+
+  if (count)
+    printf("%zu\n", query->match_count);
+  else
+    print_query(query, hex);
+
+  if (verbose)
+    fprintf(stderr, "%zu packets selected, %lu records read, %u segments (%u skipped by time, %u scanned without index)\n",
+            query->match_count, (unsigned long) query->records_read,
+            query->segment_count, query->skipped, query->scanned);
+
+  free_query(query);
+  exit(EXIT_SUCCESS);
+}
+
+/*
+ * parse_time - used to parse capture time given as
+ * seconds since epoch with optional fraction.
+ * @text - time to parse, e.g. "1700000000.25"
+ * @ns - set to time in ns
+ *
+ * Return: 0 if successful, -1 otherwise
+ */
+static int parse_time(const char* text, uint64_t* ns) {
+  unsigned long long seconds;
+  uint64_t fraction = 0, scale = 100000000ull;
+  char* end;
+
+  errno = 0;
+  seconds = strtoull(text, &end, 10);
+  if (errno || end == text)
+    return -1;
+
+  if (*end == '.') {
+    for (end++; *end >= '0' && *end <= '9'; end++, scale /= 10)
+      fraction += (*end - '0') * scale;
+  }
+
+  if (*end)
+    return -1;
+  *ns = seconds * 1000000000ull + fraction;
+  return 0;
+}
+
+/*
+ * parse_port - used to parse port into network byte order.
+ * @text - port to parse
+ * @port - set to port in network byte order
+ *
+ * Return: 0 if successful, -1 otherwise
+ */
+static int parse_port(const char* text, uint16_t* port) {
+  unsigned long value;
+  char* end;
+
+  value = strtoul(text, &end, 10);
+  if (end == text || *end || value > 65535)
+    return -1;
+  *port = htons(value);
+  return 0;
+}
+
+/*
+ * parse_proto - used to parse protocol name or number.
+ * @text - protocol to parse
+ * @proto - set to protocol number
+ *
+ * Return: 0 if successful, -1 otherwise
+ */
+static int parse_proto(const char* text, uint8_t* proto) {
+  unsigned long value;
+  char* end;
+
+  if (strcasecmp(text, "udp") == 0)
+    value = IPPROTO_UDP;
+  else if (strcasecmp(text, "tcp") == 0)
+    value = IPPROTO_TCP;
+  else if (strcasecmp(text, "icmp") == 0)
+    value = IPPROTO_ICMP;
+  else if ((value = strtoul(text, &end, 10)) > 255 || end == text || *end)
+    return -1;
+
+  *proto = value;
+  return 0;
+}
+
+/*
+ * parse_args - used to fill query filter from command
+ * line arguments.
+ * @argc - amount of arguments
+ * @argv - array of arguments
+ * @filter - pointer to an object of query_filter struct
+ * @hex - set if stored bytes are printed
+ * @count - set if only amount of packets is printed
+ * @verbose - set if statistics of query are printed
+ * @dir - set to directory of segments
+ */
+void parse_args(int argc, char** argv, struct query_filter* filter, int* hex,
+                int* count, int* verbose, const char** dir) {
+  static struct option options[] = {
+    {"src", required_argument, NULL, 's'},
+    {"dst", required_argument, NULL, 'd'},
+    {"sport", required_argument, NULL, 'S'},
+    {"dport", required_argument, NULL, 'D'},
+    {"proto", required_argument, NULL, 'p'},
+    {"from", required_argument, NULL, 'f'},
+    {"until", required_argument, NULL, 'u'},
+    {"both", no_argument, NULL, 'b'},
+    {"hex", no_argument, NULL, 'x'},
+    {"count", no_argument, NULL, 'c'},
+    {"verbose", no_argument, NULL, 'v'},
+    {"help", no_argument, NULL, 'h'},
+    {NULL, 0, NULL, 0}
+  };
+  int opt;
+
+  memset(filter, 0, sizeof(*filter));
+  filter->until = UINT64_MAX;
+
+  while ((opt = getopt_long(argc, argv, "s:d:S:D:p:f:u:bxcvh", options, NULL)) != -1) {
+    switch (opt) {
+      case 's':
+        if (inet_pton(AF_INET, optarg, &filter->src) != 1)
+          usage(argv[0]);
+        filter->fields |= QUERY_SRC;
+        break;
+      case 'd':
+        if (inet_pton(AF_INET, optarg, &filter->dst) != 1)
+          usage(argv[0]);
+        filter->fields |= QUERY_DST;
+        break;
+      case 'S':
+        if (parse_port(optarg, &filter->sport) == -1)
+          usage(argv[0]);
+        filter->fields |= QUERY_SPORT;
+        break;
+      case 'D':
+        if (parse_port(optarg, &filter->dport) == -1)
+          usage(argv[0]);
+        filter->fields |= QUERY_DPORT;
+        break;
+      case 'p':
+        if (parse_proto(optarg, &filter->proto) == -1)
+          usage(argv[0]);
+        filter->fields |= QUERY_PROTO;
+        break;
+      case 'f':
+        if (parse_time(optarg, &filter->from) == -1)
+          usage(argv[0]);
+        break;
+      case 'u':
+        if (parse_time(optarg, &filter->until) == -1)
+          usage(argv[0]);
+        break;
+      case 'b':
+        filter->both = 1;
+        break;
+      case 'x':
+        *hex = 1;
+        break;
+      case 'c':
+        *count = 1;
+        break;
+      case 'v':
+        *verbose = 1;
+        break;
+      default:
+        usage(argv[0]);
+    }
+  }
+
+  if (optind != argc - 1 || filter->from > filter->until)
+    usage(argv[0]);
+  *dir = argv[optind];
+}
+
+/*
+ * usage - used to print help message and exit.
+ * @name - name of the executable
+ */
+void usage(const char* name) {
+  fprintf(stderr,
+          "Usage: %s [options] DIR\n"
+          "Print packets kept by sniffer --store=DIR, ordered by capture time.\n"
+          "  -s, --src=ADDR             source address\n"
+          "  -d, --dst=ADDR             destination address\n"
+          "  -S, --sport=PORT           source port\n"
+          "  -D, --dport=PORT           destination port\n"
+          "  -p, --proto=PROTO          udp, tcp, icmp or protocol number\n"
+          "  -f, --from=SECONDS         captured at or after SECONDS since epoch\n"
+          "  -u, --until=SECONDS        captured at or before SECONDS since epoch\n"
+          "  -b, --both                 match reversed 5-tuple too\n"
+          "  -x, --hex                  print stored bytes of every packet\n"
+          "  -c, --count                print only amount of packets\n"
+          "  -v, --verbose              print how much of store was read\n",
+          name);
+  exit(EXIT_FAILURE);
+}
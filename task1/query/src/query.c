@@ -0,0 +1,506 @@
+#include "../headers/query.h"
+#include <fcntl.h>
+#include <errno.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+/*
+ * map_file - used to map whole file read-only.
+ * @path - path to the file
+ * @length - set to size of the file
+ *
+ * Return: pointer to mapped file, NULL if file is missing or empty
+ */
+static const void* map_file(const char* path, size_t* length) {
+  struct stat st;
+  void* data;
+  int fd;
+
+  *length = 0;
+  fd = open(path, O_RDONLY);
+  if (fd == -1) {
+    if (errno == ENOENT)
+      return NULL;
+    print_error("open");
+  }
+
+  if (fstat(fd, &st) == -1)
+    print_error("fstat");
+  if (st.st_size == 0) {
+    close(fd);
+    return NULL;
+  }
+
+  data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  if (data == MAP_FAILED)
+    print_error("mmap");
+  close(fd);
+
+  *length = st.st_size;
+  return data;
+}
+
+/*
+ * open_index - used to map index of segment and check
+ * that it describes mapped records.
+ * @segment - pointer to an object of segment struct
+ */
+static void open_index(struct segment* segment) {
+  char path[PATH_MAX + 8];
+  const struct segment_header* header;
+  size_t length;
+
+  snprintf(path, sizeof(path), "%s" SEGMENT_INDEX, segment->path);
+  header = (const struct segment_header*) map_file(path, &length);
+  if (!header)
+    return;
+
+  if (length < sizeof(*header) || header->magic != SEGMENT_MAGIC ||
+      header->version != SEGMENT_VERSION || header->stride == 0 ||
+      header->records != segment->count ||
+      length != sizeof(*header) + header->blocks * sizeof(struct segment_block) +
+                header->flows * sizeof(struct segment_flow) +
+                header->records * sizeof(uint32_t)) {
+    fprintf(stderr, "%s: bad index, segment is scanned\n", path);
+    munmap((void*) header, length);
+    return;
+  }
+
+  segment->header = header;
+  segment->index_length = length;
+  segment->blocks = (const struct segment_block*) (header + 1);
+  segment->flows = (const struct segment_flow*) (segment->blocks + header->blocks);
+  segment->postings = (const uint32_t*) (segment->flows + header->flows);
+}
+
+/*
+ * open_segment - used to map records, packet bytes and
+ * index of segment. Records are mapped before bytes, store
+ * writes bytes first, so every mapped record has its bytes.
+ * @segment - pointer to an object of segment struct
+ * @base - path of segment without extension
+ */
+static void open_segment(struct segment* segment, const char* base) {
+  char path[PATH_MAX + 8];
+  size_t length;
+
+  memset(segment, 0, sizeof(*segment));
+  snprintf(segment->path, sizeof(segment->path), "%s", base);
+
+  snprintf(path, sizeof(path), "%s" SEGMENT_RECORDS, base);
+  segment->records = (const struct segment_record*) map_file(path, &length);
+  segment->count = length / sizeof(struct segment_record);
+
+  snprintf(path, sizeof(path), "%s" SEGMENT_DATA, base);
+  segment->data = (const uint8_t*) map_file(path, &segment->data_length);
+
+  open_index(segment);
+}
+
+/*
+ * compare_names - used to order segment names.
+ * @a - pointer to first name
+ * @b - pointer to second name
+ *
+ * Return: negative, zero or positive like strcmp
+ */
+static int compare_names(const void* a, const void* b) {
+  return strcmp(*(char* const*) a, *(char* const*) b);
+}
+
+/*
+ * create_query - used to map every segment of store.
+ * @dir - directory of segments
+ * @filter - pointer to filter of selected packets
+ *
+ * Return: pointer to an object of query struct
+ */
+struct query* create_query(const char* dir, const struct query_filter* filter) {
+  char path[PATH_MAX];
+  struct query* query;
+  struct dirent* entry;
+  char** names = NULL;
+  size_t length, suffix = strlen(SEGMENT_RECORDS);
+  unsigned int count = 0, capacity = 0, i;
+  DIR* handle;
+
+  query = (struct query*) calloc(1, sizeof(struct query));
+  if (!query)
+    print_error("calloc");
+  query->filter = *filter;
+
+  handle = opendir(dir);
+  if (!handle)
+    print_error(dir);
+
+  /* Every segment has records file, index may be missing */
+  while ((entry = readdir(handle))) {
+    length = strlen(entry->d_name);
+    if (strncmp(entry->d_name, SEGMENT_PREFIX "-", strlen(SEGMENT_PREFIX) + 1) != 0 ||
+        length <= suffix || strcmp(entry->d_name + length - suffix, SEGMENT_RECORDS) != 0)
+      continue;
+
+    if (count == capacity) {
+      capacity = capacity ? capacity * 2 : 64;
+      names = (char**) realloc(names, capacity * sizeof(char*));
+      if (!names)
+        print_error("realloc");
+    }
+    names[count] = strndup(entry->d_name, length - suffix);
+    if (!names[count])
+      print_error("strndup");
+    count++;
+  }
+  closedir(handle);
+
+  qsort(names, count, sizeof(char*), compare_names);
+
+  query->segments = (struct segment*) calloc(count ? count : 1, sizeof(struct segment));
+  if (!query->segments)
+    print_error("calloc");
+
+  for (i = 0; i < count; i++) {
+    snprintf(path, sizeof(path), "%s/%s", dir, names[i]);
+    open_segment(&query->segments[i], path);
+    free(names[i]);
+  }
+  query->segment_count = count;
+  free(names);
+
+  return query;
+}
+
+/*
+ * match_tuple - used to check fields of filter against
+ * one direction of 5-tuple.
+ * @filter - pointer to an object of query_filter struct
+ * @src, @dst, @sport, @dport, @proto - 5-tuple in network byte order
+ *
+ * Return: 1 if tuple matches, 0 otherwise
+ */
+static int match_tuple(const struct query_filter* filter, uint32_t src, uint32_t dst,
+                       uint16_t sport, uint16_t dport, uint8_t proto) {
+  return (!(filter->fields & QUERY_SRC) || filter->src == src) &&
+         (!(filter->fields & QUERY_DST) || filter->dst == dst) &&
+         (!(filter->fields & QUERY_SPORT) || filter->sport == sport) &&
+         (!(filter->fields & QUERY_DPORT) || filter->dport == dport) &&
+         (!(filter->fields & QUERY_PROTO) || filter->proto == proto);
+}
+
+/*
+ * match_flow - used to check flow against filter, in both
+ * directions if asked.
+ * @filter - pointer to an object of query_filter struct
+ * @flow - pointer to flow of index
+ *
+ * Return: 1 if flow matches, 0 otherwise
+ */
+static int match_flow(const struct query_filter* filter, const struct segment_flow* flow) {
+  return match_tuple(filter, flow->src, flow->dst, flow->sport, flow->dport, flow->proto) ||
+         (filter->both &&
+          match_tuple(filter, flow->dst, flow->src, flow->dport, flow->sport, flow->proto));
+}
+
+/*
+ * match_record - used to check record against filter
+ * when segment has no index.
+ * @filter - pointer to an object of query_filter struct
+ * @record - pointer to record
+ *
+ * Return: 1 if record matches, 0 otherwise
+ */
+static int match_record(const struct query_filter* filter, const struct segment_record* record) {
+  if (record->timestamp < filter->from || record->timestamp > filter->until)
+    return 0;
+  return match_tuple(filter, record->src, record->dst, record->sport, record->dport,
+                     record->proto) ||
+         (filter->both && match_tuple(filter, record->dst, record->src, record->dport,
+                                      record->sport, record->proto));
+}
+
+/*
+ * add_match - used to remember selected record.
+ * @query - pointer to an object of query struct
+ * @segment - index of segment
+ * @record - index of record in segment
+ */
+static void add_match(struct query* query, uint32_t segment, uint32_t record) {
+  struct query_match* match;
+
+  if (query->match_count == query->match_capacity) {
+    query->match_capacity = query->match_capacity ? query->match_capacity * 2 : 1024;
+    query->matches = (struct query_match*) realloc(query->matches,
+                       query->match_capacity * sizeof(struct query_match));
+    if (!query->matches)
+      print_error("realloc");
+  }
+
+  match = &query->matches[query->match_count++];
+  match->timestamp = query->segments[segment].records[record].timestamp;
+  match->segment = segment;
+  match->record = record;
+}
+
+/*
+ * block_overlaps - used to check if time index block can
+ * hold records of time range.
+ * @filter - pointer to an object of query_filter struct
+ * @block - pointer to block of time index
+ *
+ * Return: 1 if block overlaps range, 0 otherwise
+ */
+static inline int block_overlaps(const struct query_filter* filter,
+                                 const struct segment_block* block) {
+  return block->last >= filter->from && block->first <= filter->until;
+}
+
+/*
+ * find_flow - used to look up exact 5-tuple in flow index.
+ * @segment - pointer to an object of segment struct
+ * @key - flow to look up
+ *
+ * Return: pointer to flow of index, NULL if segment has no such flow
+ */
+static const struct segment_flow* find_flow(const struct segment* segment,
+                                            const struct segment_flow* key) {
+  uint32_t low = 0, high = segment->header->flows, middle;
+  int result;
+
+  while (low < high) {
+    middle = low + (high - low) / 2;
+    result = compare_segment_flows(&segment->flows[middle], key);
+    if (result == 0)
+      return &segment->flows[middle];
+    if (result < 0)
+      low = middle + 1;
+    else
+      high = middle;
+  }
+
+  return NULL;
+}
+
+/*
+ * query_postings - used to select records of one flow.
+ * Records in blocks outside time range are never read.
+ * @query - pointer to an object of query struct
+ * @index - index of segment
+ * @flow - pointer to flow of index
+ */
+static void query_postings(struct query* query, uint32_t index, const struct segment_flow* flow) {
+  const struct segment* segment = &query->segments[index];
+  uint32_t i, record;
+
+  for (i = flow->first; i < flow->first + flow->count; i++) {
+    record = segment->postings[i];
+    if (!block_overlaps(&query->filter, &segment->blocks[record / segment->header->stride]))
+      continue;
+
+    query->records_read++;
+    if (segment->records[record].timestamp >= query->filter.from &&
+        segment->records[record].timestamp <= query->filter.until)
+      add_match(query, index, record);
+  }
+}
+
+/*
+ * query_flows - used to select records through flow index.
+ * Fully specified 5-tuple is found by binary search, partial
+ * one by walking flows, which are far fewer than records.
+ * @query - pointer to an object of query struct
+ * @index - index of segment
+ */
+static void query_flows(struct query* query, uint32_t index) {
+  const struct segment* segment = &query->segments[index];
+  const struct query_filter* filter = &query->filter;
+  const struct segment_flow* flow;
+  struct segment_flow key;
+  uint32_t i;
+
+  if ((filter->fields & QUERY_FLOW) != QUERY_FLOW) {
+    for (i = 0; i < segment->header->flows; i++) {
+      if (match_flow(filter, &segment->flows[i]))
+        query_postings(query, index, &segment->flows[i]);
+    }
+    return;
+  }
+
+  memset(&key, 0, sizeof(key));
+  key.src = filter->src;
+  key.dst = filter->dst;
+  key.sport = filter->sport;
+  key.dport = filter->dport;
+  key.proto = filter->proto;
+  if ((flow = find_flow(segment, &key)))
+    query_postings(query, index, flow);
+
+  /* Reversed flow differs unless endpoints are equal */
+  if (!filter->both || (key.src == key.dst && key.sport == key.dport))
+    return;
+  key.src = filter->dst;
+  key.dst = filter->src;
+  key.sport = filter->dport;
+  key.dport = filter->sport;
+  if ((flow = find_flow(segment, &key)))
+    query_postings(query, index, flow);
+}
+
+/*
+ * query_times - used to select records through time index
+ * when filter has no 5-tuple fields.
+ * @query - pointer to an object of query struct
+ * @index - index of segment
+ */
+static void query_times(struct query* query, uint32_t index) {
+  const struct segment* segment = &query->segments[index];
+  uint32_t block, record, end;
+
+  for (block = 0; block < segment->header->blocks; block++) {
+    if (!block_overlaps(&query->filter, &segment->blocks[block]))
+      continue;
+
+    end = (block + 1) * segment->header->stride;
+    if (end > segment->count)
+      end = segment->count;
+    for (record = block * segment->header->stride; record < end; record++) {
+      query->records_read++;
+      if (segment->records[record].timestamp >= query->filter.from &&
+          segment->records[record].timestamp <= query->filter.until)
+        add_match(query, index, record);
+    }
+  }
+}
+
+/*
+ * compare_matches - used to order selected packets by
+ * capture time, then by position in store.
+ * @a - pointer to first match
+ * @b - pointer to second match
+ *
+ * Return: negative, zero or positive like memcmp
+ */
+static int compare_matches(const void* a, const void* b) {
+  const struct query_match* x = (const struct query_match*) a;
+  const struct query_match* y = (const struct query_match*) b;
+
+  if (x->timestamp != y->timestamp)
+    return x->timestamp < y->timestamp ? -1 : 1;
+  if (x->segment != y->segment)
+    return x->segment < y->segment ? -1 : 1;
+  return x->record < y->record ? -1 : x->record > y->record;
+}
+
+/*
+ * run_query - used to select packets of every segment
+ * and order them by capture time.
+ * @query - pointer to an object of query struct
+ */
+void run_query(struct query* query) {
+  const struct segment* segment;
+  uint32_t i, record;
+
+  for (i = 0; i < query->segment_count; i++) {
+    segment = &query->segments[i];
+
+    /* Segment still being written is scanned */
+    if (!segment->header) {
+      query->scanned++;
+      for (record = 0; record < segment->count; record++) {
+        query->records_read++;
+        if (match_record(&query->filter, &segment->records[record]))
+          add_match(query, i, record);
+      }
+      continue;
+    }
+
+    if (segment->header->last < query->filter.from ||
+        segment->header->first > query->filter.until) {
+      query->skipped++;
+      continue;
+    }
+
+    if (query->filter.fields)
+      query_flows(query, i);
+    else
+      query_times(query, i);
+  }
+
+  qsort(query->matches, query->match_count, sizeof(struct query_match), compare_matches);
+}
+
+/*
+ * print_bytes - used to print stored bytes as hex dump.
+ * @data - bytes to print
+ * @length - amount of bytes
+ */
+static void print_bytes(const uint8_t* data, size_t length) {
+  size_t i, j;
+
+  for (i = 0; i < length; i += 16) {
+    printf("  %04zx ", i);
+    for (j = i; j < i + 16 && j < length; j++)
+      printf(" %02x", data[j]);
+    printf("\n");
+  }
+}
+
+/*
+ * print_query - used to print selected packets, one line
+ * per packet.
+ * @query - pointer to an object of query struct
+ * @hex - print stored bytes of every packet too
+ */
+void print_query(const struct query* query, int hex) {
+  char src[INET_ADDRSTRLEN], dst[INET_ADDRSTRLEN];
+  const struct segment* segment;
+  const struct segment_record* record;
+  const char* proto;
+  size_t i;
+
+  for (i = 0; i < query->match_count; i++) {
+    segment = &query->segments[query->matches[i].segment];
+    record = &segment->records[query->matches[i].record];
+
+    inet_ntop(AF_INET, &record->src, src, sizeof(src));
+    inet_ntop(AF_INET, &record->dst, dst, sizeof(dst));
+    proto = record->proto == IPPROTO_UDP ? "UDP" :
+            record->proto == IPPROTO_TCP ? "TCP" :
+            record->proto == IPPROTO_ICMP ? "ICMP" : NULL;
+
+    printf("%lu.%09lu ", (unsigned long) (record->timestamp / 1000000000ull),
+           (unsigned long) (record->timestamp % 1000000000ull));
+    if (proto)
+      printf("%s", proto);
+    else
+      printf("proto %u", record->proto);
+    printf(" %s:%u -> %s:%u length %u\n", src, ntohs(record->sport),
+           dst, ntohs(record->dport), record->wire_length);
+
+    if (hex && (uint64_t) record->offset + record->caplen <= segment->data_length)
+      print_bytes(segment->data + record->offset, record->caplen);
+  }
+}
+
+/*
+ * free_query - used to unmap segments and free query.
+ * @query - pointer to an object of query struct
+ */
+void free_query(struct query* query) {
+  struct segment* segment;
+  unsigned int i;
+
+  for (i = 0; i < query->segment_count; i++) {
+    segment = &query->segments[i];
+    if (segment->records)
+      munmap((void*) segment->records, segment->count * sizeof(struct segment_record));
+    if (segment->data)
+      munmap((void*) segment->data, segment->data_length);
+    if (segment->header)
+      munmap((void*) segment->header, segment->index_length);
+  }
+
+  free(query->segments);
+  free(query->matches);
+  free(query);
+}
@@ -0,0 +1,63 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stdint.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+#include <linux/if_packet.h>
+#include <netinet/in.h>
+
+#define BATCH_SIZE 32
+#define BATCH_TIMEOUT 200
+#define BATCH_CONTROL_SIZE (CMSG_SPACE(sizeof(struct timespec)) + \
+                            CMSG_SPACE(sizeof(struct tpacket_auxdata)) + \
+                            CMSG_SPACE(sizeof(struct in_pktinfo)))
+
+/*
+ * Used to receive several datagrams from raw socket
+ * with one recvmmsg call. All buffers and iovecs are
+ * allocated once and reused for every call. In link mode
+ * frames come with sender address and VLAN auxiliary data,
+ * in raw mode packets come with receiving interface.
+ */
+struct batch {
+  /* Message headers passed to recvmmsg */
+  struct mmsghdr* msgs;
+
+  /* One iovec per message */
+  struct iovec* iovecs;
+
+  /* Contiguous storage for all packet buffers */
+  char* buffers;
+
+  /* Control buffers receiving kernel timestamp of every packet */
+  char* controls;
+
+  /* Link layer addresses of frames (CAPTURE_LINK only) */
+  struct sockaddr_ll* addresses;
+
+  /* Maximum amount of datagrams per call */
+  unsigned int size;
+
+  /* Index of loopback interface (CAPTURE_RAW only) */
+  int loopback;
+
+  /* Amount of recvmmsg calls that returned packets */
+  uint64_t calls;
+
+  /* Amount of packets received */
+  uint64_t packets;
+
+  /* Frames that do not carry IPv4 or IPv6 (CAPTURE_LINK only) */
+  uint64_t other;
+};
+
+struct sniffer;
+
+void create_batch(struct sniffer* sniffer);
+
+void run_batch(struct sniffer* sniffer);
+
+void free_batch(struct sniffer* sniffer);
+
+#endif // !BATCH_H
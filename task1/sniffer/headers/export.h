@@ -0,0 +1,85 @@
+#ifndef EXPORT_H
+#define EXPORT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+#include "flow.h"
+
+#define EXPORT_MESSAGE_SIZE 1400
+#define EXPORT_ACTIVE_TIMEOUT 60
+#define EXPORT_TEMPLATE_MESSAGES 20
+#define EXPORT_TEMPLATE_INTERVAL 30
+#define EXPORT_FLUSH_INTERVAL 1
+#define EXPORT_TEMPLATE_ID 256
+
+/* Export protocol versions, as in message header */
+#define EXPORT_NETFLOW9 9
+#define EXPORT_IPFIX 10
+
+/* Why flow record is exported, values of IPFIX flowEndReason */
+enum flow_end {
+  FLOW_END_IDLE = 1,
+  FLOW_END_ACTIVE = 2,
+  FLOW_END_FORCED = 4
+};
+
+/*
+ * Used to send flow records to collector over UDP as IPFIX
+ * or NetFlow v9. Records are packed into one message that
+ * fits into MTU and is sent when full or once per flush
+ * interval. Template goes in front of data every few messages
+ * and seconds, so collector that started late or lost a
+ * datagram learns it again. Owned by one thread, every
+ * worker has own exporter and observation domain.
+ */
+struct exporter {
+  /* UDP socket connected to collector */
+  int socket;
+
+  /* EXPORT_IPFIX or EXPORT_NETFLOW9 */
+  unsigned int version;
+
+  /* Observation domain of IPFIX, source id of NetFlow v9 */
+  uint32_t domain;
+
+  /* Message being filled */
+  uint8_t message[EXPORT_MESSAGE_SIZE];
+  size_t length;
+
+  /* Offset of open data set, 0 if there is none */
+  size_t data_set;
+
+  /* Data records in message, set if template is in front of them */
+  unsigned int records;
+  int templated;
+
+  /* Data records sent for IPFIX, messages sent for NetFlow v9 */
+  uint32_t sequence;
+
+  /* Messages sent since template and time it was last sent */
+  unsigned int since_template;
+  time_t template_sent;
+
+  /* Time first record was added to message */
+  time_t started;
+
+  /* Statistics */
+  uint64_t exported;
+  uint64_t messages;
+  uint64_t errors;
+};
+
+struct exporter* create_exporter(const char* collector, unsigned int version,
+                                 uint32_t domain);
+
+void export_flow(struct exporter* exporter, const struct flow_entry* entry,
+                 enum flow_end reason, uint64_t now);
+
+void flush_exporter(struct exporter* exporter, uint64_t now);
+
+void tick_exporter(struct exporter* exporter, uint64_t now);
+
+void free_exporter(struct exporter* exporter);
+
+#endif // !EXPORT_H
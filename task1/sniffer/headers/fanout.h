@@ -0,0 +1,30 @@
+#ifndef FANOUT_H
+#define FANOUT_H
+
+#include <pthread.h>
+
+#define FANOUT_WORKERS 1
+
+/* Ways kernel spreads packets between fanout sockets */
+enum fanout_mode {
+  /* By flow hash, flow always lands on the same worker */
+  FANOUT_HASH,
+
+  /* By CPU that received packet */
+  FANOUT_CPU,
+
+  /* Round robin between workers */
+  FANOUT_LB
+};
+
+struct sniffer;
+
+void join_fanout(struct sniffer* worker);
+
+void create_workers(struct sniffer* sniffer);
+
+void run_workers(struct sniffer* sniffer);
+
+void free_workers(struct sniffer* sniffer);
+
+#endif // !FANOUT_H
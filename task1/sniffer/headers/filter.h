@@ -0,0 +1,39 @@
+#ifndef FILTER_H
+#define FILTER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <linux/filter.h>
+
+#define FILTER_MAX_INSNS 512
+#define FILTER_MAX_NODES 128
+#define FILTER_MAX_TOKEN 64
+
+/*
+ * Used to hold classic BPF program compiled from
+ * filter expression, ready for SO_ATTACH_FILTER.
+ * Expression grammar:
+ *   expr      := term { ("or" | "||") term }
+ *   term      := factor { ("and" | "&&") factor }
+ *   factor    := ("not" | "!") factor | "(" expr ")" | primitive
+ *   primitive := "ip" | [proto] [dir] ("host" ADDR | "net" ADDR/LEN |
+ *                "port" N | "portrange" N-M) | proto
+ *   proto     := "udp" | "tcp" | "icmp"
+ *   dir       := "src" | "dst"
+ * Example: udp dst port 8080 and src host 127.0.0.1
+ */
+struct filter {
+  /* Program instructions */
+  struct sock_filter insns[FILTER_MAX_INSNS];
+
+  /* Amount of instructions */
+  unsigned short length;
+};
+
+int compile_filter(const char* expression, uint32_t sample, struct filter* filter);
+
+uint32_t run_filter(const struct filter* filter, const void* packet, size_t length);
+
+void print_filter(const struct filter* filter);
+
+#endif // !FILTER_H
@@ -0,0 +1,202 @@
+#ifndef FLOW_H
+#define FLOW_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <limits.h>
+#include <pthread.h>
+#include "hist.h"
+
+#define FLOW_MEMORY (64 << 20)
+#define FLOW_TIMEOUT 60
+#define FLOW_INTERVAL 10
+#define FLOW_LOAD_PERCENT 75
+#define FLOW_SWEEP_SLOTS 4096
+#define FLOW_SNAPSHOT_SLOTS 16384
+
+/*
+ * Used as 5-tuple key of flow. Addresses and ports
+ * are kept in network byte order as in headers.
+ */
+struct flow_key {
+  uint32_t src;
+  uint32_t dst;
+  uint16_t sport;
+  uint16_t dport;
+  uint8_t proto;
+
+  /* Non-zero if slot is used, always 1 in lookups */
+  uint8_t used;
+  uint8_t pad[2];
+};
+
+/*
+ * flow_key_hash - used to hash flow key. Mixes both halves
+ * of key with multiply-xorshift rounds.
+ * @key - pointer to flow key
+ *
+ * Return: hash of the key
+ */
+static inline uint64_t flow_key_hash(const struct flow_key* key) {
+  uint64_t a, b, h;
+
+  memcpy(&a, key, sizeof(a));
+  memcpy(&b, (const uint8_t*) key + sizeof(a), sizeof(b));
+
+  h = a * 0x9E3779B97F4A7C15ull ^ b;
+  h ^= h >> 33;
+  h *= 0xFF51AFD7ED558CCDull;
+  h ^= h >> 33;
+  h *= 0xC4CEB9FE1A85EC53ull;
+  h ^= h >> 33;
+  return h;
+}
+
+/*
+ * flow_keys_equal - used to compare two flow keys.
+ * @a - pointer to first key
+ * @b - pointer to second key
+ *
+ * Return: 1 if keys are equal, 0 otherwise
+ */
+static inline int flow_keys_equal(const struct flow_key* a, const struct flow_key* b) {
+  uint64_t a0, a1, b0, b1;
+
+  memcpy(&a0, a, sizeof(a0));
+  memcpy(&a1, (const uint8_t*) a + sizeof(a0), sizeof(a1));
+  memcpy(&b0, b, sizeof(b0));
+  memcpy(&b1, (const uint8_t*) b + sizeof(b0), sizeof(b1));
+  return a0 == b0 && a1 == b1;
+}
+
+/*
+ * Used as slot of flow table. Exactly one cache line,
+ * so lookup touches single line in common case.
+ */
+struct flow_entry {
+  struct flow_key key;
+
+  /* Packets and payload bytes of flow */
+  uint64_t packets;
+  uint64_t bytes;
+
+  /* Capture time of first and last packet in ns */
+  uint64_t first_seen;
+  uint64_t last_seen;
+
+  /* Minimum and maximum gap between packets in ns, saturated */
+  uint32_t iat_min;
+  uint32_t iat_max;
+
+  /* Histogram of gaps, index in pool plus one, 0 if none */
+  uint32_t histogram;
+
+  /* Packets dropped for bad checksum, saturated */
+  uint32_t errors;
+} __attribute__((aligned(64)));
+
+/*
+ * Used to aggregate packets into flows. Open addressing
+ * with linear probing inside fixed memory budget. Idle
+ * flows are evicted by incremental sweep with backward
+ * shift deletion, so table never needs tombstones.
+ */
+struct flow_table {
+  /* Slots, power of two */
+  struct flow_entry* entries;
+  size_t capacity;
+  size_t mask;
+
+  /* Used slots and limit that keeps probes short */
+  size_t count;
+  size_t limit;
+
+  /* Flows idle for longer than this are evicted, ns */
+  uint64_t timeout;
+
+  /* Preallocated gap histograms and stack of free ones */
+  struct histogram* histograms;
+  uint32_t* free_histograms;
+  uint32_t histogram_count;
+  uint32_t free_histogram_count;
+
+  /* Next slot checked by incremental sweep */
+  size_t cursor;
+
+  /* Receives ended flows, NULL if flows are not exported */
+  struct exporter* exporter;
+
+  /* Flows older than this are exported in parts, ns */
+  uint64_t active_timeout;
+
+  /* Statistics */
+  uint64_t created;
+  uint64_t evicted;
+  uint64_t dropped;
+  uint64_t unhistogrammed;
+};
+
+/*
+ * Used to write flow snapshots off packet path. Thread that
+ * owns flow table copies used slots into snapshot a bounded
+ * step at a time, dumper thread formats copy and writes it,
+ * so neither scan nor disk stalls capture. Flows inserted or
+ * shifted into part of table already copied are missed by
+ * snapshot and appear in the next one.
+ */
+struct flow_dumper {
+  /* Path of snapshot file */
+  char path[PATH_MAX];
+
+  /* Copied flows, amount of them and room for them */
+  struct flow_entry* entries;
+  size_t count;
+  size_t size;
+
+  /* Next slot of table to copy */
+  size_t cursor;
+
+  /* Copy is in progress on owner thread */
+  int copying;
+
+  /* Copy was handed to dumper thread, dumper is stopped */
+  int writing;
+  int stop;
+
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+
+  /* Snapshots written, skipped while previous one was written */
+  uint64_t written;
+  uint64_t skipped;
+};
+
+struct exporter;
+
+struct flow_table* create_flow_table(size_t memory, uint64_t timeout, uint32_t histograms,
+                                     struct exporter* exporter, uint64_t active_timeout);
+
+void update_flow(struct flow_table* table, const struct flow_key* key, 
+                 uint32_t bytes, uint64_t now);
+
+void count_flow_error(struct flow_table* table, const struct flow_key* key);
+
+void expire_flows(struct flow_table* table, uint64_t now, size_t slots);
+
+void export_flows(struct flow_table* table, uint64_t now);
+
+struct flow_dumper* create_flow_dumper(const char* prefix, unsigned int id, size_t size);
+
+void start_flow_snapshot(struct flow_dumper* dumper);
+
+void copy_flow_snapshot(struct flow_dumper* dumper, const struct flow_table* table, size_t slots);
+
+void free_flow_dumper(struct flow_dumper* dumper, const struct flow_table* table);
+
+void log_flow_histograms(struct flow_table* table);
+
+void free_flow_table(struct flow_table* table);
+
+#endif // !FLOW_H
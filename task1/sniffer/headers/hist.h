@@ -0,0 +1,72 @@
+#ifndef HIST_H
+#define HIST_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define HIST_SUB_BITS 3
+#define HIST_SUB_BUCKETS (1 << HIST_SUB_BITS)
+#define HIST_MAX_EXPONENT 40
+#define HIST_BUCKETS ((HIST_MAX_EXPONENT - HIST_SUB_BITS + 2) * HIST_SUB_BUCKETS)
+#define HIST_FLOWS 1024
+#define HIST_INTERVAL 0
+
+/*
+ * Used to count values in log-linear buckets, as HDR
+ * histograms do. Every power of two is split into eight
+ * linear sub-buckets, so bucket is within 12.5% of value
+ * from 1 ns up to 2^41 ns. Larger values go to last bucket.
+ */
+struct histogram {
+  uint64_t counts[HIST_BUCKETS];
+
+  /* Amount of recorded values */
+  uint64_t total;
+
+  /* Smallest and largest recorded values */
+  uint64_t min;
+  uint64_t max;
+};
+
+/*
+ * histogram_bucket - used to get bucket of value.
+ * @value - recorded value
+ *
+ * Return: index of bucket
+ */
+static inline unsigned int histogram_bucket(uint64_t value) {
+  unsigned int exponent;
+
+  if (value < HIST_SUB_BUCKETS)
+    return value;
+
+  exponent = 63 - __builtin_clzll(value);
+  if (exponent > HIST_MAX_EXPONENT)
+    return HIST_BUCKETS - 1;
+
+  return (exponent - HIST_SUB_BITS + 1) * HIST_SUB_BUCKETS +
+         ((value >> (exponent - HIST_SUB_BITS)) & (HIST_SUB_BUCKETS - 1));
+}
+
+/*
+ * record_histogram - used to add value to histogram.
+ * Constant time, no allocation.
+ * @histogram - pointer to an object of histogram struct
+ * @value - value to record
+ */
+static inline void record_histogram(struct histogram* histogram, uint64_t value) {
+  histogram->counts[histogram_bucket(value)]++;
+  if (histogram->total++ == 0 || value < histogram->min)
+    histogram->min = value;
+  if (value > histogram->max)
+    histogram->max = value;
+}
+
+void reset_histogram(struct histogram* histogram);
+
+uint64_t histogram_percentile(const struct histogram* histogram, double percentile);
+
+int format_histogram(const struct histogram* histogram, const char* what,
+                     char* buffer, size_t size);
+
+#endif // !HIST_H
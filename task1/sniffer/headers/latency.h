@@ -0,0 +1,95 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "flow.h"
+#include "hist.h"
+
+#define LATENCY_PENDING 65536
+#define LATENCY_WAYS 4
+#define LATENCY_ENDPOINTS 64
+#define LATENCY_TIMEOUT 5
+
+/*
+ * Used as slot of pending request table. Key is 5-tuple
+ * of request, response is looked up by its reversed tuple.
+ */
+struct latency_request {
+  struct flow_key key;
+
+  /* Capture time of request in ns */
+  uint64_t sent;
+
+  /* Index of server endpoint */
+  uint32_t endpoint;
+  uint32_t pad;
+};
+
+/*
+ * Used to collect response times of one server endpoint.
+ */
+struct latency_endpoint {
+  /* Address and port in network byte order */
+  uint32_t addr;
+  uint16_t port;
+
+  /* Non-zero if slot is used */
+  uint16_t used;
+
+  /* Requests seen and requests that got no response in time */
+  uint64_t requests;
+  uint64_t unanswered;
+
+  /* Response times in ns */
+  struct histogram histogram;
+};
+
+/*
+ * Used to measure server response time passively. Packet
+ * to server port is a request and waits in set-associative
+ * table, the next packet back on reversed 5-tuple is its
+ * response. Table never grows: request that finds its set
+ * full replaces the oldest one. Endpoints are kept in small
+ * open addressing table that is never cleared.
+ */
+struct latency {
+  /* Pending requests, sets of LATENCY_WAYS slots */
+  struct latency_request* pending;
+  size_t sets;
+
+  /* Server endpoints */
+  struct latency_endpoint endpoints[LATENCY_ENDPOINTS];
+  unsigned int endpoint_count;
+
+  /* Server port in network byte order */
+  uint16_t port;
+
+  /* Request without response for this long is dropped, in ns */
+  uint64_t timeout;
+
+  /* Responses matched to request */
+  uint64_t responses;
+
+  /* Responses with no pending request */
+  uint64_t unmatched;
+
+  /* Requests repeated before response, first one is timed */
+  uint64_t repeated;
+
+  /* Live requests replaced because set was full */
+  uint64_t evicted;
+
+  /* Requests to endpoints that did not fit into table */
+  uint64_t overflow;
+};
+
+struct latency* create_latency(uint16_t port, size_t pending, uint64_t timeout);
+
+void track_latency(struct latency* latency, const struct flow_key* key, uint64_t now);
+
+void log_latency(const struct latency* latency, unsigned int id);
+
+void free_latency(struct latency* latency);
+
+#endif // !LATENCY_H
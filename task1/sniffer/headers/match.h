@@ -0,0 +1,101 @@
+#ifndef MATCH_H
+#define MATCH_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define MATCH_MAX_PATTERN 256
+#define MATCH_MAX_REPORTS 16
+#define MATCH_SKIP_LIMIT 64
+
+/* Set in transition to state that ends signature */
+#define MATCH_FLAG 0x80000000u
+
+/* Instruction sets of start byte prefilter */
+enum match_isa {
+  /* Byte at a time table lookup */
+  MATCH_SCALAR,
+
+  /* 16 bytes at a time nibble shuffles */
+  MATCH_SSSE3,
+
+  /* 32 bytes at a time nibble shuffles */
+  MATCH_AVX2
+};
+
+struct matcher;
+
+/*
+ * Used to find next byte in data that may start a
+ * signature, implemented once per instruction set.
+ */
+typedef size_t (*match_skip)(const struct matcher* matcher, const uint8_t* data, 
+                             size_t position, size_t length);
+
+/*
+ * Used to report signature that ends at given offset.
+ */
+typedef void (*match_callback)(const struct matcher* matcher, unsigned int pattern, 
+                               size_t end, void* arg);
+
+/*
+ * Used to find many signatures in payload in one pass.
+ * Aho-Corasick automaton is compiled into a dense table
+ * of byte classes, so every payload byte costs one lookup.
+ * While automaton is in root state, bytes that can not
+ * start any signature are skipped with SIMD prefilter
+ * selected at runtime for the CPU.
+ */
+struct matcher {
+  /* Signatures as written in file, used in reports */
+  char** names;
+
+  /* Decoded bytes of signatures */
+  uint8_t** patterns;
+  size_t* lengths;
+  unsigned int count;
+
+  /* Class of every byte value, bytes of no signature share class 0 */
+  uint8_t classes[256];
+  unsigned int class_count;
+
+  /* Transitions, state_count rows of class_count entries. Every
+   * entry holds offset of target row, flagged if target ends
+   * signature, so scan needs no multiplication */
+  uint32_t* next;
+  unsigned int state_count;
+
+  /* Signature that ends in state, -1 if none */
+  int32_t* match;
+
+  /* Nearest state on suffix chain that ends signature, -1 if none */
+  int32_t* output;
+
+  /* Next signature with the same bytes, -1 if none */
+  int32_t* same;
+
+  /* Bytes that start at least one signature */
+  uint8_t start[256];
+  unsigned int start_count;
+
+  /* Start bytes as bit masks indexed by low nibble, for shuffles */
+  uint8_t mask_low[16];
+  uint8_t mask_high[16];
+
+  /* Prefilter selected for CPU, NULL if too many start bytes */
+  enum match_isa isa;
+  match_skip skip;
+};
+
+struct matcher* create_matcher(const char* path);
+
+void set_matcher_isa(struct matcher* matcher, enum match_isa isa);
+
+void scan_payload(const struct matcher* matcher, const uint8_t* data, size_t length,
+                  match_callback callback, void* arg);
+
+void bench_matcher(struct matcher* matcher);
+
+void free_matcher(struct matcher* matcher);
+
+#endif // !MATCH_H
@@ -0,0 +1,135 @@
+#ifndef MERGE_H
+#define MERGE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+
+#define MERGE_INPUTS 16
+#define MERGE_WINDOW 10
+#define MERGE_SLOTS 16384
+#define MERGE_POOL_SIZE (16 << 20)
+#define MERGE_ALIGNMENT 64
+#define MERGE_BATCH 64
+#define MERGE_IDLE_US 50
+
+/*
+ * Used as descriptor of packet queued by input. Packet
+ * lives in pool of input as capture metadata followed by
+ * its bytes.
+ */
+struct merge_packet {
+  /* Pool position after packet, pool is released up to it */
+  uint64_t end;
+
+  /* Offset of packet in pool and amount of its bytes */
+  uint32_t offset;
+  uint32_t length;
+};
+
+/*
+ * Used as lock-free single-producer single-consumer queue
+ * between capture thread of one input and merge thread.
+ * Packets of one input are queued in capture order, so
+ * merge only compares heads of queues.
+ */
+struct merge_queue {
+  struct merge_packet slots[MERGE_SLOTS];
+
+  /* Packet pool, used as byte ring */
+  uint8_t* pool;
+
+  /* Sniffer capturing on input */
+  struct sniffer* sniffer;
+
+  /* Interface or capture file of input */
+  const char* name;
+
+  /* Index of input, tag of its packets */
+  unsigned int index;
+
+  /* Producer side */
+  uint64_t head __attribute__((aligned(64)));
+  uint64_t pool_head;
+  uint64_t tail_cache;
+  uint64_t released_cache;
+
+  /* Packets dropped because queue or pool was full, waits of replay */
+  uint64_t dropped;
+  uint64_t waits;
+
+  /* Set by capture thread after its last packet */
+  int done;
+
+  /* Consumer side */
+  uint64_t tail __attribute__((aligned(64)));
+  uint64_t released;
+
+  /* Capture time of packet at head in ns, valid while queue is in heap */
+  uint64_t key;
+
+  /* Queue is in heap, input finished and its queue drained */
+  int heaped;
+  int finished;
+
+  /* Packets merged from this input */
+  uint64_t packets;
+};
+
+/*
+ * Used to capture on several interfaces, or replay several
+ * files, and pass their packets on as one stream ordered by
+ * capture time. Every input is a sniffer with own socket and
+ * thread that only queues packets. Merge thread keeps inputs
+ * with queued packets in min-heap by time of their head and
+ * releases the oldest one once every input has a packet
+ * queued, so it is globally oldest, or once it is older than
+ * reorder window, so idle input never holds others back.
+ * Replay waits for every input instead, files are never idle.
+ */
+struct merge {
+  struct sniffer* sniffer;
+
+  /* Sniffers capturing on inputs */
+  struct sniffer* inputs;
+  struct merge_queue* queues;
+  unsigned int count;
+
+  /* Inputs whose queues are not finished yet */
+  unsigned int active;
+
+  /* Indexes of inputs with queued packets, ordered by key */
+  unsigned int heap[MERGE_INPUTS];
+  unsigned int heap_size;
+
+  /* Packet waits at most this long for other inputs in ns, UINT64_MAX in replay */
+  uint64_t window;
+
+  /* Capture time of last released packet in ns */
+  uint64_t last;
+
+  /* Packets released, released older than previous one */
+  uint64_t packets;
+  uint64_t late;
+
+  /* Polls that found nothing to release */
+  uint64_t idle;
+};
+
+struct sniffer;
+struct packet_meta;
+
+void create_merge(struct sniffer* sniffer);
+
+void queue_packet(struct merge_queue* queue, const char* packet, size_t length,
+                  const struct packet_meta* meta);
+
+void run_merge(struct sniffer* sniffer);
+
+const char* merge_input_name(const struct sniffer* sniffer, const struct packet_meta* meta);
+
+void log_merge(const struct merge* merge, const char* name);
+
+void free_merge(struct sniffer* sniffer);
+
+#endif // !MERGE_H
@@ -0,0 +1,80 @@
+#ifndef PCAP_H
+#define PCAP_H
+
+#include <stdint.h>
+
+#define PCAP_MAGIC_USEC 0xa1b2c3d4
+#define PCAP_MAGIC_NSEC 0xa1b23c4d
+#define PCAPNG_SHB 0x0A0D0D0A
+#define PCAPNG_IDB 0x00000001
+#define PCAPNG_EPB 0x00000006
+#define PCAPNG_BYTE_ORDER 0x1A2B3C4D
+#define PCAPNG_IF_NAME 2
+#define PCAPNG_IF_TSRESOL 9
+
+/* pcap link type for packets starting at Ethernet header */
+#define LINKTYPE_ETHERNET 1
+
+/* pcap link type for packets starting at IP header */
+#define LINKTYPE_RAW 101
+
+/* Global header of pcap file */
+struct pcap_header {
+  uint32_t magic;
+  uint16_t version_major;
+  uint16_t version_minor;
+  int32_t thiszone;
+  uint32_t sigfigs;
+  uint32_t snaplen;
+  uint32_t linktype;
+};
+
+/* Header of every pcap record */
+struct pcap_record {
+  uint32_t ts_sec;
+  uint32_t ts_nsec;
+  uint32_t caplen;
+  uint32_t len;
+};
+
+/* Section header block and interface description block of pcapng */
+struct pcapng_header {
+  uint32_t shb_type;
+  uint32_t shb_length;
+  uint32_t byte_order;
+  uint16_t version_major;
+  uint16_t version_minor;
+  int64_t section_length;
+  uint32_t shb_length_end;
+
+  uint32_t idb_type;
+  uint32_t idb_length;
+  uint16_t linktype;
+  uint16_t reserved;
+  uint32_t snaplen;
+  uint16_t tsresol_code;
+  uint16_t tsresol_length;
+  uint8_t tsresol;
+  uint8_t tsresol_pad[3];
+  uint32_t end_of_options;
+  uint32_t idb_length_end;
+} __attribute__((packed));
+
+/* Generic header of every pcapng block */
+struct pcapng_block {
+  uint32_t type;
+  uint32_t length;
+};
+
+/* Enhanced packet block of pcapng without data and trailer */
+struct pcapng_epb {
+  uint32_t type;
+  uint32_t length;
+  uint32_t interface;
+  uint32_t ts_high;
+  uint32_t ts_low;
+  uint32_t caplen;
+  uint32_t len;
+};
+
+#endif // !PCAP_H
@@ -0,0 +1,144 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+#include "sample.h"
+
+#define PIPELINE_SLOTS 4096
+#define PIPELINE_POOL_SIZE (32 << 20)
+#define PIPELINE_ALIGNMENT 64
+#define PIPELINE_BATCH 64
+#define PIPELINE_IDLE_US 50
+#define PIPELINE_TICK_MS 10
+#define PIPELINE_STAGES 3
+
+/* What output stage does with packet */
+enum pipeline_action {
+  /* Release packet only */
+  ACTION_NONE,
+
+  /* Print payload */
+  ACTION_PRINT
+};
+
+/*
+ * Used as descriptor of packet passed between stages.
+ * Packet lives in pool as capture metadata followed by
+ * its bytes, descriptor only points to it.
+ */
+struct pipeline_packet {
+  /* Pool position after packet, pool is released up to it */
+  uint64_t end;
+
+  /* Offset of packet in pool and amount of its bytes */
+  uint32_t offset;
+  uint32_t length;
+
+  /* Filled by parse stage: payload relative to packet */
+  uint32_t payload_offset;
+  uint32_t payload_length;
+  enum pipeline_action action;
+  uint32_t pad;
+};
+
+/*
+ * Used as lock-free single-producer single-consumer ring
+ * of descriptors. Producer and consumer indexes live on
+ * their own cache lines with cached copy of the other
+ * side, so shared lines are touched only when cache runs out.
+ */
+struct pipeline_ring {
+  struct pipeline_packet slots[PIPELINE_SLOTS];
+
+  /* Producer side */
+  uint64_t head __attribute__((aligned(64)));
+  uint64_t tail_cache;
+
+  /* Pushes that found ring full */
+  uint64_t full;
+
+  /* Consumer side */
+  uint64_t tail __attribute__((aligned(64)));
+  uint64_t head_cache;
+
+  /* Polls that found ring empty */
+  uint64_t empty;
+
+  /* Batches taken, their total and largest size */
+  uint64_t batches;
+  uint64_t occupancy;
+  uint64_t occupancy_max;
+};
+
+/*
+ * Used to run capture, parse/aggregate and output stages of
+ * one sniffer on separate threads. Capture copies packets
+ * into shared pool and passes descriptors to parse stage,
+ * which passes them on to output stage in the same order,
+ * so output stage releases pool strictly in order. Live
+ * capture drops packets when pool or ring is full, replay
+ * waits. Parse stage waits for output stage.
+ */
+struct pipeline {
+  struct sniffer* sniffer;
+
+  /* Packet pool, used as byte ring */
+  uint8_t* pool;
+
+  /* Pool position of next packet, written by capture stage */
+  uint64_t pool_head;
+  uint64_t released_cache;
+
+  /* Pool position released by output stage */
+  uint64_t released __attribute__((aligned(64)));
+
+  /* Capture to parse and parse to output rings */
+  struct pipeline_ring* parse_ring;
+  struct pipeline_ring* output_ring;
+
+  /* Flow sampling of reassembled datagrams in parse stage */
+  struct sampler sampler;
+
+  /* Formatted text of output stage */
+  struct output* output;
+
+  /* CPU of capture, parse and output stage, -1 for any */
+  int cpus[PIPELINE_STAGES];
+
+  /* Threads of parse and output stages */
+  pthread_t parse_thread;
+  pthread_t output_thread;
+
+  /* Set when upstream stage has nothing more to pass */
+  int capture_done;
+  int parse_done;
+  int running;
+
+  /* Packets dropped by capture stage, pool full or ring full */
+  uint64_t dropped;
+  uint64_t pool_full;
+
+  /* Waits of replay capture stage for free space */
+  uint64_t waits;
+};
+
+struct sniffer;
+struct packet_meta;
+struct output;
+
+struct pipeline* create_pipeline(struct sniffer* sniffer, const int* cpus);
+
+void start_pipeline(struct pipeline* pipeline);
+
+void submit_packet(struct pipeline* pipeline, const char* packet, size_t length,
+                   const struct packet_meta* meta);
+
+void stop_pipeline(struct pipeline* pipeline);
+
+void log_pipeline(const struct pipeline* pipeline, const char* name);
+
+void free_pipeline(struct pipeline* pipeline);
+
+#endif // !PIPELINE_H
@@ -0,0 +1,41 @@
+#ifndef PUBLISH_H
+#define PUBLISH_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <limits.h>
+#include "../../common/headers/shmring.h"
+
+/*
+ * Used to publish captured packets into shared-memory ring,
+ * so any number of reader processes see them without own
+ * socket and without slowing capture down. Every worker has
+ * own ring named NAME-<worker>. Packets longer than slot
+ * are cut.
+ */
+struct publisher {
+  /* Name of shared memory object */
+  char name[NAME_MAX];
+
+  /* Mapping of whole ring */
+  struct shm_ring_header* header;
+  uint8_t* slots;
+  size_t size;
+  uint64_t mask;
+
+  /* Sequence of next packet, only publisher writes it */
+  uint64_t head;
+
+  /* Statistics */
+  uint64_t truncated;
+};
+
+struct publisher* create_publisher(const char* name, unsigned int id,
+                                   uint32_t slot_count, uint32_t slot_size);
+
+void publish_packet(struct publisher* publisher, uint64_t timestamp, const void* data,
+                    uint32_t length, uint32_t wire_length);
+
+void free_publisher(struct publisher* publisher);
+
+#endif // !PUBLISH_H
@@ -0,0 +1,118 @@
+#ifndef REASM_H
+#define REASM_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define REASM_MEMORY (4 << 20)
+#define REASM_TIMEOUT 30
+#define REASM_CHUNK_SIZE 2048
+#define REASM_MAX_PAYLOAD 65535
+#define REASM_CHUNKS_PER_DATAGRAM ((REASM_MAX_PAYLOAD + REASM_CHUNK_SIZE - 1) / REASM_CHUNK_SIZE)
+#define REASM_UNITS ((REASM_MAX_PAYLOAD + 7) / 8)
+#define REASM_MAX_HEADER 60
+
+/*
+ * Used as key of datagram fragments belong to.
+ */
+struct reasm_key {
+  uint32_t src;
+  uint32_t dst;
+  uint16_t id;
+  uint8_t proto;
+  uint8_t pad;
+};
+
+/*
+ * Used to collect fragments of one datagram. Payload is
+ * kept in chunks of shared pool, so small datagrams take
+ * little memory. Received bytes are tracked in 8-byte units,
+ * the granularity of fragment offsets.
+ */
+struct reasm_context {
+  struct reasm_key key;
+
+  /* Header of first fragment */
+  uint8_t header[REASM_MAX_HEADER];
+  unsigned int header_length;
+
+  /* Payload length, known once last fragment arrives, 0 before */
+  unsigned int total;
+
+  /* End of furthest fragment so far */
+  unsigned int end;
+
+  /* Amount of distinct units received */
+  unsigned int received;
+
+  /* Capture time after which datagram is dropped, ns */
+  uint64_t deadline;
+
+  /* Chunks holding payload, -1 if not allocated */
+  int32_t chunks[REASM_CHUNKS_PER_DATAGRAM];
+
+  /* Bit per received unit */
+  uint64_t units[(REASM_UNITS + 63) / 64];
+
+  /* Next context in hash bucket or free list */
+  int32_t next;
+
+  /* Neighbours in list ordered by deadline */
+  int32_t older;
+  int32_t newer;
+};
+
+/*
+ * Used to reassemble IPv4 fragments. All memory is
+ * allocated on creation: contexts, payload chunks and
+ * output buffer, so flood of fragments can not make sniffer
+ * allocate. When pool is exhausted, oldest datagram is
+ * dropped to make room.
+ */
+struct reassembly {
+  /* Preallocated contexts and free list of them */
+  struct reasm_context* contexts;
+  unsigned int context_count;
+  int32_t free_contexts;
+
+  /* Hash buckets of used contexts */
+  int32_t* buckets;
+  uint32_t bucket_mask;
+
+  /* Oldest and newest used contexts */
+  int32_t oldest;
+  int32_t newest;
+
+  /* Payload chunks and stack of free chunk indices */
+  uint8_t* chunks;
+  int32_t* free_chunks;
+  unsigned int chunk_count;
+  unsigned int free_chunk_count;
+
+  /* Datagrams are dropped this long after first fragment, ns */
+  uint64_t timeout;
+
+  /* Complete datagram, valid until next fragment */
+  uint8_t output[REASM_MAX_HEADER + REASM_MAX_PAYLOAD];
+
+  /* Statistics */
+  uint64_t fragments;
+  uint64_t datagrams;
+  uint64_t timeouts;
+  uint64_t evicted;
+  uint64_t overlaps;
+  uint64_t invalid;
+};
+
+struct reassembly* create_reassembly(size_t memory, uint64_t timeout);
+
+int is_fragment(const uint8_t* packet, size_t length);
+
+int reassemble(struct reassembly* reasm, const uint8_t* packet, size_t length, uint64_t now,
+               const uint8_t** datagram, size_t* datagram_length);
+
+void expire_reassembly(struct reassembly* reasm, uint64_t now);
+
+void free_reassembly(struct reassembly* reasm);
+
+#endif // !REASM_H
@@ -0,0 +1,111 @@
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+#include <limits.h>
+#include <pthread.h>
+#include "filter.h"
+
+#define RECORDER_MEMORY (256 << 20)
+#define RECORDER_PREFIX "snapshot"
+#define RECORDER_HOLDOFF 10
+#define RECORDER_WRITE_SIZE (1 << 20)
+#define RECORDER_ALIGNMENT 8
+
+/* Caplen of marker that sends reader to start of buffer */
+#define RECORDER_WRAP UINT32_MAX
+
+/*
+ * Used as header of packet in history buffer,
+ * packet bytes follow padded to RECORDER_ALIGNMENT.
+ */
+struct recorder_record {
+  /* Capture time in ns */
+  uint64_t timestamp;
+
+  uint32_t caplen;
+  uint32_t wire_length;
+};
+
+/*
+ * Used to keep last seconds or bytes of packets in one
+ * preallocated circular buffer and write them to pcap file
+ * when something goes wrong. Capture thread appends records
+ * and evicts oldest ones, no packet is allocated. Snapshot is
+ * written by recorder thread while capture goes on: capture
+ * never evicts records the thread has not written yet and
+ * drops packets instead when buffer is full of them.
+ */
+struct recorder {
+  /* Prefix of snapshot files */
+  char prefix[PATH_MAX];
+
+  /* Index of the worker, part of file names */
+  unsigned int id;
+
+  /* Maximum bytes kept per packet */
+  uint32_t snaplen;
+
+  /* Evict records older than this, ns, 0 to keep until buffer is full */
+  uint64_t window;
+
+  /* History, capacity is multiple of RECORDER_ALIGNMENT */
+  uint8_t* buffer;
+  size_t capacity;
+
+  /* Positions of next and oldest record, never wrap */
+  uint64_t head;
+  uint64_t tail;
+
+  /* Packets that start snapshot, NULL if only signal does */
+  struct filter* trigger;
+
+  /* Time snapshot was last started */
+  time_t triggered;
+
+  /* Snapshot range, position written so far is published to capture */
+  uint64_t dump_start;
+  uint64_t dump_end;
+  uint64_t released;
+
+  /* Set by capture when snapshot starts, cleared by recorder thread */
+  int dumping;
+
+  /* Snapshot waits for recorder thread, protected by lock */
+  int pending;
+
+  /* Records formatted for write */
+  uint8_t* output;
+
+  /* Wakes recorder thread */
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+
+  /* Recorder thread */
+  pthread_t thread;
+  int stop;
+
+  /* State of recorder thread */
+  unsigned int sequence;
+  char path[PATH_MAX];
+
+  /* Statistics */
+  uint64_t packets;
+  uint64_t dropped;
+  uint64_t snapshots;
+  uint64_t ignored;
+};
+
+struct recorder* create_recorder(const char* prefix, unsigned int id, size_t memory,
+                                 unsigned int seconds, uint32_t snaplen, const char* trigger);
+
+void record_packet(struct recorder* recorder, uint64_t timestamp, const void* data,
+                   uint32_t length, uint32_t wire_length);
+
+int trigger_recorder(struct recorder* recorder);
+
+void free_recorder(struct recorder* recorder);
+
+#endif // !RECORDER_H
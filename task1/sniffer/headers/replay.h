@@ -0,0 +1,67 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "writer.h"
+
+#define REPLAY_BATCH 64
+#define REPLAY_INTERFACES 16
+
+/*
+ * Used to describe one interface of capture file.
+ * Plain pcap files have exactly one.
+ */
+struct replay_interface {
+  /* Link type of packets */
+  uint32_t linktype;
+
+  /* Timestamp units per second */
+  uint64_t units;
+};
+
+/*
+ * Used to feed packets of pcap or pcapng file into
+ * pipeline. File is mapped into memory and packets are
+ * passed to pipeline in place, without copies.
+ */
+struct replay {
+  /* Mapped file */
+  const uint8_t* map;
+  size_t size;
+
+  /* Format of file */
+  enum capture_format format;
+
+  /* File was written on host with other byte order */
+  int swapped;
+
+  /* Interfaces described in file */
+  struct replay_interface interfaces[REPLAY_INTERFACES];
+  unsigned int interface_count;
+
+  /* Offset of next record */
+  size_t offset;
+
+  /* Records fed into pipeline */
+  uint64_t packets;
+
+  /* Bytes of fed records */
+  uint64_t bytes;
+
+  /* Records of unknown link type or interface */
+  uint64_t skipped;
+
+  /* Wall time of replay in seconds */
+  double elapsed;
+};
+
+struct sniffer;
+
+void create_replay(struct sniffer* sniffer);
+
+void run_replay(struct sniffer* sniffer);
+
+void free_replay(struct sniffer* sniffer);
+
+#endif // !REPLAY_H
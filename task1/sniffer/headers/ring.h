@@ -0,0 +1,56 @@
+#ifndef RING_H
+#define RING_H
+
+#include <stdint.h>
+#include <sys/uio.h>
+#include <linux/if_packet.h>
+
+#define RING_BLOCK_SIZE (1 << 22)
+#define RING_BLOCK_COUNT 64
+#define RING_FRAME_SIZE 2048
+#define RING_RETIRE_TIMEOUT 60
+#define RING_POLL_TIMEOUT 200
+
+/*
+ * Used to hold PACKET_MMAP TPACKET_V3 ring mapped
+ * into process memory. Kernel fills blocks with
+ * frames, user space walks them in place and hands
+ * blocks back by setting their status.
+ */
+struct ring {
+  /* Start of mapped memory */
+  uint8_t* map;
+
+  /* Size of mapped memory */
+  size_t map_size;
+
+  /* Pointers to every block in mapped memory */
+  struct iovec* blocks;
+
+  /* Kernel request used to set up ring */
+  struct tpacket_req3 req;
+
+  /* Index of the next block to read */
+  unsigned int current;
+
+  /* Packets seen by kernel */
+  uint64_t packets;
+
+  /* Packets dropped because ring was full */
+  uint64_t drops;
+
+  /* Times queue was frozen because ring was full */
+  uint64_t freezes;
+};
+
+struct sniffer;
+
+void create_ring(struct sniffer* sniffer);
+
+void run_ring(struct sniffer* sniffer);
+
+void update_ring_stats(struct sniffer* sniffer);
+
+void free_ring(struct sniffer* sniffer);
+
+#endif // !RING_H
@@ -0,0 +1,66 @@
+#ifndef SAMPLE_H
+#define SAMPLE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Multipliers of flow hash, same in kernel filter and user space */
+#define SAMPLE_MULT_SRC 0x9E3779B1u
+#define SAMPLE_MULT_DST 0x85EBCA6Bu
+#define SAMPLE_MULT_PORTS 0xC2B2AE35u
+
+/* Token bucket holds this many milliseconds of rate cap */
+#define SAMPLE_BURST_MS 100
+
+/*
+ * Used to thin out traffic before it reaches pipeline.
+ * Flow sampling keeps 1 of every rate flows by hash of
+ * 5-tuple, so every sniffer keeps the same flows whole.
+ * Rate cap passes at most pps packets per second through
+ * token bucket driven by capture timestamps.
+ */
+struct sampler {
+  /* Keep 1 of every rate flows, 0 or 1 keeps all */
+  uint32_t rate;
+
+  /* Packets per second cap, 0 for none */
+  uint64_t pps;
+
+  /* Credit of token bucket, packet costs 10^9 */
+  uint64_t credit;
+  uint64_t depth;
+
+  /* Capture time of last packet charged to bucket in ns */
+  uint64_t last;
+
+  /* Packets dropped in user space by flow hash and by rate cap */
+  uint64_t sampled;
+  uint64_t limited;
+};
+
+/*
+ * sample_hash - used to hash 5-tuple of packet. Program
+ * emitted by compile_filter computes the same value from
+ * header fields in host byte order.
+ * @src - source address
+ * @dst - destination address
+ * @ports - source port in high half, destination port in low half
+ * @proto - IP protocol
+ *
+ * Return: hash of flow
+ */
+static inline uint32_t sample_hash(uint32_t src, uint32_t dst, uint32_t ports, uint8_t proto) {
+  uint32_t hash;
+
+  hash = src * SAMPLE_MULT_SRC;
+  hash = (hash ^ dst) * SAMPLE_MULT_DST;
+  hash = (hash ^ ports) * SAMPLE_MULT_PORTS;
+  hash ^= proto;
+  return hash ^ (hash >> 16);
+}
+
+void init_sampler(struct sampler* sampler, uint32_t rate, uint64_t pps);
+
+int sample_packet(struct sampler* sampler, const uint8_t* packet, size_t length, uint64_t now);
+
+#endif // !SAMPLE_H
@@ -0,0 +1,90 @@
+#ifndef SKETCH_H
+#define SKETCH_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define SKETCH_MEMORY (4 << 20)
+#define SKETCH_DEPTH 4
+#define SKETCH_TOP 10
+#define SKETCH_CANDIDATES 4
+#define SKETCH_HLL_BITS 12
+#define SKETCH_HLL_SIZE (1 << SKETCH_HLL_BITS)
+#define SKETCH_INTERVAL 10
+
+/*
+ * Used as candidate heavy hitter. Candidates form min-heap
+ * by estimated count, slot points back into address index.
+ */
+struct sketch_candidate {
+  uint32_t addr;
+  uint32_t slot;
+  uint64_t count;
+};
+
+/*
+ * Used as slot of address index of candidates. Open
+ * addressing with linear probing and backward shift deletion.
+ */
+struct sketch_slot {
+  uint32_t addr;
+
+  /* Position in heap plus one, 0 if slot is free */
+  uint32_t position;
+};
+
+/*
+ * Used to keep the largest sources seen by Count-Min sketch.
+ * Sources whose estimate beats the smallest candidate replace
+ * it, so update costs O(log capacity) with fixed capacity.
+ */
+struct sketch_top {
+  struct sketch_candidate* heap;
+  unsigned int size;
+  unsigned int capacity;
+
+  /* Index of candidates by address */
+  struct sketch_slot* index;
+  unsigned int index_mask;
+};
+
+/*
+ * Used to summarize traffic in fixed memory. Count-Min
+ * sketches with conservative update estimate packets and
+ * bytes per source address, heaps keep top talkers by both,
+ * HyperLogLog registers count distinct sources and
+ * destinations. Everything is reset after every report.
+ */
+struct sketch {
+  /* Counters of Count-Min sketches, SKETCH_DEPTH rows each */
+  uint32_t* packets;
+  uint64_t* bytes;
+  size_t width;
+
+  /* Top talkers by packets and by bytes */
+  struct sketch_top top_packets;
+  struct sketch_top top_bytes;
+
+  /* HyperLogLog registers of sources and destinations */
+  uint8_t sources[SKETCH_HLL_SIZE];
+  uint8_t destinations[SKETCH_HLL_SIZE];
+
+  /* Amount of top talkers reported */
+  unsigned int top;
+
+  /* Packets and bytes since last reset */
+  uint64_t total_packets;
+  uint64_t total_bytes;
+};
+
+struct sketch* create_sketch(size_t memory, unsigned int top);
+
+void update_sketch(struct sketch* sketch, uint32_t src, uint32_t dst, uint32_t bytes);
+
+void log_sketch(const struct sketch* sketch, unsigned int id);
+
+void reset_sketch(struct sketch* sketch);
+
+void free_sketch(struct sketch* sketch);
+
+#endif // !SKETCH_H
@@ -2,22 +2,455 @@
 #define SNIFFER_H
 
 #include "../../common/headers/common.h"
+#include "../../common/headers/packet.h"
+#include "../../common/headers/log.h"
+#include <signal.h>
+#include <errno.h>
+#include <limits.h>
+#include <net/if.h>
+#include "ring.h"
+#include "batch.h"
+#include "filter.h"
+#include "fanout.h"
+#include "writer.h"
+#include "store.h"
+#include "recorder.h"
+#include "publish.h"
+#include "flow.h"
+#include "export.h"
+#include "replay.h"
+#include "match.h"
+#include "reasm.h"
+#include "hist.h"
+#include "sample.h"
+#include "xsk.h"
+#include "latency.h"
+#include "sketch.h"
+#include "pipeline.h"
+#include "merge.h"
+
+#define OUTPUT_SIZE 65536
+
+/* Capture modes supported by sniffer */
+enum capture_mode {
+  /* Batched recvmmsg calls on AF_INET raw socket */
+  CAPTURE_RAW,
+  
+  /* PACKET_MMAP TPACKET_V3 block ring on AF_PACKET socket */
+  CAPTURE_RING,
+
+  /* Packets of memory-mapped pcap or pcapng file */
+  CAPTURE_FILE,
+
+  /* Batched recvmmsg calls on AF_PACKET socket seeing whole frames */
+  CAPTURE_LINK,
+
+  /* AF_XDP socket fed by XDP program on interface */
+  CAPTURE_XDP
+};
+
+/*
+ * Used to configure sniffer before creation.
+ * Filled by main from command line arguments.
+ */
+struct sniffer_config {
+  /* Selected capture mode */
+  enum capture_mode mode;
+
+  /* Interface to capture on, NULL for all */
+  const char* interface;
+
+  /* Interfaces, or capture files in CAPTURE_FILE mode, merged by time */
+  const char* inputs[MERGE_INPUTS];
+  unsigned int input_count;
+
+  /* Packet waits this many ms for older packets of idle interfaces */
+  unsigned int merge_window;
+
+  /* Queue of interface bound to AF_XDP socket */
+  unsigned int queue;
+
+  /* Maximum amount of datagrams per recvmmsg call */
+  unsigned int batch_size;
+
+  /* Size of one ring block in bytes */
+  unsigned int block_size;
+  
+  /* Amount of blocks in ring */
+  unsigned int block_count;
+  
+  /* Timeout in ms after which kernel retires block */
+  unsigned int retire_timeout;
+
+  /* Filter expression, NULL to capture everything */
+  const char* filter;
+
+  /* File with filter expression, re-read on SIGHUP */
+  const char* filter_file;
+
+  /* Keep 1 of every sample flows, 0 or 1 keeps all */
+  unsigned int sample;
+
+  /* Packets per second cap of pipeline, 0 for none */
+  unsigned long max_pps;
+
+  /* Amount of capture threads, each with own fanout socket */
+  unsigned int workers;
+
+  /* How kernel spreads packets between workers */
+  enum fanout_mode fanout;
+
+  /* Prefix of capture files, NULL to not write them */
+  const char* write_prefix;
+
+  /* Format of capture files */
+  enum capture_format write_format;
+
+  /* Maximum bytes written per packet */
+  uint32_t snaplen;
+
+  /* Rotate capture file after this many bytes, 0 to disable */
+  uint64_t rotate_size;
+
+  /* Rotate capture file after this many seconds, 0 to disable */
+  unsigned int rotate_time;
+
+  /* Compress closed capture files */
+  int compress;
+
+  /* Directory of indexed packet store, NULL to not store */
+  const char* store_dir;
+
+  /* Seal store segment after this many data bytes */
+  uint64_t store_size;
+
+  /* Seal store segment after this many seconds, 0 to disable */
+  unsigned int store_time;
+
+  /* Memory of flight recorder history of all workers, 0 to not record */
+  size_t record_memory;
+
+  /* Keep packets of this many seconds in history, 0 until it is full */
+  unsigned int record_time;
+
+  /* Prefix of snapshot files */
+  const char* record_prefix;
+
+  /* Filter expression of packets that start snapshot, NULL for none */
+  const char* record_trigger;
+
+  /* Name of shared-memory rings for readers, NULL to not publish */
+  const char* publish_name;
+
+  /* Slots of every ring, power of two, and size of slot in bytes */
+  uint32_t publish_slots;
+  uint32_t publish_slot_size;
+
+  /* Capture file replayed in CAPTURE_FILE mode */
+  const char* read_path;
+
+  /* Replay packets at their original timestamps */
+  int realtime;
+
+  /* Memory of fragment reassembly in bytes, 0 to disable */
+  size_t reasm_memory;
+
+  /* Drop datagram this many seconds after its first fragment */
+  unsigned int reasm_timeout;
+
+  /* Drop packets with bad IP or UDP checksum */
+  int verify;
+
+  /* Keep histograms of gaps between packets */
+  int histograms;
+
+  /* Amount of flows of all workers with own histogram */
+  uint32_t hist_flows;
+
+  /* Log histograms every this many seconds, 0 only on SIGUSR2 */
+  unsigned int hist_interval;
+
+  /* File with payload signatures, NULL to not match */
+  const char* signatures;
+
+  /* Aggregate packets into flows instead of printing payloads */
+  int flows;
+
+  /* Memory budget of flow tables of all workers in bytes */
+  size_t flow_memory;
+
+  /* Evict flow after this many idle seconds */
+  unsigned int flow_timeout;
+
+  /* Write flow snapshot every this many seconds */
+  unsigned int flow_interval;
+
+  /* Prefix of flow snapshot files, NULL to log only summary */
+  const char* flow_dump;
+
+  /* HOST:PORT of flow collector, NULL to not export */
+  const char* export_collector;
+
+  /* EXPORT_IPFIX or EXPORT_NETFLOW9 */
+  unsigned int export_version;
+
+  /* Export flows active for longer than this many seconds */
+  unsigned int active_timeout;
+
+  /* Server port whose response time is measured, 0 to disable */
+  unsigned int latency_port;
+
+  /* Request without response for this many seconds is unanswered */
+  unsigned int latency_timeout;
+
+  /* Non-zero to summarize traffic in sketches */
+  int sketches;
+
+  /* Memory budget of Count-Min sketches in bytes, split between workers */
+  size_t sketch_memory;
+
+  /* Amount of top talkers reported */
+  unsigned int sketch_top;
+
+  /* Report and reset sketches every this many seconds */
+  unsigned int sketch_interval;
+
+  /* Run capture, parse and output stages on own threads */
+  int pipeline;
+
+  /* CPU of every pipeline stage, -1 to not pin */
+  int pipeline_cpus[PIPELINE_STAGES];
+};
+
+/*
+ * Used to pass capture metadata of packet
+ * along with its bytes through pipeline.
+ */
+struct packet_meta {
+  /* Time packet was captured */
+  struct timespec ts;
+
+  /* Original length of packet from IP header */
+  uint32_t wire_length;
+
+  /* Checksum state reported by kernel */
+  enum packet_checksum checksum;
+
+  /* VLAN TCIs of frame, outer tag first */
+  uint16_t vlan_tci[PACKET_MAX_VLANS];
+  unsigned int vlan_count;
+
+  /* Index of merged input packet was captured on, 0 without merge */
+  unsigned int interface;
+};
+
+/*
+ * Used to collect formatted output of one thread and
+ * pass it to logger as one message instead of one per packet.
+ */
+struct output {
+  /* Formatted text not yet written */
+  char buffer[OUTPUT_SIZE];
+
+  /* Amount of bytes in buffer */
+  size_t length;
+};
+
+/*
+ * Used to count packets passed through pipeline.
+ * Owned by one thread, never shared.
+ */
+struct sniffer_stats {
+  /* UDP packets processed */
+  uint64_t packets;
+
+  /* Payload bytes processed */
+  uint64_t bytes;
+
+  /* Packets that matched at least one signature */
+  uint64_t matches;
+
+  /* Packets dropped for bad IP header or UDP checksum */
+  uint64_t ip_errors;
+  uint64_t udp_errors;
+
+  /* UDP checksums verified or not filled yet by kernel, or replayed */
+  uint64_t offloaded;
+
+  /* Packets of other protocols, counted but not processed */
+  uint64_t tcp;
+  uint64_t icmp;
+  uint64_t udp6;
+  uint64_t fragments;
+  uint64_t other;
+
+  /* IPv6 packets among them */
+  uint64_t ipv6;
+};
 
 /**
  * Used as a sniffer for UDP packets
  * on RAW socket. Skips IP header and UDP
  * header and prints payload on stdout.
+ * In worker mode parent sniffer has no socket
+ * and only owns workers, which are sniffers too.
+ * Merging sniffer has no socket either, it processes
+ * packets its inputs capture on their sockets.
  */
 struct sniffer {
   /* Fd for socket */
   int raw_socket;
+
+  /* Index of worker, 0 for single sniffer */
+  unsigned int id;
+
+  /* Configuration of sniffer */
+  struct sniffer_config config;
+
+  /* Batched receive buffers (CAPTURE_RAW only) */
+  struct batch batch;
+
+  /* Memory-mapped ring (CAPTURE_RING only) */
+  struct ring ring;
+
+  /* Memory-mapped capture file (CAPTURE_FILE only) */
+  struct replay replay;
+
+  /* AF_XDP socket and its UMEM (CAPTURE_XDP only) */
+  struct xsk xsk;
+
+  /* Buffered output of this sniffer */
+  struct output output;
+
+  /* Capture file writer, NULL if not writing */
+  struct capture_writer* writer;
+
+  /* Indexed packet store, NULL if not storing */
+  struct store* store;
+
+  /* Flight recorder, NULL if not recording */
+  struct recorder* recorder;
+
+  /* Shared-memory ring for other processes, NULL if not publishing */
+  struct publisher* publisher;
+
+  /* Pipeline counters of this sniffer */
+  struct sniffer_stats stats;
+
+  /* Flow sampling and rate cap in front of pipeline */
+  struct sampler sampler;
+
+  /* Fragment reassembly, NULL if disabled */
+  struct reassembly* reasm;
+
+  /* Server response times, NULL if disabled */
+  struct latency* latency;
+
+  /* Traffic sketches, NULL if disabled */
+  struct sketch* sketch;
+
+  /* Wall clock time of last sketch report */
+  time_t sketch_reported;
+
+  /* Capture time of newest packet in ns, written by capture thread */
+  uint64_t latest;
+
+  /* Parse and output stages, NULL if capture thread does everything */
+  struct pipeline* pipeline;
+
+  /* Gaps between all packets of sniffer, NULL if disabled */
+  struct histogram* histogram;
+
+  /* Capture time of previous packet in ns */
+  uint64_t histogram_last;
+
+  /* Time histograms were last logged */
+  time_t histograms_dumped;
+
+  /* Signature matcher shared by all workers, NULL if not matching */
+  struct matcher* matcher;
+
+  /* Flow table, NULL if flows are not aggregated */
+  struct flow_table* flows;
+
+  /* Writer of flow snapshots, NULL if they are not written */
+  struct flow_dumper* flow_dumper;
+
+  /* Time of last flow snapshot */
+  time_t flows_dumped;
+
+  /* Flow record exporter, NULL if flows are not exported */
+  struct exporter* exporter;
+
+  /* Inputs merged by time, NULL if sniffer has own socket */
+  struct merge* merge;
+
+  /* Queue of merge this input feeds, NULL if sniffer processes packets */
+  struct merge_queue* merge_queue;
+
+  /* Workers with own sockets (worker mode only) */
+  struct sniffer* workers;
+  unsigned int worker_count;
+
+  /* Thread running this worker */
+  pthread_t thread;
+
+  /* Cleared by signal handler to stop sniffing */
+  volatile sig_atomic_t running;
+
+  /* Set by signal handler to re-read filter file */
+  volatile sig_atomic_t reload;
+
+  /* Set by signal handler to log histograms */
+  volatile sig_atomic_t dump;
+
+  /* Set by signal handler to write flight recorder snapshot */
+  volatile sig_atomic_t snapshot;
 };
 
-struct sniffer* create_sniffer();
+void init_sniffer_config(struct sniffer_config* config);
+
+struct sniffer* create_sniffer(const struct sniffer_config* config);
+
+void init_sniffer(struct sniffer* sniffer, const struct sniffer_config* config, 
+                  unsigned int id);
 
 void run_sniffer(struct sniffer* sniffer);
 
-char* extract_payload(char* buffer);
+void stop_sniffer(struct sniffer* sniffer);
+
+void request_reload(struct sniffer* sniffer);
+
+void request_histograms(struct sniffer* sniffer);
+
+void request_snapshot(struct sniffer* sniffer);
+
+void bind_sniffer(struct sniffer* sniffer, int protocol);
+
+void setup_filter(struct sniffer* sniffer);
+
+int set_sniffer_filter(struct sniffer* sniffer, const char* expression);
+
+void reload_sniffer_filter(struct sniffer* sniffer);
+
+void process_packet(struct sniffer* sniffer, const char* packet, size_t length,
+                    const struct packet_meta* meta);
+
+int inspect_packet(struct sniffer* sniffer, const char* packet, size_t length,
+                   const struct packet_meta* meta, struct packet_view* view);
+
+void print_payload(struct output* output, const struct packet_meta* meta,
+                   const char* interface, const uint8_t* payload, size_t length);
+
+void flush_output(struct output* output);
+
+void tick_sniffer(struct sniffer* sniffer);
+
+void flush_sniffer(struct sniffer* sniffer);
+
+void print_sniffer_stats(struct sniffer* sniffer);
+
+void destroy_sniffer(struct sniffer* sniffer);
 
 void free_sniffer(struct sniffer* sniffer);
 
@@ -0,0 +1,116 @@
+#ifndef STORE_H
+#define STORE_H
+
+#include <stdint.h>
+#include <time.h>
+#include <limits.h>
+#include <pthread.h>
+#include "../../common/headers/segment.h"
+
+#define STORE_BUFFERS 8
+#define STORE_BUFFER_SIZE (4 << 20)
+#define STORE_BUFFER_RECORDS 16384
+#define STORE_SEGMENT_SIZE (256 << 20)
+#define STORE_SEGMENT_RECORDS (1 << 20)
+#define STORE_SEGMENT_TIME 60
+#define STORE_FLUSH_INTERVAL 1
+
+/*
+ * Used as pair of buffers handed from capture thread to
+ * store thread: records and packet bytes they point to.
+ */
+struct store_buffer {
+  struct segment_record* records;
+  unsigned int count;
+
+  uint8_t* data;
+  size_t length;
+
+  /* Segment is sealed after this buffer is written */
+  int seal;
+};
+
+/*
+ * Used to keep packets in indexed segments that can be
+ * queried without reading whole capture. Capture thread only
+ * copies records and bytes into buffers, store thread appends
+ * them to segment files and builds index when segment is
+ * sealed, so capture never waits for disk. When all buffers
+ * are busy packets are dropped.
+ */
+struct store {
+  /* Directory of segments */
+  char dir[PATH_MAX];
+
+  /* Index of the worker, part of segment names */
+  unsigned int id;
+
+  /* Maximum bytes stored per packet */
+  uint32_t snaplen;
+
+  /* Seal segment after this many data bytes */
+  uint64_t segment_size;
+
+  /* Seal segment after this many seconds, 0 to disable */
+  unsigned int segment_time;
+
+  /* Buffer filled by capture thread */
+  struct store_buffer* current;
+
+  /* Records and data bytes of current segment, counted by capture thread */
+  uint32_t segment_records;
+  uint64_t segment_bytes;
+
+  /* Capture time current segment was started, 0 before first packet */
+  time_t segment_started;
+
+  /* Time current buffer was last handed to store thread */
+  time_t last_submit;
+
+  /* Buffer pool */
+  struct store_buffer buffers[STORE_BUFFERS];
+
+  /* Buffers ready to be filled */
+  struct store_buffer* free_list[STORE_BUFFERS];
+  unsigned int free_count;
+
+  /* Buffers waiting to be written, in order */
+  struct store_buffer* full_queue[STORE_BUFFERS];
+  unsigned int full_head;
+  unsigned int full_count;
+
+  /* Protects queues, held only to move buffers */
+  pthread_mutex_t lock;
+  pthread_cond_t full_cond;
+
+  /* Store thread */
+  pthread_t thread;
+  int stop;
+
+  /* State of store thread */
+  int record_fd;
+  int data_fd;
+  unsigned int sequence;
+  char path[PATH_MAX];
+  uint32_t written;
+  uint64_t data_written;
+  struct segment_block* blocks;
+  unsigned int block_capacity;
+
+  /* Statistics */
+  uint64_t packets;
+  uint64_t dropped;
+  uint64_t segments;
+};
+
+struct store* create_store(const char* dir, unsigned int id, uint32_t snaplen,
+                           uint64_t segment_size, unsigned int segment_time);
+
+void store_packet(struct store* store, uint64_t timestamp, const void* data,
+                  uint32_t length, uint32_t wire_length);
+
+void tick_store(struct store* store, time_t now);
+
+void free_store(struct store* store);
+
+#endif // !STORE_H
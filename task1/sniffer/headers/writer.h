@@ -0,0 +1,137 @@
+#ifndef WRITER_H
+#define WRITER_H
+
+#include <stdint.h>
+#include <time.h>
+#include <limits.h>
+#include <pthread.h>
+
+#define WRITER_BUFFERS 8
+#define WRITER_BUFFER_SIZE (4 << 20)
+#define WRITER_ALIGNMENT 4096
+#define WRITER_FLUSH_INTERVAL 1
+#define WRITER_SNAPLEN 65535
+#define WRITER_MAX_PENDING 64
+
+/* On-disk capture formats */
+enum capture_format {
+  FORMAT_PCAP,
+  FORMAT_PCAPNG
+};
+
+/*
+ * Used as one large aligned buffer of capture records.
+ * Capture thread fills it, writer thread writes it.
+ */
+struct writer_buffer {
+  /* Aligned memory for records */
+  uint8_t* data;
+
+  /* Amount of bytes used */
+  size_t length;
+
+  /* File is closed after this buffer is written */
+  int rotate;
+};
+
+/*
+ * Used to persist captured packets into pcap or pcapng
+ * files. Capture thread only copies records into buffers,
+ * writing is done by writer thread and gzip compression of
+ * closed files by compressor thread, so capture never waits
+ * for disk. When all buffers are busy packets are dropped.
+ */
+struct capture_writer {
+  /* Prefix of file names */
+  char prefix[PATH_MAX];
+
+  /* Index of the worker, part of file names */
+  unsigned int id;
+
+  /* File format */
+  enum capture_format format;
+
+  /* Maximum bytes stored per packet */
+  uint32_t snaplen;
+
+  /* Rotate file after this many bytes, 0 to disable */
+  uint64_t rotate_size;
+
+  /* Rotate file after this many seconds, 0 to disable */
+  unsigned int rotate_time;
+
+  /* Compress closed files */
+  int compress;
+
+  /* Names of merged inputs, pcapng describes every one, NULL for one unnamed */
+  const char* const* interfaces;
+  unsigned int interface_count;
+
+  /* Size of file header */
+  size_t header_length;
+
+  /* Buffer filled by capture thread */
+  struct writer_buffer* current;
+
+  /* Bytes of current file, counted by capture thread */
+  uint64_t file_bytes;
+
+  /* Capture time current file was started, 0 before first packet */
+  time_t file_started;
+
+  /* Time current buffer was last handed to writer */
+  time_t last_submit;
+
+  /* Buffer pool */
+  struct writer_buffer buffers[WRITER_BUFFERS];
+
+  /* Buffers ready to be filled */
+  struct writer_buffer* free_list[WRITER_BUFFERS];
+  unsigned int free_count;
+
+  /* Buffers waiting to be written, in order */
+  struct writer_buffer* full_queue[WRITER_BUFFERS];
+  unsigned int full_head;
+  unsigned int full_count;
+
+  /* Closed files waiting for compression */
+  char pending[WRITER_MAX_PENDING][PATH_MAX];
+  unsigned int pending_head;
+  unsigned int pending_count;
+
+  /* Protects queues, held only to move buffers */
+  pthread_mutex_t lock;
+  pthread_cond_t full_cond;
+  pthread_cond_t pending_cond;
+
+  /* Writer and compressor threads */
+  pthread_t thread;
+  pthread_t compressor;
+  int stop;
+
+  /* State of writer thread */
+  int fd;
+  unsigned int sequence;
+  char path[PATH_MAX];
+
+  /* Statistics */
+  uint64_t packets;
+  uint64_t dropped;
+  uint64_t files;
+};
+
+struct capture_writer* create_writer(const char* prefix, unsigned int id, 
+                                     enum capture_format format, uint32_t snaplen, 
+                                     uint64_t rotate_size, unsigned int rotate_time, 
+                                     int compress, const char* const* interfaces,
+                                     unsigned int interface_count);
+
+void write_packet(struct capture_writer* writer, const struct timespec* ts, 
+                  unsigned int interface, const void* data, uint32_t length,
+                  uint32_t wire_length);
+
+void tick_writer(struct capture_writer* writer, time_t now);
+
+void free_writer(struct capture_writer* writer);
+
+#endif // !WRITER_H
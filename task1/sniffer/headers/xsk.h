@@ -0,0 +1,86 @@
+#ifndef XSK_H
+#define XSK_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <linux/if_xdp.h>
+
+#define XSK_FRAME_SIZE 2048
+#define XSK_FRAME_COUNT 4096
+#define XSK_BATCH 64
+#define XSK_POLL_TIMEOUT 200
+#define XSK_LOG_SIZE 4096
+
+/*
+ * Used to hold one of rings shared with kernel. Producer
+ * and consumer are free-running indexes, entries are
+ * fill addresses or receive descriptors.
+ */
+struct xsk_queue {
+  /* Indexes and flags inside mapped memory */
+  uint32_t* producer;
+  uint32_t* consumer;
+  uint32_t* flags;
+
+  /* Entries of ring */
+  void* entries;
+
+  /* Amount of entries, power of two */
+  uint32_t size;
+
+  /* Mapped memory */
+  void* map;
+  size_t map_size;
+};
+
+/*
+ * Used to hold AF_XDP socket with its UMEM. XDP program
+ * attached to interface redirects IPv4 UDP of one queue
+ * to socket through XSKMAP, everything else goes on to
+ * kernel stack. Kernel writes frames into UMEM frames
+ * taken from fill ring and reports them in rx ring, user
+ * space reads them in place and hands them back through
+ * fill ring. Completion ring is required by kernel, but
+ * stays empty as nothing is transmitted.
+ */
+struct xsk {
+  /* Packet buffer shared with kernel */
+  uint8_t* umem;
+  size_t umem_size;
+
+  /* Rings of socket and UMEM */
+  struct xsk_queue rx;
+  struct xsk_queue fill;
+  struct xsk_queue completion;
+
+  /* Interface and its queue bound to socket */
+  unsigned int ifindex;
+  unsigned int queue;
+
+  /* XSKMAP, XDP program and link attaching it to interface */
+  int map_fd;
+  int prog_fd;
+  int link_fd;
+
+  /* Set if program runs in driver and frames are not copied */
+  int native;
+  int zerocopy;
+
+  /* Frames read from rx ring */
+  uint64_t packets;
+
+  /* Kernel statistics of socket */
+  struct xdp_statistics stats;
+};
+
+struct sniffer;
+
+void create_xsk(struct sniffer* sniffer);
+
+void run_xsk(struct sniffer* sniffer);
+
+void update_xsk_stats(struct sniffer* sniffer);
+
+void free_xsk(struct sniffer* sniffer);
+
+#endif // !XSK_H
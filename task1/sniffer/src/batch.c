@@ -0,0 +1,229 @@
+#define _GNU_SOURCE
+#include "../headers/sniffer.h"
+
+/*
+ * create_batch - used to create raw UDP socket, or packet
+ * socket for all protocols in link mode, and preallocate
+ * message headers, iovecs and buffers for batched receive.
+ * Batch size is taken from sniffer config. Kernel stamps
+ * every packet with receive time in ns.
+ * @sniffer - pointer to an object of sniffer struct
+ */
+void create_batch(struct sniffer* sniffer) {
+  struct batch* batch = &sniffer->batch;
+  struct timeval timeout;
+  unsigned int i;
+  int enable = 1;
+
+  /* Create Raw UDP socket or packet socket that sees whole frames */
+  if (sniffer->config.mode == CAPTURE_LINK)
+    sniffer->raw_socket = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ALL));
+  else
+    sniffer->raw_socket = socket(AF_INET, SOCK_RAW, IPPROTO_UDP); 
+  if (sniffer->raw_socket == -1)
+    print_error("socket");
+
+  bind_sniffer(sniffer, ETH_P_ALL);
+
+  /* VLAN tag stripped by NIC is passed as auxiliary data */
+  if (sniffer->config.mode == CAPTURE_LINK &&
+      setsockopt(sniffer->raw_socket, SOL_PACKET, PACKET_AUXDATA, 
+                 &enable, sizeof(enable)) == -1)
+    print_error("setsockopt PACKET_AUXDATA");
+
+  /* Raw socket has no checksum state, only interface tells looped back packets */
+  if (sniffer->config.mode != CAPTURE_LINK &&
+      setsockopt(sniffer->raw_socket, IPPROTO_IP, IP_PKTINFO, 
+                 &enable, sizeof(enable)) == -1)
+    print_error("setsockopt IP_PKTINFO");
+  batch->loopback = if_nametoindex("lo");
+
+  /* Filter traffic in kernel before anything is queued */
+  setup_filter(sniffer);
+
+  /* Wake up periodically to flush output when idle */
+  timeout.tv_sec = 0;
+  timeout.tv_usec = BATCH_TIMEOUT * 1000;
+  if (setsockopt(sniffer->raw_socket, SOL_SOCKET, SO_RCVTIMEO, 
+                 &timeout, sizeof(timeout)) == -1)
+    print_error("setsockopt SO_RCVTIMEO");
+
+  if (setsockopt(sniffer->raw_socket, SOL_SOCKET, SO_TIMESTAMPNS, 
+                 &enable, sizeof(enable)) == -1)
+    print_error("setsockopt SO_TIMESTAMPNS");
+
+  batch->size = sniffer->config.batch_size;
+  batch->msgs = (struct mmsghdr*) calloc(batch->size, sizeof(struct mmsghdr));
+  batch->iovecs = (struct iovec*) calloc(batch->size, sizeof(struct iovec));
+  batch->buffers = (char*) malloc((size_t) batch->size * BUFFER_SIZE);
+  batch->controls = (char*) calloc(batch->size, BATCH_CONTROL_SIZE);
+  batch->addresses = (struct sockaddr_ll*) calloc(batch->size, sizeof(struct sockaddr_ll));
+  if (!batch->msgs || !batch->iovecs || !batch->buffers || !batch->controls || 
+      !batch->addresses)
+    print_error("malloc");
+
+  /* Point every message to its own buffer */
+  for (i = 0; i < batch->size; i++) {
+    batch->iovecs[i].iov_base = batch->buffers + (size_t) i * BUFFER_SIZE;
+    batch->iovecs[i].iov_len = BUFFER_SIZE;
+    batch->msgs[i].msg_hdr.msg_iov = &batch->iovecs[i];
+    batch->msgs[i].msg_hdr.msg_iovlen = 1;
+    batch->msgs[i].msg_hdr.msg_control = batch->controls + (size_t) i * BATCH_CONTROL_SIZE;
+    batch->msgs[i].msg_hdr.msg_controllen = BATCH_CONTROL_SIZE;
+    if (sniffer->config.mode == CAPTURE_LINK) {
+      batch->msgs[i].msg_hdr.msg_name = &batch->addresses[i];
+      batch->msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_ll);
+    }
+  }
+
+  batch->calls = 0;
+  batch->packets = 0;
+  batch->other = 0;
+}
+
+/*
+ * read_control - used to get kernel receive timestamp,
+ * VLAN tag stripped by NIC and checksum state from control
+ * data of message. Falls back to current time if timestamp
+ * is missing. Checksums of packets looped back to raw socket
+ * are not filled, as with CHECKSUM_PARTIAL of packet socket.
+ * @batch - pointer to an object of batch struct
+ * @msg - pointer to received message
+ * @meta - pointer to metadata of packet
+ */
+static void read_control(const struct batch* batch, struct msghdr* msg, 
+                         struct packet_meta* meta) {
+  struct tpacket_auxdata aux;
+  struct in_pktinfo info;
+  struct cmsghdr* cmsg;
+  int stamped = 0;
+
+  meta->vlan_count = 0;
+  meta->checksum = CHECKSUM_UNKNOWN;
+  meta->interface = 0;
+  for (cmsg = CMSG_FIRSTHDR(msg); cmsg; cmsg = CMSG_NXTHDR(msg, cmsg)) {
+    if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+      memcpy(&meta->ts, CMSG_DATA(cmsg), sizeof(meta->ts));
+      stamped = 1;
+    }
+    else if (cmsg->cmsg_level == SOL_PACKET && cmsg->cmsg_type == PACKET_AUXDATA) {
+      memcpy(&aux, CMSG_DATA(cmsg), sizeof(aux));
+      if (aux.tp_status & TP_STATUS_VLAN_VALID)
+        meta->vlan_tci[meta->vlan_count++] = aux.tp_vlan_tci;
+      meta->checksum = checksum_state(aux.tp_status);
+    }
+    else if (cmsg->cmsg_level == IPPROTO_IP && cmsg->cmsg_type == IP_PKTINFO) {
+      memcpy(&info, CMSG_DATA(cmsg), sizeof(info));
+      if (info.ipi_ifindex == batch->loopback)
+        meta->checksum = CHECKSUM_PARTIAL;
+    }
+  }
+
+  if (!stamped)
+    clock_gettime(CLOCK_REALTIME, &meta->ts);
+}
+
+/*
+ * process_frame - used to strip link layer of frame and
+ * pass IPv4 packet to pipeline. Tags left in frame follow
+ * tag recovered from auxiliary data. Own outgoing frames
+ * are skipped, as in ring mode.
+ * @sniffer - pointer to an object of sniffer struct
+ * @msg - pointer to received message
+ * @meta - pointer to metadata of packet
+ */
+static void process_frame(struct sniffer* sniffer, struct mmsghdr* msg, 
+                          struct packet_meta* meta) {
+  struct sockaddr_ll* sll = (struct sockaddr_ll*) msg->msg_hdr.msg_name;
+  struct packet_view view;
+  unsigned int i;
+  int type;
+
+  if (sll->sll_pkttype == PACKET_OUTGOING)
+    return;
+
+  type = parse_link(&view, msg->msg_hdr.msg_iov->iov_base, msg->msg_len);
+  if (type != ETHERTYPE_IP && type != ETHERTYPE_IPV6) {
+    sniffer->batch.other++;
+    return;
+  }
+
+  for (i = 0; i < view.vlan_count && meta->vlan_count < PACKET_MAX_VLANS; i++)
+    meta->vlan_tci[meta->vlan_count++] = view.vlan_tci[i];
+
+  meta->wire_length = view.payload.length;
+  process_packet(sniffer, (const char*) view.payload.data, view.payload.length, meta);
+}
+
+/*
+ * run_batch - used to sniff packets with recvmmsg. Blocks
+ * until at least one datagram is available, then takes every
+ * datagram already queued up to batch size. Receive timeout
+ * lets loop flush output and notice stop when idle.
+ * @sniffer - pointer to an object of sniffer struct
+ */
+void run_batch(struct sniffer* sniffer) {
+  struct batch* batch = &sniffer->batch;
+  struct packet_meta meta;
+  int received, i;
+
+  while (sniffer->running) {
+    if (sniffer->reload)
+      reload_sniffer_filter(sniffer);
+
+    received = recvmmsg(sniffer->raw_socket, batch->msgs, batch->size, 
+                        MSG_WAITFORONE, NULL);
+    /* Interrupted by signal or idle */
+    if (received == -1 && (errno == EINTR || errno == EAGAIN)) {
+      flush_sniffer(sniffer);
+      continue;
+    }
+    /* Error occured */
+    else if (received == -1)
+      print_error("recvmmsg");
+
+    batch->calls++;
+    batch->packets += received;
+
+    /* Process received packets */
+    for (i = 0; i < received; i++) {
+      read_control(batch, &batch->msgs[i].msg_hdr, &meta);
+      if (sniffer->config.mode == CAPTURE_LINK) {
+        process_frame(sniffer, &batch->msgs[i], &meta);
+      }
+      else {
+        meta.wire_length = batch->msgs[i].msg_len;
+        process_packet(sniffer, 
+                       (const char*) batch->iovecs[i].iov_base, 
+                       batch->msgs[i].msg_len,
+                       &meta);
+      }
+
+      /* Kernel shrinks control and address lengths to what it wrote */
+      batch->msgs[i].msg_hdr.msg_controllen = BATCH_CONTROL_SIZE;
+      if (batch->msgs[i].msg_hdr.msg_name)
+        batch->msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_ll);
+    }
+    flush_sniffer(sniffer);
+  }
+}
+
+/*
+ * free_batch - used to free preallocated batch buffers.
+ * @sniffer - pointer to an object of sniffer struct
+ */
+void free_batch(struct sniffer* sniffer) {
+  struct batch* batch = &sniffer->batch;
+
+  free(batch->msgs);
+  free(batch->iovecs);
+  free(batch->buffers);
+  free(batch->controls);
+  free(batch->addresses);
+
+  batch->msgs = NULL;
+  batch->iovecs = NULL;
+  batch->buffers = NULL;
+  batch->controls = NULL;
+  batch->addresses = NULL;
+}
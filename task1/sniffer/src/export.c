@@ -0,0 +1,369 @@
+#include "../headers/export.h"
+#include "../../common/headers/common.h"
+#include <errno.h>
+#include <netdb.h>
+
+#define IPFIX_HEADER_SIZE 16
+#define NETFLOW9_HEADER_SIZE 20
+#define SET_HEADER_SIZE 4
+
+/* Set ids of templates */
+#define IPFIX_TEMPLATE_SET 2
+#define NETFLOW9_TEMPLATE_SET 0
+
+/* IPv4 and UDP headers without options, not counted in flow bytes */
+#define FLOW_HEADER_BYTES 28
+
+/*
+ * Used as field specifier of template,
+ * information element id and its length.
+ */
+struct export_field {
+  uint16_t id;
+  uint16_t length;
+};
+
+/* Fields of IPFIX data record, in order of encode_ipfix */
+static const struct export_field ipfix_fields[] = {
+  {8, 4},     /* sourceIPv4Address */
+  {12, 4},    /* destinationIPv4Address */
+  {7, 2},     /* sourceTransportPort */
+  {11, 2},    /* destinationTransportPort */
+  {4, 1},     /* protocolIdentifier */
+  {136, 1},   /* flowEndReason */
+  {2, 8},     /* packetDeltaCount */
+  {1, 8},     /* octetDeltaCount */
+  {152, 8},   /* flowStartMilliseconds */
+  {153, 8}    /* flowEndMilliseconds */
+};
+
+/* Fields of NetFlow v9 data record, in order of encode_netflow9 */
+static const struct export_field netflow9_fields[] = {
+  {8, 4},     /* IPV4_SRC_ADDR */
+  {12, 4},    /* IPV4_DST_ADDR */
+  {7, 2},     /* L4_SRC_PORT */
+  {11, 2},    /* L4_DST_PORT */
+  {4, 1},     /* PROTOCOL */
+  {2, 8},     /* IN_PKTS */
+  {1, 8},     /* IN_BYTES */
+  {22, 4},    /* FIRST_SWITCHED */
+  {21, 4}     /* LAST_SWITCHED */
+};
+
+#define IPFIX_RECORD_SIZE 46
+#define NETFLOW9_RECORD_SIZE 37
+
+static uint8_t* put16(uint8_t* ptr, uint16_t value) {
+  value = htons(value);
+  memcpy(ptr, &value, sizeof(value));
+  return ptr + sizeof(value);
+}
+
+static uint8_t* put32(uint8_t* ptr, uint32_t value) {
+  value = htonl(value);
+  memcpy(ptr, &value, sizeof(value));
+  return ptr + sizeof(value);
+}
+
+static uint8_t* put64(uint8_t* ptr, uint64_t value) {
+  ptr = put32(ptr, value >> 32);
+  return put32(ptr, (uint32_t) value);
+}
+
+/*
+ * open_collector - used to create UDP socket connected
+ * to collector. Connected socket sends without address
+ * and reports collector that is down as send error.
+ * @collector - HOST:PORT of collector, IPv6 host in brackets
+ *
+ * Return: fd of socket
+ */
+static int open_collector(const char* collector) {
+  struct addrinfo hints, *result, *ai;
+  char host[256];
+  const char* port = strrchr(collector, ':');
+  size_t length;
+  int fd = -1, err;
+
+  if (!port || port == collector || (size_t) (port - collector) >= sizeof(host)) {
+    fprintf(stderr, "Exporter: collector must be HOST:PORT, got %s\n", collector);
+    exit(EXIT_FAILURE);
+  }
+
+  length = port - collector;
+  if (collector[0] == '[' && collector[length - 1] == ']') {
+    memcpy(host, collector + 1, length - 2);
+    host[length - 2] = '\0';
+  }
+  else {
+    memcpy(host, collector, length);
+    host[length] = '\0';
+  }
+
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_DGRAM;
+  err = getaddrinfo(host, port + 1, &hints, &result);
+  if (err) {
+    fprintf(stderr, "Exporter: %s: %s\n", collector, gai_strerror(err));
+    exit(EXIT_FAILURE);
+  }
+
+  for (ai = result; ai; ai = ai->ai_next) {
+    fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+    if (fd == -1)
+      continue;
+    if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0)
+      break;
+    close(fd);
+    fd = -1;
+  }
+
+  freeaddrinfo(result);
+  if (fd == -1)
+    print_error("connect");
+  return fd;
+}
+
+/*
+ * create_exporter - used to create exporter sending
+ * to collector.
+ * @collector - HOST:PORT of collector
+ * @version - EXPORT_IPFIX or EXPORT_NETFLOW9
+ * @domain - observation domain or source id of messages
+ *
+ * Return: pointer to an object of exporter struct
+ */
+struct exporter* create_exporter(const char* collector, unsigned int version,
+                                 uint32_t domain) {
+  struct exporter* exporter;
+
+  exporter = (struct exporter*) calloc(1, sizeof(struct exporter));
+  if (!exporter)
+    print_error("calloc");
+
+  exporter->socket = open_collector(collector);
+  exporter->version = version;
+  exporter->domain = domain;
+  return exporter;
+}
+
+/*
+ * put_template - used to write template set describing
+ * data records of exporter.
+ * @exporter - pointer to an object of exporter struct
+ */
+static void put_template(struct exporter* exporter) {
+  const struct export_field* fields = ipfix_fields;
+  size_t count = sizeof(ipfix_fields) / sizeof(ipfix_fields[0]);
+  uint16_t set = IPFIX_TEMPLATE_SET;
+  uint8_t* ptr = exporter->message + exporter->length;
+  size_t i;
+
+  if (exporter->version == EXPORT_NETFLOW9) {
+    fields = netflow9_fields;
+    count = sizeof(netflow9_fields) / sizeof(netflow9_fields[0]);
+    set = NETFLOW9_TEMPLATE_SET;
+  }
+
+  ptr = put16(ptr, set);
+  ptr = put16(ptr, SET_HEADER_SIZE + 4 + count * 4);
+  ptr = put16(ptr, EXPORT_TEMPLATE_ID);
+  ptr = put16(ptr, count);
+  for (i = 0; i < count; i++) {
+    ptr = put16(ptr, fields[i].id);
+    ptr = put16(ptr, fields[i].length);
+  }
+
+  exporter->length = ptr - exporter->message;
+  exporter->templated = 1;
+}
+
+/*
+ * start_message - used to begin message after header,
+ * with template in front when it is due.
+ * @exporter - pointer to an object of exporter struct
+ */
+static void start_message(struct exporter* exporter) {
+  time_t now = time(NULL);
+
+  exporter->length = exporter->version == EXPORT_NETFLOW9 ?
+                     NETFLOW9_HEADER_SIZE : IPFIX_HEADER_SIZE;
+  exporter->data_set = 0;
+  exporter->records = 0;
+  exporter->templated = 0;
+  exporter->started = now;
+
+  if (!exporter->messages || exporter->since_template >= EXPORT_TEMPLATE_MESSAGES ||
+      now - exporter->template_sent >= EXPORT_TEMPLATE_INTERVAL)
+    put_template(exporter);
+}
+
+/*
+ * close_data_set - used to write length of open data set.
+ * NetFlow v9 sets are padded to four bytes.
+ * @exporter - pointer to an object of exporter struct
+ */
+static void close_data_set(struct exporter* exporter) {
+  if (!exporter->data_set)
+    return;
+
+  if (exporter->version == EXPORT_NETFLOW9) {
+    while (exporter->length % 4)
+      exporter->message[exporter->length++] = 0;
+  }
+
+  put16(exporter->message + exporter->data_set + 2, exporter->length - exporter->data_set);
+  exporter->data_set = 0;
+}
+
+/*
+ * send_message - used to fill header of message and
+ * send it. Message that collector does not take is
+ * counted and lost, capture never waits for it.
+ * @exporter - pointer to an object of exporter struct
+ * @now - current time in ns
+ */
+static void send_message(struct exporter* exporter, uint64_t now) {
+  uint8_t* ptr = exporter->message;
+
+  close_data_set(exporter);
+
+  ptr = put16(ptr, exporter->version);
+  if (exporter->version == EXPORT_NETFLOW9) {
+    ptr = put16(ptr, exporter->records + exporter->templated);
+    ptr = put32(ptr, (uint32_t) (now / 1000000));
+    ptr = put32(ptr, now / 1000000000ull);
+    ptr = put32(ptr, exporter->sequence++);
+  }
+  else {
+    ptr = put16(ptr, exporter->length);
+    ptr = put32(ptr, now / 1000000000ull);
+    ptr = put32(ptr, exporter->sequence);
+    exporter->sequence += exporter->records;
+  }
+  put32(ptr, exporter->domain);
+
+  if (send(exporter->socket, exporter->message, exporter->length, MSG_DONTWAIT) == -1)
+    exporter->errors++;
+
+  if (exporter->templated) {
+    exporter->since_template = 0;
+    exporter->template_sent = exporter->started;
+  }
+  else {
+    exporter->since_template++;
+  }
+
+  exporter->messages++;
+  exporter->length = 0;
+}
+
+/*
+ * encode_ipfix - used to write IPFIX data record of flow.
+ * @ptr - where record is written
+ * @entry - flow being exported
+ * @reason - why flow is exported
+ */
+static void encode_ipfix(uint8_t* ptr, const struct flow_entry* entry, enum flow_end reason) {
+  memcpy(ptr, &entry->key.src, 4);
+  memcpy(ptr + 4, &entry->key.dst, 4);
+  memcpy(ptr + 8, &entry->key.sport, 2);
+  memcpy(ptr + 10, &entry->key.dport, 2);
+  ptr[12] = entry->key.proto;
+  ptr[13] = reason;
+  ptr = put64(ptr + 14, entry->packets);
+  ptr = put64(ptr, entry->bytes + entry->packets * FLOW_HEADER_BYTES);
+  ptr = put64(ptr, entry->first_seen / 1000000);
+  put64(ptr, entry->last_seen / 1000000);
+}
+
+/*
+ * encode_netflow9 - used to write NetFlow v9 data record
+ * of flow. Times are milliseconds of the same clock as
+ * uptime in header, so collector gets them right as long
+ * as flow is younger than 49 days.
+ * @ptr - where record is written
+ * @entry - flow being exported
+ */
+static void encode_netflow9(uint8_t* ptr, const struct flow_entry* entry) {
+  memcpy(ptr, &entry->key.src, 4);
+  memcpy(ptr + 4, &entry->key.dst, 4);
+  memcpy(ptr + 8, &entry->key.sport, 2);
+  memcpy(ptr + 10, &entry->key.dport, 2);
+  ptr[12] = entry->key.proto;
+  ptr = put64(ptr + 13, entry->packets);
+  ptr = put64(ptr, entry->bytes + entry->packets * FLOW_HEADER_BYTES);
+  ptr = put32(ptr, (uint32_t) (entry->first_seen / 1000000));
+  put32(ptr, (uint32_t) (entry->last_seen / 1000000));
+}
+
+/*
+ * export_flow - used to add record of flow to message.
+ * Full message is sent first. Bytes of flow include
+ * IPv4 and UDP headers without options.
+ * @exporter - pointer to an object of exporter struct
+ * @entry - flow being exported
+ * @reason - why flow is exported
+ * @now - current time in ns
+ */
+void export_flow(struct exporter* exporter, const struct flow_entry* entry,
+                 enum flow_end reason, uint64_t now) {
+  size_t size = exporter->version == EXPORT_NETFLOW9 ?
+                NETFLOW9_RECORD_SIZE : IPFIX_RECORD_SIZE;
+
+  /* Room for record, header of data set and padding */
+  if (exporter->length &&
+      exporter->length + size + SET_HEADER_SIZE + 3 > EXPORT_MESSAGE_SIZE)
+    send_message(exporter, now);
+
+  if (!exporter->length)
+    start_message(exporter);
+
+  if (!exporter->data_set) {
+    exporter->data_set = exporter->length;
+    put16(exporter->message + exporter->length, EXPORT_TEMPLATE_ID);
+    exporter->length += SET_HEADER_SIZE;
+  }
+
+  if (exporter->version == EXPORT_NETFLOW9)
+    encode_netflow9(exporter->message + exporter->length, entry);
+  else
+    encode_ipfix(exporter->message + exporter->length, entry, reason);
+
+  exporter->length += size;
+  exporter->records++;
+  exporter->exported++;
+}
+
+/*
+ * flush_exporter - used to send message that is not full.
+ * @exporter - pointer to an object of exporter struct
+ * @now - current time in ns
+ */
+void flush_exporter(struct exporter* exporter, uint64_t now) {
+  if (exporter->length)
+    send_message(exporter, now);
+}
+
+/*
+ * tick_exporter - used to send message once its first
+ * record waited for flush interval, so collector sees
+ * flows of quiet capture without much delay.
+ * @exporter - pointer to an object of exporter struct
+ * @now - current time in ns
+ */
+void tick_exporter(struct exporter* exporter, uint64_t now) {
+  if (exporter->length && time(NULL) - exporter->started >= EXPORT_FLUSH_INTERVAL)
+    send_message(exporter, now);
+}
+
+/*
+ * free_exporter - used to close socket and free exporter.
+ * Message that is not sent yet is lost.
+ * @exporter - pointer to an object of exporter struct
+ */
+void free_exporter(struct exporter* exporter) {
+  close(exporter->socket);
+  free(exporter);
+}
@@ -0,0 +1,106 @@
+#include "../headers/sniffer.h"
+
+/*
+ * join_fanout - used to add worker socket to fanout group
+ * of the process. All workers share group id, so kernel
+ * spreads packets between their rings. Hash mode defragments
+ * packets first, so fragments follow their flow.
+ * @worker - pointer to worker sniffer
+ */
+void join_fanout(struct sniffer* worker) {
+  int mode, arg;
+
+  switch (worker->config.fanout) {
+    case FANOUT_CPU:
+      mode = PACKET_FANOUT_CPU;
+      break;
+    case FANOUT_LB:
+      mode = PACKET_FANOUT_LB;
+      break;
+    default:
+      mode = PACKET_FANOUT_HASH | PACKET_FANOUT_FLAG_DEFRAG;
+  }
+
+  arg = (getpid() & 0xFFFF) | (mode << 16);
+  if (setsockopt(worker->raw_socket, SOL_PACKET, PACKET_FANOUT, &arg, sizeof(arg)) == -1)
+    print_error("setsockopt PACKET_FANOUT");
+}
+
+/*
+ * create_workers - used to create one sniffer per worker.
+ * Every worker owns its ring, counters and output buffer,
+ * so workers share nothing on hot path but read-only
+ * signature matcher.
+ * @sniffer - pointer to parent sniffer
+ */
+void create_workers(struct sniffer* sniffer) {
+  unsigned int i;
+
+  sniffer->worker_count = sniffer->config.workers;
+  sniffer->workers = (struct sniffer*) calloc(sniffer->worker_count, sizeof(struct sniffer));
+  if (!sniffer->workers)
+    print_error("calloc");
+
+  for (i = 0; i < sniffer->worker_count; i++) {
+    init_sniffer(&sniffer->workers[i], &sniffer->config, i);
+    sniffer->workers[i].matcher = sniffer->matcher;
+    join_fanout(&sniffer->workers[i]);
+  }
+}
+
+/*
+ * worker_main - used as thread routine of worker.
+ * @arg - pointer to worker sniffer
+ *
+ * Return: NULL
+ */
+static void* worker_main(void* arg) {
+  struct sniffer* worker = (struct sniffer*) arg;
+
+  run_ring(worker);
+  flush_sniffer(worker);
+  return NULL;
+}
+
+/*
+ * run_workers - used to start worker threads and wait
+ * until they stop. Signals are left to main thread.
+ * @sniffer - pointer to parent sniffer
+ */
+void run_workers(struct sniffer* sniffer) {
+  sigset_t mask, old;
+  unsigned int i;
+  int result;
+
+  sigfillset(&mask);
+  pthread_sigmask(SIG_BLOCK, &mask, &old);
+
+  for (i = 0; i < sniffer->worker_count; i++) {
+    result = pthread_create(&sniffer->workers[i].thread, NULL, 
+                            worker_main, &sniffer->workers[i]);
+    if (result != 0) {
+      errno = result;
+      print_error("pthread_create");
+    }
+  }
+
+  pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+  for (i = 0; i < sniffer->worker_count; i++)
+    pthread_join(sniffer->workers[i].thread, NULL);
+}
+
+/*
+ * free_workers - used to free all workers.
+ * @sniffer - pointer to parent sniffer
+ */
+void free_workers(struct sniffer* sniffer) {
+  unsigned int i;
+
+  for (i = 0; i < sniffer->worker_count; i++)
+    destroy_sniffer(&sniffer->workers[i]);
+  free(sniffer->workers);
+
+  sniffer->workers = NULL;
+  sniffer->worker_count = 0;
+}
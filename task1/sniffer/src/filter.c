@@ -0,0 +1,939 @@
+#include "../headers/filter.h"
+#include "../headers/sample.h"
+#include "../../common/headers/common.h"
+#include <ctype.h>
+#include <linux/if_ether.h>
+
+#define FILTER_MAX_LABELS (FILTER_MAX_INSNS * 2)
+
+/* Accepted packets are passed whole */
+#define FILTER_SNAPLEN 0x40000
+
+/* Loads relative to network header work for any link layer */
+#define NET(offset) (SKF_NET_OFF + (offset))
+
+/* Kinds of nodes in expression tree */
+enum node_type {
+  NODE_AND,
+  NODE_OR,
+  NODE_NOT,
+  NODE_IP,
+  NODE_PROTO,
+  NODE_HOST,
+  NODE_NET,
+  NODE_PORT
+};
+
+/* Direction qualifier of primitive */
+enum node_dir {
+  DIR_ANY,
+  DIR_SRC,
+  DIR_DST
+};
+
+/*
+ * Used as node of expression tree. Children are
+ * indexes into compiler node array.
+ */
+struct node {
+  enum node_type type;
+  enum node_dir dir;
+
+  /* Children of AND/OR/NOT */
+  int left;
+  int right;
+
+  /* IP protocol, 0 if not specified */
+  int proto;
+
+  /* Address and mask in host byte order */
+  uint32_t addr;
+  uint32_t mask;
+
+  /* Inclusive port range */
+  uint16_t port_lo;
+  uint16_t port_hi;
+};
+
+/*
+ * Used to hold state of parser and code generator.
+ * Jump targets are emitted as labels and resolved
+ * to relative offsets after whole program is built.
+ */
+struct compiler {
+  /* Expression and position of the next token */
+  const char* input;
+  const char* pos;
+
+  /* Current token */
+  char token[FILTER_MAX_TOKEN];
+
+  /* Expression tree */
+  struct node nodes[FILTER_MAX_NODES];
+  int node_count;
+
+  /* Generated program and labels of its jumps */
+  struct filter* filter;
+  int jt_label[FILTER_MAX_INSNS];
+  int jf_label[FILTER_MAX_INSNS];
+
+  /* Instruction index of every label */
+  int labels[FILTER_MAX_LABELS];
+  int label_count;
+
+  /* Set after first error */
+  int failed;
+};
+
+static int parse_expr(struct compiler* c);
+
+/*
+ * fail - used to report compile error once.
+ * @c - pointer to compiler state
+ * @message - description of the error
+ */
+static void fail(struct compiler* c, const char* message) {
+  if (!c->failed)
+    fprintf(stderr, "filter: %s near '%s'\n", message, c->token);
+  c->failed = 1;
+}
+
+/*
+ * next_token - used to read the next token of expression
+ * into c->token. Empty token means end of input.
+ * @c - pointer to compiler state
+ */
+static void next_token(struct compiler* c) {
+  size_t length = 0;
+
+  while (isspace((unsigned char) *c->pos))
+    c->pos++;
+
+  /* Punctuation */
+  if (*c->pos == '(' || *c->pos == ')' || *c->pos == '!') {
+    c->token[length++] = *c->pos++;
+  }
+  else if ((c->pos[0] == '&' && c->pos[1] == '&') ||
+           (c->pos[0] == '|' && c->pos[1] == '|')) {
+    c->token[length++] = *c->pos++;
+    c->token[length++] = *c->pos++;
+  }
+  /* Words, numbers and addresses */
+  else {
+    while (*c->pos && (isalnum((unsigned char) *c->pos) ||
+           *c->pos == '.' || *c->pos == '/' || *c->pos == '-')) {
+      if (length == FILTER_MAX_TOKEN - 1) {
+        fail(c, "token too long");
+        break;
+      }
+      c->token[length++] = *c->pos++;
+    }
+
+    if (length == 0 && *c->pos) {
+      c->token[length++] = *c->pos++;
+      c->token[length] = '\0';
+      fail(c, "unexpected character");
+    }
+  }
+
+  c->token[length] = '\0';
+}
+
+/*
+ * accept_token - used to consume current token if it matches.
+ * @c - pointer to compiler state
+ * @word - expected token
+ *
+ * Return: 1 if token was consumed, 0 otherwise
+ */
+static int accept_token(struct compiler* c, const char* word) {
+  if (strcmp(c->token, word) != 0)
+    return 0;
+  next_token(c);
+  return 1;
+}
+
+/*
+ * new_node - used to allocate node from compiler pool.
+ * @c - pointer to compiler state
+ * @type - type of the node
+ *
+ * Return: index of the node, -1 on error
+ */
+static int new_node(struct compiler* c, enum node_type type) {
+  struct node* node;
+
+  if (c->node_count == FILTER_MAX_NODES) {
+    fail(c, "expression too long");
+    return -1;
+  }
+
+  node = &c->nodes[c->node_count];
+  memset(node, 0, sizeof(struct node));
+  node->type = type;
+  node->left = -1;
+  node->right = -1;
+  return c->node_count++;
+}
+
+/*
+ * parse_number - used to parse port number.
+ * @c - pointer to compiler state
+ * @text - text of the number
+ * @value - pointer to result
+ *
+ * Return: 0 if successful, -1 otherwise
+ */
+static int parse_number(struct compiler* c, const char* text, uint16_t* value) {
+  char* end;
+  unsigned long number = strtoul(text, &end, 10);
+
+  if (end == text || *end != '\0' || number > 0xFFFF) {
+    fail(c, "bad port");
+    return -1;
+  }
+
+  *value = (uint16_t) number;
+  return 0;
+}
+
+/*
+ * parse_qualified - used to parse host, net, port or portrange
+ * primitive after optional protocol and direction.
+ * @c - pointer to compiler state
+ * @proto - protocol qualifier, 0 if none
+ * @dir - direction qualifier
+ *
+ * Return: index of the node, -1 on error
+ */
+static int parse_qualified(struct compiler* c, int proto, enum node_dir dir) {
+  struct in_addr addr;
+  char text[FILTER_MAX_TOKEN];
+  char* slash;
+  char* dash;
+  int index, prefix;
+
+  if (accept_token(c, "host")) {
+    index = new_node(c, NODE_HOST);
+    if (index == -1 || inet_pton(AF_INET, c->token, &addr) != 1) {
+      fail(c, "bad host address");
+      return -1;
+    }
+    c->nodes[index].addr = ntohl(addr.s_addr);
+    c->nodes[index].mask = 0xFFFFFFFF;
+  }
+  else if (accept_token(c, "net")) {
+    index = new_node(c, NODE_NET);
+    strcpy(text, c->token);
+    slash = strchr(text, '/');
+    prefix = 32;
+    if (slash) {
+      *slash = '\0';
+      prefix = atoi(slash + 1);
+    }
+    if (index == -1 || inet_pton(AF_INET, text, &addr) != 1 || prefix < 0 || prefix > 32) {
+      fail(c, "bad network");
+      return -1;
+    }
+    c->nodes[index].mask = prefix ? 0xFFFFFFFF << (32 - prefix) : 0;
+    c->nodes[index].addr = ntohl(addr.s_addr) & c->nodes[index].mask;
+  }
+  else if (accept_token(c, "port")) {
+    index = new_node(c, NODE_PORT);
+    if (index == -1 || parse_number(c, c->token, &c->nodes[index].port_lo) == -1)
+      return -1;
+    c->nodes[index].port_hi = c->nodes[index].port_lo;
+  }
+  else if (accept_token(c, "portrange")) {
+    index = new_node(c, NODE_PORT);
+    strcpy(text, c->token);
+    dash = strchr(text, '-');
+    if (index == -1 || !dash) {
+      fail(c, "bad port range");
+      return -1;
+    }
+    *dash = '\0';
+    if (parse_number(c, text, &c->nodes[index].port_lo) == -1 ||
+        parse_number(c, dash + 1, &c->nodes[index].port_hi) == -1)
+      return -1;
+    if (c->nodes[index].port_lo > c->nodes[index].port_hi) {
+      fail(c, "bad port range");
+      return -1;
+    }
+  }
+  else {
+    fail(c, "expected host, net, port or portrange");
+    return -1;
+  }
+
+  /* Ports exist only for TCP and UDP */
+  if (c->nodes[index].type == NODE_PORT && proto == IPPROTO_ICMP) {
+    fail(c, "icmp has no ports");
+    return -1;
+  }
+
+  c->nodes[index].proto = proto;
+  c->nodes[index].dir = dir;
+  next_token(c);
+  return index;
+}
+
+/*
+ * parse_primitive - used to parse single primitive with
+ * its qualifiers.
+ * @c - pointer to compiler state
+ *
+ * Return: index of the node, -1 on error
+ */
+static int parse_primitive(struct compiler* c) {
+  enum node_dir dir = DIR_ANY;
+  int proto = 0;
+  int index;
+
+  if (accept_token(c, "ip"))
+    return new_node(c, NODE_IP);
+
+  /* Protocol qualifier */
+  if (accept_token(c, "udp"))
+    proto = IPPROTO_UDP;
+  else if (accept_token(c, "tcp"))
+    proto = IPPROTO_TCP;
+  else if (accept_token(c, "icmp"))
+    proto = IPPROTO_ICMP;
+
+  /* Direction qualifier */
+  if (accept_token(c, "src"))
+    dir = DIR_SRC;
+  else if (accept_token(c, "dst"))
+    dir = DIR_DST;
+
+  /* Bare protocol */
+  if (proto && dir == DIR_ANY && strcmp(c->token, "host") != 0 &&
+      strcmp(c->token, "net") != 0 && strcmp(c->token, "port") != 0 &&
+      strcmp(c->token, "portrange") != 0) {
+    index = new_node(c, NODE_PROTO);
+    if (index != -1)
+      c->nodes[index].proto = proto;
+    return index;
+  }
+
+  return parse_qualified(c, proto, dir);
+}
+
+/*
+ * parse_factor - used to parse negation, parenthesized
+ * expression or primitive.
+ * @c - pointer to compiler state
+ *
+ * Return: index of the node, -1 on error
+ */
+static int parse_factor(struct compiler* c) {
+  int index, child;
+
+  if (accept_token(c, "not") || accept_token(c, "!")) {
+    child = parse_factor(c);
+    index = new_node(c, NODE_NOT);
+    if (child == -1 || index == -1)
+      return -1;
+    c->nodes[index].left = child;
+    return index;
+  }
+
+  if (accept_token(c, "(")) {
+    index = parse_expr(c);
+    if (!accept_token(c, ")")) {
+      fail(c, "expected ')'");
+      return -1;
+    }
+    return index;
+  }
+
+  return parse_primitive(c);
+}
+
+/*
+ * parse_binary - used to build AND/OR chain of operands.
+ * @c - pointer to compiler state
+ * @type - NODE_AND or NODE_OR
+ * @left - index of the first operand
+ * @right - index of the second operand
+ *
+ * Return: index of the node, -1 on error
+ */
+static int parse_binary(struct compiler* c, enum node_type type, int left, int right) {
+  int index;
+
+  if (left == -1 || right == -1)
+    return -1;
+
+  index = new_node(c, type);
+  if (index == -1)
+    return -1;
+  c->nodes[index].left = left;
+  c->nodes[index].right = right;
+  return index;
+}
+
+/*
+ * parse_term - used to parse chain of factors joined by "and".
+ * @c - pointer to compiler state
+ *
+ * Return: index of the node, -1 on error
+ */
+static int parse_term(struct compiler* c) {
+  int index = parse_factor(c);
+
+  while (!c->failed && (accept_token(c, "and") || accept_token(c, "&&")))
+    index = parse_binary(c, NODE_AND, index, parse_factor(c));
+
+  return index;
+}
+
+/*
+ * parse_expr - used to parse chain of terms joined by "or".
+ * @c - pointer to compiler state
+ *
+ * Return: index of the node, -1 on error
+ */
+static int parse_expr(struct compiler* c) {
+  int index = parse_term(c);
+
+  while (!c->failed && (accept_token(c, "or") || accept_token(c, "||")))
+    index = parse_binary(c, NODE_OR, index, parse_term(c));
+
+  return index;
+}
+
+/*
+ * new_label - used to create label for jump target.
+ * @c - pointer to compiler state
+ *
+ * Return: id of the label
+ */
+static int new_label(struct compiler* c) {
+  if (c->label_count == FILTER_MAX_LABELS) {
+    fail(c, "program too long");
+    return 0;
+  }
+  c->labels[c->label_count] = -1;
+  return c->label_count++;
+}
+
+/*
+ * place_label - used to bind label to the next instruction.
+ * @c - pointer to compiler state
+ * @label - id of the label
+ */
+static void place_label(struct compiler* c, int label) {
+  c->labels[label] = c->filter->length;
+}
+
+/*
+ * emit - used to append instruction to program.
+ * @c - pointer to compiler state
+ * @code - opcode
+ * @k - constant operand
+ * @jt - label of true branch, -1 if not a conditional jump
+ * @jf - label of false branch, -1 if not a conditional jump
+ */
+static void emit(struct compiler* c, uint16_t code, uint32_t k, int jt, int jf) {
+  struct filter* filter = c->filter;
+
+  if (filter->length == FILTER_MAX_INSNS) {
+    fail(c, "program too long");
+    return;
+  }
+
+  filter->insns[filter->length].code = code;
+  filter->insns[filter->length].k = k;
+  filter->insns[filter->length].jt = 0;
+  filter->insns[filter->length].jf = 0;
+  c->jt_label[filter->length] = jt;
+  c->jf_label[filter->length] = jf;
+  filter->length++;
+}
+
+/*
+ * emit_ip_check - used to emit check that packet is IPv4.
+ * @c - pointer to compiler state
+ * @f - label of false branch
+ */
+static void emit_ip_check(struct compiler* c, int f) {
+  int next = new_label(c);
+
+  emit(c, BPF_LD | BPF_H | BPF_ABS, SKF_AD_OFF + SKF_AD_PROTOCOL, -1, -1);
+  emit(c, BPF_JMP | BPF_JEQ | BPF_K, ETH_P_IP, next, f);
+  place_label(c, next);
+}
+
+/*
+ * emit_proto_check - used to emit check of IP protocol.
+ * Without explicit protocol ports match both TCP and UDP.
+ * @c - pointer to compiler state
+ * @node - pointer to primitive node
+ * @f - label of false branch
+ */
+static void emit_proto_check(struct compiler* c, const struct node* node, int f) {
+  int next = new_label(c);
+  int udp;
+
+  emit_ip_check(c, f);
+  emit(c, BPF_LD | BPF_B | BPF_ABS, NET(9), -1, -1);
+
+  if (node->proto) {
+    emit(c, BPF_JMP | BPF_JEQ | BPF_K, node->proto, next, f);
+  }
+  else {
+    udp = new_label(c);
+    emit(c, BPF_JMP | BPF_JEQ | BPF_K, IPPROTO_UDP, next, udp);
+    place_label(c, udp);
+    emit(c, BPF_JMP | BPF_JEQ | BPF_K, IPPROTO_TCP, next, f);
+  }
+
+  place_label(c, next);
+}
+
+/*
+ * emit_port_match - used to emit comparison of port already
+ * loaded into accumulator with node port range.
+ * @c - pointer to compiler state
+ * @node - pointer to port node
+ * @t - label of true branch
+ * @f - label of false branch
+ */
+static void emit_port_match(struct compiler* c, const struct node* node, int t, int f) {
+  int next;
+
+  if (node->port_lo == node->port_hi) {
+    emit(c, BPF_JMP | BPF_JEQ | BPF_K, node->port_lo, t, f);
+    return;
+  }
+
+  next = new_label(c);
+  emit(c, BPF_JMP | BPF_JGE | BPF_K, node->port_lo, next, f);
+  place_label(c, next);
+  emit(c, BPF_JMP | BPF_JGT | BPF_K, node->port_hi, f, t);
+}
+
+/*
+ * emit_addr_match - used to emit comparison of source or
+ * destination address with node address and mask.
+ * @c - pointer to compiler state
+ * @node - pointer to host or net node
+ * @offset - offset of address in IP header
+ * @t - label of true branch
+ * @f - label of false branch
+ */
+static void emit_addr_match(struct compiler* c, const struct node* node, uint32_t offset,
+                            int t, int f) {
+  emit(c, BPF_LD | BPF_W | BPF_ABS, NET(offset), -1, -1);
+  if (node->mask != 0xFFFFFFFF)
+    emit(c, BPF_ALU | BPF_AND | BPF_K, node->mask, -1, -1);
+  emit(c, BPF_JMP | BPF_JEQ | BPF_K, node->addr, t, f);
+}
+
+/*
+ * gen - used to emit code for expression tree. Code jumps
+ * to label t if expression is true and to label f otherwise.
+ * @c - pointer to compiler state
+ * @index - index of the node
+ * @t - label of true branch
+ * @f - label of false branch
+ */
+static void gen(struct compiler* c, int index, int t, int f) {
+  const struct node* node = &c->nodes[index];
+  int next;
+
+  if (c->failed)
+    return;
+
+  switch (node->type) {
+    case NODE_AND:
+      next = new_label(c);
+      gen(c, node->left, next, f);
+      place_label(c, next);
+      gen(c, node->right, t, f);
+      break;
+    case NODE_OR:
+      next = new_label(c);
+      gen(c, node->left, t, next);
+      place_label(c, next);
+      gen(c, node->right, t, f);
+      break;
+    case NODE_NOT:
+      gen(c, node->left, f, t);
+      break;
+    case NODE_IP:
+      emit_ip_check(c, f);
+      emit(c, BPF_JMP | BPF_JA, 0, t, -1);
+      break;
+    case NODE_PROTO:
+      emit_proto_check(c, node, f);
+      emit(c, BPF_JMP | BPF_JA, 0, t, -1);
+      break;
+    case NODE_HOST:
+    case NODE_NET:
+      if (node->proto)
+        emit_proto_check(c, node, f);
+      else
+        emit_ip_check(c, f);
+
+      if (node->dir == DIR_SRC) {
+        emit_addr_match(c, node, 12, t, f);
+      }
+      else if (node->dir == DIR_DST) {
+        emit_addr_match(c, node, 16, t, f);
+      }
+      else {
+        next = new_label(c);
+        emit_addr_match(c, node, 12, t, next);
+        place_label(c, next);
+        emit_addr_match(c, node, 16, t, f);
+      }
+      break;
+    case NODE_PORT:
+      emit_proto_check(c, node, f);
+
+      /* Only first fragment carries transport header */
+      next = new_label(c);
+      emit(c, BPF_LD | BPF_H | BPF_ABS, NET(6), -1, -1);
+      emit(c, BPF_JMP | BPF_JSET | BPF_K, IP_OFFMASK, f, next);
+      place_label(c, next);
+
+      /* X = IP header length */
+      emit(c, BPF_LDX | BPF_B | BPF_MSH, NET(0), -1, -1);
+
+      if (node->dir == DIR_SRC) {
+        emit(c, BPF_LD | BPF_H | BPF_IND, NET(0), -1, -1);
+        emit_port_match(c, node, t, f);
+      }
+      else if (node->dir == DIR_DST) {
+        emit(c, BPF_LD | BPF_H | BPF_IND, NET(2), -1, -1);
+        emit_port_match(c, node, t, f);
+      }
+      else {
+        next = new_label(c);
+        emit(c, BPF_LD | BPF_H | BPF_IND, NET(0), -1, -1);
+        emit_port_match(c, node, t, next);
+        place_label(c, next);
+        emit(c, BPF_LD | BPF_H | BPF_IND, NET(2), -1, -1);
+        emit_port_match(c, node, t, f);
+      }
+      break;
+  }
+}
+
+/*
+ * emit_sample - used to emit flow sampling in front of
+ * accept. Computes sample_hash of 5-tuple with scratch
+ * memory M[0] holding hash and M[1] protocol. Non IPv4
+ * packets and fragments are passed to user space, which
+ * decides on them after reassembly.
+ * @c - pointer to compiler state
+ * @rate - keep 1 of every rate flows
+ * @t - label of sampled packets
+ * @f - label of dropped packets
+ */
+static void emit_sample(struct compiler* c, uint32_t rate, int t, int f) {
+  int hash = new_label(c);
+  int udp = new_label(c);
+  int ports = new_label(c);
+  int portless = new_label(c);
+  int mix = new_label(c);
+
+  emit(c, BPF_LD | BPF_H | BPF_ABS, SKF_AD_OFF + SKF_AD_PROTOCOL, -1, -1);
+  emit(c, BPF_JMP | BPF_JEQ | BPF_K, ETH_P_IP, hash, t);
+  place_label(c, hash);
+  emit(c, BPF_LD | BPF_H | BPF_ABS, NET(6), -1, -1);
+  emit(c, BPF_JMP | BPF_JSET | BPF_K, 0x3FFF, t, udp);
+
+  /* M[0] = (src * SAMPLE_MULT_SRC ^ dst) * SAMPLE_MULT_DST */
+  place_label(c, udp);
+  emit(c, BPF_LD | BPF_W | BPF_ABS, NET(12), -1, -1);
+  emit(c, BPF_ALU | BPF_MUL | BPF_K, SAMPLE_MULT_SRC, -1, -1);
+  emit(c, BPF_ST, 0, -1, -1);
+  emit(c, BPF_LD | BPF_W | BPF_ABS, NET(16), -1, -1);
+  emit(c, BPF_LDX | BPF_MEM, 0, -1, -1);
+  emit(c, BPF_ALU | BPF_XOR | BPF_X, 0, -1, -1);
+  emit(c, BPF_ALU | BPF_MUL | BPF_K, SAMPLE_MULT_DST, -1, -1);
+  emit(c, BPF_ST, 0, -1, -1);
+
+  /* Ports of UDP and TCP in one word, zero for other protocols */
+  emit(c, BPF_LD | BPF_B | BPF_ABS, NET(9), -1, -1);
+  emit(c, BPF_ST, 1, -1, -1);
+  hash = new_label(c);
+  emit(c, BPF_JMP | BPF_JEQ | BPF_K, IPPROTO_UDP, ports, hash);
+  place_label(c, hash);
+  emit(c, BPF_JMP | BPF_JEQ | BPF_K, IPPROTO_TCP, ports, portless);
+  place_label(c, portless);
+  emit(c, BPF_LD | BPF_IMM, 0, -1, -1);
+  emit(c, BPF_JMP | BPF_JA, 0, mix, -1);
+  place_label(c, ports);
+  emit(c, BPF_LDX | BPF_B | BPF_MSH, NET(0), -1, -1);
+  emit(c, BPF_LD | BPF_W | BPF_IND, NET(0), -1, -1);
+
+  /* A = ((M[0] ^ ports) * SAMPLE_MULT_PORTS) ^ protocol, then fold */
+  place_label(c, mix);
+  emit(c, BPF_LDX | BPF_MEM, 0, -1, -1);
+  emit(c, BPF_ALU | BPF_XOR | BPF_X, 0, -1, -1);
+  emit(c, BPF_ALU | BPF_MUL | BPF_K, SAMPLE_MULT_PORTS, -1, -1);
+  emit(c, BPF_ST, 0, -1, -1);
+  emit(c, BPF_LD | BPF_MEM, 1, -1, -1);
+  emit(c, BPF_LDX | BPF_MEM, 0, -1, -1);
+  emit(c, BPF_ALU | BPF_XOR | BPF_X, 0, -1, -1);
+  emit(c, BPF_ST, 0, -1, -1);
+  emit(c, BPF_ALU | BPF_RSH | BPF_K, 16, -1, -1);
+  emit(c, BPF_LDX | BPF_MEM, 0, -1, -1);
+  emit(c, BPF_ALU | BPF_XOR | BPF_X, 0, -1, -1);
+  emit(c, BPF_ALU | BPF_MOD | BPF_K, rate, -1, -1);
+  emit(c, BPF_JMP | BPF_JEQ | BPF_K, 0, t, f);
+}
+
+/*
+ * resolve_labels - used to replace labels of jumps with
+ * relative offsets. Classic BPF jumps only forward and
+ * conditional offsets must fit into 8 bits.
+ * @c - pointer to compiler state
+ */
+static void resolve_labels(struct compiler* c) {
+  struct filter* filter = c->filter;
+  int i, offset;
+
+  for (i = 0; i < filter->length && !c->failed; i++) {
+    if (BPF_CLASS(filter->insns[i].code) != BPF_JMP)
+      continue;
+
+    /* Unconditional jump keeps offset in k */
+    if (BPF_OP(filter->insns[i].code) == BPF_JA) {
+      filter->insns[i].k = c->labels[c->jt_label[i]] - (i + 1);
+      continue;
+    }
+
+    offset = c->labels[c->jt_label[i]] - (i + 1);
+    if (offset < 0 || offset > 255)
+      fail(c, "expression too complex");
+    filter->insns[i].jt = offset;
+
+    offset = c->labels[c->jf_label[i]] - (i + 1);
+    if (offset < 0 || offset > 255)
+      fail(c, "expression too complex");
+    filter->insns[i].jf = offset;
+  }
+}
+
+/*
+ * compile_filter - used to compile filter expression into
+ * classic BPF program. Errors are reported on stderr. With
+ * flow sampling packets that matched expression are also
+ * sampled in kernel, empty expression then matches all.
+ * @expression - filter expression
+ * @sample - keep 1 of every sample flows, 0 or 1 keeps all
+ * @filter - pointer to an object of filter struct
+ *
+ * Return: 0 if successful, -1 otherwise
+ */
+int compile_filter(const char* expression, uint32_t sample, struct filter* filter) {
+  struct compiler* c = (struct compiler*) calloc(1, sizeof(struct compiler));
+  int root, match_label, accept_label, reject_label, result, sampled_only;
+
+  if (!c)
+    print_error("calloc");
+
+  c->input = expression;
+  c->pos = expression;
+  c->filter = filter;
+  filter->length = 0;
+
+  /* Parse expression tree, sampling alone needs no expression */
+  next_token(c);
+  sampled_only = sample > 1 && c->token[0] == '\0';
+  root = sampled_only ? -1 : parse_expr(c);
+  if (!c->failed && c->token[0] != '\0')
+    fail(c, "unexpected token");
+
+  /* Generate program */
+  match_label = new_label(c);
+  accept_label = new_label(c);
+  reject_label = new_label(c);
+  if (!c->failed && (root != -1 || sampled_only)) {
+    if (!sampled_only)
+      gen(c, root, match_label, reject_label);
+    place_label(c, match_label);
+    if (sample > 1)
+      emit_sample(c, sample, accept_label, reject_label);
+    place_label(c, accept_label);
+    emit(c, BPF_RET | BPF_K, FILTER_SNAPLEN, -1, -1);
+    place_label(c, reject_label);
+    emit(c, BPF_RET | BPF_K, 0, -1, -1);
+    resolve_labels(c);
+  }
+
+  result = c->failed || (root == -1 && !sampled_only) ? -1 : 0;
+  free(c);
+  return result;
+}
+
+/*
+ * load_packet - used to load big endian value of packet
+ * for filter run in user space. Packet starts at network
+ * header, so network offsets and plain offsets are the same.
+ * Only protocol of ancillary data is known.
+ * @packet - pointer to IP header
+ * @length - amount of bytes of packet
+ * @offset - offset as in BPF_ABS load
+ * @size - amount of bytes to load
+ * @value - set to loaded value
+ *
+ * Return: 0 if successful, -1 if offset is outside of packet
+ */
+static int load_packet(const uint8_t* packet, size_t length, int32_t offset,
+                       uint32_t size, uint32_t* value) {
+  uint32_t i;
+
+  if (offset == SKF_AD_OFF + SKF_AD_PROTOCOL) {
+    if (length == 0)
+      return -1;
+    *value = (packet[0] >> 4) == 6 ? ETH_P_IPV6 : ETH_P_IP;
+    return 0;
+  }
+
+  if (offset >= SKF_NET_OFF && offset < SKF_AD_OFF)
+    offset -= SKF_NET_OFF;
+  if (offset < 0 || (size_t) offset + size > length)
+    return -1;
+
+  *value = 0;
+  for (i = 0; i < size; i++)
+    *value = *value << 8 | packet[offset + i];
+  return 0;
+}
+
+/*
+ * run_filter - used to run compiled program on packet in
+ * user space, as kernel would run it on socket. Loads
+ * outside of packet and division by zero reject packet.
+ * @filter - pointer to an object of filter struct
+ * @packet - pointer to IP header
+ * @length - amount of captured bytes starting from IP header
+ *
+ * Return: amount of bytes to accept, 0 if packet is rejected
+ */
+uint32_t run_filter(const struct filter* filter, const void* packet, size_t length) {
+  static const uint32_t sizes[] = {4, 2, 1, 0};
+  const uint8_t* data = (const uint8_t*) packet;
+  const struct sock_filter* insn;
+  uint32_t a = 0, x = 0, mem[BPF_MEMWORDS] = {0};
+  uint32_t operand, value, pc = 0;
+  int taken;
+
+  while (pc < filter->length) {
+    insn = &filter->insns[pc++];
+
+    switch (BPF_CLASS(insn->code)) {
+      case BPF_LD:
+      case BPF_LDX:
+        switch (BPF_MODE(insn->code)) {
+          case BPF_IMM:
+            value = insn->k;
+            break;
+          case BPF_LEN:
+            value = length;
+            break;
+          case BPF_MEM:
+            if (insn->k >= BPF_MEMWORDS)
+              return 0;
+            value = mem[insn->k];
+            break;
+          case BPF_ABS:
+          case BPF_IND:
+            operand = BPF_MODE(insn->code) == BPF_IND ? x + insn->k : insn->k;
+            if (load_packet(data, length, (int32_t) operand, 
+                            sizes[BPF_SIZE(insn->code) >> 3], &value) == -1)
+              return 0;
+            break;
+          case BPF_MSH:
+            if (load_packet(data, length, (int32_t) insn->k, 1, &value) == -1)
+              return 0;
+            value = (value & 0xF) << 2;
+            break;
+          default:
+            return 0;
+        }
+        if (BPF_CLASS(insn->code) == BPF_LD)
+          a = value;
+        else
+          x = value;
+        break;
+      case BPF_ST:
+      case BPF_STX:
+        if (insn->k >= BPF_MEMWORDS)
+          return 0;
+        mem[insn->k] = BPF_CLASS(insn->code) == BPF_ST ? a : x;
+        break;
+      case BPF_ALU:
+        operand = BPF_SRC(insn->code) == BPF_X ? x : insn->k;
+        switch (BPF_OP(insn->code)) {
+          case BPF_ADD: a += operand; break;
+          case BPF_SUB: a -= operand; break;
+          case BPF_MUL: a *= operand; break;
+          case BPF_AND: a &= operand; break;
+          case BPF_OR: a |= operand; break;
+          case BPF_XOR: a ^= operand; break;
+          case BPF_LSH: a = operand < 32 ? a << operand : 0; break;
+          case BPF_RSH: a = operand < 32 ? a >> operand : 0; break;
+          case BPF_NEG: a = -a; break;
+          case BPF_DIV:
+          case BPF_MOD:
+            if (operand == 0)
+              return 0;
+            a = BPF_OP(insn->code) == BPF_DIV ? a / operand : a % operand;
+            break;
+          default:
+            return 0;
+        }
+        break;
+      case BPF_JMP:
+        if (BPF_OP(insn->code) == BPF_JA) {
+          pc += insn->k;
+          break;
+        }
+        operand = BPF_SRC(insn->code) == BPF_X ? x : insn->k;
+        switch (BPF_OP(insn->code)) {
+          case BPF_JEQ: taken = a == operand; break;
+          case BPF_JGT: taken = a > operand; break;
+          case BPF_JGE: taken = a >= operand; break;
+          case BPF_JSET: taken = (a & operand) != 0; break;
+          default: return 0;
+        }
+        pc += taken ? insn->jt : insn->jf;
+        break;
+      case BPF_RET:
+        return BPF_RVAL(insn->code) == BPF_A ? a : insn->k;
+      case BPF_MISC:
+        if (BPF_MISCOP(insn->code) == BPF_TAX)
+          x = a;
+        else
+          a = x;
+        break;
+    }
+  }
+
+  return 0;
+}
+
+/*
+ * print_filter - used to print compiled program in
+ * format of tcpdump -dd.
+ * @filter - pointer to an object of filter struct
+ */
+void print_filter(const struct filter* filter) {
+  int i;
+
+  for (i = 0; i < filter->length; i++) {
+    printf("{ 0x%02x, %u, %u, 0x%08x },\n",
+           filter->insns[i].code,
+           filter->insns[i].jt,
+           filter->insns[i].jf,
+           filter->insns[i].k);
+  }
+}
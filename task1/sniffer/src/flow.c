@@ -0,0 +1,503 @@
+#include "../headers/flow.h"
+#include "../headers/export.h"
+#include "../../common/headers/common.h"
+#include "../../common/headers/log.h"
+#include <limits.h>
+#include <errno.h>
+
+/*
+ * create_flow_table - used to create flow table that fits
+ * into memory budget. Capacity is the largest power of two
+ * of slots that fits, and only part of it is filled.
+ * Gap histograms are preallocated and given to flows in
+ * order of arrival until they run out.
+ * @memory - memory budget in bytes
+ * @timeout - idle timeout of flows in ns
+ * @histograms - amount of flows with gap histogram
+ * @exporter - receives ended flows, NULL to not export
+ * @active_timeout - flows are exported every this many ns
+ *
+ * Return: pointer to an object of flow_table struct
+ */
+struct flow_table* create_flow_table(size_t memory, uint64_t timeout, uint32_t histograms,
+                                     struct exporter* exporter, uint64_t active_timeout) {
+  struct flow_table* table;
+  size_t capacity = 64;
+  uint32_t i;
+
+  table = (struct flow_table*) calloc(1, sizeof(struct flow_table));
+  if (!table)
+    print_error("calloc");
+
+  while (capacity * 2 * sizeof(struct flow_entry) <= memory)
+    capacity *= 2;
+
+  if (posix_memalign((void**) &table->entries, sizeof(struct flow_entry),
+                     capacity * sizeof(struct flow_entry)) != 0)
+    print_error("posix_memalign");
+  memset(table->entries, 0, capacity * sizeof(struct flow_entry));
+
+  table->capacity = capacity;
+  table->mask = capacity - 1;
+  table->limit = capacity * FLOW_LOAD_PERCENT / 100;
+  table->timeout = timeout;
+  table->exporter = exporter;
+  table->active_timeout = active_timeout;
+
+  if (histograms) {
+    table->histograms = (struct histogram*) malloc(histograms * sizeof(struct histogram));
+    table->free_histograms = (uint32_t*) malloc(histograms * sizeof(uint32_t));
+    if (!table->histograms || !table->free_histograms)
+      print_error("malloc");
+    for (i = 0; i < histograms; i++)
+      table->free_histograms[i] = histograms - 1 - i;
+    table->histogram_count = histograms;
+    table->free_histogram_count = histograms;
+  }
+  return table;
+}
+
+/*
+ * update_flow - used to account packet in its flow.
+ * Creates flow on first packet. When table is at its
+ * limit new flows are dropped and counted. Gap since
+ * previous packet is recorded in histogram of flow.
+ * Flow that was just exported starts again from packet.
+ * @table - pointer to an object of flow_table struct
+ * @key - 5-tuple of packet
+ * @bytes - payload bytes of packet
+ * @now - capture time of packet in ns
+ */
+void update_flow(struct flow_table* table, const struct flow_key* key, 
+                 uint32_t bytes, uint64_t now) {
+  size_t index = flow_key_hash(key) & table->mask;
+  struct flow_entry* entry;
+  uint64_t gap;
+
+  while (1) {
+    entry = &table->entries[index];
+
+    /* Existing flow */
+    if (flow_keys_equal(&entry->key, key)) {
+      if (!entry->packets)
+        entry->first_seen = now;
+      gap = now > entry->last_seen ? now - entry->last_seen : 0;
+      if (entry->histogram)
+        record_histogram(&table->histograms[entry->histogram - 1], gap);
+      if (gap > UINT32_MAX)
+        gap = UINT32_MAX;
+      if (entry->packets == 1 || gap < entry->iat_min)
+        entry->iat_min = gap;
+      if (gap > entry->iat_max)
+        entry->iat_max = gap;
+      if (now > entry->last_seen)
+        entry->last_seen = now;
+      entry->packets++;
+      entry->bytes += bytes;
+      return;
+    }
+
+    /* New flow */
+    if (!entry->key.used) {
+      if (table->count >= table->limit) {
+        table->dropped++;
+        return;
+      }
+
+      entry->key = *key;
+      entry->packets = 1;
+      entry->bytes = bytes;
+      entry->first_seen = now;
+      entry->last_seen = now;
+      entry->iat_min = 0;
+      entry->iat_max = 0;
+      entry->histogram = 0;
+      entry->errors = 0;
+      if (table->free_histogram_count) {
+        entry->histogram = table->free_histograms[--table->free_histogram_count] + 1;
+        reset_histogram(&table->histograms[entry->histogram - 1]);
+      }
+      else if (table->histogram_count) {
+        table->unhistogrammed++;
+      }
+      table->count++;
+      table->created++;
+      return;
+    }
+
+    index = (index + 1) & table->mask;
+  }
+}
+
+/*
+ * count_flow_error - used to account packet with bad
+ * checksum in its flow. Such packet is not part of flow
+ * and its header may be corrupted too, so only existing
+ * flows are counted and no flow is created.
+ * @table - pointer to an object of flow_table struct
+ * @key - 5-tuple of packet
+ */
+void count_flow_error(struct flow_table* table, const struct flow_key* key) {
+  size_t index = flow_key_hash(key) & table->mask;
+  struct flow_entry* entry;
+
+  while (1) {
+    entry = &table->entries[index];
+    if (flow_keys_equal(&entry->key, key)) {
+      if (entry->errors < UINT32_MAX)
+        entry->errors++;
+      return;
+    }
+    if (!entry->key.used)
+      return;
+    index = (index + 1) & table->mask;
+  }
+}
+
+/*
+ * remove_slot - used to delete entry with backward shift.
+ * Following entries of the same probe chain are moved back,
+ * so lookups never meet a hole before their key.
+ * @table - pointer to an object of flow_table struct
+ * @index - index of slot to delete
+ */
+static void remove_slot(struct flow_table* table, size_t index) {
+  size_t next = (index + 1) & table->mask;
+  size_t home;
+
+  if (table->entries[index].histogram)
+    table->free_histograms[table->free_histogram_count++] = table->entries[index].histogram - 1;
+
+  while (table->entries[next].key.used) {
+    home = flow_key_hash(&table->entries[next].key) & table->mask;
+
+    /* Entry may move back if its home is not between hole and entry */
+    if (((next - home) & table->mask) >= ((next - index) & table->mask)) {
+      table->entries[index] = table->entries[next];
+      index = next;
+    }
+    next = (next + 1) & table->mask;
+  }
+
+  memset(&table->entries[index], 0, sizeof(struct flow_entry));
+  table->count--;
+}
+
+/*
+ * expire_flows - used to evict idle flows. Checks given
+ * amount of slots from where previous call stopped, so cost
+ * of every call is bounded. With exporter evicted flows are
+ * exported, and flows older than active timeout are exported
+ * and their counters restarted.
+ * @table - pointer to an object of flow_table struct
+ * @now - current time in ns
+ * @slots - amount of slots to check
+ */
+void expire_flows(struct flow_table* table, uint64_t now, size_t slots) {
+  struct flow_entry* entry;
+
+  if (slots > table->capacity)
+    slots = table->capacity;
+
+  while (slots-- > 0) {
+    entry = &table->entries[table->cursor];
+
+    /* Shifted entry lands into same slot, check it again */
+    if (entry->key.used && now > entry->last_seen && 
+        now - entry->last_seen > table->timeout) {
+      if (table->exporter && entry->packets)
+        export_flow(table->exporter, entry, FLOW_END_IDLE, now);
+      remove_slot(table, table->cursor);
+      table->evicted++;
+      continue;
+    }
+
+    if (table->exporter && entry->packets && now > entry->first_seen &&
+        now - entry->first_seen > table->active_timeout) {
+      export_flow(table->exporter, entry, FLOW_END_ACTIVE, now);
+      entry->packets = 0;
+      entry->bytes = 0;
+    }
+
+    table->cursor = (table->cursor + 1) & table->mask;
+  }
+}
+
+/*
+ * export_flows - used to export every flow with packets
+ * not exported yet, when capture ends.
+ * @table - pointer to an object of flow_table struct
+ * @now - current time in ns
+ */
+void export_flows(struct flow_table* table, uint64_t now) {
+  struct flow_entry* entry;
+  size_t i;
+
+  for (i = 0; i < table->capacity; i++) {
+    entry = &table->entries[i];
+    if (entry->packets) {
+      export_flow(table->exporter, entry, FLOW_END_FORCED, now);
+      entry->packets = 0;
+      entry->bytes = 0;
+    }
+  }
+}
+
+/*
+ * write_flow_snapshot - used by dumper thread to write copied
+ * flows into file. Snapshot is written to temporary file and
+ * renamed, so readers always see complete snapshot.
+ * @dumper - pointer to an object of flow_dumper struct
+ *
+ * Return: 0 if successful, -1 otherwise
+ */
+static int write_flow_snapshot(struct flow_dumper* dumper) {
+  char tmp_path[PATH_MAX + 4];
+  char src[INET_ADDRSTRLEN], dst[INET_ADDRSTRLEN];
+  struct flow_entry* entry;
+  FILE* file;
+  size_t i;
+
+  snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", dumper->path);
+  file = fopen(tmp_path, "w");
+  if (!file) {
+    perror(tmp_path);
+    return -1;
+  }
+
+  fprintf(file, "# src sport dst dport proto packets bytes first_ns last_ns "
+                "iat_mean_ns iat_min_ns iat_max_ns checksum_errors\n");
+
+  for (i = 0; i < dumper->count; i++) {
+    entry = &dumper->entries[i];
+
+    inet_ntop(AF_INET, &entry->key.src, src, sizeof(src));
+    inet_ntop(AF_INET, &entry->key.dst, dst, sizeof(dst));
+    fprintf(file, "%s %u %s %u %u %lu %lu %lu %lu %lu %lu %lu %u\n",
+            src, ntohs(entry->key.sport), dst, ntohs(entry->key.dport), 
+            entry->key.proto,
+            (unsigned long) entry->packets,
+            (unsigned long) entry->bytes,
+            (unsigned long) entry->first_seen,
+            (unsigned long) entry->last_seen,
+            (unsigned long) (entry->packets > 1 ? 
+              (entry->last_seen - entry->first_seen) / (entry->packets - 1) : 0),
+            (unsigned long) entry->iat_min,
+            (unsigned long) entry->iat_max,
+            entry->errors);
+  }
+
+  if (fclose(file) != 0 || rename(tmp_path, dumper->path) == -1) {
+    perror(dumper->path);
+    return -1;
+  }
+
+  return 0;
+}
+
+/*
+ * dumper_main - used as dumper thread. Waits for copy handed
+ * over by owner of table, writes it and gives it back.
+ * @arg - pointer to an object of flow_dumper struct
+ *
+ * Return: NULL
+ */
+static void* dumper_main(void* arg) {
+  struct flow_dumper* dumper = (struct flow_dumper*) arg;
+
+  while (1) {
+    pthread_mutex_lock(&dumper->lock);
+    while (!dumper->writing && !dumper->stop)
+      pthread_cond_wait(&dumper->cond, &dumper->lock);
+    if (!dumper->writing) {
+      pthread_mutex_unlock(&dumper->lock);
+      break;
+    }
+    pthread_mutex_unlock(&dumper->lock);
+
+    write_flow_snapshot(dumper);
+
+    pthread_mutex_lock(&dumper->lock);
+    dumper->writing = 0;
+    dumper->written++;
+    pthread_cond_broadcast(&dumper->cond);
+    pthread_mutex_unlock(&dumper->lock);
+  }
+
+  return NULL;
+}
+
+/*
+ * create_flow_dumper - used to create flow dumper and
+ * start its thread. Copy has room for every flow table
+ * may hold, so snapshot doubles memory of flows.
+ * @prefix - prefix of snapshot file
+ * @id - index of the worker, part of file name
+ * @size - amount of flows in copy
+ *
+ * Return: pointer to an object of flow_dumper struct
+ */
+struct flow_dumper* create_flow_dumper(const char* prefix, unsigned int id, size_t size) {
+  struct flow_dumper* dumper;
+  int result;
+
+  dumper = (struct flow_dumper*) calloc(1, sizeof(struct flow_dumper));
+  if (!dumper)
+    print_error("calloc");
+
+  if (snprintf(dumper->path, sizeof(dumper->path), "%s-%u", prefix, id) >= 
+      (int) sizeof(dumper->path)) {
+    fprintf(stderr, "%s: flow snapshot path is too long\n", prefix);
+    exit(EXIT_FAILURE);
+  }
+
+  dumper->entries = (struct flow_entry*) malloc(size * sizeof(struct flow_entry));
+  if (!dumper->entries)
+    print_error("malloc");
+  dumper->size = size;
+
+  pthread_mutex_init(&dumper->lock, NULL);
+  pthread_cond_init(&dumper->cond, NULL);
+
+  result = pthread_create(&dumper->thread, NULL, dumper_main, dumper);
+  if (result != 0) {
+    errno = result;
+    print_error("pthread_create");
+  }
+
+  return dumper;
+}
+
+/*
+ * start_flow_snapshot - used by owner of table to start
+ * copying new snapshot. Snapshot is skipped while previous
+ * one is still copied or written.
+ * @dumper - pointer to an object of flow_dumper struct
+ */
+void start_flow_snapshot(struct flow_dumper* dumper) {
+  int writing;
+
+  pthread_mutex_lock(&dumper->lock);
+  writing = dumper->writing;
+  pthread_mutex_unlock(&dumper->lock);
+
+  if (dumper->copying || writing) {
+    dumper->skipped++;
+    return;
+  }
+
+  dumper->copying = 1;
+  dumper->cursor = 0;
+  dumper->count = 0;
+}
+
+/*
+ * copy_flow_snapshot - used by owner of table to copy next
+ * slots into snapshot and hand complete copy to dumper thread.
+ * Flows whose probe wrapped past end of table are copied
+ * together with last slots, since deletions may shift them
+ * from start of table to its end.
+ * @dumper - pointer to an object of flow_dumper struct
+ * @table - pointer to an object of flow_table struct
+ * @slots - amount of slots to copy
+ */
+void copy_flow_snapshot(struct flow_dumper* dumper, const struct flow_table* table, size_t slots) {
+  const struct flow_entry* entry;
+  size_t i, end;
+
+  if (!dumper->copying)
+    return;
+
+  end = slots < table->capacity - dumper->cursor ? dumper->cursor + slots : table->capacity;
+  for (i = dumper->cursor; i < end && dumper->count < dumper->size; i++) {
+    entry = &table->entries[i];
+    if (entry->key.used && (flow_key_hash(&entry->key) & table->mask) <= i)
+      dumper->entries[dumper->count++] = *entry;
+  }
+  dumper->cursor = end;
+  if (end < table->capacity)
+    return;
+
+  /* Wrapped flows sit in the first run of used slots */
+  for (i = 0; i < table->capacity && table->entries[i].key.used &&
+       dumper->count < dumper->size; i++) {
+    entry = &table->entries[i];
+    if ((flow_key_hash(&entry->key) & table->mask) > i)
+      dumper->entries[dumper->count++] = *entry;
+  }
+
+  dumper->copying = 0;
+  pthread_mutex_lock(&dumper->lock);
+  dumper->writing = 1;
+  pthread_cond_broadcast(&dumper->cond);
+  pthread_mutex_unlock(&dumper->lock);
+}
+
+/*
+ * free_flow_dumper - used to write last snapshot of table
+ * when capture ends, stop dumper thread and free dumper.
+ * @dumper - pointer to an object of flow_dumper struct
+ * @table - pointer to an object of flow_table struct
+ */
+void free_flow_dumper(struct flow_dumper* dumper, const struct flow_table* table) {
+  pthread_mutex_lock(&dumper->lock);
+  while (dumper->writing)
+    pthread_cond_wait(&dumper->cond, &dumper->lock);
+  pthread_mutex_unlock(&dumper->lock);
+
+  dumper->copying = 1;
+  dumper->cursor = 0;
+  dumper->count = 0;
+  copy_flow_snapshot(dumper, table, table->capacity);
+
+  pthread_mutex_lock(&dumper->lock);
+  dumper->stop = 1;
+  pthread_cond_broadcast(&dumper->cond);
+  pthread_mutex_unlock(&dumper->lock);
+
+  pthread_join(dumper->thread, NULL);
+  pthread_mutex_destroy(&dumper->lock);
+  pthread_cond_destroy(&dumper->cond);
+  free(dumper->entries);
+  free(dumper);
+}
+
+/*
+ * log_flow_histograms - used to log gap histogram of
+ * every flow that has one.
+ * @table - pointer to an object of flow_table struct
+ */
+void log_flow_histograms(struct flow_table* table) {
+  char src[INET_ADDRSTRLEN], dst[INET_ADDRSTRLEN];
+  char summary[LOG_LINE_SIZE / 2];
+  struct histogram* histogram;
+  struct flow_entry* entry;
+  size_t i;
+
+  for (i = 0; i < table->capacity; i++) {
+    entry = &table->entries[i];
+    if (!entry->key.used || !entry->histogram)
+      continue;
+
+    histogram = &table->histograms[entry->histogram - 1];
+    if (histogram->total == 0)
+      continue;
+
+    inet_ntop(AF_INET, &entry->key.src, src, sizeof(src));
+    inet_ntop(AF_INET, &entry->key.dst, dst, sizeof(dst));
+    format_histogram(histogram, "gaps", summary, sizeof(summary));
+    log_message(LOG_LEVEL_INFO, "Histogram flow %s:%u -> %s:%u: %s\n",
+                src, ntohs(entry->key.sport), dst, ntohs(entry->key.dport), summary);
+  }
+}
+
+/*
+ * free_flow_table - used to free flow table.
+ * @table - pointer to an object of flow_table struct
+ */
+void free_flow_table(struct flow_table* table) {
+  free(table->histograms);
+  free(table->free_histograms);
+  free(table->entries);
+  free(table);
+}
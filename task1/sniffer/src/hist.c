@@ -0,0 +1,82 @@
+#include "../headers/hist.h"
+#include <stdio.h>
+#include <string.h>
+
+/*
+ * bucket_highest - used to get largest value that falls
+ * into bucket, reported for percentiles as HDR does.
+ * @bucket - index of bucket
+ *
+ * Return: largest value of bucket
+ */
+static uint64_t bucket_highest(unsigned int bucket) {
+  unsigned int exponent, sub;
+
+  if (bucket < HIST_SUB_BUCKETS)
+    return bucket;
+
+  exponent = bucket / HIST_SUB_BUCKETS + HIST_SUB_BITS - 1;
+  sub = bucket % HIST_SUB_BUCKETS;
+  return ((uint64_t) (HIST_SUB_BUCKETS + sub + 1) << (exponent - HIST_SUB_BITS)) - 1;
+}
+
+/*
+ * reset_histogram - used to clear all counts.
+ * @histogram - pointer to an object of histogram struct
+ */
+void reset_histogram(struct histogram* histogram) {
+  memset(histogram, 0, sizeof(struct histogram));
+}
+
+/*
+ * histogram_percentile - used to get value below which
+ * given percent of recorded values lie.
+ * @histogram - pointer to an object of histogram struct
+ * @percentile - percent in range 0..100
+ *
+ * Return: percentile value, bounded by recorded maximum
+ */
+uint64_t histogram_percentile(const struct histogram* histogram, double percentile) {
+  uint64_t rank, seen = 0, value;
+  unsigned int i;
+
+  if (histogram->total == 0)
+    return 0;
+
+  rank = (uint64_t) (percentile / 100.0 * histogram->total + 0.5);
+  if (rank == 0)
+    rank = 1;
+
+  for (i = 0; i < HIST_BUCKETS; i++) {
+    seen += histogram->counts[i];
+    if (seen >= rank)
+      break;
+  }
+
+  value = bucket_highest(i < HIST_BUCKETS ? i : HIST_BUCKETS - 1);
+  return value < histogram->max ? value : histogram->max;
+}
+
+/*
+ * format_histogram - used to print summary of histogram
+ * into buffer.
+ * @histogram - pointer to an object of histogram struct
+ * @what - name of recorded values
+ * @buffer - output buffer
+ * @size - size of the buffer
+ *
+ * Return: amount of characters printed, as snprintf
+ */
+int format_histogram(const struct histogram* histogram, const char* what,
+                     char* buffer, size_t size) {
+  return snprintf(buffer, size, 
+                  "%lu %s, min %lu, p50 %lu, p90 %lu, p99 %lu, p99.9 %lu, max %lu ns",
+                  (unsigned long) histogram->total,
+                  what,
+                  (unsigned long) histogram->min,
+                  (unsigned long) histogram_percentile(histogram, 50.0),
+                  (unsigned long) histogram_percentile(histogram, 90.0),
+                  (unsigned long) histogram_percentile(histogram, 99.0),
+                  (unsigned long) histogram_percentile(histogram, 99.9),
+                  (unsigned long) histogram->max);
+}
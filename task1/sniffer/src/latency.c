@@ -0,0 +1,211 @@
+#include "../headers/latency.h"
+#include "../../common/headers/common.h"
+#include "../../common/headers/log.h"
+
+/*
+ * create_latency - used to create response time tracker.
+ * Amount of pending slots is rounded down to power of two
+ * of sets.
+ * @port - server port in host byte order
+ * @pending - amount of pending request slots
+ * @timeout - time in ns after which request is unanswered
+ *
+ * Return: pointer to an object of latency struct
+ */
+struct latency* create_latency(uint16_t port, size_t pending, uint64_t timeout) {
+  struct latency* latency = (struct latency*) calloc(1, sizeof(struct latency));
+  if (!latency)
+    print_error("calloc");
+
+  latency->sets = 1;
+  while (latency->sets * 2 * LATENCY_WAYS <= pending)
+    latency->sets *= 2;
+
+  latency->pending = (struct latency_request*) calloc(latency->sets * LATENCY_WAYS,
+                                                      sizeof(struct latency_request));
+  if (!latency->pending)
+    print_error("calloc");
+
+  latency->port = htons(port);
+  latency->timeout = timeout;
+  return latency;
+}
+
+/*
+ * find_endpoint - used to find server endpoint or add it
+ * to endpoint table.
+ * @latency - pointer to an object of latency struct
+ * @addr - server address in network byte order
+ * @port - server port in network byte order
+ *
+ * Return: index of endpoint, -1 if table is full
+ */
+static int find_endpoint(struct latency* latency, uint32_t addr, uint16_t port) {
+  struct latency_endpoint* endpoint;
+  unsigned int index = ((addr ^ port) * 0x9E3779B1u) >> 26;
+  unsigned int i;
+
+  for (i = 0; i < LATENCY_ENDPOINTS; i++, index = (index + 1) & (LATENCY_ENDPOINTS - 1)) {
+    endpoint = &latency->endpoints[index];
+    if (endpoint->used && endpoint->addr == addr && endpoint->port == port)
+      return index;
+    if (endpoint->used)
+      continue;
+
+    endpoint->used = 1;
+    endpoint->addr = addr;
+    endpoint->port = port;
+    latency->endpoint_count++;
+    return index;
+  }
+
+  return -1;
+}
+
+/*
+ * find_set - used to get slots of set the key maps to.
+ * @latency - pointer to an object of latency struct
+ * @key - 5-tuple of request
+ *
+ * Return: pointer to first slot of set
+ */
+static inline struct latency_request* find_set(struct latency* latency,
+                                               const struct flow_key* key) {
+  return &latency->pending[(flow_key_hash(key) & (latency->sets - 1)) * LATENCY_WAYS];
+}
+
+/*
+ * add_request - used to remember time of request. Repeated
+ * request keeps time of the first one. Free slot of set is
+ * taken first, otherwise the oldest request is replaced
+ * and counted as unanswered.
+ * @latency - pointer to an object of latency struct
+ * @key - 5-tuple of request
+ * @now - capture time of request in ns
+ */
+static void add_request(struct latency* latency, const struct flow_key* key, uint64_t now) {
+  struct latency_request* set = find_set(latency, key);
+  struct latency_request* victim = NULL;
+  unsigned int i;
+  int endpoint;
+
+  for (i = 0; i < LATENCY_WAYS; i++) {
+    if (set[i].sent && flow_keys_equal(&set[i].key, key)) {
+      if (now - set[i].sent <= latency->timeout) {
+        latency->repeated++;
+        return;
+      }
+      victim = &set[i];
+      break;
+    }
+    if (!victim || (victim->sent && set[i].sent < victim->sent))
+      victim = &set[i];
+  }
+
+  endpoint = find_endpoint(latency, key->dst, key->dport);
+  if (endpoint == -1) {
+    latency->overflow++;
+    return;
+  }
+
+  if (victim->sent) {
+    latency->endpoints[victim->endpoint].unanswered++;
+    if (now - victim->sent <= latency->timeout)
+      latency->evicted++;
+  }
+
+  latency->endpoints[endpoint].requests++;
+  victim->key = *key;
+  victim->sent = now ? now : 1;
+  victim->endpoint = endpoint;
+}
+
+/*
+ * add_response - used to match response to pending request
+ * on reversed 5-tuple and record response time of server.
+ * @latency - pointer to an object of latency struct
+ * @key - 5-tuple of response
+ * @now - capture time of response in ns
+ */
+static void add_response(struct latency* latency, const struct flow_key* key, uint64_t now) {
+  struct latency_request* set;
+  struct latency_endpoint* endpoint;
+  struct flow_key request = *key;
+  unsigned int i;
+
+  request.src = key->dst;
+  request.dst = key->src;
+  request.sport = key->dport;
+  request.dport = key->sport;
+
+  set = find_set(latency, &request);
+  for (i = 0; i < LATENCY_WAYS; i++) {
+    if (!set[i].sent || !flow_keys_equal(&set[i].key, &request))
+      continue;
+
+    endpoint = &latency->endpoints[set[i].endpoint];
+    if (now - set[i].sent > latency->timeout) {
+      endpoint->unanswered++;
+      latency->unmatched++;
+    }
+    else {
+      record_histogram(&endpoint->histogram, now > set[i].sent ? now - set[i].sent : 0);
+      latency->responses++;
+    }
+    set[i].sent = 0;
+    return;
+  }
+
+  latency->unmatched++;
+}
+
+/*
+ * track_latency - used to pass packet to tracker. Packets
+ * to server port are requests, packets from it responses,
+ * other packets are ignored. Constant time.
+ * @latency - pointer to an object of latency struct
+ * @key - 5-tuple of packet
+ * @now - capture time of packet in ns
+ */
+void track_latency(struct latency* latency, const struct flow_key* key, uint64_t now) {
+  if (key->dport == latency->port)
+    add_request(latency, key, now);
+  else if (key->sport == latency->port)
+    add_response(latency, key, now);
+}
+
+/*
+ * log_latency - used to log response time percentiles of
+ * every server endpoint.
+ * @latency - pointer to an object of latency struct
+ * @id - index of the worker
+ */
+void log_latency(const struct latency* latency, unsigned int id) {
+  char addr[INET_ADDRSTRLEN];
+  char summary[LOG_LINE_SIZE / 2];
+  const struct latency_endpoint* endpoint;
+  unsigned int i;
+
+  for (i = 0; i < LATENCY_ENDPOINTS; i++) {
+    endpoint = &latency->endpoints[i];
+    if (!endpoint->used)
+      continue;
+
+    inet_ntop(AF_INET, &endpoint->addr, addr, sizeof(addr));
+    format_histogram(&endpoint->histogram, "responses", summary, sizeof(summary));
+    log_message(LOG_LEVEL_INFO, "Latency %u %s:%u: %lu requests, %lu unanswered, %s\n",
+                id, addr, ntohs(endpoint->port),
+                (unsigned long) endpoint->requests,
+                (unsigned long) endpoint->unanswered,
+                summary);
+  }
+}
+
+/*
+ * free_latency - used to free response time tracker.
+ * @latency - pointer to an object of latency struct
+ */
+void free_latency(struct latency* latency) {
+  free(latency->pending);
+  free(latency);
+}
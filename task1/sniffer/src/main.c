@@ -1,18 +1,665 @@
 #include "../headers/sniffer.h"
+#include <getopt.h>
 
 struct sniffer* sniffer;
 
 void cleanup();
 
-int main(void) {
+void handle_signal(int signal);
+
+void handle_reload(int signal);
+
+void handle_dump(int signal);
+
+void handle_snapshot(int signal);
+
+void parse_args(int argc, char** argv, struct sniffer_config* config);
+
+void usage(const char* name);
+
+int parse_cpus(const char* list, int* cpus);
+
+int parse_inputs(char* list, struct sniffer_config* config);
+
+int main(int argc, char** argv) {
+  struct sniffer_config config;
+  struct sigaction action;
+
+  init_log(STDOUT_FILENO);
+  init_sniffer_config(&config);
+  parse_args(argc, argv, &config);
+
   atexit(cleanup);
-  sniffer = create_sniffer();
-  printf("Starting sniffer\n");
+  sniffer = create_sniffer(&config);
+
+  /* Stop sniffer on Ctrl+C without restarting blocked calls */
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = handle_signal;
+  sigemptyset(&action.sa_mask);
+  sigaction(SIGINT, &action, NULL);
+  sigaction(SIGTERM, &action, NULL);
+
+  /* Re-read filter file on SIGHUP */
+  action.sa_handler = handle_reload;
+  sigaction(SIGHUP, &action, NULL);
+
+  /* Log histograms on SIGUSR2 */
+  action.sa_handler = handle_dump;
+  sigaction(SIGUSR2, &action, NULL);
+
+  /* Write flight recorder history on SIGUSR1 */
+  action.sa_handler = handle_snapshot;
+  sigaction(SIGUSR1, &action, NULL);
+
+  log_message(LOG_LEVEL_INFO, "Starting sniffer\n");
 
   run_sniffer(sniffer);
   exit(EXIT_SUCCESS);
 }
 
 void cleanup() {
+  if (!sniffer)
+    return;
+  print_sniffer_stats(sniffer);
   free_sniffer(sniffer);
 }
+
+void handle_signal(int signal) {
+  (void) signal;
+  if (sniffer)
+    stop_sniffer(sniffer);
+}
+
+void handle_reload(int signal) {
+  (void) signal;
+  if (sniffer)
+    request_reload(sniffer);
+}
+
+void handle_dump(int signal) {
+  (void) signal;
+  if (sniffer)
+    request_histograms(sniffer);
+}
+
+void handle_snapshot(int signal) {
+  (void) signal;
+  if (sniffer)
+    request_snapshot(sniffer);
+}
+
+/* Options without short form */
+enum long_option {
+  OPTION_RECORD_TIME = 256,
+  OPTION_RECORD_PREFIX,
+  OPTION_RECORD_TRIGGER,
+  OPTION_PUBLISH,
+  OPTION_PUBLISH_SLOTS,
+  OPTION_PUBLISH_SLOT_SIZE,
+  OPTION_REORDER_WINDOW
+};
+
+/*
+ * parse_args - used to fill sniffer config from
+ * command line arguments.
+ * @argc - amount of arguments
+ * @argv - array of arguments
+ * @config - pointer to an object of sniffer_config struct
+ */
+void parse_args(int argc, char** argv, struct sniffer_config* config) {
+  static struct option options[] = {
+    {"mode", required_argument, NULL, 'm'},
+    {"interface", required_argument, NULL, 'e'},
+    {"reorder-window", required_argument, NULL, OPTION_REORDER_WINDOW},
+    {"queue", required_argument, NULL, 'q'},
+    {"batch-size", required_argument, NULL, 'B'},
+    {"block-size", required_argument, NULL, 'b'},
+    {"block-count", required_argument, NULL, 'n'},
+    {"retire-timeout", required_argument, NULL, 't'},
+    {"filter", required_argument, NULL, 'f'},
+    {"filter-file", required_argument, NULL, 'F'},
+    {"sample", required_argument, NULL, 'k'},
+    {"max-pps", required_argument, NULL, 'x'},
+    {"workers", required_argument, NULL, 'w'},
+    {"fanout", required_argument, NULL, 'o'},
+    {"write", required_argument, NULL, 'W'},
+    {"format", required_argument, NULL, 'P'},
+    {"snaplen", required_argument, NULL, 's'},
+    {"rotate-size", required_argument, NULL, 'R'},
+    {"rotate-time", required_argument, NULL, 'T'},
+    {"compress", no_argument, NULL, 'z'},
+    {"store", required_argument, NULL, 'A'},
+    {"store-size", required_argument, NULL, 'J'},
+    {"store-time", required_argument, NULL, 'Q'},
+    {"record", required_argument, NULL, 'u'},
+    {"record-time", required_argument, NULL, OPTION_RECORD_TIME},
+    {"record-prefix", required_argument, NULL, OPTION_RECORD_PREFIX},
+    {"record-trigger", required_argument, NULL, OPTION_RECORD_TRIGGER},
+    {"publish", required_argument, NULL, OPTION_PUBLISH},
+    {"publish-slots", required_argument, NULL, OPTION_PUBLISH_SLOTS},
+    {"publish-slot-size", required_argument, NULL, OPTION_PUBLISH_SLOT_SIZE},
+    {"read", required_argument, NULL, 'r'},
+    {"realtime", no_argument, NULL, 'p'},
+    {"reasm-memory", required_argument, NULL, 'G'},
+    {"reasm-timeout", required_argument, NULL, 'g'},
+    {"no-verify", no_argument, NULL, 'Z'},
+    {"histograms", no_argument, NULL, 'H'},
+    {"hist-flows", required_argument, NULL, 'N'},
+    {"hist-interval", required_argument, NULL, 'Y'},
+    {"signatures", required_argument, NULL, 'S'},
+    {"bench-match", no_argument, NULL, 'E'},
+    {"flows", no_argument, NULL, 'a'},
+    {"flow-memory", required_argument, NULL, 'M'},
+    {"flow-timeout", required_argument, NULL, 'I'},
+    {"flow-interval", required_argument, NULL, 'i'},
+    {"flow-dump", required_argument, NULL, 'D'},
+    {"export", required_argument, NULL, 'X'},
+    {"export-version", required_argument, NULL, 'v'},
+    {"active-timeout", required_argument, NULL, 'c'},
+    {"latency", required_argument, NULL, 'l'},
+    {"latency-timeout", required_argument, NULL, 'U'},
+    {"sketch", no_argument, NULL, 'K'},
+    {"sketch-memory", required_argument, NULL, 'C'},
+    {"sketch-top", required_argument, NULL, 'O'},
+    {"sketch-interval", required_argument, NULL, 'V'},
+    {"pipeline", no_argument, NULL, 'j'},
+    {"pin", required_argument, NULL, 'y'},
+    {"log-level", required_argument, NULL, 'L'},
+    {"dump-filter", no_argument, NULL, 'd'},
+    {"help", no_argument, NULL, 'h'},
+    {NULL, 0, NULL, 0}
+  };
+  struct filter filter;
+  enum log_level level;
+  struct matcher* matcher;
+  char* interfaces = NULL;
+  char* files = NULL;
+  int dump = 0, bench = 0;
+  int opt;
+
+  while ((opt = getopt_long(argc, argv, "m:e:q:B:b:n:t:f:F:k:x:w:o:W:P:s:R:T:zA:J:Q:u:r:pG:g:ZHN:Y:S:EaM:I:i:D:X:v:c:l:U:KC:O:V:jy:L:dh", options, NULL)) != -1) {
+    switch (opt) {
+      case 'm':
+        if (strcmp(optarg, "raw") == 0)
+          config->mode = CAPTURE_RAW;
+        else if (strcmp(optarg, "ring") == 0)
+          config->mode = CAPTURE_RING;
+        else if (strcmp(optarg, "link") == 0)
+          config->mode = CAPTURE_LINK;
+        else if (strcmp(optarg, "xdp") == 0)
+          config->mode = CAPTURE_XDP;
+        else
+          usage(argv[0]);
+        break;
+      case 'e':
+        config->interface = optarg;
+        interfaces = optarg;
+        break;
+      case OPTION_REORDER_WINDOW:
+        config->merge_window = strtoul(optarg, NULL, 0);
+        break;
+      case 'q':
+        config->queue = strtoul(optarg, NULL, 0);
+        break;
+      case 'B':
+        config->batch_size = strtoul(optarg, NULL, 0);
+        break;
+      case 'b':
+        config->block_size = strtoul(optarg, NULL, 0);
+        break;
+      case 'n':
+        config->block_count = strtoul(optarg, NULL, 0);
+        break;
+      case 't':
+        config->retire_timeout = strtoul(optarg, NULL, 0);
+        break;
+      case 'f':
+        config->filter = optarg;
+        break;
+      case 'F':
+        config->filter_file = optarg;
+        break;
+      case 'k':
+        config->sample = strtoul(optarg, NULL, 0);
+        break;
+      case 'x':
+        config->max_pps = strtoul(optarg, NULL, 0);
+        break;
+      case 'w':
+        config->workers = strtoul(optarg, NULL, 0);
+        break;
+      case 'o':
+        if (strcmp(optarg, "hash") == 0)
+          config->fanout = FANOUT_HASH;
+        else if (strcmp(optarg, "cpu") == 0)
+          config->fanout = FANOUT_CPU;
+        else if (strcmp(optarg, "lb") == 0)
+          config->fanout = FANOUT_LB;
+        else
+          usage(argv[0]);
+        break;
+      case 'W':
+        config->write_prefix = optarg;
+        break;
+      case 'P':
+        if (strcmp(optarg, "pcap") == 0)
+          config->write_format = FORMAT_PCAP;
+        else if (strcmp(optarg, "pcapng") == 0)
+          config->write_format = FORMAT_PCAPNG;
+        else
+          usage(argv[0]);
+        break;
+      case 's':
+        config->snaplen = strtoul(optarg, NULL, 0);
+        break;
+      case 'R':
+        config->rotate_size = strtoull(optarg, NULL, 0);
+        break;
+      case 'T':
+        config->rotate_time = strtoul(optarg, NULL, 0);
+        break;
+      case 'z':
+        config->compress = 1;
+        break;
+      case 'A':
+        config->store_dir = optarg;
+        break;
+      case 'J':
+        config->store_size = strtoull(optarg, NULL, 0);
+        break;
+      case 'Q':
+        config->store_time = strtoul(optarg, NULL, 0);
+        break;
+      case 'u':
+        config->record_memory = strtoull(optarg, NULL, 0);
+        break;
+      case OPTION_RECORD_TIME:
+        config->record_time = strtoul(optarg, NULL, 0);
+        break;
+      case OPTION_RECORD_PREFIX:
+        config->record_prefix = optarg;
+        break;
+      case OPTION_RECORD_TRIGGER:
+        config->record_trigger = optarg;
+        break;
+      case OPTION_PUBLISH:
+        config->publish_name = optarg;
+        break;
+      case OPTION_PUBLISH_SLOTS:
+        config->publish_slots = strtoul(optarg, NULL, 0);
+        break;
+      case OPTION_PUBLISH_SLOT_SIZE:
+        config->publish_slot_size = strtoul(optarg, NULL, 0);
+        break;
+      case 'r':
+        config->read_path = optarg;
+        files = optarg;
+        break;
+      case 'p':
+        config->realtime = 1;
+        break;
+      case 'G':
+        config->reasm_memory = strtoull(optarg, NULL, 0);
+        break;
+      case 'g':
+        config->reasm_timeout = strtoul(optarg, NULL, 0);
+        break;
+      case 'Z':
+        config->verify = 0;
+        break;
+      case 'H':
+        config->histograms = 1;
+        break;
+      case 'N':
+        config->histograms = 1;
+        config->hist_flows = strtoul(optarg, NULL, 0);
+        break;
+      case 'Y':
+        config->histograms = 1;
+        config->hist_interval = strtoul(optarg, NULL, 0);
+        break;
+      case 'S':
+        config->signatures = optarg;
+        break;
+      case 'E':
+        bench = 1;
+        break;
+      case 'a':
+        config->flows = 1;
+        break;
+      case 'M':
+        config->flows = 1;
+        config->flow_memory = strtoull(optarg, NULL, 0);
+        break;
+      case 'I':
+        config->flows = 1;
+        config->flow_timeout = strtoul(optarg, NULL, 0);
+        break;
+      case 'i':
+        config->flows = 1;
+        config->flow_interval = strtoul(optarg, NULL, 0);
+        break;
+      case 'D':
+        config->flows = 1;
+        config->flow_dump = optarg;
+        break;
+      case 'X':
+        config->flows = 1;
+        config->export_collector = optarg;
+        break;
+      case 'v':
+        config->export_version = strtoul(optarg, NULL, 0);
+        break;
+      case 'c':
+        config->active_timeout = strtoul(optarg, NULL, 0);
+        break;
+      case 'l':
+        config->latency_port = strtoul(optarg, NULL, 0);
+        break;
+      case 'U':
+        config->latency_timeout = strtoul(optarg, NULL, 0);
+        break;
+      case 'K':
+        config->sketches = 1;
+        break;
+      case 'C':
+        config->sketch_memory = strtoull(optarg, NULL, 0);
+        break;
+      case 'O':
+        config->sketch_top = strtoul(optarg, NULL, 0);
+        break;
+      case 'V':
+        config->sketch_interval = strtoul(optarg, NULL, 0);
+        break;
+      case 'j':
+        config->pipeline = 1;
+        break;
+      case 'y':
+        config->pipeline = 1;
+        if (parse_cpus(optarg, config->pipeline_cpus) == -1)
+          usage(argv[0]);
+        break;
+      case 'L':
+        if (parse_log_level(optarg, &level) == -1)
+          usage(argv[0]);
+        set_log_level(level);
+        break;
+      case 'd':
+        dump = 1;
+        break;
+      default:
+        usage(argv[0]);
+    }
+  }
+
+  /* Print compiled filter and exit */
+  if (dump) {
+    if ((!config->filter && config->sample <= 1) ||
+        compile_filter(config->filter ? config->filter : "", config->sample, &filter) == -1)
+      exit(EXIT_FAILURE);
+    print_filter(&filter);
+    exit(EXIT_SUCCESS);
+  }
+
+  /* Replay pipeline on capture file instead of socket */
+  if (config->read_path) {
+    config->mode = CAPTURE_FILE;
+    if (config->filter || config->filter_file) {
+      fprintf(stderr, "Filters run in kernel and can not be used with replay\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  /* Several interfaces or files are captured by own inputs and merged */
+  if (parse_inputs(config->mode == CAPTURE_FILE ? files : interfaces, config) == -1) {
+    fprintf(stderr, "At most %d interfaces or files can be merged, names must not be empty\n",
+            MERGE_INPUTS);
+    exit(EXIT_FAILURE);
+  }
+  if (config->input_count > 1 && config->workers > 1) {
+    fprintf(stderr, "Several interfaces can not be used with several workers\n");
+    exit(EXIT_FAILURE);
+  }
+
+  /* XDP program replaces socket filter and serves one queue of one interface */
+  if (config->mode == CAPTURE_XDP) {
+    if (!config->interface) {
+      fprintf(stderr, "XDP mode requires interface\n");
+      exit(EXIT_FAILURE);
+    }
+    if (config->filter || config->filter_file) {
+      fprintf(stderr, "Filters can not be attached to AF_XDP socket\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  /* Benchmark signature matching and exit */
+  if (bench) {
+    if (!config->signatures)
+      usage(argv[0]);
+    matcher = create_matcher(config->signatures);
+    bench_matcher(matcher);
+    free_matcher(matcher);
+    exit(EXIT_SUCCESS);
+  }
+
+  if (config->batch_size == 0 || config->batch_size > UIO_MAXIOV) {
+    fprintf(stderr, "Batch size must be in range 1..%d\n", UIO_MAXIOV);
+    exit(EXIT_FAILURE);
+  }
+
+  /* Pipeline splits one capture socket, workers have sockets of their own */
+  if (config->pipeline && config->workers > 1) {
+    fprintf(stderr, "Pipeline can not be used with several workers\n");
+    exit(EXIT_FAILURE);
+  }
+
+  /* Fanout groups exist only for packet sockets */
+  if (config->workers == 0 || (config->workers > 1 && config->mode != CAPTURE_RING)) {
+    fprintf(stderr, "Workers must be positive, several workers require ring mode\n");
+    exit(EXIT_FAILURE);
+  }
+
+  if (config->snaplen == 0 || config->snaplen > WRITER_SNAPLEN) {
+    fprintf(stderr, "Snaplen must be in range 1..%d\n", WRITER_SNAPLEN);
+    exit(EXIT_FAILURE);
+  }
+
+  /* Records address packet bytes of segment with 32-bit offsets */
+  if (config->store_dir && (config->store_size == 0 || config->store_size > UINT32_MAX)) {
+    fprintf(stderr, "Store segment size must be in range 1..%u\n", UINT32_MAX);
+    exit(EXIT_FAILURE);
+  }
+
+  /* Every worker needs room for a few packets of largest size */
+  if ((config->record_time || config->record_trigger) && !config->record_memory)
+    config->record_memory = RECORDER_MEMORY;
+  if (config->record_memory && config->record_memory / config->workers < 
+      4 * (sizeof(struct recorder_record) + (size_t) config->snaplen)) {
+    fprintf(stderr, "Record memory must be at least %zu bytes per worker\n",
+            4 * (sizeof(struct recorder_record) + (size_t) config->snaplen));
+    exit(EXIT_FAILURE);
+  }
+  if (config->record_trigger && compile_filter(config->record_trigger, 0, &filter) == -1)
+    exit(EXIT_FAILURE);
+
+  /* Readers find slot by masking sequence, slots keep cache line alignment */
+  if (config->publish_name && (config->publish_slots == 0 ||
+      (config->publish_slots & (config->publish_slots - 1)) ||
+      config->publish_slot_size % 64 || config->publish_slot_size < 128)) {
+    fprintf(stderr, "Publish slots must be a power of two and slot size a multiple of 64, at least 128\n");
+    exit(EXIT_FAILURE);
+  }
+
+  /* Every worker needs room for at least a few flows */
+  if (config->flows && (config->flow_interval == 0 ||
+      config->flow_memory / config->workers < 64 * sizeof(struct flow_entry))) {
+    fprintf(stderr, "Flow interval must be positive and flow memory at least %zu bytes per worker\n",
+            64 * sizeof(struct flow_entry));
+    exit(EXIT_FAILURE);
+  }
+
+  if (config->export_collector && (config->active_timeout == 0 ||
+      (config->export_version != EXPORT_IPFIX && config->export_version != EXPORT_NETFLOW9))) {
+    fprintf(stderr, "Active timeout must be positive and export version 9 or 10\n");
+    exit(EXIT_FAILURE);
+  }
+
+  /* Request and its response must reach the same worker */
+  if (config->latency_port && (config->latency_port > 65535 || config->latency_timeout == 0 ||
+      (config->workers > 1 && config->fanout != FANOUT_HASH))) {
+    fprintf(stderr, "Latency port must be in range 1..65535, timeout positive and fanout hash\n");
+    exit(EXIT_FAILURE);
+  }
+
+  if (config->sketches && (config->sketch_top == 0 || config->sketch_interval == 0)) {
+    fprintf(stderr, "Sketch top and interval must be positive\n");
+    exit(EXIT_FAILURE);
+  }
+
+  /* Kernel requires page aligned blocks that fit at least one frame */
+  if (config->block_size < RING_FRAME_SIZE || 
+      config->block_size % getpagesize() != 0 ||
+      config->block_count == 0) {
+    fprintf(stderr, "Block size must be a multiple of page size and block count positive\n");
+    exit(EXIT_FAILURE);
+  }
+}
+
+/*
+ * parse_cpus - used to parse comma separated CPUs of
+ * pipeline stages. Empty entry leaves stage unpinned.
+ * @list - list to parse, e.g. "0,2,4" or ",3"
+ * @cpus - array of PIPELINE_STAGES CPUs, -1 for any
+ *
+ * Return: 0 if successful, -1 otherwise
+ */
+int parse_cpus(const char* list, int* cpus) {
+  unsigned long cpu;
+  unsigned int i;
+  char* end;
+
+  for (i = 0; i < PIPELINE_STAGES; i++) {
+    if (*list == ',' || *list == '\0') {
+      cpus[i] = -1;
+    }
+    else {
+      cpu = strtoul(list, &end, 10);
+      if (end == list || cpu >= (unsigned long) sysconf(_SC_NPROCESSORS_CONF))
+        return -1;
+      cpus[i] = cpu;
+      list = end;
+    }
+
+    if (*list == '\0')
+      return 0;
+    if (*list++ != ',')
+      return -1;
+  }
+
+  return -1;
+}
+
+/*
+ * parse_inputs - used to split comma separated interfaces
+ * or capture files to merge. List is split in place, single
+ * name is left to interface or read path.
+ * @list - list to parse, e.g. "eth0,eth1", NULL for none
+ * @config - pointer to an object of sniffer_config struct
+ *
+ * Return: 0 if successful, -1 otherwise
+ */
+int parse_inputs(char* list, struct sniffer_config* config) {
+  char* next;
+
+  if (!list || !strchr(list, ','))
+    return 0;
+
+  while (list) {
+    next = strchr(list, ',');
+    if (next)
+      *next++ = '\0';
+    if (*list == '\0' || config->input_count == MERGE_INPUTS)
+      return -1;
+    config->inputs[config->input_count++] = list;
+    list = next;
+  }
+
+  return 0;
+}
+
+/*
+ * usage - used to print help message and exit.
+ * @name - name of the executable
+ */
+void usage(const char* name) {
+  fprintf(stderr, 
+          "Usage: %s [options]\n"
+          "  -m, --mode=MODE            raw, ring, link or xdp (default raw)\n"
+          "  -e, --interface=NAME       capture only on interface NAME, NAME,NAME,... merges them\n"
+          "      --reorder-window=MS    merged packet waits MS for idle interfaces (default %d)\n"
+          "  -q, --queue=N              queue of interface read in xdp mode (default 0)\n"
+          "  -B, --batch-size=N         datagrams per recvmmsg call (default %d)\n"
+          "  -b, --block-size=BYTES     ring block size (default %d)\n"
+          "  -n, --block-count=N        ring block count (default %d)\n"
+          "  -t, --retire-timeout=MS    ring block retire timeout (default %d)\n"
+          "  -f, --filter=EXPR          kernel filter, e.g. \"udp dst port 8080\"\n"
+          "  -F, --filter-file=PATH     read filter from file, re-read on SIGHUP\n"
+          "  -k, --sample=N             keep 1 of every N flows by hash of 5-tuple\n"
+          "  -x, --max-pps=N            pass at most N packets per second to pipeline\n"
+          "  -w, --workers=N            capture threads in fanout group (default %d)\n"
+          "  -o, --fanout=hash|cpu|lb   how packets are spread between workers\n"
+          "  -W, --write=PREFIX         write packets to PREFIX-<worker>-<n>.pcap[ng]\n"
+          "  -P, --format=pcap|pcapng   capture file format (default pcap)\n"
+          "  -s, --snaplen=BYTES        bytes stored per packet (default %d)\n"
+          "  -R, --rotate-size=BYTES    start new file after BYTES\n"
+          "  -T, --rotate-time=SECONDS  start new file after SECONDS\n"
+          "  -z, --compress             gzip closed capture files\n"
+          "  -A, --store=DIR            keep packets in indexed segments in DIR, see query\n"
+          "  -J, --store-size=BYTES     seal segment after BYTES of packets (default %d)\n"
+          "  -Q, --store-time=SECONDS   seal segment after SECONDS, 0 to disable (default %d)\n"
+          "  -u, --record=BYTES         keep last BYTES of packets, written on SIGUSR1\n"
+          "      --record-time=SECONDS  keep only last SECONDS of packets\n"
+          "      --record-prefix=PREFIX write snapshots to PREFIX-<worker>-<time>-<n>.pcap\n"
+          "      --record-trigger=EXPR  write snapshot when packet matches EXPR\n"
+          "      --publish=NAME         publish packets to shared-memory ring NAME-<worker>\n"
+          "      --publish-slots=N      slots of every ring, power of two (default %d)\n"
+          "      --publish-slot-size=BYTES size of slot, packets are cut to fit (default %d)\n"
+          "                             2048 keeps full packets at higher capture cost\n"
+          "  -r, --read=PATH            replay pcap or pcapng file, PATH,PATH,... merges them\n"
+          "  -p, --realtime             replay at original timestamps, not at full speed\n"
+          "  -G, --reasm-memory=BYTES   memory of fragment reassembly, 0 to disable (default %d)\n"
+          "  -g, --reasm-timeout=SECONDS drop incomplete datagrams after SECONDS (default %d)\n"
+          "  -Z, --no-verify            accept packets with bad IP or UDP checksum,\n"
+          "                             replay checks IP header only, bad packets are\n"
+          "                             counted only in flows -a already tracks\n"
+          "  -H, --histograms           keep gap histograms, logged on SIGUSR2\n"
+          "  -N, --hist-flows=N         flows with own histogram, needs --flows (default %d)\n"
+          "  -Y, --hist-interval=SECONDS log histograms every SECONDS\n"
+          "  -S, --signatures=PATH      report payloads containing signatures of file\n"
+          "  -E, --bench-match          benchmark signature matching and exit\n"
+          "  -a, --flows                aggregate flows instead of printing payloads\n"
+          "  -M, --flow-memory=BYTES    memory of flow tables (default %d)\n"
+          "  -I, --flow-timeout=SECONDS evict flows idle for SECONDS (default %d)\n"
+          "  -i, --flow-interval=SECONDS write flow snapshot every SECONDS (default %d)\n"
+          "  -D, --flow-dump=PREFIX     write flow snapshots to PREFIX-<worker>\n"
+          "                             off capture thread, copy doubles flow memory\n"
+          "  -X, --export=HOST:PORT     send flow records to collector, implies -a\n"
+          "  -v, --export-version=N     9 for NetFlow v9, 10 for IPFIX (default %d)\n"
+          "  -c, --active-timeout=SEC   export flows active for SEC seconds (default %d)\n"
+          "  -l, --latency=PORT         measure response time of servers on PORT\n"
+          "  -U, --latency-timeout=SEC  request unanswered after SEC seconds (default %d)\n"
+          "  -K, --sketch               report top talkers and distinct addresses\n"
+          "  -C, --sketch-memory=BYTES  memory of sketches (default %d)\n"
+          "  -O, --sketch-top=N         top talkers reported (default %d)\n"
+          "  -V, --sketch-interval=SEC  report and reset sketches every SEC seconds (default %d)\n"
+          "  -j, --pipeline             capture, parse and output on own threads\n"
+          "  -y, --pin=CPU,CPU,CPU      pin capture, parse and output stage, implies -j\n"
+          "  -L, --log-level=LEVEL      debug, info, warn or error (default info)\n"
+          "  -d, --dump-filter          print compiled filter and exit\n",
+          name, MERGE_WINDOW, BATCH_SIZE, RING_BLOCK_SIZE, RING_BLOCK_COUNT, RING_RETIRE_TIMEOUT, FANOUT_WORKERS, 
+          WRITER_SNAPLEN, STORE_SEGMENT_SIZE, STORE_SEGMENT_TIME, SHM_RING_SLOTS, SHM_RING_SLOT_SIZE, REASM_MEMORY, REASM_TIMEOUT, HIST_FLOWS, FLOW_MEMORY, FLOW_TIMEOUT, FLOW_INTERVAL,
+          EXPORT_IPFIX, EXPORT_ACTIVE_TIMEOUT,
+          LATENCY_TIMEOUT, SKETCH_MEMORY, SKETCH_TOP, SKETCH_INTERVAL);
+  exit(EXIT_FAILURE);
+}
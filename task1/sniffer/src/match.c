@@ -0,0 +1,559 @@
+#define _GNU_SOURCE
+#include "../headers/match.h"
+#include "../../common/headers/common.h"
+#include <time.h>
+#include <ctype.h>
+#include <immintrin.h>
+
+#define BENCH_SIZE (4 << 20)
+#define BENCH_PAYLOAD 1024
+#define BENCH_ROUNDS 8
+
+/*
+ * decode_pattern - used to decode signature line. Bytes
+ * are taken as is except \xHH and \\ escapes.
+ * @line - signature as written in file
+ * @pattern - buffer for decoded bytes
+ *
+ * Return: amount of decoded bytes, -1 if line is invalid
+ */
+static int decode_pattern(const char* line, uint8_t* pattern) {
+  char hex[3] = {0};
+  int length = 0;
+
+  while (*line) {
+    if (length == MATCH_MAX_PATTERN)
+      return -1;
+
+    if (line[0] == '\\' && line[1] == 'x') {
+      if (!isxdigit((unsigned char) line[2]) || !isxdigit((unsigned char) line[3]))
+        return -1;
+      hex[0] = line[2];
+      hex[1] = line[3];
+      pattern[length++] = strtoul(hex, NULL, 16);
+      line += 4;
+      continue;
+    }
+    if (line[0] == '\\' && line[1] == '\\')
+      line++;
+    pattern[length++] = *line++;
+  }
+
+  return length;
+}
+
+/*
+ * read_signatures - used to read signatures from file,
+ * one per line. Empty lines and lines starting with # are
+ * skipped. Exits on invalid signature.
+ * @matcher - pointer to an object of matcher struct
+ * @path - path to signature file
+ */
+static void read_signatures(struct matcher* matcher, const char* path) {
+  uint8_t pattern[MATCH_MAX_PATTERN];
+  unsigned int capacity = 0, number = 0;
+  char* line = NULL;
+  size_t size = 0;
+  ssize_t read;
+  int length;
+  FILE* file;
+
+  file = fopen(path, "r");
+  if (!file)
+    print_error(path);
+
+  while ((read = getline(&line, &size, file)) != -1) {
+    number++;
+    while (read > 0 && (line[read - 1] == '\n' || line[read - 1] == '\r'))
+      line[--read] = '\0';
+    if (read == 0 || line[0] == '#')
+      continue;
+
+    length = decode_pattern(line, pattern);
+    if (length <= 0) {
+      fprintf(stderr, "%s:%u: invalid signature\n", path, number);
+      exit(EXIT_FAILURE);
+    }
+
+    if (matcher->count == capacity) {
+      capacity = capacity ? capacity * 2 : 64;
+      matcher->names = (char**) realloc(matcher->names, capacity * sizeof(char*));
+      matcher->patterns = (uint8_t**) realloc(matcher->patterns, capacity * sizeof(uint8_t*));
+      matcher->lengths = (size_t*) realloc(matcher->lengths, capacity * sizeof(size_t));
+      if (!matcher->names || !matcher->patterns || !matcher->lengths)
+        print_error("realloc");
+    }
+
+    matcher->names[matcher->count] = strdup(line);
+    matcher->patterns[matcher->count] = (uint8_t*) malloc(length);
+    if (!matcher->names[matcher->count] || !matcher->patterns[matcher->count])
+      print_error("malloc");
+    memcpy(matcher->patterns[matcher->count], pattern, length);
+    matcher->lengths[matcher->count] = length;
+    matcher->count++;
+  }
+
+  free(line);
+  fclose(file);
+
+  if (matcher->count == 0) {
+    fprintf(stderr, "%s: no signatures\n", path);
+    exit(EXIT_FAILURE);
+  }
+}
+
+/*
+ * build_trie - used to assign byte classes and insert
+ * every signature into trie of transition table. While
+ * automaton is built, entries hold state numbers and -1
+ * for missing transitions.
+ * @matcher - pointer to an object of matcher struct
+ */
+static void build_trie(struct matcher* matcher) {
+  size_t states = 1, i, j;
+  unsigned int c;
+  int32_t* row;
+  int32_t state;
+
+  /* Every byte used by signatures gets own class */
+  matcher->class_count = 1;
+  for (i = 0; i < matcher->count; i++) {
+    states += matcher->lengths[i];
+    for (j = 0; j < matcher->lengths[i]; j++) {
+      c = matcher->patterns[i][j];
+      if (!matcher->classes[c])
+        matcher->classes[c] = matcher->class_count++;
+    }
+  }
+
+  matcher->next = (uint32_t*) malloc(states * matcher->class_count * sizeof(uint32_t));
+  matcher->match = (int32_t*) malloc(states * sizeof(int32_t));
+  matcher->output = (int32_t*) malloc(states * sizeof(int32_t));
+  matcher->same = (int32_t*) malloc(matcher->count * sizeof(int32_t));
+  if (!matcher->next || !matcher->match || !matcher->output || !matcher->same)
+    print_error("malloc");
+  memset(matcher->next, 0xFF, states * matcher->class_count * sizeof(uint32_t));
+  memset(matcher->match, 0xFF, states * sizeof(int32_t));
+
+  matcher->state_count = 1;
+  for (i = 0; i < matcher->count; i++) {
+    state = 0;
+    for (j = 0; j < matcher->lengths[i]; j++) {
+      row = (int32_t*) matcher->next + (size_t) state * matcher->class_count;
+      c = matcher->classes[matcher->patterns[i][j]];
+      if (row[c] == -1)
+        row[c] = matcher->state_count++;
+      state = row[c];
+    }
+
+    /* Duplicates are chained to the first signature */
+    matcher->same[i] = matcher->match[state];
+    matcher->match[state] = i;
+
+    c = matcher->patterns[i][0];
+    if (!matcher->start[c]) {
+      matcher->start[c] = 1;
+      matcher->start_count++;
+      if (c < 0x80)
+        matcher->mask_low[c & 0x0F] |= 1 << (c >> 4);
+      else
+        matcher->mask_high[c & 0x0F] |= 1 << ((c >> 4) & 0x07);
+    }
+  }
+
+  /* Shared prefixes leave part of rows unused */
+  row = (int32_t*) realloc(matcher->next, 
+                           (size_t) matcher->state_count * matcher->class_count * sizeof(uint32_t));
+  if (row)
+    matcher->next = (uint32_t*) row;
+}
+
+/*
+ * build_automaton - used to turn trie into deterministic
+ * automaton. States are visited in breadth-first order, so
+ * failure state of every state is complete before its use.
+ * @matcher - pointer to an object of matcher struct
+ */
+static void build_automaton(struct matcher* matcher) {
+  unsigned int classes = matcher->class_count;
+  int32_t* table = (int32_t*) matcher->next;
+  int32_t* fail;
+  int32_t* queue;
+  int32_t* row;
+  int32_t* fail_row;
+  size_t head = 0, tail = 0;
+  unsigned int c;
+  int32_t state, child;
+
+  fail = (int32_t*) calloc(matcher->state_count, sizeof(int32_t));
+  queue = (int32_t*) malloc(matcher->state_count * sizeof(int32_t));
+  if (!fail || !queue)
+    print_error("malloc");
+
+  /* Missing transitions of root loop back to root */
+  matcher->output[0] = -1;
+  for (c = 0; c < classes; c++) {
+    child = table[c];
+    if (child == -1) {
+      table[c] = 0;
+      continue;
+    }
+    fail[child] = 0;
+    queue[tail++] = child;
+  }
+
+  while (head < tail) {
+    state = queue[head++];
+    row = table + (size_t) state * classes;
+    fail_row = table + (size_t) fail[state] * classes;
+
+    matcher->output[state] = matcher->match[fail[state]] != -1 ? 
+                             fail[state] : matcher->output[fail[state]];
+
+    for (c = 0; c < classes; c++) {
+      child = row[c];
+      if (child == -1) {
+        row[c] = fail_row[c];
+        continue;
+      }
+      fail[child] = fail_row[c];
+      queue[tail++] = child;
+    }
+  }
+
+  /* Rows are addressed by offset, targets that end signatures are flagged */
+  for (head = 0; head < (size_t) matcher->state_count * classes; head++) {
+    state = table[head];
+    matcher->next[head] = (uint32_t) state * classes | 
+      (matcher->match[state] != -1 || matcher->output[state] != -1 ? MATCH_FLAG : 0);
+  }
+
+  free(fail);
+  free(queue);
+}
+
+/*
+ * skip_scalar - used to find next start byte one
+ * byte at a time.
+ * @matcher - pointer to an object of matcher struct
+ * @data - scanned bytes
+ * @position - offset to start from
+ * @length - amount of bytes
+ *
+ * Return: offset of next start byte, length if there is none
+ */
+static size_t skip_scalar(const struct matcher* matcher, const uint8_t* data, 
+                          size_t position, size_t length) {
+  while (position < length && !matcher->start[data[position]])
+    position++;
+  return position;
+}
+
+/*
+ * skip_ssse3 - used to find next start byte 16 bytes at
+ * a time. Low nibble of every byte selects bit mask of start
+ * bytes with that nibble, high nibble selects bit in mask.
+ * Bytes with top bit set use second table, shuffle zeroes
+ * lanes with top bit, so tables never mix.
+ * @matcher - pointer to an object of matcher struct
+ * @data - scanned bytes
+ * @position - offset to start from
+ * @length - amount of bytes
+ *
+ * Return: offset of next start byte, length if there is none
+ */
+__attribute__((target("ssse3")))
+static size_t skip_ssse3(const struct matcher* matcher, const uint8_t* data, 
+                         size_t position, size_t length) {
+  const __m128i low = _mm_loadu_si128((const __m128i*) matcher->mask_low);
+  const __m128i high = _mm_loadu_si128((const __m128i*) matcher->mask_high);
+  const __m128i bits = _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 
+                                     1, 2, 4, 8, 16, 32, 64, -128);
+  const __m128i nibble = _mm_set1_epi8(0x0F);
+  const __m128i top = _mm_set1_epi8(-128);
+  __m128i bytes, masks, bit;
+  unsigned int found;
+
+  while (position + 16 <= length) {
+    bytes = _mm_loadu_si128((const __m128i*) (data + position));
+    masks = _mm_or_si128(_mm_shuffle_epi8(low, bytes),
+                         _mm_shuffle_epi8(high, _mm_xor_si128(bytes, top)));
+    bit = _mm_shuffle_epi8(bits, _mm_and_si128(_mm_srli_epi16(bytes, 4), nibble));
+    found = ~_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(masks, bit), 
+                                              _mm_setzero_si128())) & 0xFFFF;
+    if (found)
+      return position + __builtin_ctz(found);
+    position += 16;
+  }
+
+  return skip_scalar(matcher, data, position, length);
+}
+
+/*
+ * skip_avx2 - used to find next start byte 32 bytes at
+ * a time. Same as skip_ssse3 on both 128-bit lanes.
+ * @matcher - pointer to an object of matcher struct
+ * @data - scanned bytes
+ * @position - offset to start from
+ * @length - amount of bytes
+ *
+ * Return: offset of next start byte, length if there is none
+ */
+__attribute__((target("avx2")))
+static size_t skip_avx2(const struct matcher* matcher, const uint8_t* data, 
+                        size_t position, size_t length) {
+  const __m256i low = _mm256_broadcastsi128_si256(
+                        _mm_loadu_si128((const __m128i*) matcher->mask_low));
+  const __m256i high = _mm256_broadcastsi128_si256(
+                         _mm_loadu_si128((const __m128i*) matcher->mask_high));
+  const __m256i bits = _mm256_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 
+                                        1, 2, 4, 8, 16, 32, 64, -128,
+                                        1, 2, 4, 8, 16, 32, 64, -128, 
+                                        1, 2, 4, 8, 16, 32, 64, -128);
+  const __m256i nibble = _mm256_set1_epi8(0x0F);
+  const __m256i top = _mm256_set1_epi8(-128);
+  __m256i bytes, masks, bit;
+  unsigned int found;
+
+  while (position + 32 <= length) {
+    bytes = _mm256_loadu_si256((const __m256i*) (data + position));
+    masks = _mm256_or_si256(_mm256_shuffle_epi8(low, bytes),
+                            _mm256_shuffle_epi8(high, _mm256_xor_si256(bytes, top)));
+    bit = _mm256_shuffle_epi8(bits, _mm256_and_si256(_mm256_srli_epi16(bytes, 4), nibble));
+    found = ~(unsigned int) _mm256_movemask_epi8(
+              _mm256_cmpeq_epi8(_mm256_and_si256(masks, bit), _mm256_setzero_si256()));
+    if (found)
+      return position + __builtin_ctz(found);
+    position += 32;
+  }
+
+  /* Tail stays scalar, legacy SSE code after AVX stalls */
+  return skip_scalar(matcher, data, position, length);
+}
+
+/*
+ * set_matcher_isa - used to select prefilter implementation.
+ * Prefilter is disabled when so many bytes start signatures
+ * that automaton rarely stays in root state.
+ * @matcher - pointer to an object of matcher struct
+ * @isa - instruction set of prefilter
+ */
+void set_matcher_isa(struct matcher* matcher, enum match_isa isa) {
+  matcher->isa = isa;
+
+  if (matcher->start_count > MATCH_SKIP_LIMIT)
+    matcher->skip = NULL;
+  else if (isa == MATCH_AVX2)
+    matcher->skip = skip_avx2;
+  else if (isa == MATCH_SSSE3)
+    matcher->skip = skip_ssse3;
+  else
+    matcher->skip = skip_scalar;
+}
+
+/*
+ * create_matcher - used to compile signatures of file
+ * into automaton and select widest prefilter the CPU runs.
+ * @path - path to signature file
+ *
+ * Return: pointer to an object of matcher struct
+ */
+struct matcher* create_matcher(const char* path) {
+  struct matcher* matcher = (struct matcher*) calloc(1, sizeof(struct matcher));
+  if (!matcher)
+    print_error("calloc");
+
+  read_signatures(matcher, path);
+  build_trie(matcher);
+  build_automaton(matcher);
+
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+    set_matcher_isa(matcher, MATCH_AVX2);
+  else if (__builtin_cpu_supports("ssse3"))
+    set_matcher_isa(matcher, MATCH_SSSE3);
+  else
+    set_matcher_isa(matcher, MATCH_SCALAR);
+
+  return matcher;
+}
+
+/*
+ * scan_payload - used to find all signatures in payload.
+ * Every occurrence is reported, including overlapping ones.
+ * @matcher - pointer to an object of matcher struct
+ * @data - payload bytes
+ * @length - amount of bytes
+ * @callback - called for every occurrence
+ * @arg - passed to callback
+ */
+void scan_payload(const struct matcher* matcher, const uint8_t* data, size_t length,
+                  match_callback callback, void* arg) {
+  const uint32_t* next = matcher->next;
+  const uint8_t* classes = matcher->classes;
+  uint32_t offset = 0;
+  int32_t state, pattern;
+  size_t i = 0;
+
+  while (i < length) {
+    /* Only start bytes leave root state */
+    if (offset == 0 && matcher->skip) {
+      i = matcher->skip(matcher, data, i, length);
+      if (i == length)
+        break;
+    }
+
+    offset = next[offset + classes[data[i]]];
+
+    /* Slow path only for states that end signatures */
+    if (offset & MATCH_FLAG) {
+      offset &= ~MATCH_FLAG;
+      state = offset / matcher->class_count;
+      if (matcher->match[state] == -1)
+        state = matcher->output[state];
+      for (; state != -1; state = matcher->output[state])
+        for (pattern = matcher->match[state]; pattern != -1; pattern = matcher->same[pattern])
+          callback(matcher, pattern, i + 1, arg);
+    }
+    i++;
+  }
+}
+
+/*
+ * Used to count signatures found in benchmark payloads,
+ * every signature once per payload.
+ */
+struct bench_count {
+  /* Payload signature was last counted in, per signature */
+  uint64_t* seen;
+
+  /* Index of current payload plus one */
+  uint64_t payload;
+
+  /* Amount of counted signatures */
+  uint64_t matches;
+};
+
+/*
+ * count_match - used as benchmark callback.
+ * @matcher - pointer to an object of matcher struct
+ * @pattern - index of found signature
+ * @end - offset after signature
+ * @arg - pointer to an object of bench_count struct
+ */
+static void count_match(const struct matcher* matcher, unsigned int pattern, 
+                        size_t end, void* arg) {
+  struct bench_count* count = (struct bench_count*) arg;
+
+  (void) matcher;
+  (void) end;
+  if (count->seen[pattern] != count->payload) {
+    count->seen[pattern] = count->payload;
+    count->matches++;
+  }
+}
+
+/*
+ * elapsed_since - used to measure benchmark round.
+ * @start - time round started
+ *
+ * Return: seconds since start
+ */
+static double elapsed_since(const struct timespec* start) {
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/*
+ * bench_matcher - used to compare automaton with every
+ * prefilter the CPU runs against naive scan with one memmem
+ * per signature. Payloads are generated text with a
+ * signature planted into every 16th payload.
+ * @matcher - pointer to an object of matcher struct
+ */
+void bench_matcher(struct matcher* matcher) {
+  static const char* isa_names[] = {"scalar", "ssse3", "avx2"};
+  enum match_isa best = matcher->isa;
+  struct bench_count count;
+  struct timespec start;
+  uint8_t* data;
+  unsigned int pattern, isa, round;
+  size_t offset, i;
+  uint64_t naive = 0;
+  double seconds;
+
+  data = (uint8_t*) malloc(BENCH_SIZE);
+  count.seen = (uint64_t*) calloc(matcher->count, sizeof(uint64_t));
+  if (!data || !count.seen)
+    print_error("malloc");
+
+  srand(1);
+  for (i = 0; i < BENCH_SIZE; i++)
+    data[i] = rand() % 8 == 0 ? ' ' : 'a' + rand() % 26;
+  for (offset = 0; offset + BENCH_PAYLOAD <= BENCH_SIZE; offset += 16 * BENCH_PAYLOAD) {
+    pattern = rand() % matcher->count;
+    if (matcher->lengths[pattern] <= BENCH_PAYLOAD)
+      memcpy(data + offset + rand() % (BENCH_PAYLOAD - matcher->lengths[pattern] + 1),
+             matcher->patterns[pattern], matcher->lengths[pattern]);
+  }
+
+  printf("Signatures: %u, states: %u, byte classes: %u, start bytes: %u%s\n",
+         matcher->count, matcher->state_count, matcher->class_count, matcher->start_count,
+         matcher->start_count > MATCH_SKIP_LIMIT ? " (prefilter disabled)" : "");
+
+  /* Naive scan, one pass per signature */
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (offset = 0; offset + BENCH_PAYLOAD <= BENCH_SIZE; offset += BENCH_PAYLOAD)
+    for (pattern = 0; pattern < matcher->count; pattern++)
+      if (memmem(data + offset, BENCH_PAYLOAD, matcher->patterns[pattern], matcher->lengths[pattern]))
+        naive++;
+  seconds = elapsed_since(&start);
+  printf("%-8s %10.1f MB/s %10lu matches\n", "naive", BENCH_SIZE / seconds / 1e6, 
+         (unsigned long) naive);
+
+  for (isa = MATCH_SCALAR; isa <= best; isa++) {
+    set_matcher_isa(matcher, (enum match_isa) isa);
+    memset(count.seen, 0, matcher->count * sizeof(uint64_t));
+    count.payload = 0;
+    count.matches = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (round = 0; round < BENCH_ROUNDS; round++)
+      for (offset = 0; offset + BENCH_PAYLOAD <= BENCH_SIZE; offset += BENCH_PAYLOAD) {
+        count.payload++;
+        scan_payload(matcher, data + offset, BENCH_PAYLOAD, count_match, &count);
+      }
+    seconds = elapsed_since(&start);
+
+    printf("%-8s %10.1f MB/s %10lu matches\n", isa_names[isa],
+           (double) BENCH_SIZE * BENCH_ROUNDS / seconds / 1e6, 
+           (unsigned long) (count.matches / BENCH_ROUNDS));
+  }
+
+  set_matcher_isa(matcher, best);
+  free(count.seen);
+  free(data);
+}
+
+/*
+ * free_matcher - used to free automaton and signatures.
+ * @matcher - pointer to an object of matcher struct
+ */
+void free_matcher(struct matcher* matcher) {
+  unsigned int i;
+
+  for (i = 0; i < matcher->count; i++) {
+    free(matcher->names[i]);
+    free(matcher->patterns[i]);
+  }
+  free(matcher->names);
+  free(matcher->patterns);
+  free(matcher->lengths);
+  free(matcher->next);
+  free(matcher->match);
+  free(matcher->output);
+  free(matcher->same);
+  free(matcher);
+}
@@ -0,0 +1,444 @@
+#include "../headers/sniffer.h"
+
+/*
+ * record_size - used to get pool space taken by packet.
+ * @length - amount of packet bytes
+ *
+ * Return: size of metadata and packet rounded up to alignment
+ */
+static inline uint64_t record_size(size_t length) {
+  return (sizeof(struct packet_meta) + length + MERGE_ALIGNMENT - 1) &
+         ~(uint64_t) (MERGE_ALIGNMENT - 1);
+}
+
+/*
+ * wall_clock - used to get time live packets are aged against.
+ *
+ * Return: current time in ns
+ */
+static uint64_t wall_clock(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/*
+ * head_packet - used by merge thread to get metadata of
+ * oldest packet of queue.
+ * @queue - pointer to an object of merge_queue struct
+ *
+ * Return: pointer to metadata of packet, NULL if queue is empty
+ */
+static const struct packet_meta* head_packet(const struct merge_queue* queue) {
+  if (__atomic_load_n(&queue->head, __ATOMIC_ACQUIRE) == queue->tail)
+    return NULL;
+  return (const struct packet_meta*) (queue->pool +
+                                      queue->slots[queue->tail & (MERGE_SLOTS - 1)].offset);
+}
+
+/*
+ * heap_less - used to order queues in heap by time of
+ * their head packet, ties by index of input.
+ * @merge - pointer to an object of merge struct
+ * @a - index of first input
+ * @b - index of second input
+ *
+ * Return: non-zero if head of a goes first
+ */
+static inline int heap_less(const struct merge* merge, unsigned int a, unsigned int b) {
+  if (merge->queues[a].key != merge->queues[b].key)
+    return merge->queues[a].key < merge->queues[b].key;
+  return a < b;
+}
+
+/*
+ * sift_up - used to move entry of heap towards root
+ * until its parent goes first.
+ * @merge - pointer to an object of merge struct
+ * @position - position of entry in heap
+ */
+static void sift_up(struct merge* merge, unsigned int position) {
+  unsigned int entry = merge->heap[position], parent;
+
+  while (position > 0) {
+    parent = (position - 1) / 2;
+    if (!heap_less(merge, entry, merge->heap[parent]))
+      break;
+    merge->heap[position] = merge->heap[parent];
+    position = parent;
+  }
+  merge->heap[position] = entry;
+}
+
+/*
+ * sift_down - used to move entry of heap towards leaves
+ * until both children go after it.
+ * @merge - pointer to an object of merge struct
+ * @position - position of entry in heap
+ */
+static void sift_down(struct merge* merge, unsigned int position) {
+  unsigned int entry = merge->heap[position], child;
+
+  while ((child = 2 * position + 1) < merge->heap_size) {
+    if (child + 1 < merge->heap_size && heap_less(merge, merge->heap[child + 1], merge->heap[child]))
+      child++;
+    if (!heap_less(merge, merge->heap[child], entry))
+      break;
+    merge->heap[position] = merge->heap[child];
+    position = child;
+  }
+  merge->heap[position] = entry;
+}
+
+/*
+ * poll_inputs - used by merge thread to put queues that got
+ * packets since they ran empty back into heap. Queue of input
+ * whose capture thread finished is retired once it is drained.
+ * Costs O(k), so it is done once per batch, not per packet.
+ * @merge - pointer to an object of merge struct
+ */
+static void poll_inputs(struct merge* merge) {
+  const struct packet_meta* meta;
+  struct merge_queue* queue;
+  unsigned int i;
+  int done;
+
+  for (i = 0; i < merge->count; i++) {
+    queue = &merge->queues[i];
+    if (queue->heaped || queue->finished)
+      continue;
+
+    /* Done is read first, so packets queued before it are seen */
+    done = __atomic_load_n(&queue->done, __ATOMIC_ACQUIRE);
+    meta = head_packet(queue);
+    if (meta) {
+      queue->key = (uint64_t) meta->ts.tv_sec * 1000000000ull + meta->ts.tv_nsec;
+      queue->heaped = 1;
+      merge->heap[merge->heap_size++] = i;
+      sift_up(merge, merge->heap_size - 1);
+    }
+    else if (done) {
+      queue->finished = 1;
+      merge->active--;
+    }
+  }
+}
+
+/*
+ * release_packet - used by merge thread to pass head packet
+ * of queue at root of heap on to sniffer and release its
+ * pool space. Queue stays in heap keyed by its next packet,
+ * or leaves heap when it runs empty. Costs O(log k).
+ * @merge - pointer to an object of merge struct
+ */
+static void release_packet(struct merge* merge) {
+  struct merge_queue* queue = &merge->queues[merge->heap[0]];
+  const struct merge_packet* packet = &queue->slots[queue->tail & (MERGE_SLOTS - 1)];
+  const struct packet_meta* meta = (const struct packet_meta*) (queue->pool + packet->offset);
+
+  /* Input was idle for longer than window, or its stamps went back */
+  if (queue->key < merge->last)
+    merge->late++;
+  else
+    merge->last = queue->key;
+
+  process_packet(merge->sniffer, (const char*) (meta + 1), packet->length, meta);
+  merge->packets++;
+  queue->packets++;
+
+  __atomic_store_n(&queue->released, packet->end, __ATOMIC_RELEASE);
+  __atomic_store_n(&queue->tail, queue->tail + 1, __ATOMIC_RELEASE);
+
+  meta = head_packet(queue);
+  if (meta) {
+    queue->key = (uint64_t) meta->ts.tv_sec * 1000000000ull + meta->ts.tv_nsec;
+  }
+  else {
+    queue->heaped = 0;
+    merge->heap[0] = merge->heap[--merge->heap_size];
+  }
+  if (merge->heap_size)
+    sift_down(merge, 0);
+}
+
+/*
+ * input_config - used to build configuration of input
+ * sniffer. Input only captures and queues packets, so
+ * everything that consumes them is left to merge sniffer.
+ * Kernel filter and flow sampling stay on every socket.
+ * @config - configuration of merge sniffer
+ * @name - interface or capture file of input
+ * @input - filled with configuration of input
+ */
+static void input_config(const struct sniffer_config* config, const char* name,
+                         struct sniffer_config* input) {
+  *input = *config;
+  input->input_count = 0;
+  if (config->mode == CAPTURE_FILE)
+    input->read_path = name;
+  else
+    input->interface = name;
+
+  input->max_pps = 0;
+  input->verify = 0;
+  input->write_prefix = NULL;
+  input->store_dir = NULL;
+  input->record_memory = 0;
+  input->publish_name = NULL;
+  input->reasm_memory = 0;
+  input->histograms = 0;
+  input->signatures = NULL;
+  input->flows = 0;
+  input->export_collector = NULL;
+  input->latency_port = 0;
+  input->sketches = 0;
+  input->pipeline = 0;
+}
+
+/*
+ * create_merge - used to create one input sniffer with own
+ * socket and queue per interface, or per file in replay mode.
+ * Merge sniffer itself has no socket, it consumes queues.
+ * @sniffer - pointer to merge sniffer
+ */
+void create_merge(struct sniffer* sniffer) {
+  struct sniffer_config config;
+  struct merge* merge;
+  unsigned int i;
+
+  merge = (struct merge*) calloc(1, sizeof(struct merge));
+  if (!merge)
+    print_error("calloc");
+
+  merge->sniffer = sniffer;
+  merge->count = sniffer->config.input_count;
+  merge->active = merge->count;
+  merge->window = sniffer->config.mode == CAPTURE_FILE ? UINT64_MAX :
+                  (uint64_t) sniffer->config.merge_window * 1000000ull;
+
+  /* Ring hands packets over only when their block is retired, so they come that late */
+  if (sniffer->config.mode == CAPTURE_RING)
+    merge->window += (uint64_t) sniffer->config.retire_timeout * 1000000ull;
+
+  /* Indexes of both sides sit on own cache lines */
+  if (posix_memalign((void**) &merge->queues, MERGE_ALIGNMENT,
+                     merge->count * sizeof(struct merge_queue)) != 0)
+    print_error("posix_memalign");
+  memset(merge->queues, 0, merge->count * sizeof(struct merge_queue));
+
+  merge->inputs = (struct sniffer*) calloc(merge->count, sizeof(struct sniffer));
+  if (!merge->inputs)
+    print_error("calloc");
+
+  sniffer->raw_socket = -1;
+  sniffer->merge = merge;
+
+  for (i = 0; i < merge->count; i++) {
+    if (posix_memalign((void**) &merge->queues[i].pool, getpagesize(), MERGE_POOL_SIZE) != 0)
+      print_error("posix_memalign");
+    merge->queues[i].sniffer = &merge->inputs[i];
+    merge->queues[i].name = sniffer->config.inputs[i];
+    merge->queues[i].index = i;
+
+    input_config(&sniffer->config, sniffer->config.inputs[i], &config);
+    init_sniffer(&merge->inputs[i], &config, i);
+    merge->inputs[i].merge_queue = &merge->queues[i];
+  }
+}
+
+/*
+ * queue_packet - used by capture thread of input to copy
+ * packet with its metadata into pool and queue it for merge.
+ * Packet is tagged with index of input. Live capture never
+ * waits, packet is dropped when pool or queue is full.
+ * Replay waits, so every packet of file is merged.
+ * @queue - pointer to an object of merge_queue struct
+ * @packet - pointer to IP header
+ * @length - amount of captured bytes starting from IP header
+ * @meta - capture metadata of packet
+ */
+void queue_packet(struct merge_queue* queue, const char* packet, size_t length,
+                  const struct packet_meta* meta) {
+  struct sniffer* input = queue->sniffer;
+  struct merge_packet* slot;
+  uint64_t size = record_size(length);
+  uint64_t start = queue->pool_head;
+  uint64_t offset = start % MERGE_POOL_SIZE;
+  uint64_t head = queue->head;
+  int replay = input->config.mode == CAPTURE_FILE;
+
+  if (size > MERGE_POOL_SIZE) {
+    queue->dropped++;
+    return;
+  }
+
+  /* Packet never wraps, tail of pool is skipped instead */
+  if (offset + size > MERGE_POOL_SIZE) {
+    start += MERGE_POOL_SIZE - offset;
+    offset = 0;
+  }
+
+  /* Other side is read only when cached copy says there is no room */
+  while (start + size - queue->released_cache > MERGE_POOL_SIZE ||
+         head - queue->tail_cache == MERGE_SLOTS) {
+    queue->released_cache = __atomic_load_n(&queue->released, __ATOMIC_ACQUIRE);
+    queue->tail_cache = __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE);
+    if (start + size - queue->released_cache <= MERGE_POOL_SIZE &&
+        head - queue->tail_cache < MERGE_SLOTS)
+      break;
+    if (!replay || !input->running) {
+      queue->dropped++;
+      return;
+    }
+    queue->waits++;
+    usleep(MERGE_IDLE_US);
+  }
+
+  memcpy(queue->pool + offset, meta, sizeof(struct packet_meta));
+  ((struct packet_meta*) (queue->pool + offset))->interface = queue->index;
+  memcpy(queue->pool + offset + sizeof(struct packet_meta), packet, length);
+
+  slot = &queue->slots[head & (MERGE_SLOTS - 1)];
+  slot->end = start + size;
+  slot->offset = offset;
+  slot->length = length;
+
+  queue->pool_head = start + size;
+  __atomic_store_n(&queue->head, head + 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * input_main - used as thread routine of input. Capture
+ * loop queues packets instead of processing them.
+ * @arg - pointer to input sniffer
+ *
+ * Return: NULL
+ */
+static void* input_main(void* arg) {
+  struct sniffer* input = (struct sniffer*) arg;
+
+  run_sniffer(input);
+  __atomic_store_n(&input->merge_queue->done, 1, __ATOMIC_RELEASE);
+  return NULL;
+}
+
+/*
+ * run_merge - used to start input threads and merge their
+ * packets on calling thread until every input is finished
+ * and drained. Oldest queued packet is released when every
+ * unfinished input has packet queued, or when it is older
+ * than reorder window. Signals are left to calling thread.
+ * @sniffer - pointer to merge sniffer
+ */
+void run_merge(struct sniffer* sniffer) {
+  struct merge* merge = sniffer->merge;
+  const struct merge_queue* queue;
+  unsigned int released, i;
+  sigset_t mask, old;
+  uint64_t now;
+  int result;
+
+  sigfillset(&mask);
+  pthread_sigmask(SIG_BLOCK, &mask, &old);
+
+  for (i = 0; i < merge->count; i++) {
+    result = pthread_create(&merge->inputs[i].thread, NULL, input_main, &merge->inputs[i]);
+    if (result != 0) {
+      errno = result;
+      print_error("pthread_create");
+    }
+  }
+
+  pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+  while (1) {
+    poll_inputs(merge);
+    if (merge->active == 0)
+      break;
+
+    now = merge->window == UINT64_MAX ? 0 : wall_clock();
+    for (released = 0; released < MERGE_BATCH && merge->heap_size; released++) {
+      queue = &merge->queues[merge->heap[0]];
+
+      /* Input without queued packet may still deliver older one */
+      if (merge->heap_size < merge->active &&
+          (now < queue->key || now - queue->key < merge->window))
+        break;
+      release_packet(merge);
+    }
+
+    /* Flush as often as capture loop does after a batch */
+    flush_sniffer(sniffer);
+    if (released == 0) {
+      merge->idle++;
+      usleep(MERGE_IDLE_US);
+    }
+  }
+
+  for (i = 0; i < merge->count; i++)
+    pthread_join(merge->inputs[i].thread, NULL);
+}
+
+/*
+ * merge_input_name - used to get tag of packet printed
+ * by merge sniffer.
+ * @sniffer - pointer to an object of sniffer struct
+ * @meta - capture metadata of packet
+ *
+ * Return: interface or capture file of packet, NULL without merge
+ */
+const char* merge_input_name(const struct sniffer* sniffer, const struct packet_meta* meta) {
+  if (!sniffer->merge)
+    return NULL;
+  return sniffer->merge->queues[meta->interface].name;
+}
+
+/*
+ * log_merge - used to log how many packets every input
+ * contributed and how many left merge out of order.
+ * @merge - pointer to an object of merge struct
+ * @name - name printed in front of statistics
+ */
+void log_merge(const struct merge* merge, const char* name) {
+  const struct merge_queue* queue;
+  unsigned int i;
+
+  log_message(LOG_LEVEL_INFO, "%s: %lu packets merged from %u inputs, %lu out of order, "
+              "%lu idle polls\n",
+              name,
+              (unsigned long) merge->packets,
+              merge->count,
+              (unsigned long) merge->late,
+              (unsigned long) merge->idle);
+
+  for (i = 0; i < merge->count; i++) {
+    queue = &merge->queues[i];
+    log_message(LOG_LEVEL_INFO, "%s: input %u %s: %lu packets, %lu dropped (queue full), "
+                "%lu waits for space\n",
+                name, i, queue->name,
+                (unsigned long) queue->packets,
+                (unsigned long) queue->dropped,
+                (unsigned long) queue->waits);
+  }
+}
+
+/*
+ * free_merge - used to free input sniffers, their queues
+ * and merge.
+ * @sniffer - pointer to merge sniffer
+ */
+void free_merge(struct sniffer* sniffer) {
+  struct merge* merge = sniffer->merge;
+  unsigned int i;
+
+  for (i = 0; i < merge->count; i++) {
+    destroy_sniffer(&merge->inputs[i]);
+    free(merge->queues[i].pool);
+  }
+
+  free(merge->inputs);
+  free(merge->queues);
+  free(merge);
+  sniffer->merge = NULL;
+}
@@ -0,0 +1,438 @@
+#define _GNU_SOURCE
+#include "../headers/sniffer.h"
+#include <sched.h>
+#include <time.h>
+
+/*
+ * record_size - used to get pool space taken by packet.
+ * @length - amount of packet bytes
+ *
+ * Return: size of metadata and packet rounded up to alignment
+ */
+static inline uint64_t record_size(size_t length) {
+  return (sizeof(struct packet_meta) + length + PIPELINE_ALIGNMENT - 1) &
+         ~(uint64_t) (PIPELINE_ALIGNMENT - 1);
+}
+
+/*
+ * monotonic_ms - used to get monotonic time of idle ticks.
+ *
+ * Return: time in ms
+ */
+static uint64_t monotonic_ms(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/*
+ * push_packet - used by producer to add descriptor to ring.
+ * Consumer index is read only when cached copy says ring
+ * is full.
+ * @ring - pointer to an object of pipeline_ring struct
+ * @packet - descriptor to add
+ *
+ * Return: 0 if successful, -1 if ring is full
+ */
+static int push_packet(struct pipeline_ring* ring, const struct pipeline_packet* packet) {
+  uint64_t head = ring->head;
+
+  if (head - ring->tail_cache == PIPELINE_SLOTS) {
+    ring->tail_cache = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    if (head - ring->tail_cache == PIPELINE_SLOTS) {
+      ring->full++;
+      return -1;
+    }
+  }
+
+  ring->slots[head & (PIPELINE_SLOTS - 1)] = *packet;
+  __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+  return 0;
+}
+
+/*
+ * peek_packets - used by consumer to get amount of descriptors
+ * it can take. Occupancy is sampled on every batch.
+ * @ring - pointer to an object of pipeline_ring struct
+ *
+ * Return: amount of descriptors, at most PIPELINE_BATCH
+ */
+static unsigned int peek_packets(struct pipeline_ring* ring) {
+  uint64_t count = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) - ring->tail;
+
+  if (count == 0) {
+    ring->empty++;
+    return 0;
+  }
+
+  ring->batches++;
+  ring->occupancy += count;
+  if (count > ring->occupancy_max)
+    ring->occupancy_max = count;
+  return count < PIPELINE_BATCH ? count : PIPELINE_BATCH;
+}
+
+/*
+ * take_packets - used by consumer to hand slots of taken
+ * descriptors back to producer.
+ * @ring - pointer to an object of pipeline_ring struct
+ * @count - amount of descriptors
+ */
+static inline void take_packets(struct pipeline_ring* ring, unsigned int count) {
+  __atomic_store_n(&ring->tail, ring->tail + count, __ATOMIC_RELEASE);
+}
+
+/*
+ * pin_thread - used to bind thread to one CPU.
+ * @thread - thread to bind
+ * @cpu - index of CPU, -1 to leave thread unbound
+ */
+static void pin_thread(pthread_t thread, int cpu) {
+  cpu_set_t set;
+  int result;
+
+  if (cpu < 0)
+    return;
+
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  result = pthread_setaffinity_np(thread, sizeof(set), &set);
+  if (result != 0) {
+    errno = result;
+    print_error("pthread_setaffinity_np");
+  }
+}
+
+/*
+ * create_pipeline - used to allocate pool and rings of
+ * pipeline. Threads are started by start_pipeline.
+ * @sniffer - pointer to an object of sniffer struct
+ * @cpus - CPU of every stage, -1 for any
+ *
+ * Return: pointer to an object of pipeline struct
+ */
+struct pipeline* create_pipeline(struct sniffer* sniffer, const int* cpus) {
+  struct pipeline* pipeline;
+  unsigned int i;
+
+  /* Indexes of both sides sit on own cache lines */
+  if (posix_memalign((void**) &pipeline, PIPELINE_ALIGNMENT, sizeof(struct pipeline)) != 0)
+    print_error("posix_memalign");
+  memset(pipeline, 0, sizeof(struct pipeline));
+
+  if (posix_memalign((void**) &pipeline->parse_ring, PIPELINE_ALIGNMENT,
+                     sizeof(struct pipeline_ring)) != 0 ||
+      posix_memalign((void**) &pipeline->output_ring, PIPELINE_ALIGNMENT,
+                     sizeof(struct pipeline_ring)) != 0 ||
+      posix_memalign((void**) &pipeline->pool, getpagesize(), PIPELINE_POOL_SIZE) != 0)
+    print_error("posix_memalign");
+  memset(pipeline->parse_ring, 0, sizeof(struct pipeline_ring));
+  memset(pipeline->output_ring, 0, sizeof(struct pipeline_ring));
+
+  pipeline->output = (struct output*) calloc(1, sizeof(struct output));
+  if (!pipeline->output)
+    print_error("calloc");
+
+  pipeline->sniffer = sniffer;
+  init_sampler(&pipeline->sampler, sniffer->config.sample, 0);
+  for (i = 0; i < PIPELINE_STAGES; i++)
+    pipeline->cpus[i] = cpus[i];
+
+  return pipeline;
+}
+
+/*
+ * submit_packet - used by capture stage to copy packet with
+ * its metadata into pool and pass it to parse stage. Live
+ * capture never waits, packet is dropped when pool or ring
+ * is full. Replay waits, so every packet of file is processed.
+ * @pipeline - pointer to an object of pipeline struct
+ * @packet - pointer to IP header
+ * @length - amount of captured bytes starting from IP header
+ * @meta - capture metadata of packet
+ */
+void submit_packet(struct pipeline* pipeline, const char* packet, size_t length,
+                   const struct packet_meta* meta) {
+  struct sniffer* sniffer = pipeline->sniffer;
+  struct pipeline_packet descriptor;
+  uint64_t size = record_size(length);
+  uint64_t start = pipeline->pool_head;
+  uint64_t offset = start % PIPELINE_POOL_SIZE;
+  int replay = sniffer->config.mode == CAPTURE_FILE;
+
+  if (size > PIPELINE_POOL_SIZE) {
+    pipeline->dropped++;
+    return;
+  }
+
+  /* Packet never wraps, tail of pool is skipped instead */
+  if (offset + size > PIPELINE_POOL_SIZE) {
+    start += PIPELINE_POOL_SIZE - offset;
+    offset = 0;
+  }
+
+  while (start + size - pipeline->released_cache > PIPELINE_POOL_SIZE) {
+    pipeline->released_cache = __atomic_load_n(&pipeline->released, __ATOMIC_ACQUIRE);
+    if (start + size - pipeline->released_cache <= PIPELINE_POOL_SIZE)
+      break;
+    if (!replay || !sniffer->running) {
+      pipeline->pool_full++;
+      pipeline->dropped++;
+      return;
+    }
+    pipeline->waits++;
+    usleep(PIPELINE_IDLE_US);
+  }
+
+  memcpy(pipeline->pool + offset, meta, sizeof(struct packet_meta));
+  memcpy(pipeline->pool + offset + sizeof(struct packet_meta), packet, length);
+
+  memset(&descriptor, 0, sizeof(descriptor));
+  descriptor.end = start + size;
+  descriptor.offset = offset;
+  descriptor.length = length;
+
+  while (push_packet(pipeline->parse_ring, &descriptor) == -1) {
+    if (!replay || !sniffer->running) {
+      pipeline->dropped++;
+      return;
+    }
+    pipeline->waits++;
+    usleep(PIPELINE_IDLE_US);
+  }
+
+  pipeline->pool_head = start + size;
+}
+
+/*
+ * tick_parse - used by parse stage to do periodic work of
+ * sniffer. Pipeline counters are logged on SIGUSR2 together
+ * with histograms.
+ * @pipeline - pointer to an object of pipeline struct
+ */
+static void tick_parse(struct pipeline* pipeline) {
+  struct sniffer* sniffer = pipeline->sniffer;
+
+  if (sniffer->dump) {
+    log_pipeline(pipeline, "Pipeline");
+    if (!sniffer->histogram && !sniffer->latency)
+      sniffer->dump = 0;
+  }
+
+  tick_sniffer(sniffer);
+}
+
+/*
+ * parse_main - used as thread routine of parse stage. Inspects
+ * packets in order and passes every descriptor on to output
+ * stage, waiting for it when its ring is full. Payload of
+ * reassembled datagram is not in pool and is printed here.
+ * @arg - pointer to an object of pipeline struct
+ *
+ * Return: NULL
+ */
+static void* parse_main(void* arg) {
+  struct pipeline* pipeline = (struct pipeline*) arg;
+  struct sniffer* sniffer = pipeline->sniffer;
+  struct pipeline_ring* ring = pipeline->parse_ring;
+  struct pipeline_packet* packet;
+  const struct packet_meta* meta;
+  struct packet_view view;
+  const char* data;
+  uint64_t ticked = monotonic_ms(), now;
+  unsigned int count, i;
+
+  while (1) {
+    count = peek_packets(ring);
+    if (count == 0) {
+      if (__atomic_load_n(&pipeline->capture_done, __ATOMIC_ACQUIRE) &&
+          __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == ring->tail)
+        break;
+
+      now = monotonic_ms();
+      if (now - ticked >= PIPELINE_TICK_MS) {
+        ticked = now;
+        tick_parse(pipeline);
+      }
+      usleep(PIPELINE_IDLE_US);
+      continue;
+    }
+
+    for (i = 0; i < count; i++) {
+      packet = &ring->slots[(ring->tail + i) & (PIPELINE_SLOTS - 1)];
+      meta = (const struct packet_meta*) (pipeline->pool + packet->offset);
+      data = (const char*) (meta + 1);
+
+      packet->action = ACTION_NONE;
+      if (inspect_packet(sniffer, data, packet->length, meta, &view)) {
+        if ((uintptr_t) view.payload.data >= (uintptr_t) data &&
+            (uintptr_t) view.payload.data <= (uintptr_t) data + packet->length) {
+          packet->action = ACTION_PRINT;
+          packet->payload_offset = (const char*) view.payload.data - data;
+          packet->payload_length = view.payload.length;
+        }
+        else {
+          print_payload(&sniffer->output, meta, merge_input_name(sniffer, meta),
+                        view.payload.data, view.payload.length);
+        }
+      }
+
+      while (push_packet(pipeline->output_ring, packet) == -1)
+        usleep(PIPELINE_IDLE_US);
+    }
+    take_packets(ring, count);
+
+    ticked = monotonic_ms();
+    tick_parse(pipeline);
+  }
+
+  __atomic_store_n(&pipeline->parse_done, 1, __ATOMIC_RELEASE);
+  return NULL;
+}
+
+/*
+ * output_main - used as thread routine of output stage.
+ * Formats payloads in order and releases pool behind them.
+ * Buffered text is handed to logger when stage is idle.
+ * @arg - pointer to an object of pipeline struct
+ *
+ * Return: NULL
+ */
+static void* output_main(void* arg) {
+  struct pipeline* pipeline = (struct pipeline*) arg;
+  struct pipeline_ring* ring = pipeline->output_ring;
+  const struct pipeline_packet* packet = NULL;
+  const struct packet_meta* meta;
+  unsigned int count, i;
+
+  while (1) {
+    count = peek_packets(ring);
+    if (count == 0) {
+      flush_output(pipeline->output);
+      if (__atomic_load_n(&pipeline->parse_done, __ATOMIC_ACQUIRE) &&
+          __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == ring->tail)
+        break;
+      usleep(PIPELINE_IDLE_US);
+      continue;
+    }
+
+    for (i = 0; i < count; i++) {
+      packet = &ring->slots[(ring->tail + i) & (PIPELINE_SLOTS - 1)];
+      if (packet->action != ACTION_PRINT)
+        continue;
+
+      meta = (const struct packet_meta*) (pipeline->pool + packet->offset);
+      print_payload(pipeline->output, meta, merge_input_name(pipeline->sniffer, meta),
+                    (const uint8_t*) (meta + 1) + packet->payload_offset,
+                    packet->payload_length);
+    }
+
+    /* Pool is released in order, up to the last packet of batch */
+    __atomic_store_n(&pipeline->released, packet->end, __ATOMIC_RELEASE);
+    take_packets(ring, count);
+  }
+
+  return NULL;
+}
+
+/*
+ * start_pipeline - used to pin capture stage to calling
+ * thread and start parse and output stages. Signals are
+ * left to capture thread.
+ * @pipeline - pointer to an object of pipeline struct
+ */
+void start_pipeline(struct pipeline* pipeline) {
+  sigset_t mask, old;
+  int result;
+
+  pin_thread(pthread_self(), pipeline->cpus[0]);
+
+  sigfillset(&mask);
+  pthread_sigmask(SIG_BLOCK, &mask, &old);
+
+  result = pthread_create(&pipeline->parse_thread, NULL, parse_main, pipeline);
+  if (result == 0)
+    result = pthread_create(&pipeline->output_thread, NULL, output_main, pipeline);
+  if (result != 0) {
+    errno = result;
+    print_error("pthread_create");
+  }
+
+  pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+  pin_thread(pipeline->parse_thread, pipeline->cpus[1]);
+  pin_thread(pipeline->output_thread, pipeline->cpus[2]);
+  pipeline->running = 1;
+}
+
+/*
+ * stop_pipeline - used by capture stage after its loop ends.
+ * Stages finish every queued packet before they exit, then
+ * datagrams sampled out by parse stage are counted in sniffer.
+ * @pipeline - pointer to an object of pipeline struct
+ */
+void stop_pipeline(struct pipeline* pipeline) {
+  if (!pipeline->running)
+    return;
+
+  __atomic_store_n(&pipeline->capture_done, 1, __ATOMIC_RELEASE);
+  pthread_join(pipeline->parse_thread, NULL);
+  pthread_join(pipeline->output_thread, NULL);
+  pipeline->running = 0;
+
+  pipeline->sniffer->sampler.sampled += pipeline->sampler.sampled;
+  pipeline->sampler.sampled = 0;
+}
+
+/*
+ * log_ring - used to log occupancy and stalls of one ring.
+ * @ring - pointer to an object of pipeline_ring struct
+ * @name - name printed in front of statistics
+ * @what - stages connected by ring
+ * @full - what full ring means for producer
+ */
+static void log_ring(const struct pipeline_ring* ring, const char* name, const char* what,
+                     const char* full) {
+  log_message(LOG_LEVEL_INFO, "%s: %s ring %.1f average, %lu max of %u slots, "
+              "%lu batches, %lu full (%s), %lu empty polls\n",
+              name, what,
+              ring->batches ? (double) ring->occupancy / ring->batches : 0.0,
+              (unsigned long) ring->occupancy_max, PIPELINE_SLOTS,
+              (unsigned long) ring->batches,
+              (unsigned long) ring->full, full,
+              (unsigned long) ring->empty);
+}
+
+/*
+ * log_pipeline - used to log occupancy and stall counters
+ * of both rings. Ring that is often full points at slow
+ * consumer, ring that is often empty at slow producer.
+ * @pipeline - pointer to an object of pipeline struct
+ * @name - name printed in front of statistics
+ */
+void log_pipeline(const struct pipeline* pipeline, const char* name) {
+  log_ring(pipeline->parse_ring, name, "capture->parse",
+           pipeline->sniffer->config.mode == CAPTURE_FILE ? "replay waited" : "packet dropped");
+  log_ring(pipeline->output_ring, name, "parse->output", "parse waited");
+  log_message(LOG_LEVEL_INFO, "%s: %lu packets dropped by capture stage (%lu pool full), "
+              "%lu waits for space\n",
+              name,
+              (unsigned long) pipeline->dropped,
+              (unsigned long) pipeline->pool_full,
+              (unsigned long) pipeline->waits);
+}
+
+/*
+ * free_pipeline - used to stop stages if they still run
+ * and free pool and rings.
+ * @pipeline - pointer to an object of pipeline struct
+ */
+void free_pipeline(struct pipeline* pipeline) {
+  stop_pipeline(pipeline);
+  free(pipeline->output);
+  free(pipeline->pool);
+  free(pipeline->parse_ring);
+  free(pipeline->output_ring);
+  free(pipeline);
+}
@@ -0,0 +1,113 @@
+#include "../headers/publish.h"
+#include "../headers/pcap.h"
+#include "../../common/headers/common.h"
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+
+/*
+ * create_publisher - used to create shared-memory ring of
+ * worker. Object left by previous run is unlinked first, its
+ * readers keep old mapping and see no more packets.
+ * @name - name of ring, worker index is appended
+ * @id - index of the worker
+ * @slot_count - amount of slots, power of two
+ * @slot_size - size of slot including its header, multiple of 64
+ *
+ * Return: pointer to an object of publisher struct
+ */
+struct publisher* create_publisher(const char* name, unsigned int id,
+                                   uint32_t slot_count, uint32_t slot_size) {
+  struct publisher* publisher;
+  struct shm_ring_header* header;
+  void* map;
+  int fd;
+
+  publisher = (struct publisher*) calloc(1, sizeof(struct publisher));
+  if (!publisher)
+    print_error("calloc");
+
+  snprintf(publisher->name, sizeof(publisher->name), "%s%s-%u",
+           name[0] == '/' ? "" : "/", name, id);
+  publisher->size = sizeof(struct shm_ring_header) + (size_t) slot_count * slot_size;
+  publisher->mask = slot_count - 1;
+
+  shm_unlink(publisher->name);
+  fd = shm_open(publisher->name, O_RDWR | O_CREAT | O_EXCL, 0644);
+  if (fd == -1)
+    print_error("shm_open");
+  if (ftruncate(fd, publisher->size) == -1)
+    print_error("ftruncate");
+
+  /* Slots are faulted in now, in huge pages where shmem allows, not by first lap of capture */
+  map = mmap(NULL, publisher->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (map == MAP_FAILED)
+    print_error("mmap");
+  close(fd);
+  madvise(map, publisher->size, MADV_HUGEPAGE);
+  memset(map, 0, publisher->size);
+
+  header = (struct shm_ring_header*) map;
+  header->version = SHM_RING_VERSION;
+  header->header_size = sizeof(struct shm_ring_header);
+  header->slot_count = slot_count;
+  header->slot_size = slot_size;
+  header->snaplen = slot_size - sizeof(struct shm_slot);
+  header->linktype = LINKTYPE_RAW;
+
+  /* Readers check magic first, so it is written last */
+  __atomic_store_n(&header->magic, SHM_RING_MAGIC, __ATOMIC_RELEASE);
+
+  publisher->header = header;
+  publisher->slots = (uint8_t*) map + sizeof(struct shm_ring_header);
+  return publisher;
+}
+
+/*
+ * publish_packet - used by capture thread to write packet
+ * into next slot. Slot sequence is odd while it is written,
+ * head moves only after slot is complete. Never waits for
+ * readers, slowest of them is overrun instead.
+ * @publisher - pointer to an object of publisher struct
+ * @timestamp - capture time in ns
+ * @data - pointer to IP header
+ * @length - amount of captured bytes
+ * @wire_length - original length of packet
+ */
+void publish_packet(struct publisher* publisher, uint64_t timestamp, const void* data,
+                    uint32_t length, uint32_t wire_length) {
+  uint64_t sequence = publisher->head;
+  struct shm_slot* slot = (struct shm_slot*) (publisher->slots +
+                          (sequence & publisher->mask) * publisher->header->slot_size);
+  uint32_t caplen = length;
+
+  if (caplen > publisher->header->snaplen) {
+    caplen = publisher->header->snaplen;
+    publisher->truncated++;
+  }
+
+  __atomic_store_n(&slot->sequence, 2 * sequence + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+
+  slot->timestamp = timestamp;
+  slot->caplen = caplen;
+  slot->wire_length = wire_length;
+  memcpy(slot + 1, data, caplen);
+
+  __atomic_store_n(&slot->sequence, 2 * sequence + 2, __ATOMIC_RELEASE);
+  publisher->head = sequence + 1;
+  __atomic_store_n(&publisher->header->head, publisher->head, __ATOMIC_RELEASE);
+}
+
+/*
+ * free_publisher - used to tell readers that no more
+ * packets come, unlink ring and free publisher. Readers
+ * keep mapping until they close it.
+ * @publisher - pointer to an object of publisher struct
+ */
+void free_publisher(struct publisher* publisher) {
+  __atomic_store_n(&publisher->header->closed, 1, __ATOMIC_RELEASE);
+  shm_unlink(publisher->name);
+  munmap(publisher->header, publisher->size);
+  free(publisher);
+}
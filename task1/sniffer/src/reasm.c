@@ -0,0 +1,397 @@
+#include "../headers/reasm.h"
+#include "../../common/headers/common.h"
+#include "../../common/headers/packet.h"
+
+/*
+ * hash_reasm_key - used to hash key of datagram.
+ * @key - pointer to key
+ *
+ * Return: hash of the key
+ */
+static inline uint32_t hash_reasm_key(const struct reasm_key* key) {
+  uint64_t h = ((uint64_t) key->src << 32 | key->dst) * 0x9E3779B97F4A7C15ull;
+
+  h ^= ((uint64_t) key->id << 8 | key->proto) * 0xC2B2AE3D27D4EB4Full;
+  h ^= h >> 29;
+  return (uint32_t) h;
+}
+
+/*
+ * header_checksum - used to calculate checksum of IP header.
+ * @header - pointer to header with zeroed checksum field
+ * @length - length of header in bytes
+ *
+ * Return: checksum in network byte order
+ */
+static uint16_t header_checksum(const uint8_t* header, size_t length) {
+  return ~checksum_fold(checksum_add(header, length, 0));
+}
+
+/*
+ * create_reassembly - used to allocate reassembly pool.
+ * Memory budget is spent on payload chunks, one context is
+ * created per four chunks.
+ * @memory - memory for fragment payloads in bytes
+ * @timeout - time datagram may take to complete in ns
+ *
+ * Return: pointer to an object of reassembly struct
+ */
+struct reassembly* create_reassembly(size_t memory, uint64_t timeout) {
+  struct reassembly* reasm;
+  unsigned int i;
+
+  reasm = (struct reassembly*) calloc(1, sizeof(struct reassembly));
+  if (!reasm)
+    print_error("calloc");
+
+  reasm->chunk_count = memory / REASM_CHUNK_SIZE;
+  if (reasm->chunk_count < REASM_CHUNKS_PER_DATAGRAM)
+    reasm->chunk_count = REASM_CHUNKS_PER_DATAGRAM;
+  reasm->context_count = reasm->chunk_count / 4;
+
+  reasm->bucket_mask = 1;
+  while (reasm->bucket_mask < reasm->context_count * 2)
+    reasm->bucket_mask <<= 1;
+
+  reasm->contexts = (struct reasm_context*) malloc(reasm->context_count * sizeof(struct reasm_context));
+  reasm->buckets = (int32_t*) malloc(reasm->bucket_mask * sizeof(int32_t));
+  reasm->chunks = (uint8_t*) malloc((size_t) reasm->chunk_count * REASM_CHUNK_SIZE);
+  reasm->free_chunks = (int32_t*) malloc(reasm->chunk_count * sizeof(int32_t));
+  if (!reasm->contexts || !reasm->buckets || !reasm->chunks || !reasm->free_chunks)
+    print_error("malloc");
+  reasm->bucket_mask--;
+
+  memset(reasm->buckets, 0xFF, (reasm->bucket_mask + 1) * sizeof(int32_t));
+  for (i = 0; i < reasm->context_count; i++)
+    reasm->contexts[i].next = i + 1 < reasm->context_count ? (int32_t) i + 1 : -1;
+  for (i = 0; i < reasm->chunk_count; i++)
+    reasm->free_chunks[i] = i;
+
+  reasm->free_contexts = 0;
+  reasm->free_chunk_count = reasm->chunk_count;
+  reasm->oldest = -1;
+  reasm->newest = -1;
+  reasm->timeout = timeout;
+  return reasm;
+}
+
+/*
+ * is_fragment - used to check if packet is part of
+ * fragmented IPv4 datagram.
+ * @packet - pointer to IP header
+ * @length - amount of captured bytes
+ *
+ * Return: 1 if packet is a fragment, 0 otherwise
+ */
+int is_fragment(const uint8_t* packet, size_t length) {
+  const struct iphdr* ip = (const struct iphdr*) packet;
+
+  return length >= sizeof(struct iphdr) && ip->version == 4 &&
+         (ntohs(ip->frag_off) & (IP_MF | IP_OFFMASK)) != 0;
+}
+
+/*
+ * release_context - used to return context and its chunks
+ * to pools and unlink it from bucket and age list.
+ * @reasm - pointer to an object of reassembly struct
+ * @index - index of the context
+ */
+static void release_context(struct reassembly* reasm, int32_t index) {
+  struct reasm_context* context = &reasm->contexts[index];
+  int32_t* link = &reasm->buckets[hash_reasm_key(&context->key) & reasm->bucket_mask];
+  unsigned int i;
+
+  while (*link != index)
+    link = &reasm->contexts[*link].next;
+  *link = context->next;
+
+  if (context->older != -1)
+    reasm->contexts[context->older].newer = context->newer;
+  else
+    reasm->oldest = context->newer;
+  if (context->newer != -1)
+    reasm->contexts[context->newer].older = context->older;
+  else
+    reasm->newest = context->older;
+
+  for (i = 0; i < REASM_CHUNKS_PER_DATAGRAM; i++)
+    if (context->chunks[i] != -1)
+      reasm->free_chunks[reasm->free_chunk_count++] = context->chunks[i];
+
+  context->next = reasm->free_contexts;
+  reasm->free_contexts = index;
+}
+
+/*
+ * find_context - used to find datagram of fragment or
+ * start new one. When no context is free, oldest
+ * datagram is dropped.
+ * @reasm - pointer to an object of reassembly struct
+ * @key - key of the datagram
+ * @now - capture time of fragment in ns
+ *
+ * Return: index of the context
+ */
+static int32_t find_context(struct reassembly* reasm, const struct reasm_key* key, uint64_t now) {
+  uint32_t bucket = hash_reasm_key(key) & reasm->bucket_mask;
+  struct reasm_context* context;
+  int32_t index;
+
+  for (index = reasm->buckets[bucket]; index != -1; index = context->next) {
+    context = &reasm->contexts[index];
+    if (memcmp(&context->key, key, sizeof(*key)) == 0)
+      return index;
+  }
+
+  if (reasm->free_contexts == -1) {
+    release_context(reasm, reasm->oldest);
+    reasm->evicted++;
+  }
+
+  index = reasm->free_contexts;
+  context = &reasm->contexts[index];
+  reasm->free_contexts = context->next;
+
+  context->key = *key;
+  context->header_length = 0;
+  context->total = 0;
+  context->end = 0;
+  context->received = 0;
+  context->deadline = now + reasm->timeout;
+  memset(context->chunks, 0xFF, sizeof(context->chunks));
+  memset(context->units, 0, sizeof(context->units));
+
+  context->next = reasm->buckets[bucket];
+  reasm->buckets[bucket] = index;
+
+  context->older = reasm->newest;
+  context->newer = -1;
+  if (reasm->newest != -1)
+    reasm->contexts[reasm->newest].newer = index;
+  else
+    reasm->oldest = index;
+  reasm->newest = index;
+  return index;
+}
+
+/*
+ * reserve_chunks - used to allocate chunks for payload
+ * range of fragment. Other datagrams are dropped, oldest
+ * first, when chunk pool is empty.
+ * @reasm - pointer to an object of reassembly struct
+ * @index - index of the context
+ * @offset - offset of fragment payload
+ * @length - length of fragment payload
+ *
+ * Return: 0 if successful, -1 if there is no other datagram to drop
+ */
+static int reserve_chunks(struct reassembly* reasm, int32_t index, 
+                          unsigned int offset, unsigned int length) {
+  struct reasm_context* context = &reasm->contexts[index];
+  unsigned int chunk;
+
+  for (chunk = offset / REASM_CHUNK_SIZE; chunk <= (offset + length - 1) / REASM_CHUNK_SIZE; chunk++) {
+    if (context->chunks[chunk] != -1)
+      continue;
+
+    while (reasm->free_chunk_count == 0) {
+      if (reasm->oldest == index && reasm->newest == index)
+        return -1;
+      release_context(reasm, reasm->oldest == index ? context->newer : reasm->oldest);
+      reasm->evicted++;
+    }
+    context->chunks[chunk] = reasm->free_chunks[--reasm->free_chunk_count];
+  }
+
+  return 0;
+}
+
+/*
+ * store_fragment - used to copy fragment payload into
+ * chunks unit by unit. Units received before are compared
+ * instead: identical retransmissions are accepted, overlap
+ * with different bytes invalidates the datagram.
+ * @reasm - pointer to an object of reassembly struct
+ * @context - pointer to the context
+ * @data - fragment payload
+ * @offset - offset of fragment payload
+ * @length - length of fragment payload
+ *
+ * Return: 0 if successful, -1 on conflicting overlap
+ */
+static int store_fragment(struct reassembly* reasm, struct reasm_context* context,
+                          const uint8_t* data, unsigned int offset, unsigned int length) {
+  unsigned int position, size, unit;
+  uint8_t* target;
+
+  for (position = offset; position < offset + length; position += size) {
+    unit = position / 8;
+    size = offset + length - position < 8 ? offset + length - position : 8;
+    target = reasm->chunks + (size_t) context->chunks[position / REASM_CHUNK_SIZE] * REASM_CHUNK_SIZE +
+             position % REASM_CHUNK_SIZE;
+
+    if (context->units[unit / 64] & (1ull << (unit % 64))) {
+      if (memcmp(target, data + position - offset, size) != 0)
+        return -1;
+      continue;
+    }
+
+    memcpy(target, data + position - offset, size);
+    context->units[unit / 64] |= 1ull << (unit % 64);
+    context->received++;
+  }
+
+  return 0;
+}
+
+/*
+ * build_datagram - used to join header of first fragment
+ * and payload chunks into output buffer. Header gets length
+ * of whole datagram, no fragment flags and new checksum.
+ * @reasm - pointer to an object of reassembly struct
+ * @context - pointer to complete context
+ *
+ * Return: length of datagram
+ */
+static size_t build_datagram(struct reassembly* reasm, const struct reasm_context* context) {
+  struct iphdr* ip = (struct iphdr*) reasm->output;
+  unsigned int position, size;
+
+  memcpy(reasm->output, context->header, context->header_length);
+  for (position = 0; position < context->total; position += size) {
+    size = context->total - position < REASM_CHUNK_SIZE ? context->total - position : REASM_CHUNK_SIZE;
+    memcpy(reasm->output + context->header_length + position,
+           reasm->chunks + (size_t) context->chunks[position / REASM_CHUNK_SIZE] * REASM_CHUNK_SIZE,
+           size);
+  }
+
+  ip->tot_len = htons(context->header_length + context->total);
+  ip->frag_off = 0;
+  ip->check = 0;
+  ip->check = header_checksum(reasm->output, context->header_length);
+  return context->header_length + context->total;
+}
+
+/*
+ * reassemble - used to add fragment to its datagram.
+ * Fragments that can not belong to valid datagram are
+ * dropped and counted, as is datagram they belong to.
+ * @reasm - pointer to an object of reassembly struct
+ * @packet - pointer to IP header of fragment
+ * @length - amount of captured bytes
+ * @now - capture time of fragment in ns
+ * @datagram - set to complete datagram
+ * @datagram_length - set to length of complete datagram
+ *
+ * Return: 1 if datagram is complete, 0 otherwise
+ */
+int reassemble(struct reassembly* reasm, const uint8_t* packet, size_t length, uint64_t now,
+               const uint8_t** datagram, size_t* datagram_length) {
+  const struct iphdr* ip = (const struct iphdr*) packet;
+  struct reasm_context* context;
+  struct reasm_key key;
+  unsigned int header_length, payload_length, offset, flags, units;
+  int32_t index;
+
+  reasm->fragments++;
+  expire_reassembly(reasm, now);
+
+  /* Fragment must be captured completely */
+  header_length = ip->ihl * 4;
+  flags = ntohs(ip->frag_off);
+  if (header_length < sizeof(struct iphdr) || ntohs(ip->tot_len) > length ||
+      ntohs(ip->tot_len) <= header_length) {
+    reasm->invalid++;
+    return 0;
+  }
+
+  /* Datagram with its header must fit in total length field */
+  payload_length = ntohs(ip->tot_len) - header_length;
+  offset = (flags & IP_OFFMASK) * 8;
+  if (((flags & IP_MF) && payload_length % 8 != 0) ||
+      header_length + offset + payload_length > IP_MAXPACKET) {
+    reasm->invalid++;
+    return 0;
+  }
+
+  memset(&key, 0, sizeof(key));
+  key.src = ip->saddr;
+  key.dst = ip->daddr;
+  key.id = ip->id;
+  key.proto = ip->protocol;
+  index = find_context(reasm, &key, now);
+  context = &reasm->contexts[index];
+
+  /* Fragment past the end or second different end */
+  if ((context->total && offset + payload_length > context->total) ||
+      (!(flags & IP_MF) && (context->end > offset + payload_length ||
+                            (context->total && context->total != offset + payload_length)))) {
+    release_context(reasm, index);
+    reasm->invalid++;
+    return 0;
+  }
+
+  if (reserve_chunks(reasm, index, offset, payload_length) == -1) {
+    release_context(reasm, index);
+    reasm->evicted++;
+    return 0;
+  }
+
+  if (store_fragment(reasm, context, packet + header_length, offset, payload_length) == -1) {
+    release_context(reasm, index);
+    reasm->overlaps++;
+    return 0;
+  }
+
+  if (offset + payload_length > context->end)
+    context->end = offset + payload_length;
+  if (!(flags & IP_MF))
+    context->total = offset + payload_length;
+  if (offset == 0) {
+    memcpy(context->header, packet, header_length);
+    context->header_length = header_length;
+  }
+
+  units = (context->total + 7) / 8;
+  if (!context->total || !context->header_length || context->received != units)
+    return 0;
+
+  /* Header of first fragment may be longer than those of the rest */
+  if (context->header_length + context->total > IP_MAXPACKET) {
+    release_context(reasm, index);
+    reasm->invalid++;
+    return 0;
+  }
+
+  *datagram_length = build_datagram(reasm, context);
+  *datagram = reasm->output;
+  release_context(reasm, index);
+  reasm->datagrams++;
+  return 1;
+}
+
+/*
+ * expire_reassembly - used to drop datagrams that did not
+ * complete in time. Contexts are ordered by deadline, so only
+ * expired ones are visited.
+ * @reasm - pointer to an object of reassembly struct
+ * @now - current capture time in ns
+ */
+void expire_reassembly(struct reassembly* reasm, uint64_t now) {
+  while (reasm->oldest != -1 && reasm->contexts[reasm->oldest].deadline <= now) {
+    release_context(reasm, reasm->oldest);
+    reasm->timeouts++;
+  }
+}
+
+/*
+ * free_reassembly - used to free reassembly pool.
+ * @reasm - pointer to an object of reassembly struct
+ */
+void free_reassembly(struct reassembly* reasm) {
+  free(reasm->contexts);
+  free(reasm->buckets);
+  free(reasm->chunks);
+  free(reasm->free_chunks);
+  free(reasm);
+}
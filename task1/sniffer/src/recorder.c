@@ -0,0 +1,365 @@
+#include "../headers/recorder.h"
+#include "../headers/pcap.h"
+#include "../../common/headers/common.h"
+#include "../../common/headers/log.h"
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+
+/*
+ * record_size - used to get size of record in history.
+ * @caplen - amount of kept packet bytes
+ *
+ * Return: size of record in bytes
+ */
+static size_t record_size(uint32_t caplen) {
+  return (sizeof(struct recorder_record) + caplen + RECORDER_ALIGNMENT - 1) &
+         ~(size_t) (RECORDER_ALIGNMENT - 1);
+}
+
+/*
+ * record_at - used to find record at position of history.
+ * @recorder - pointer to an object of recorder struct
+ * @position - position of record
+ *
+ * Return: pointer to record, NULL if position is end of buffer
+ */
+static struct recorder_record* record_at(const struct recorder* recorder, uint64_t position) {
+  size_t offset = position % recorder->capacity;
+  struct recorder_record* record;
+
+  if (recorder->capacity - offset < sizeof(struct recorder_record))
+    return NULL;
+
+  record = (struct recorder_record*) (recorder->buffer + offset);
+  return record->caplen == RECORDER_WRAP ? NULL : record;
+}
+
+/*
+ * next_record - used to get position of record after
+ * the one at position.
+ * @recorder - pointer to an object of recorder struct
+ * @position - position of record
+ *
+ * Return: position of next record
+ */
+static uint64_t next_record(const struct recorder* recorder, uint64_t position) {
+  const struct recorder_record* record = record_at(recorder, position);
+
+  if (!record)
+    return position + recorder->capacity - position % recorder->capacity;
+  return position + record_size(record->caplen);
+}
+
+/*
+ * write_all - used to write whole buffer to file.
+ * @fd - file descriptor
+ * @data - bytes to write
+ * @length - amount of bytes
+ *
+ * Return: 0 if successful, -1 otherwise
+ */
+static int write_all(int fd, const void* data, size_t length) {
+  const uint8_t* ptr = (const uint8_t*) data;
+  ssize_t result;
+
+  while (length > 0) {
+    result = write(fd, ptr, length);
+    if (result == -1 && errno == EINTR)
+      continue;
+    if (result == -1)
+      return -1;
+    ptr += result;
+    length -= result;
+  }
+
+  return 0;
+}
+
+/*
+ * write_snapshot - used by recorder thread to write records
+ * of snapshot range into pcap file. Records are released to
+ * capture thread as soon as they are written.
+ * @recorder - pointer to an object of recorder struct
+ *
+ * Return: amount of packets written, -1 on error
+ */
+static long write_snapshot(struct recorder* recorder) {
+  const struct recorder_record* record;
+  struct pcap_header header;
+  struct pcap_record pcap;
+  uint64_t position = recorder->dump_start;
+  size_t used = 0;
+  long packets = 0;
+  int fd;
+
+  /* Cut name could overwrite another snapshot */
+  if (snprintf(recorder->path, sizeof(recorder->path), "%s-%u-%ld-%05u.pcap",
+               recorder->prefix, recorder->id, (long) time(NULL), recorder->sequence++) >=
+      (int) sizeof(recorder->path)) {
+    errno = ENAMETOOLONG;
+    perror(recorder->prefix);
+    return -1;
+  }
+
+  fd = open(recorder->path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd == -1) {
+    perror(recorder->path);
+    return -1;
+  }
+
+  header.magic = PCAP_MAGIC_NSEC;
+  header.version_major = 2;
+  header.version_minor = 4;
+  header.thiszone = 0;
+  header.sigfigs = 0;
+  header.snaplen = recorder->snaplen;
+  header.linktype = LINKTYPE_RAW;
+  memcpy(recorder->output, &header, sizeof(header));
+  used = sizeof(header);
+
+  while (position < recorder->dump_end) {
+    record = record_at(recorder, position);
+    if (record) {
+      if (used + sizeof(pcap) + record->caplen > RECORDER_WRITE_SIZE) {
+        if (write_all(fd, recorder->output, used) == -1)
+          break;
+        used = 0;
+        __atomic_store_n(&recorder->released, position, __ATOMIC_RELEASE);
+      }
+
+      pcap.ts_sec = record->timestamp / 1000000000ull;
+      pcap.ts_nsec = record->timestamp % 1000000000ull;
+      pcap.caplen = record->caplen;
+      pcap.len = record->wire_length;
+      memcpy(recorder->output + used, &pcap, sizeof(pcap));
+      memcpy(recorder->output + used + sizeof(pcap), record + 1, record->caplen);
+      used += sizeof(pcap) + record->caplen;
+      packets++;
+    }
+    position = next_record(recorder, position);
+  }
+
+  if (position < recorder->dump_end || write_all(fd, recorder->output, used) == -1) {
+    perror(recorder->path);
+    packets = -1;
+  }
+
+  close(fd);
+  return packets;
+}
+
+/*
+ * recorder_main - used as thread routine of recorder.
+ * Writes snapshot when capture asks for one and then
+ * gives whole history back to capture.
+ * @arg - pointer to an object of recorder struct
+ *
+ * Return: NULL
+ */
+static void* recorder_main(void* arg) {
+  struct recorder* recorder = (struct recorder*) arg;
+  long packets;
+
+  while (1) {
+    pthread_mutex_lock(&recorder->lock);
+    while (!recorder->pending && !recorder->stop)
+      pthread_cond_wait(&recorder->cond, &recorder->lock);
+
+    if (!recorder->pending) {
+      pthread_mutex_unlock(&recorder->lock);
+      break;
+    }
+    recorder->pending = 0;
+    pthread_mutex_unlock(&recorder->lock);
+
+    packets = write_snapshot(recorder);
+    if (packets != -1)
+      log_message(LOG_LEVEL_INFO, "Recorder %u: %ld packets written to %s\n",
+                  recorder->id, packets, recorder->path);
+
+    __atomic_store_n(&recorder->released, UINT64_MAX, __ATOMIC_RELEASE);
+    __atomic_store_n(&recorder->dumping, 0, __ATOMIC_RELEASE);
+  }
+
+  return NULL;
+}
+
+/*
+ * create_recorder - used to create recorder with history
+ * preallocated and start its thread.
+ * @prefix - prefix of snapshot files
+ * @id - index of the worker
+ * @memory - size of history in bytes
+ * @seconds - keep packets of this many seconds, 0 until history is full
+ * @snaplen - maximum bytes kept per packet
+ * @trigger - filter expression of packets that start snapshot, NULL for none
+ *
+ * Return: pointer to an object of recorder struct
+ */
+struct recorder* create_recorder(const char* prefix, unsigned int id, size_t memory,
+                                 unsigned int seconds, uint32_t snaplen, const char* trigger) {
+  struct recorder* recorder;
+  int result;
+
+  recorder = (struct recorder*) calloc(1, sizeof(struct recorder));
+  if (!recorder)
+    print_error("calloc");
+
+  if (snprintf(recorder->prefix, sizeof(recorder->prefix), "%s", prefix) >=
+      (int) sizeof(recorder->prefix)) {
+    fprintf(stderr, "%s: snapshot prefix is too long\n", prefix);
+    exit(EXIT_FAILURE);
+  }
+  recorder->id = id;
+  recorder->snaplen = snaplen;
+  recorder->window = (uint64_t) seconds * 1000000000ull;
+  recorder->capacity = memory & ~(size_t) (RECORDER_ALIGNMENT - 1);
+  recorder->released = UINT64_MAX;
+
+  /* Whole history is faulted in now, in huge pages where possible, not by first lap of capture */
+  recorder->buffer = (uint8_t*) mmap(NULL, recorder->capacity, PROT_READ | PROT_WRITE,
+                                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (recorder->buffer == MAP_FAILED)
+    print_error("mmap");
+  madvise(recorder->buffer, recorder->capacity, MADV_HUGEPAGE);
+  memset(recorder->buffer, 0, recorder->capacity);
+
+  recorder->output = (uint8_t*) malloc(RECORDER_WRITE_SIZE);
+  if (!recorder->output)
+    print_error("malloc");
+
+  if (trigger) {
+    recorder->trigger = (struct filter*) malloc(sizeof(struct filter));
+    if (!recorder->trigger)
+      print_error("malloc");
+    if (compile_filter(trigger, 0, recorder->trigger) == -1)
+      exit(EXIT_FAILURE);
+  }
+
+  pthread_mutex_init(&recorder->lock, NULL);
+  pthread_cond_init(&recorder->cond, NULL);
+
+  result = pthread_create(&recorder->thread, NULL, recorder_main, recorder);
+  if (result != 0) {
+    errno = result;
+    print_error("pthread_create");
+  }
+
+  return recorder;
+}
+
+/*
+ * record_packet - used by capture thread to append packet
+ * to history. Records older than window and records in the
+ * way of new one are evicted, unless snapshot has not
+ * written them yet, then packet is dropped. Packet that
+ * matches trigger starts snapshot, at most once per hold-off.
+ * @recorder - pointer to an object of recorder struct
+ * @timestamp - capture time in ns
+ * @data - pointer to IP header
+ * @length - amount of captured bytes
+ * @wire_length - original length of packet
+ */
+void record_packet(struct recorder* recorder, uint64_t timestamp, const void* data,
+                   uint32_t length, uint32_t wire_length) {
+  uint32_t caplen = length < recorder->snaplen ? length : recorder->snaplen;
+  uint64_t limit = __atomic_load_n(&recorder->released, __ATOMIC_ACQUIRE);
+  size_t size = record_size(caplen);
+  size_t offset, skip;
+  struct recorder_record* record;
+
+  if (size > recorder->capacity) {
+    recorder->dropped++;
+    return;
+  }
+
+  /* Packets out of window */
+  while (recorder->window && recorder->tail < recorder->head && recorder->tail < limit) {
+    record = record_at(recorder, recorder->tail);
+    if (record && record->timestamp + recorder->window >= timestamp)
+      break;
+    recorder->tail = next_record(recorder, recorder->tail);
+  }
+
+  /* Record never wraps, rest of buffer is skipped */
+  offset = recorder->head % recorder->capacity;
+  skip = recorder->capacity - offset < size ? recorder->capacity - offset : 0;
+
+  while (recorder->head + skip + size - recorder->tail > recorder->capacity) {
+    if (recorder->tail >= limit) {
+      recorder->dropped++;
+      return;
+    }
+    recorder->tail = next_record(recorder, recorder->tail);
+  }
+
+  if (skip) {
+    if (skip >= sizeof(struct recorder_record))
+      ((struct recorder_record*) (recorder->buffer + offset))->caplen = RECORDER_WRAP;
+    recorder->head += skip;
+    offset = 0;
+  }
+
+  record = (struct recorder_record*) (recorder->buffer + offset);
+  record->timestamp = timestamp;
+  record->caplen = caplen;
+  record->wire_length = wire_length;
+  memcpy(record + 1, data, caplen);
+  recorder->head += size;
+  recorder->packets++;
+
+  if (recorder->trigger && run_filter(recorder->trigger, data, length) &&
+      time(NULL) - recorder->triggered >= RECORDER_HOLDOFF)
+    trigger_recorder(recorder);
+}
+
+/*
+ * trigger_recorder - used by capture thread to start
+ * snapshot of whole history. Ignored while previous
+ * snapshot is being written.
+ * @recorder - pointer to an object of recorder struct
+ *
+ * Return: 0 if snapshot is started, -1 otherwise
+ */
+int trigger_recorder(struct recorder* recorder) {
+  if (__atomic_load_n(&recorder->dumping, __ATOMIC_ACQUIRE) ||
+      recorder->tail == recorder->head) {
+    recorder->ignored++;
+    return -1;
+  }
+
+  recorder->triggered = time(NULL);
+  recorder->snapshots++;
+
+  pthread_mutex_lock(&recorder->lock);
+  recorder->dump_start = recorder->tail;
+  recorder->dump_end = recorder->head;
+  __atomic_store_n(&recorder->released, recorder->tail, __ATOMIC_RELEASE);
+  __atomic_store_n(&recorder->dumping, 1, __ATOMIC_RELEASE);
+  recorder->pending = 1;
+  pthread_cond_signal(&recorder->cond);
+  pthread_mutex_unlock(&recorder->lock);
+  return 0;
+}
+
+/*
+ * free_recorder - used to finish snapshot being written,
+ * wait for recorder thread and free recorder.
+ * @recorder - pointer to an object of recorder struct
+ */
+void free_recorder(struct recorder* recorder) {
+  pthread_mutex_lock(&recorder->lock);
+  recorder->stop = 1;
+  pthread_cond_signal(&recorder->cond);
+  pthread_mutex_unlock(&recorder->lock);
+  pthread_join(recorder->thread, NULL);
+
+  pthread_mutex_destroy(&recorder->lock);
+  pthread_cond_destroy(&recorder->cond);
+
+  munmap(recorder->buffer, recorder->capacity);
+  free(recorder->output);
+  free(recorder->trigger);
+  free(recorder);
+}
@@ -0,0 +1,372 @@
+#include "../headers/sniffer.h"
+#include "../headers/pcap.h"
+#include <fcntl.h>
+#include <byteswap.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/*
+ * Used to pass one record of capture file
+ * from file parser to replay loop.
+ */
+struct replay_packet {
+  /* Captured bytes of record */
+  const uint8_t* data;
+  uint32_t caplen;
+
+  /* Original length of packet */
+  uint32_t len;
+
+  /* Timestamp in units of interface */
+  uint64_t timestamp;
+
+  /* Interface the packet was captured on */
+  const struct replay_interface* interface;
+};
+
+/*
+ * read32 - used to read 32-bit field of capture file
+ * in byte order of host that wrote it.
+ * @replay - pointer to an object of replay struct
+ * @ptr - pointer to field
+ *
+ * Return: value of field
+ */
+static inline uint32_t read32(const struct replay* replay, const uint8_t* ptr) {
+  uint32_t value;
+
+  memcpy(&value, ptr, sizeof(value));
+  return replay->swapped ? bswap_32(value) : value;
+}
+
+/*
+ * read16 - used to read 16-bit field of capture file
+ * in byte order of host that wrote it.
+ * @replay - pointer to an object of replay struct
+ * @ptr - pointer to field
+ *
+ * Return: value of field
+ */
+static inline uint16_t read16(const struct replay* replay, const uint8_t* ptr) {
+  uint16_t value;
+
+  memcpy(&value, ptr, sizeof(value));
+  return replay->swapped ? bswap_16(value) : value;
+}
+
+/*
+ * add_interface - used to register interface described
+ * by pcapng interface description block.
+ * @replay - pointer to an object of replay struct
+ * @block - pointer to the block
+ * @length - total length of the block
+ */
+static void add_interface(struct replay* replay, const uint8_t* block, uint32_t length) {
+  struct replay_interface* interface;
+  const uint8_t* option = block + 16;
+  const uint8_t* end = block + length - sizeof(uint32_t);
+  uint16_t code, option_length;
+  uint8_t resolution;
+
+  if (replay->interface_count == REPLAY_INTERFACES || length < 20)
+    return;
+
+  interface = &replay->interfaces[replay->interface_count++];
+  interface->linktype = read16(replay, block + 8);
+  interface->units = 1000000;
+
+  /* Options are padded to 32 bits */
+  while (option + 4 <= end) {
+    code = read16(replay, option);
+    option_length = read16(replay, option + 2);
+    if (code == 0 || option + 4 + option_length > end)
+      break;
+
+    if (code == PCAPNG_IF_TSRESOL && option_length >= 1) {
+      resolution = option[4];
+      if (resolution & 0x80)
+        interface->units = 1ull << ((resolution & 0x7f) < 63 ? resolution & 0x7f : 63);
+      else
+        for (interface->units = 1; resolution > 0 && resolution < 20; resolution--)
+          interface->units *= 10;
+    }
+
+    option += 4 + ((option_length + 3) & ~3u);
+  }
+}
+
+/*
+ * next_pcapng - used to find next packet in pcapng file.
+ * Section headers and interface descriptions met on the way
+ * are applied, other blocks are skipped.
+ * @replay - pointer to an object of replay struct
+ * @packet - pointer to result
+ *
+ * Return: 1 if packet was found, 0 at end of file
+ */
+static int next_pcapng(struct replay* replay, struct replay_packet* packet) {
+  const uint8_t* block;
+  uint32_t type, length, byte_order, interface;
+
+  while (replay->offset + sizeof(struct pcapng_block) <= replay->size) {
+    block = replay->map + replay->offset;
+    type = read32(replay, block);
+
+    /* New section may change byte order */
+    if (type == PCAPNG_SHB) {
+      if (replay->offset + 12 > replay->size)
+        break;
+      memcpy(&byte_order, block + 8, sizeof(byte_order));
+      replay->swapped = byte_order != PCAPNG_BYTE_ORDER;
+      replay->interface_count = 0;
+    }
+
+    length = read32(replay, block + 4);
+    if (length < 12 || length % 4 != 0 || length > replay->size - replay->offset) {
+      fprintf(stderr, "Replay: truncated block at offset %zu\n", replay->offset);
+      break;
+    }
+    replay->offset += length;
+
+    if (type == PCAPNG_IDB) {
+      add_interface(replay, block, length);
+      continue;
+    }
+    if (type != PCAPNG_EPB || length < sizeof(struct pcapng_epb) + 4)
+      continue;
+
+    interface = read32(replay, block + 8);
+    packet->timestamp = (uint64_t) read32(replay, block + 12) << 32 | read32(replay, block + 16);
+    packet->caplen = read32(replay, block + 20);
+    packet->len = read32(replay, block + 24);
+    packet->data = block + sizeof(struct pcapng_epb);
+
+    if (interface >= replay->interface_count ||
+        packet->caplen > length - sizeof(struct pcapng_epb) - 4) {
+      replay->skipped++;
+      continue;
+    }
+
+    packet->interface = &replay->interfaces[interface];
+    return 1;
+  }
+
+  return 0;
+}
+
+/*
+ * next_pcap - used to get next packet of pcap file.
+ * @replay - pointer to an object of replay struct
+ * @packet - pointer to result
+ *
+ * Return: 1 if packet was found, 0 at end of file
+ */
+static int next_pcap(struct replay* replay, struct replay_packet* packet) {
+  const uint8_t* record;
+  const struct replay_interface* interface = &replay->interfaces[0];
+
+  if (replay->offset + sizeof(struct pcap_record) > replay->size)
+    return 0;
+
+  record = replay->map + replay->offset;
+  packet->caplen = read32(replay, record + 8);
+  packet->len = read32(replay, record + 12);
+  if (packet->caplen > replay->size - replay->offset - sizeof(struct pcap_record)) {
+    fprintf(stderr, "Replay: truncated record at offset %zu\n", replay->offset);
+    return 0;
+  }
+
+  packet->timestamp = (uint64_t) read32(replay, record) * interface->units +
+                      read32(replay, record + 4);
+  packet->data = record + sizeof(struct pcap_record);
+  packet->interface = interface;
+
+  replay->offset += sizeof(struct pcap_record) + packet->caplen;
+  return 1;
+}
+
+/*
+ * network_offset - used to find IP header of packet
+ * according to link type of its interface. VLAN tags of
+ * Ethernet frames are stored in packet metadata.
+ * @packet - pointer to packet of capture file
+ * @meta - pointer to metadata of packet
+ *
+ * Return: offset of IP header, -1 if packet is not IPv4 or IPv6
+ */
+static int network_offset(const struct replay_packet* packet, struct packet_meta* meta) {
+  struct packet_view view;
+  int type;
+
+  meta->vlan_count = 0;
+  if (packet->interface->linktype == LINKTYPE_RAW)
+    return 0;
+  if (packet->interface->linktype != LINKTYPE_ETHERNET)
+    return -1;
+  type = parse_link(&view, packet->data, packet->caplen);
+  if (type != ETHERTYPE_IP && type != ETHERTYPE_IPV6)
+    return -1;
+
+  memcpy(meta->vlan_tci, view.vlan_tci, sizeof(meta->vlan_tci));
+  meta->vlan_count = view.vlan_count;
+  return view.eth.length;
+}
+
+/*
+ * create_replay - used to map capture file into memory
+ * and read its header. Whole file is faulted in at once,
+ * so replay measures pipeline and not the disk.
+ * @sniffer - pointer to an object of sniffer struct
+ */
+void create_replay(struct sniffer* sniffer) {
+  struct replay* replay = &sniffer->replay;
+  struct replay_interface* interface = &replay->interfaces[0];
+  struct stat st;
+  uint32_t magic;
+  int fd;
+
+  /* Replay has no capture socket */
+  sniffer->raw_socket = -1;
+
+  fd = open(sniffer->config.read_path, O_RDONLY);
+  if (fd == -1)
+    print_error(sniffer->config.read_path);
+  if (fstat(fd, &st) == -1)
+    print_error("fstat");
+  if (st.st_size < (off_t) sizeof(struct pcap_header)) {
+    fprintf(stderr, "%s: not a pcap or pcapng file\n", sniffer->config.read_path);
+    exit(EXIT_FAILURE);
+  }
+
+  replay->size = st.st_size;
+  replay->map = (const uint8_t*) mmap(NULL, replay->size, PROT_READ, 
+                                      MAP_PRIVATE | MAP_POPULATE, fd, 0);
+  if (replay->map == MAP_FAILED)
+    print_error("mmap");
+  close(fd);
+  madvise((void*) replay->map, replay->size, MADV_SEQUENTIAL);
+
+  memcpy(&magic, replay->map, sizeof(magic));
+  if (magic == PCAPNG_SHB) {
+    replay->format = FORMAT_PCAPNG;
+    replay->offset = 0;
+    return;
+  }
+
+  replay->format = FORMAT_PCAP;
+  replay->swapped = magic == bswap_32(PCAP_MAGIC_USEC) || magic == bswap_32(PCAP_MAGIC_NSEC);
+  magic = read32(replay, replay->map);
+  if (magic != PCAP_MAGIC_USEC && magic != PCAP_MAGIC_NSEC) {
+    fprintf(stderr, "%s: not a pcap or pcapng file\n", sniffer->config.read_path);
+    exit(EXIT_FAILURE);
+  }
+
+  interface->linktype = read32(replay, replay->map + offsetof(struct pcap_header, linktype));
+  interface->units = magic == PCAP_MAGIC_NSEC ? 1000000000 : 1000000;
+  replay->interface_count = 1;
+  replay->offset = sizeof(struct pcap_header);
+}
+
+/*
+ * pace_replay - used to wait until packet is due when
+ * replaying at original speed. Output is flushed before
+ * waiting, as capture loops do when idle.
+ * @sniffer - pointer to an object of sniffer struct
+ * @start - monotonic time replay started
+ * @offset - time of packet since first packet in ns
+ */
+static void pace_replay(struct sniffer* sniffer, const struct timespec* start, 
+                        uint64_t offset) {
+  struct timespec due, now;
+  uint64_t nsec;
+
+  nsec = start->tv_nsec + offset % 1000000000ull;
+  due.tv_sec = start->tv_sec + offset / 1000000000ull + nsec / 1000000000ull;
+  due.tv_nsec = nsec % 1000000000ull;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  if (now.tv_sec > due.tv_sec || (now.tv_sec == due.tv_sec && now.tv_nsec >= due.tv_nsec))
+    return;
+
+  flush_sniffer(sniffer);
+  while (sniffer->running && 
+         clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &due, NULL) == EINTR)
+    ;
+}
+
+/*
+ * run_replay - used to feed every packet of capture file
+ * through the same pipeline as live capture. Packets go
+ * as fast as possible or at their original timestamps.
+ * @sniffer - pointer to an object of sniffer struct
+ */
+void run_replay(struct sniffer* sniffer) {
+  struct replay* replay = &sniffer->replay;
+  struct replay_packet packet;
+  struct packet_meta meta;
+  struct timespec start, end;
+  uint64_t first = 0, time;
+  unsigned int pending = 0;
+  int offset, found;
+
+  /* Capture files keep no checksum state */
+  meta.checksum = CHECKSUM_REPLAYED;
+  meta.interface = 0;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  while (sniffer->running) {
+    if (replay->format == FORMAT_PCAPNG)
+      found = next_pcapng(replay, &packet);
+    else
+      found = next_pcap(replay, &packet);
+    if (!found)
+      break;
+
+    offset = network_offset(&packet, &meta);
+    if (offset == -1) {
+      replay->skipped++;
+      continue;
+    }
+
+    /* Convert timestamp from units of interface to ns */
+    time = packet.timestamp / packet.interface->units * 1000000000ull +
+           (uint64_t) ((unsigned __int128) (packet.timestamp % packet.interface->units) *
+                       1000000000ull / packet.interface->units);
+    meta.ts.tv_sec = time / 1000000000ull;
+    meta.ts.tv_nsec = time % 1000000000ull;
+    meta.wire_length = packet.len > (uint32_t) offset ? packet.len - offset : 0;
+
+    if (sniffer->config.realtime) {
+      if (replay->packets == 0)
+        first = time;
+      pace_replay(sniffer, &start, time > first ? time - first : 0);
+    }
+
+    replay->packets++;
+    replay->bytes += packet.caplen;
+    process_packet(sniffer, (const char*) packet.data + offset, 
+                   packet.caplen - offset, &meta);
+
+    /* Flush as often as live capture does after a batch */
+    if (++pending == REPLAY_BATCH) {
+      flush_sniffer(sniffer);
+      pending = 0;
+    }
+  }
+
+  flush_sniffer(sniffer);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  replay->elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+/*
+ * free_replay - used to unmap capture file.
+ * @sniffer - pointer to an object of sniffer struct
+ */
+void free_replay(struct sniffer* sniffer) {
+  struct replay* replay = &sniffer->replay;
+
+  if (replay->map)
+    munmap((void*) replay->map, replay->size);
+  replay->map = NULL;
+}
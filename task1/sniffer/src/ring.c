@@ -0,0 +1,181 @@
+#include "../headers/sniffer.h"
+#include <poll.h>
+#include <sys/mman.h>
+#include <net/ethernet.h>
+
+/*
+ * create_ring - used to create AF_PACKET socket with
+ * TPACKET_V3 receive ring and map ring into memory.
+ * Ring geometry is taken from sniffer config.
+ * @sniffer - pointer to an object of sniffer struct
+ */
+void create_ring(struct sniffer* sniffer) {
+  struct ring* ring = &sniffer->ring;
+  int version = TPACKET_V3;
+  unsigned int i;
+
+  /* Create packet socket for all frames, IPv6 included */
+  sniffer->raw_socket = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ALL));
+  if (sniffer->raw_socket == -1)
+    print_error("socket");
+
+  bind_sniffer(sniffer, ETH_P_ALL);
+
+  /* Filter traffic in kernel before anything is queued */
+  setup_filter(sniffer);
+
+  if (setsockopt(sniffer->raw_socket, SOL_PACKET, PACKET_VERSION, 
+                 &version, sizeof(version)) == -1)
+    print_error("setsockopt PACKET_VERSION");
+
+  /* Describe ring geometry */
+  memset(&ring->req, 0, sizeof(ring->req));
+  ring->req.tp_block_size = sniffer->config.block_size;
+  ring->req.tp_block_nr = sniffer->config.block_count;
+  ring->req.tp_frame_size = RING_FRAME_SIZE;
+  ring->req.tp_frame_nr = (sniffer->config.block_size * sniffer->config.block_count) 
+    / RING_FRAME_SIZE;
+  ring->req.tp_retire_blk_tov = sniffer->config.retire_timeout;
+  ring->req.tp_feature_req_word = 0;
+
+  if (setsockopt(sniffer->raw_socket, SOL_PACKET, PACKET_RX_RING, 
+                 &ring->req, sizeof(ring->req)) == -1)
+    print_error("setsockopt PACKET_RX_RING");
+
+  /* Map ring into process memory */
+  ring->map_size = (size_t) ring->req.tp_block_size * ring->req.tp_block_nr;
+  ring->map = mmap(NULL, ring->map_size, PROT_READ | PROT_WRITE, 
+                   MAP_SHARED | MAP_POPULATE, sniffer->raw_socket, 0);
+  if (ring->map == MAP_FAILED)
+    print_error("mmap");
+
+  /* Remember start of every block */
+  ring->blocks = (struct iovec*) malloc(ring->req.tp_block_nr * sizeof(struct iovec));
+  if (!ring->blocks)
+    print_error("malloc");
+  
+  for (i = 0; i < ring->req.tp_block_nr; i++) {
+    ring->blocks[i].iov_base = ring->map + (size_t) i * ring->req.tp_block_size;
+    ring->blocks[i].iov_len = ring->req.tp_block_size;
+  }
+
+  ring->current = 0;
+  ring->packets = 0;
+  ring->drops = 0;
+  ring->freezes = 0;
+}
+
+/*
+ * walk_block - used to pass every frame of retired block
+ * to sniffer pipeline. Frames are read in place, without
+ * copying. Frames sent by this host are skipped, as raw
+ * AF_INET socket does not see them either. VLAN tag
+ * stripped by NIC is taken from frame header.
+ * @sniffer - pointer to an object of sniffer struct
+ * @block - pointer to block descriptor
+ */
+static void walk_block(struct sniffer* sniffer, struct tpacket_block_desc* block) {
+  struct tpacket3_hdr* frame;
+  struct sockaddr_ll* sll;
+  struct packet_meta meta;
+  uint32_t i;
+
+  frame = (struct tpacket3_hdr*) ((uint8_t*) block + block->hdr.bh1.offset_to_first_pkt);
+
+  for (i = 0; i < block->hdr.bh1.num_pkts; i++) {
+    sll = (struct sockaddr_ll*) ((uint8_t*) frame + 
+                                 TPACKET_ALIGN(sizeof(struct tpacket3_hdr)));
+
+    /* Skip own outgoing frames and frames truncated before IP header */
+    if (sll->sll_pkttype != PACKET_OUTGOING && 
+        frame->tp_net >= frame->tp_mac &&
+        frame->tp_snaplen >= frame->tp_net - frame->tp_mac) {
+      meta.ts.tv_sec = frame->tp_sec;
+      meta.ts.tv_nsec = frame->tp_nsec;
+      meta.wire_length = frame->tp_len - (frame->tp_net - frame->tp_mac);
+      meta.checksum = checksum_state(frame->tp_status);
+      meta.vlan_count = 0;
+      meta.interface = 0;
+      if (frame->tp_status & TP_STATUS_VLAN_VALID)
+        meta.vlan_tci[meta.vlan_count++] = frame->hv1.tp_vlan_tci;
+      process_packet(sniffer, 
+                     (const char*) frame + frame->tp_net, 
+                     frame->tp_snaplen - (frame->tp_net - frame->tp_mac),
+                     &meta);
+    }
+
+    frame = (struct tpacket3_hdr*) ((uint8_t*) frame + frame->tp_next_offset);
+  }
+}
+
+/*
+ * run_ring - used to sniff packets from TPACKET_V3 ring.
+ * Waits for kernel to retire block, walks its frames and
+ * returns block to kernel. Poll wakes up periodically, so
+ * worker threads notice when sniffer is stopped.
+ * @sniffer - pointer to an object of sniffer struct
+ */
+void run_ring(struct sniffer* sniffer) {
+  struct ring* ring = &sniffer->ring;
+  struct tpacket_block_desc* block;
+  struct pollfd pfd;
+
+  pfd.fd = sniffer->raw_socket;
+  pfd.events = POLLIN | POLLERR;
+  pfd.revents = 0;
+
+  while (sniffer->running) {
+    if (sniffer->reload)
+      reload_sniffer_filter(sniffer);
+
+    block = (struct tpacket_block_desc*) ring->blocks[ring->current].iov_base;
+
+    /* Wait until kernel hands block to user space */
+    if (!(__atomic_load_n(&block->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER)) {
+      flush_sniffer(sniffer);
+      if (poll(&pfd, 1, RING_POLL_TIMEOUT) == -1 && errno != EINTR)
+        print_error("poll");
+      continue;
+    }
+
+    walk_block(sniffer, block);
+
+    /* Return block to kernel */
+    __atomic_store_n(&block->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+    ring->current = (ring->current + 1) % ring->req.tp_block_nr;
+  }
+}
+
+/*
+ * update_ring_stats - used to read ring statistics from kernel.
+ * Kernel resets counters on every read, so they are accumulated.
+ * @sniffer - pointer to an object of sniffer struct
+ */
+void update_ring_stats(struct sniffer* sniffer) {
+  struct ring* ring = &sniffer->ring;
+  struct tpacket_stats_v3 stats;
+  socklen_t length = sizeof(stats);
+
+  if (getsockopt(sniffer->raw_socket, SOL_PACKET, PACKET_STATISTICS, 
+                 &stats, &length) == -1)
+    print_error("getsockopt PACKET_STATISTICS");
+
+  ring->packets += stats.tp_packets;
+  ring->drops += stats.tp_drops;
+  ring->freezes += stats.tp_freeze_q_cnt;
+}
+
+/*
+ * free_ring - used to unmap ring and free block table.
+ * @sniffer - pointer to an object of sniffer struct
+ */
+void free_ring(struct sniffer* sniffer) {
+  struct ring* ring = &sniffer->ring;
+
+  if (ring->map && ring->map != MAP_FAILED)
+    munmap(ring->map, ring->map_size);
+  free(ring->blocks);
+  
+  ring->map = NULL;
+  ring->blocks = NULL;
+}
@@ -0,0 +1,133 @@
+#include "../headers/sample.h"
+#include <string.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/ip6.h>
+#include <stddef.h>
+
+/*
+ * init_sampler - used to set sampling rate and rate cap.
+ * Bucket starts full, so first burst is not cut.
+ * @sampler - pointer to an object of sampler struct
+ * @rate - keep 1 of every rate flows, 0 or 1 keeps all
+ * @pps - packets per second cap, 0 for none
+ */
+void init_sampler(struct sampler* sampler, uint32_t rate, uint64_t pps) {
+  memset(sampler, 0, sizeof(struct sampler));
+  sampler->rate = rate;
+  sampler->pps = pps;
+
+  /* Bucket always fits at least one packet */
+  sampler->depth = pps * SAMPLE_BURST_MS * 1000000ull;
+  if (sampler->depth < 1000000000ull)
+    sampler->depth = 1000000000ull;
+  sampler->credit = sampler->depth;
+}
+
+/*
+ * fold_address - used to fold IPv6 address into 32 bits,
+ * so it is hashed like IPv4 address.
+ * @address - pointer to address in network byte order
+ *
+ * Return: folded address in host byte order
+ */
+static inline uint32_t fold_address(const uint8_t* address) {
+  uint32_t words[4];
+
+  memcpy(words, address, sizeof(words));
+  return ntohl(words[0] ^ words[1] ^ words[2] ^ words[3]);
+}
+
+/*
+ * sample_flow - used to decide whether flow of IP packet
+ * is sampled. Mirrors program emitted by compile_filter:
+ * ports are hashed only for UDP and TCP, fragments are kept
+ * and decided again once reassembled. IPv6 addresses are
+ * folded, extension headers are not walked and IPv6
+ * fragments are always kept, as they are not reassembled.
+ * @sampler - pointer to an object of sampler struct
+ * @packet - pointer to IP header
+ * @length - amount of captured bytes
+ *
+ * Return: 1 if packet is kept, 0 otherwise
+ */
+static int sample_flow(const struct sampler* sampler, const uint8_t* packet, size_t length) {
+  const struct iphdr* ip = (const struct iphdr*) packet;
+  const struct ip6_hdr* ip6 = (const struct ip6_hdr*) packet;
+  uint32_t src, dst, ports = 0;
+  size_t header;
+  uint16_t port;
+  uint8_t proto;
+
+  if (length >= sizeof(struct ip6_hdr) && ip->version == 6 &&
+      ip6->ip6_nxt != IPPROTO_FRAGMENT) {
+    src = fold_address(packet + offsetof(struct ip6_hdr, ip6_src));
+    dst = fold_address(packet + offsetof(struct ip6_hdr, ip6_dst));
+    proto = ip6->ip6_nxt;
+    header = sizeof(struct ip6_hdr);
+  }
+  else if (length >= sizeof(struct iphdr) && ip->version == 4 &&
+           !(ntohs(ip->frag_off) & (IP_MF | IP_OFFMASK))) {
+    src = ntohl(ip->saddr);
+    dst = ntohl(ip->daddr);
+    proto = ip->protocol;
+    header = ip->ihl * 4;
+  }
+  else
+    return 1;
+
+  if (proto == IPPROTO_UDP || proto == IPPROTO_TCP) {
+    if (length < header + 4)
+      return 1;
+    memcpy(&port, packet + header, sizeof(port));
+    ports = (uint32_t) ntohs(port) << 16;
+    memcpy(&port, packet + header + 2, sizeof(port));
+    ports |= ntohs(port);
+  }
+
+  return sample_hash(src, dst, ports, proto) % sampler->rate == 0;
+}
+
+/*
+ * sample_packet - used to decide whether packet enters
+ * pipeline. Flow sampling goes first, so rate cap is spent
+ * only on sampled flows. Tokens accrue with capture time,
+ * so replay is limited the same way as live capture.
+ * @sampler - pointer to an object of sampler struct
+ * @packet - pointer to IP header
+ * @length - amount of captured bytes
+ * @now - capture time of packet in ns
+ *
+ * Return: 1 if packet is kept, 0 otherwise
+ */
+int sample_packet(struct sampler* sampler, const uint8_t* packet, size_t length, uint64_t now) {
+  uint64_t elapsed;
+
+  if (sampler->rate > 1 && !sample_flow(sampler, packet, length)) {
+    sampler->sampled++;
+    return 0;
+  }
+
+  if (sampler->pps == 0)
+    return 1;
+
+  /* Clamp gap to time of filling empty bucket, so credit can not overflow */
+  elapsed = now > sampler->last ? now - sampler->last : 0;
+  if (elapsed > sampler->depth / sampler->pps)
+    elapsed = sampler->depth / sampler->pps;
+  if (now > sampler->last)
+    sampler->last = now;
+
+  sampler->credit += elapsed * sampler->pps;
+  if (sampler->credit > sampler->depth)
+    sampler->credit = sampler->depth;
+
+  if (sampler->credit < 1000000000ull) {
+    sampler->limited++;
+    return 0;
+  }
+
+  sampler->credit -= 1000000000ull;
+  return 1;
+}
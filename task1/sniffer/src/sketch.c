@@ -0,0 +1,424 @@
+#include "../headers/sketch.h"
+#include "../../common/headers/common.h"
+#include "../../common/headers/log.h"
+#include <math.h>
+
+/*
+ * hash_addr - used to hash IPv4 address. Halves of hash
+ * are used as two independent hashes.
+ * @addr - address in network byte order
+ *
+ * Return: hash of the address
+ */
+static inline uint64_t hash_addr(uint32_t addr) {
+  uint64_t h = (uint64_t) addr * 0x9E3779B97F4A7C15ull;
+
+  h ^= h >> 32;
+  h *= 0xD6E8FEB86659FD93ull;
+  h ^= h >> 32;
+  return h;
+}
+
+/*
+ * init_top - used to allocate heap and index of top talkers.
+ * Index has at least twice as many slots as heap.
+ * @top - pointer to an object of sketch_top struct
+ * @capacity - amount of candidates
+ */
+static void init_top(struct sketch_top* top, unsigned int capacity) {
+  unsigned int slots = 1;
+
+  while (slots < capacity * 2)
+    slots *= 2;
+
+  top->heap = (struct sketch_candidate*) calloc(capacity, sizeof(struct sketch_candidate));
+  top->index = (struct sketch_slot*) calloc(slots, sizeof(struct sketch_slot));
+  if (!top->heap || !top->index)
+    print_error("calloc");
+
+  top->size = 0;
+  top->capacity = capacity;
+  top->index_mask = slots - 1;
+}
+
+/*
+ * find_slot - used to find index slot of candidate.
+ * @top - pointer to an object of sketch_top struct
+ * @addr - address of candidate
+ *
+ * Return: slot of candidate, -1 if address is not a candidate
+ */
+static int find_slot(const struct sketch_top* top, uint32_t addr) {
+  unsigned int i = hash_addr(addr) & top->index_mask;
+
+  while (top->index[i].position) {
+    if (top->index[i].addr == addr)
+      return i;
+    i = (i + 1) & top->index_mask;
+  }
+
+  return -1;
+}
+
+/*
+ * insert_slot - used to add candidate to index.
+ * @top - pointer to an object of sketch_top struct
+ * @addr - address of candidate
+ * @position - position of candidate in heap
+ *
+ * Return: slot of candidate
+ */
+static uint32_t insert_slot(struct sketch_top* top, uint32_t addr, unsigned int position) {
+  unsigned int i = hash_addr(addr) & top->index_mask;
+
+  while (top->index[i].position)
+    i = (i + 1) & top->index_mask;
+
+  top->index[i].addr = addr;
+  top->index[i].position = position + 1;
+  return i;
+}
+
+/*
+ * erase_slot - used to remove candidate from index. Later
+ * slots of probe run are shifted back into the hole, and
+ * heap entries of moved slots are updated.
+ * @top - pointer to an object of sketch_top struct
+ * @slot - slot of candidate
+ */
+static void erase_slot(struct sketch_top* top, unsigned int slot) {
+  unsigned int mask = top->index_mask;
+  unsigned int hole = slot;
+  unsigned int next = slot;
+  unsigned int home;
+
+  top->index[hole].position = 0;
+  while (1) {
+    next = (next + 1) & mask;
+    if (!top->index[next].position)
+      return;
+
+    /* Entry may move only if hole lies between its home and itself */
+    home = hash_addr(top->index[next].addr) & mask;
+    if (((next - home) & mask) < ((next - hole) & mask))
+      continue;
+
+    top->index[hole] = top->index[next];
+    top->heap[top->index[hole].position - 1].slot = hole;
+    top->index[next].position = 0;
+    hole = next;
+  }
+}
+
+/*
+ * swap_candidates - used to swap two heap entries and
+ * keep index pointing at them.
+ * @top - pointer to an object of sketch_top struct
+ * @a - position of first entry
+ * @b - position of second entry
+ */
+static void swap_candidates(struct sketch_top* top, unsigned int a, unsigned int b) {
+  struct sketch_candidate tmp = top->heap[a];
+
+  top->heap[a] = top->heap[b];
+  top->heap[b] = tmp;
+  top->index[top->heap[a].slot].position = a + 1;
+  top->index[top->heap[b].slot].position = b + 1;
+}
+
+/*
+ * sift_up - used to restore heap after entry count
+ * became smaller than count of its parent.
+ * @top - pointer to an object of sketch_top struct
+ * @position - position of entry
+ */
+static void sift_up(struct sketch_top* top, unsigned int position) {
+  unsigned int parent;
+
+  while (position > 0) {
+    parent = (position - 1) / 2;
+    if (top->heap[parent].count <= top->heap[position].count)
+      return;
+    swap_candidates(top, parent, position);
+    position = parent;
+  }
+}
+
+/*
+ * sift_down - used to restore heap after entry count grew.
+ * @top - pointer to an object of sketch_top struct
+ * @position - position of entry
+ */
+static void sift_down(struct sketch_top* top, unsigned int position) {
+  unsigned int child, smallest;
+
+  while (1) {
+    smallest = position;
+    child = position * 2 + 1;
+    if (child < top->size && top->heap[child].count < top->heap[smallest].count)
+      smallest = child;
+    if (child + 1 < top->size && top->heap[child + 1].count < top->heap[smallest].count)
+      smallest = child + 1;
+    if (smallest == position)
+      return;
+    swap_candidates(top, smallest, position);
+    position = smallest;
+  }
+}
+
+/*
+ * update_top - used to offer source with its estimated
+ * count to top talkers. Estimates only grow, so known
+ * candidate moves down the min-heap.
+ * @top - pointer to an object of sketch_top struct
+ * @addr - source address
+ * @count - estimated count of source
+ */
+static void update_top(struct sketch_top* top, uint32_t addr, uint64_t count) {
+  struct sketch_candidate* candidate;
+  int slot = find_slot(top, addr);
+  unsigned int position;
+
+  if (slot != -1) {
+    position = top->index[slot].position - 1;
+    top->heap[position].count = count;
+    sift_down(top, position);
+    return;
+  }
+
+  if (top->size < top->capacity) {
+    position = top->size++;
+    candidate = &top->heap[position];
+    candidate->addr = addr;
+    candidate->count = count;
+    candidate->slot = insert_slot(top, addr, position);
+    sift_up(top, position);
+    return;
+  }
+
+  /* Replace the smallest candidate */
+  candidate = &top->heap[0];
+  if (count <= candidate->count)
+    return;
+
+  erase_slot(top, candidate->slot);
+  candidate->addr = addr;
+  candidate->count = count;
+  candidate->slot = insert_slot(top, addr, 0);
+  sift_down(top, 0);
+}
+
+/*
+ * create_sketch - used to create sketches that fit into
+ * memory budget. Width of Count-Min rows is the largest
+ * power of two that fits.
+ * @memory - memory budget of Count-Min sketches in bytes
+ * @top - amount of top talkers reported
+ *
+ * Return: pointer to an object of sketch struct
+ */
+struct sketch* create_sketch(size_t memory, unsigned int top) {
+  struct sketch* sketch = (struct sketch*) calloc(1, sizeof(struct sketch));
+  size_t column = SKETCH_DEPTH * (sizeof(uint32_t) + sizeof(uint64_t));
+
+  if (!sketch)
+    print_error("calloc");
+
+  sketch->width = 64;
+  while (sketch->width * 2 * column <= memory)
+    sketch->width *= 2;
+
+  sketch->packets = (uint32_t*) calloc(sketch->width * SKETCH_DEPTH, sizeof(uint32_t));
+  sketch->bytes = (uint64_t*) calloc(sketch->width * SKETCH_DEPTH, sizeof(uint64_t));
+  if (!sketch->packets || !sketch->bytes)
+    print_error("calloc");
+
+  /* More candidates than reported keep ranking stable near the cut */
+  sketch->top = top;
+  init_top(&sketch->top_packets, top * SKETCH_CANDIDATES);
+  init_top(&sketch->top_bytes, top * SKETCH_CANDIDATES);
+  return sketch;
+}
+
+/*
+ * add_distinct - used to add hashed value to HyperLogLog.
+ * Top bits select register, register keeps the longest run
+ * of leading zeros of remaining bits plus one.
+ * @registers - HyperLogLog registers
+ * @hash - hash of value
+ */
+static inline void add_distinct(uint8_t* registers, uint64_t hash) {
+  unsigned int index = hash >> (64 - SKETCH_HLL_BITS);
+  uint8_t rank = __builtin_clzll((hash << SKETCH_HLL_BITS) | (1ull << (SKETCH_HLL_BITS - 1))) + 1;
+
+  if (rank > registers[index])
+    registers[index] = rank;
+}
+
+/*
+ * update_sketch - used to count packet. Constant time:
+ * SKETCH_DEPTH counters of each Count-Min sketch, two
+ * registers and two bounded heaps. Conservative update
+ * raises only counters below new estimate.
+ * @sketch - pointer to an object of sketch struct
+ * @src - source address in network byte order
+ * @dst - destination address in network byte order
+ * @bytes - length of IP packet
+ */
+void update_sketch(struct sketch* sketch, uint32_t src, uint32_t dst, uint32_t bytes) {
+  uint64_t hash = hash_addr(src);
+  uint32_t h1 = (uint32_t) hash;
+  uint32_t h2 = (uint32_t) (hash >> 32) | 1;
+  size_t cells[SKETCH_DEPTH];
+  uint32_t min_packets = UINT32_MAX;
+  uint64_t min_bytes = UINT64_MAX;
+  unsigned int i;
+
+  sketch->total_packets++;
+  sketch->total_bytes += bytes;
+
+  for (i = 0; i < SKETCH_DEPTH; i++) {
+    cells[i] = i * sketch->width + ((h1 + i * h2) & (sketch->width - 1));
+    if (sketch->packets[cells[i]] < min_packets)
+      min_packets = sketch->packets[cells[i]];
+    if (sketch->bytes[cells[i]] < min_bytes)
+      min_bytes = sketch->bytes[cells[i]];
+  }
+
+  min_packets++;
+  min_bytes += bytes;
+  for (i = 0; i < SKETCH_DEPTH; i++) {
+    if (sketch->packets[cells[i]] < min_packets)
+      sketch->packets[cells[i]] = min_packets;
+    if (sketch->bytes[cells[i]] < min_bytes)
+      sketch->bytes[cells[i]] = min_bytes;
+  }
+
+  update_top(&sketch->top_packets, src, min_packets);
+  update_top(&sketch->top_bytes, src, min_bytes);
+
+  add_distinct(sketch->sources, hash);
+  add_distinct(sketch->destinations, hash_addr(dst));
+}
+
+/*
+ * estimate_distinct - used to estimate amount of distinct
+ * values added to HyperLogLog. Linear counting is used
+ * while many registers are still empty.
+ * @registers - HyperLogLog registers
+ *
+ * Return: estimated amount of distinct values
+ */
+static double estimate_distinct(const uint8_t* registers) {
+  double m = SKETCH_HLL_SIZE;
+  double sum = 0.0, estimate;
+  unsigned int zeros = 0, i;
+
+  for (i = 0; i < SKETCH_HLL_SIZE; i++) {
+    sum += ldexp(1.0, -registers[i]);
+    zeros += registers[i] == 0;
+  }
+
+  estimate = 0.7213 / (1.0 + 1.079 / m) * m * m / sum;
+  if (estimate <= 2.5 * m && zeros)
+    estimate = m * log(m / zeros);
+  return estimate;
+}
+
+/*
+ * compare_candidates - used by qsort to order candidates
+ * by count, largest first.
+ * @a - pointer to first candidate
+ * @b - pointer to second candidate
+ *
+ * Return: negative, zero or positive as strcmp
+ */
+static int compare_candidates(const void* a, const void* b) {
+  uint64_t x = ((const struct sketch_candidate*) a)->count;
+  uint64_t y = ((const struct sketch_candidate*) b)->count;
+
+  return x < y ? 1 : x > y ? -1 : 0;
+}
+
+/*
+ * log_top - used to log largest candidates of heap.
+ * @top - pointer to an object of sketch_top struct
+ * @count - amount of candidates to log
+ * @id - index of the worker
+ * @what - name of counted values
+ */
+static void log_top(const struct sketch_top* top, unsigned int count, unsigned int id,
+                    const char* what) {
+  struct sketch_candidate* sorted;
+  char addr[INET_ADDRSTRLEN];
+  unsigned int i;
+
+  sorted = (struct sketch_candidate*) malloc(top->capacity * sizeof(struct sketch_candidate));
+  if (!sorted)
+    return;
+
+  memcpy(sorted, top->heap, top->size * sizeof(struct sketch_candidate));
+  qsort(sorted, top->size, sizeof(struct sketch_candidate), compare_candidates);
+
+  for (i = 0; i < count && i < top->size; i++) {
+    inet_ntop(AF_INET, &sorted[i].addr, addr, sizeof(addr));
+    log_message(LOG_LEVEL_INFO, "Sketch %u top %s %u: %s ~%lu\n",
+                id, what, i + 1, addr, (unsigned long) sorted[i].count);
+  }
+
+  free(sorted);
+}
+
+/*
+ * log_sketch - used to log totals, distinct addresses and
+ * top talkers since last reset.
+ * @sketch - pointer to an object of sketch struct
+ * @id - index of the worker
+ */
+void log_sketch(const struct sketch* sketch, unsigned int id) {
+  log_message(LOG_LEVEL_INFO, "Sketch %u: %lu packets, %lu bytes, ~%.0f sources, ~%.0f destinations\n",
+              id,
+              (unsigned long) sketch->total_packets,
+              (unsigned long) sketch->total_bytes,
+              estimate_distinct(sketch->sources),
+              estimate_distinct(sketch->destinations));
+
+  log_top(&sketch->top_packets, sketch->top, id, "packets");
+  log_top(&sketch->top_bytes, sketch->top, id, "bytes");
+}
+
+/*
+ * reset_sketch - used to start new interval.
+ * @sketch - pointer to an object of sketch struct
+ */
+void reset_sketch(struct sketch* sketch) {
+  struct sketch_top* tops[] = {&sketch->top_packets, &sketch->top_bytes};
+  unsigned int i;
+
+  memset(sketch->packets, 0, sketch->width * SKETCH_DEPTH * sizeof(uint32_t));
+  memset(sketch->bytes, 0, sketch->width * SKETCH_DEPTH * sizeof(uint64_t));
+  memset(sketch->sources, 0, sizeof(sketch->sources));
+  memset(sketch->destinations, 0, sizeof(sketch->destinations));
+
+  for (i = 0; i < sizeof(tops) / sizeof(tops[0]); i++) {
+    memset(tops[i]->index, 0, (tops[i]->index_mask + 1) * sizeof(struct sketch_slot));
+    tops[i]->size = 0;
+  }
+
+  sketch->total_packets = 0;
+  sketch->total_bytes = 0;
+}
+
+/*
+ * free_sketch - used to free sketches.
+ * @sketch - pointer to an object of sketch struct
+ */
+void free_sketch(struct sketch* sketch) {
+  free(sketch->packets);
+  free(sketch->bytes);
+  free(sketch->top_packets.heap);
+  free(sketch->top_packets.index);
+  free(sketch->top_bytes.heap);
+  free(sketch->top_bytes.index);
+  free(sketch);
+}
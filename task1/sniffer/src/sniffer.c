@@ -1,93 +1,1228 @@
 #include "../headers/sniffer.h"
 
+/*
+ * init_sniffer_config - used to fill sniffer config
+ * with default values.
+ * @config - pointer to an object of sniffer_config struct
+ */
+void init_sniffer_config(struct sniffer_config* config) {
+  unsigned int i;
+
+  config->mode = CAPTURE_RAW;
+  config->interface = NULL;
+  config->input_count = 0;
+  config->merge_window = MERGE_WINDOW;
+  config->queue = 0;
+  config->batch_size = BATCH_SIZE;
+  config->block_size = RING_BLOCK_SIZE;
+  config->block_count = RING_BLOCK_COUNT;
+  config->retire_timeout = RING_RETIRE_TIMEOUT;
+  config->filter = NULL;
+  config->filter_file = NULL;
+  config->sample = 0;
+  config->max_pps = 0;
+  config->workers = FANOUT_WORKERS;
+  config->fanout = FANOUT_HASH;
+  config->write_prefix = NULL;
+  config->write_format = FORMAT_PCAP;
+  config->snaplen = WRITER_SNAPLEN;
+  config->rotate_size = 0;
+  config->rotate_time = 0;
+  config->compress = 0;
+  config->store_dir = NULL;
+  config->store_size = STORE_SEGMENT_SIZE;
+  config->store_time = STORE_SEGMENT_TIME;
+  config->record_memory = 0;
+  config->record_time = 0;
+  config->record_prefix = RECORDER_PREFIX;
+  config->record_trigger = NULL;
+  config->publish_name = NULL;
+  config->publish_slots = SHM_RING_SLOTS;
+  config->publish_slot_size = SHM_RING_SLOT_SIZE;
+  config->read_path = NULL;
+  config->realtime = 0;
+  config->reasm_memory = REASM_MEMORY;
+  config->reasm_timeout = REASM_TIMEOUT;
+  config->verify = 1;
+  config->histograms = 0;
+  config->hist_flows = HIST_FLOWS;
+  config->hist_interval = HIST_INTERVAL;
+  config->signatures = NULL;
+  config->flows = 0;
+  config->flow_memory = FLOW_MEMORY;
+  config->flow_timeout = FLOW_TIMEOUT;
+  config->flow_interval = FLOW_INTERVAL;
+  config->flow_dump = NULL;
+  config->export_collector = NULL;
+  config->export_version = EXPORT_IPFIX;
+  config->active_timeout = EXPORT_ACTIVE_TIMEOUT;
+  config->latency_port = 0;
+  config->latency_timeout = LATENCY_TIMEOUT;
+  config->sketches = 0;
+  config->sketch_memory = SKETCH_MEMORY;
+  config->sketch_top = SKETCH_TOP;
+  config->sketch_interval = SKETCH_INTERVAL;
+  config->pipeline = 0;
+  for (i = 0; i < PIPELINE_STAGES; i++)
+    config->pipeline_cpus[i] = -1;
+}
+
 /*
  * create_sniffer - used to create an object of UDP packet
- * sniffer.
+ * sniffer. With several workers creates one capture socket
+ * per worker instead of own socket. Signatures are compiled
+ * once and shared by all workers.
+ * @config - pointer to sniffer configuration
  *
  * Return: pointer to an object of sniffer struct
  */
-struct sniffer* create_sniffer() {
+struct sniffer* create_sniffer(const struct sniffer_config* config) {
   struct sniffer* sniffer = (struct sniffer*) malloc(sizeof(struct sniffer));
   if (!sniffer)
     print_error("malloc");
   
-  /* Create Raw UDP socket */
-  sniffer->raw_socket = socket(AF_INET, SOCK_RAW, IPPROTO_UDP); 
-  if (sniffer->raw_socket == -1)
-    print_error("socket");
+  if (config->workers > 1) {
+    memset(sniffer, 0, sizeof(struct sniffer));
+    sniffer->config = *config;
+    sniffer->raw_socket = -1;
+    sniffer->running = 1;
+    if (config->signatures)
+      sniffer->matcher = create_matcher(config->signatures);
+    create_workers(sniffer);
+    return sniffer;
+  }
 
+  init_sniffer(sniffer, config, 0);
+  if (config->signatures)
+    sniffer->matcher = create_matcher(config->signatures);
   return sniffer;
 }
 
+/*
+ * init_sniffer - used to initialize sniffer fields and
+ * create its capture socket.
+ * @sniffer - pointer to an object of sniffer struct
+ * @config - pointer to sniffer configuration
+ * @id - index of the worker
+ */
+void init_sniffer(struct sniffer* sniffer, const struct sniffer_config* config, 
+                  unsigned int id) {
+  memset(sniffer, 0, sizeof(struct sniffer));
+  sniffer->config = *config;
+  sniffer->id = id;
+  sniffer->running = 1;
+
+  /* Every capture thread gets its share of rate cap */
+  init_sampler(&sniffer->sampler, config->sample, 
+               (config->max_pps + config->workers - 1) / config->workers);
+
+  /* Create inputs, memory-mapped ring, map capture file, AF_XDP or batched socket */
+  if (config->input_count > 1)
+    create_merge(sniffer);
+  else if (config->mode == CAPTURE_RING)
+    create_ring(sniffer);
+  else if (config->mode == CAPTURE_FILE)
+    create_replay(sniffer);
+  else if (config->mode == CAPTURE_XDP)
+    create_xsk(sniffer);
+  else
+    create_batch(sniffer);
+
+  /* Every capture thread writes its own files, merged inputs keep their interface */
+  if (config->write_prefix)
+    sniffer->writer = create_writer(config->write_prefix, id, config->write_format,
+                                    config->snaplen, config->rotate_size, 
+                                    config->rotate_time, config->compress,
+                                    sniffer->config.inputs,
+                                    config->input_count > 1 ? config->input_count : 0);
+
+  /* Segments of every capture thread are numbered by worker */
+  if (config->store_dir)
+    sniffer->store = create_store(config->store_dir, id, config->snaplen,
+                                  config->store_size, config->store_time);
+
+  /* Every capture thread keeps its share of history */
+  if (config->record_memory)
+    sniffer->recorder = create_recorder(config->record_prefix, id,
+                                        config->record_memory / config->workers,
+                                        config->record_time, config->snaplen,
+                                        config->record_trigger);
+
+  /* Every capture thread publishes into own ring */
+  if (config->publish_name)
+    sniffer->publisher = create_publisher(config->publish_name, id, config->publish_slots,
+                                          config->publish_slot_size);
+
+  /* Fragments of one datagram reach the same worker only in hash fanout */
+  if (config->reasm_memory)
+    sniffer->reasm = create_reassembly(config->reasm_memory / config->workers,
+                                       (uint64_t) config->reasm_timeout * 1000000000ull);
+
+  /* Every capture thread exports its flows in own observation domain */
+  if (config->export_collector)
+    sniffer->exporter = create_exporter(config->export_collector, config->export_version, id);
+
+  /* Every capture thread owns its share of flow memory */
+  if (config->flows) {
+    sniffer->flows = create_flow_table(config->flow_memory / config->workers,
+                                       (uint64_t) config->flow_timeout * 1000000000ull,
+                                       config->histograms ? config->hist_flows / config->workers : 0,
+                                       sniffer->exporter,
+                                       (uint64_t) config->active_timeout * 1000000000ull);
+    if (config->flow_dump)
+      sniffer->flow_dumper = create_flow_dumper(config->flow_dump, id, sniffer->flows->limit);
+    sniffer->flows_dumped = time(NULL);
+  }
+
+  /* Both directions of flow reach the same worker in hash fanout */
+  if (config->latency_port) {
+    sniffer->latency = create_latency(config->latency_port, LATENCY_PENDING / config->workers,
+                                      (uint64_t) config->latency_timeout * 1000000000ull);
+    sniffer->histograms_dumped = time(NULL);
+  }
+
+  if (config->sketches) {
+    sniffer->sketch = create_sketch(config->sketch_memory / config->workers, config->sketch_top);
+    sniffer->sketch_reported = time(NULL);
+  }
+
+  if (config->histograms) {
+    sniffer->histogram = (struct histogram*) calloc(1, sizeof(struct histogram));
+    if (!sniffer->histogram)
+      print_error("calloc");
+    sniffer->histograms_dumped = time(NULL);
+  }
+
+  if (config->pipeline)
+    sniffer->pipeline = create_pipeline(sniffer, config->pipeline_cpus);
+}
+
 /*
  * run_sniffer - used to start sniffing UDP packets
- * and printing their payload.
+ * and printing their payload. With pipeline calling
+ * thread becomes capture stage.
  * @sniffer - pointer to an object of sniffer struct 
  */
 void run_sniffer(struct sniffer* sniffer) {
-  struct sockaddr_in addr;
-  socklen_t addr_size = sizeof(addr);
-  int bytes_read;
-  char buffer[BUFFER_SIZE];
-  char* ptr;
-
-  /* Sniff packets */
-  while (1) {
-    bytes_read = recvfrom(sniffer->raw_socket, buffer, BUFFER_SIZE, 
-                          0, (struct sockaddr*) &addr, &addr_size);
-    /* Error occured */
-    if (bytes_read == -1) {
-      print_error("recvfrom");
+  if (sniffer->pipeline)
+    start_pipeline(sniffer->pipeline);
+
+  if (sniffer->workers)
+    run_workers(sniffer);
+  else if (sniffer->merge)
+    run_merge(sniffer);
+  else if (sniffer->config.mode == CAPTURE_RING)
+    run_ring(sniffer);
+  else if (sniffer->config.mode == CAPTURE_FILE)
+    run_replay(sniffer);
+  else if (sniffer->config.mode == CAPTURE_XDP)
+    run_xsk(sniffer);
+  else
+    run_batch(sniffer);
+
+  /* Stages finish queued packets before last flush */
+  if (sniffer->pipeline)
+    stop_pipeline(sniffer->pipeline);
+  flush_sniffer(sniffer);
+}
+
+/*
+ * stop_sniffer - used to stop sniffing loop of sniffer
+ * and all its workers or inputs. Safe to call from signal
+ * handler.
+ * @sniffer - pointer to an object of sniffer struct
+ */
+void stop_sniffer(struct sniffer* sniffer) {
+  unsigned int i;
+
+  sniffer->running = 0;
+  for (i = 0; i < sniffer->worker_count; i++)
+    sniffer->workers[i].running = 0;
+  if (sniffer->merge)
+    for (i = 0; i < sniffer->merge->count; i++)
+      sniffer->merge->inputs[i].running = 0;
+}
+
+/*
+ * request_reload - used to ask sniffer and all its workers
+ * or inputs to re-read filter file. Safe to call from signal
+ * handler.
+ * @sniffer - pointer to an object of sniffer struct
+ */
+void request_reload(struct sniffer* sniffer) {
+  unsigned int i;
+
+  sniffer->reload = 1;
+  for (i = 0; i < sniffer->worker_count; i++)
+    sniffer->workers[i].reload = 1;
+  if (sniffer->merge)
+    for (i = 0; i < sniffer->merge->count; i++)
+      sniffer->merge->inputs[i].reload = 1;
+}
+
+/*
+ * request_histograms - used to ask sniffer and all its
+ * workers to log histograms. Safe to call from signal handler.
+ * @sniffer - pointer to an object of sniffer struct
+ */
+void request_histograms(struct sniffer* sniffer) {
+  unsigned int i;
+
+  sniffer->dump = 1;
+  for (i = 0; i < sniffer->worker_count; i++)
+    sniffer->workers[i].dump = 1;
+}
+
+/*
+ * request_snapshot - used to ask sniffer and all its
+ * workers to write flight recorder history. Safe to call
+ * from signal handler.
+ * @sniffer - pointer to an object of sniffer struct
+ */
+void request_snapshot(struct sniffer* sniffer) {
+  unsigned int i;
+
+  sniffer->snapshot = 1;
+  for (i = 0; i < sniffer->worker_count; i++)
+    sniffer->workers[i].snapshot = 1;
+}
+
+/*
+ * bind_sniffer - used to limit capture socket to interface
+ * from config. Packet sockets are bound to interface index,
+ * raw socket to device name.
+ * @sniffer - pointer to an object of sniffer struct
+ * @protocol - protocol of packet socket
+ */
+void bind_sniffer(struct sniffer* sniffer, int protocol) {
+  const char* interface = sniffer->config.interface;
+  struct sockaddr_ll sll;
+
+  if (!interface)
+    return;
+
+  if (sniffer->config.mode == CAPTURE_RAW) {
+    if (setsockopt(sniffer->raw_socket, SOL_SOCKET, SO_BINDTODEVICE, 
+                   interface, strlen(interface) + 1) == -1)
+      print_error("setsockopt SO_BINDTODEVICE");
+    return;
+  }
+
+  memset(&sll, 0, sizeof(sll));
+  sll.sll_family = AF_PACKET;
+  sll.sll_protocol = htons(protocol);
+  sll.sll_ifindex = if_nametoindex(interface);
+  if (sll.sll_ifindex == 0)
+    print_error(interface);
+
+  if (bind(sniffer->raw_socket, (struct sockaddr*) &sll, sizeof(sll)) == -1)
+    print_error("bind");
+}
+
+/*
+ * read_filter_file - used to read filter expression from file.
+ * @path - path to the file
+ * @expression - buffer for expression
+ * @size - size of the buffer
+ *
+ * Return: 0 if successful, -1 otherwise
+ */
+static int read_filter_file(const char* path, char* expression, size_t size) {
+  FILE* file = fopen(path, "r");
+  size_t length;
+
+  if (!file) {
+    perror(path);
+    return -1;
+  }
+
+  length = fread(expression, 1, size - 1, file);
+  expression[length] = '\0';
+  fclose(file);
+  return 0;
+}
+
+/*
+ * setup_filter - used to attach initial filter right after
+ * capture socket is created. Packets queued before filter
+ * was attached are drained, so unwanted traffic never
+ * reaches pipeline. Flow sampling alone also attaches
+ * program. Exits on invalid filter.
+ * @sniffer - pointer to an object of sniffer struct
+ */
+void setup_filter(struct sniffer* sniffer) {
+  char expression[BUFFER_SIZE];
+  char drain[1];
+
+  if (sniffer->config.filter_file) {
+    if (read_filter_file(sniffer->config.filter_file, expression, sizeof(expression)) == -1)
+      exit(EXIT_FAILURE);
+  }
+  else if (sniffer->config.filter) {
+    snprintf(expression, sizeof(expression), "%s", sniffer->config.filter);
+  }
+  else if (sniffer->config.sample > 1) {
+    expression[0] = '\0';
+  }
+  else {
+    return;
+  }
+
+  if (set_sniffer_filter(sniffer, expression) == -1)
+    exit(EXIT_FAILURE);
+
+  /* Drop packets received before filter was attached */
+  while (recv(sniffer->raw_socket, drain, sizeof(drain), MSG_DONTWAIT | MSG_TRUNC) >= 0)
+    ;
+}
+
+/*
+ * set_sniffer_filter - used to compile filter expression and
+ * attach it to capture socket. Kernel swaps programs atomically,
+ * so filter can be changed while sniffing. Empty expression
+ * removes filter, unless flows are sampled in it. On error
+ * previous filter stays attached.
+ * @sniffer - pointer to an object of sniffer struct
+ * @expression - filter expression
+ *
+ * Return: 0 if successful, -1 otherwise
+ */
+int set_sniffer_filter(struct sniffer* sniffer, const char* expression) {
+  struct filter filter;
+  struct sock_fprog prog;
+  const char* ptr = expression;
+
+  /* Empty expression captures everything */
+  while (*ptr == ' ' || *ptr == '\t' || *ptr == '\n')
+    ptr++;
+  if (*ptr == '\0' && sniffer->config.sample <= 1) {
+    if (setsockopt(sniffer->raw_socket, SOL_SOCKET, SO_DETACH_FILTER, NULL, 0) == -1 &&
+        errno != ENOENT) {
+      perror("setsockopt SO_DETACH_FILTER");
+      return -1;
     }
-    /* Received packet */
-    else {
-      /* Extract payload */
-      buffer[bytes_read] = '\0';
-      ptr = extract_payload(buffer);
-
-      /* Print payload */
-      printf("Sniffer UDP packet. Payload: %s\n", ptr);
-      free(ptr);
+    return 0;
+  }
+
+  if (compile_filter(ptr, sniffer->config.sample, &filter) == -1)
+    return -1;
+
+  prog.len = filter.length;
+  prog.filter = filter.insns;
+  if (setsockopt(sniffer->raw_socket, SOL_SOCKET, SO_ATTACH_FILTER, 
+                 &prog, sizeof(prog)) == -1) {
+    perror("setsockopt SO_ATTACH_FILTER");
+    return -1;
+  }
+
+  return 0;
+}
+
+/*
+ * reload_sniffer_filter - used to re-read filter file and
+ * swap attached filter. Called from capture loop after SIGHUP.
+ * @sniffer - pointer to an object of sniffer struct
+ */
+void reload_sniffer_filter(struct sniffer* sniffer) {
+  char expression[BUFFER_SIZE];
+
+  sniffer->reload = 0;
+  if (!sniffer->config.filter_file)
+    return;
+
+  if (read_filter_file(sniffer->config.filter_file, expression, sizeof(expression)) == -1 ||
+      set_sniffer_filter(sniffer, expression) == -1) {
+    fprintf(stderr, "Sniffer: keeping previous filter\n");
+    return;
+  }
+
+  fprintf(stderr, "Sniffer: filter reloaded\n");
+}
+
+/*
+ * append_output - used to append bytes to output buffer.
+ * Buffer is flushed when it runs out of space.
+ * @output - pointer to an object of output struct
+ * @data - bytes to append
+ * @length - amount of bytes
+ */
+static void append_output(struct output* output, const void* data, size_t length) {
+  if (output->length + length > OUTPUT_SIZE)
+    flush_output(output);
+
+  /* Too big for buffer, log as is */
+  if (length > OUTPUT_SIZE) {
+    log_write(LOG_LEVEL_INFO, data, length);
+    return;
+  }
+
+  memcpy(output->buffer + output->length, data, length);
+  output->length += length;
+}
+
+/*
+ * flush_output - used to pass buffered output to logger
+ * as one message.
+ * @output - pointer to an object of output struct
+ */
+void flush_output(struct output* output) {
+  if (output->length == 0)
+    return;
+
+  log_write(LOG_LEVEL_INFO, output->buffer, output->length);
+  output->length = 0;
+}
+
+/*
+ * sniffer_clock - used to get time flows and fragments are
+ * expired against. Replayed packets carry time of capture
+ * file, so they age by the newest packet instead of wall clock.
+ * @sniffer - pointer to an object of sniffer struct
+ *
+ * Return: current capture time in ns
+ */
+static uint64_t sniffer_clock(struct sniffer* sniffer) {
+  struct timespec ts;
+
+  if (sniffer->config.mode == CAPTURE_FILE)
+    return __atomic_load_n(&sniffer->latest, __ATOMIC_RELAXED);
+
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/*
+ * log_sniffer_flows - used to log summary of flow table
+ * of sniffer and of its snapshots.
+ * @sniffer - pointer to an object of sniffer struct
+ */
+static void log_sniffer_flows(struct sniffer* sniffer) {
+  struct flow_table* flows = sniffer->flows;
+
+  log_message(LOG_LEVEL_INFO, "Flows %u: %lu active of %lu slots, %lu created, %lu evicted, "
+              "%lu dropped (table full)\n",
+              sniffer->id,
+              (unsigned long) flows->count,
+              (unsigned long) flows->capacity,
+              (unsigned long) flows->created,
+              (unsigned long) flows->evicted,
+              (unsigned long) flows->dropped);
+
+  if (flows->unhistogrammed)
+    log_message(LOG_LEVEL_INFO, "Flows %u: %lu flows without histogram (pool full)\n",
+                sniffer->id, (unsigned long) flows->unhistogrammed);
+
+  if (sniffer->flow_dumper && sniffer->flow_dumper->skipped)
+    log_message(LOG_LEVEL_INFO, "Flows %u: %lu snapshots skipped (previous one not written)\n",
+                sniffer->id, (unsigned long) sniffer->flow_dumper->skipped);
+}
+
+/*
+ * tick_flows - used to evict part of idle flows and copy
+ * part of pending snapshot on every flush, so cost of every
+ * tick is bounded. Snapshot is started and table summary
+ * logged once per flow interval. Flow records that waited
+ * long enough are sent.
+ * @sniffer - pointer to an object of sniffer struct
+ */
+static void tick_flows(struct sniffer* sniffer) {
+  uint64_t now = sniffer_clock(sniffer);
+  time_t seconds = time(NULL);
+
+  if (seconds - sniffer->flows_dumped >= (time_t) sniffer->config.flow_interval) {
+    sniffer->flows_dumped = seconds;
+    log_sniffer_flows(sniffer);
+    if (sniffer->flow_dumper)
+      start_flow_snapshot(sniffer->flow_dumper);
+  }
+
+  expire_flows(sniffer->flows, now, FLOW_SWEEP_SLOTS);
+  if (sniffer->flow_dumper)
+    copy_flow_snapshot(sniffer->flow_dumper, sniffer->flows, FLOW_SNAPSHOT_SLOTS);
+
+  if (sniffer->exporter)
+    tick_exporter(sniffer->exporter, now);
+}
+
+/*
+ * tick_sketch - used to report and reset sketches once
+ * per interval.
+ * @sniffer - pointer to an object of sniffer struct
+ */
+static void tick_sketch(struct sniffer* sniffer) {
+  time_t now = time(NULL);
+
+  if (now - sniffer->sketch_reported >= (time_t) sniffer->config.sketch_interval) {
+    sniffer->sketch_reported = now;
+    log_sketch(sniffer->sketch, sniffer->id);
+    reset_sketch(sniffer->sketch);
+  }
+}
+
+/*
+ * log_histograms - used to log gap histogram of sniffer
+ * and of its flows, and response times of servers.
+ * @sniffer - pointer to an object of sniffer struct
+ */
+static void log_histograms(struct sniffer* sniffer) {
+  char summary[LOG_LINE_SIZE / 2];
+
+  if (sniffer->histogram) {
+    format_histogram(sniffer->histogram, "gaps", summary, sizeof(summary));
+    log_message(LOG_LEVEL_INFO, "Histogram %u: %s\n", sniffer->id, summary);
+
+    if (sniffer->flows)
+      log_flow_histograms(sniffer->flows);
+  }
+
+  if (sniffer->latency)
+    log_latency(sniffer->latency, sniffer->id);
+}
+
+/*
+ * tick_histograms - used to log histograms when asked
+ * by signal or once per interval.
+ * @sniffer - pointer to an object of sniffer struct
+ */
+static void tick_histograms(struct sniffer* sniffer) {
+  time_t now;
+
+  if (sniffer->dump) {
+    sniffer->dump = 0;
+    log_histograms(sniffer);
+    return;
+  }
+
+  if (!sniffer->config.hist_interval)
+    return;
+
+  now = time(NULL);
+  if (now - sniffer->histograms_dumped >= (time_t) sniffer->config.hist_interval) {
+    sniffer->histograms_dumped = now;
+    log_histograms(sniffer);
+  }
+}
+
+/*
+ * tick_sniffer - used by stage that processes packets after
+ * every batch and when idle. Writes buffered output, lets
+ * capture writer and store hand over buffers and rotate
+ * files or seal segments, starts snapshot of flight recorder
+ * asked for by signal, drops incomplete datagrams that
+ * timed out, evicts idle flows and logs histograms, response
+ * times and sketches when they are due.
+ * @sniffer - pointer to an object of sniffer struct
+ */
+void tick_sniffer(struct sniffer* sniffer) {
+  flush_output(&sniffer->output);
+  if (sniffer->writer)
+    tick_writer(sniffer->writer, sniffer_clock(sniffer) / 1000000000ull);
+  if (sniffer->store)
+    tick_store(sniffer->store, sniffer_clock(sniffer) / 1000000000ull);
+  if (sniffer->snapshot) {
+    sniffer->snapshot = 0;
+    if (sniffer->recorder)
+      trigger_recorder(sniffer->recorder);
+  }
+  if (sniffer->reasm)
+    expire_reassembly(sniffer->reasm, sniffer_clock(sniffer));
+  if (sniffer->flows)
+    tick_flows(sniffer);
+  if (sniffer->histogram || sniffer->latency)
+    tick_histograms(sniffer);
+  if (sniffer->sketch)
+    tick_sketch(sniffer);
+}
+
+/*
+ * flush_sniffer - used by capture loops after every batch
+ * or block and when idle. Without pipeline capture thread
+ * processes packets itself and ticks, with running pipeline
+ * parse stage does it.
+ * @sniffer - pointer to an object of sniffer struct
+ */
+void flush_sniffer(struct sniffer* sniffer) {
+  if (sniffer->pipeline && sniffer->pipeline->running)
+    return;
+  tick_sniffer(sniffer);
+}
+
+/*
+ * Used to collect signatures found in one payload,
+ * so every signature is reported once per packet.
+ */
+struct match_report {
+  /* Sniffer the packet belongs to */
+  struct sniffer* sniffer;
+
+  /* Parsed packet */
+  const struct packet_view* view;
+
+  /* Signatures already reported */
+  unsigned int patterns[MATCH_MAX_REPORTS];
+  unsigned int count;
+};
+
+/*
+ * report_match - used as matcher callback to print found
+ * signature with flow of the packet.
+ * @matcher - pointer to an object of matcher struct
+ * @pattern - index of found signature
+ * @end - offset after signature in payload
+ * @arg - pointer to an object of match_report struct
+ */
+static void report_match(const struct matcher* matcher, unsigned int pattern, 
+                         size_t end, void* arg) {
+  struct match_report* report = (struct match_report*) arg;
+  const struct iphdr* ip = view_ip(report->view);
+  const struct udphdr* udp = view_udp(report->view);
+  char src[INET_ADDRSTRLEN], dst[INET_ADDRSTRLEN];
+  char line[LOG_LINE_SIZE];
+  unsigned int i;
+  int length;
+
+  (void) end;
+  for (i = 0; i < report->count; i++)
+    if (report->patterns[i] == pattern)
+      return;
+  if (report->count == MATCH_MAX_REPORTS)
+    return;
+  report->patterns[report->count++] = pattern;
+
+  inet_ntop(AF_INET, &ip->saddr, src, sizeof(src));
+  inet_ntop(AF_INET, &ip->daddr, dst, sizeof(dst));
+  length = snprintf(line, sizeof(line), "Sniffer match: signature \"%s\" flow %s:%u -> %s:%u\n",
+                    matcher->names[pattern], src, ntohs(udp->source), dst, ntohs(udp->dest));
+  if (length >= (int) sizeof(line))
+    length = sizeof(line) - 1;
+  append_output(&report->sniffer->output, line, length);
+}
+
+/*
+ * print_payload - used to format payload of UDP packet into
+ * output buffer. Payload is written with its length, so
+ * binary payloads are not cut at NUL. Merged input and VLAN
+ * tags of trunk frames are printed first.
+ * @output - pointer to an object of output struct
+ * @meta - capture metadata of packet
+ * @interface - input packet was merged from, NULL without merge
+ * @payload - UDP payload
+ * @length - amount of payload bytes
+ */
+void print_payload(struct output* output, const struct packet_meta* meta,
+                   const char* interface, const uint8_t* payload, size_t length) {
+  static const char prefix[] = "Sniffer UDP packet. Payload: ";
+
+  if (meta->vlan_count || interface) {
+    char tags[64];
+    int size;
+
+    append_output(output, prefix, 7);
+    if (interface) {
+      append_output(output, " ", 1);
+      append_output(output, interface, strlen(interface));
+    }
+    if (meta->vlan_count) {
+      size = snprintf(tags, sizeof(tags), " VLAN %u", meta->vlan_tci[0] & 0x0FFF);
+      if (meta->vlan_count > 1)
+        size += snprintf(tags + size, sizeof(tags) - size, "/%u", 
+                         meta->vlan_tci[1] & 0x0FFF);
+      append_output(output, tags, size);
     }
+    append_output(output, prefix + 7, sizeof(prefix) - 8);
+  }
+  else {
+    append_output(output, prefix, sizeof(prefix) - 1);
   }
+  append_output(output, payload, length);
+  append_output(output, "\n", 1);
 }
 
 /*
- * extract_payload - used to extract payload
- * from UDP packet. Skips IP header and UDP header
- * by calculation their length. Allocates memory
- * for payload (must be free manually).
- * @buffer - pointer to UDP packet
+ * fill_flow_key - used to build flow key of IPv4 UDP packet.
+ * @view - pointer to parsed packet
+ * @key - filled with 5-tuple of packet
+ */
+static void fill_flow_key(const struct packet_view* view, struct flow_key* key) {
+  memset(key, 0, sizeof(*key));
+  key->src = view_ip(view)->saddr;
+  key->dst = view_ip(view)->daddr;
+  key->sport = view_udp(view)->source;
+  key->dport = view_udp(view)->dest;
+  key->proto = view_ip(view)->protocol;
+  key->used = 1;
+}
+
+/*
+ * count_protocol - used to count dissected packet that is
+ * not processed by its transport protocol.
+ * @stats - pointer to an object of sniffer_stats struct
+ * @view - pointer to dissected packet
+ */
+static void count_protocol(struct sniffer_stats* stats, const struct packet_view* view) {
+  if (view->network == ETHERTYPE_IPV6)
+    stats->ipv6++;
+
+  if (view->fragment && !view->transport.data)
+    stats->fragments++;
+  else if (view->proto == IPPROTO_TCP)
+    stats->tcp++;
+  else if (view->proto == IPPROTO_ICMP || view->proto == IPPROTO_ICMPV6)
+    stats->icmp++;
+  else if (view->proto == IPPROTO_UDP)
+    stats->udp6++;
+  else
+    stats->other++;
+}
+
+/*
+ * inspect_packet - used to pass sampled packet through
+ * everything but printing. Every packet is written by
+ * capture writer, kept in packet store and flight recorder,
+ * published to readers and counted in sketches, fragments
+ * as they were captured. Fragments are held until their
+ * datagram is complete and then processed as one packet.
+ * Packets with bad checksum are dropped, transport checksum
+ * is left to kernel and not summed for replayed packets.
+ * Payload is checked against signatures, requests and
+ * responses of measured server are timed. With flow
+ * aggregation packets only update their flow.
+ * @sniffer - pointer to an object of sniffer struct
+ * @packet - pointer to IP header
+ * @length - amount of captured bytes starting from IP header
+ * @meta - capture metadata of packet
+ * @view - filled with parsed packet to print
  *
- * Return: pointer to buffer with payload
+ * Return: 1 if payload of view should be printed, 0 otherwise
  */
-char* extract_payload(char* buffer) {
-  int iphdr_length, size;
-  char* ptr;
-  char* payload = (char*) malloc(BUFFER_SIZE * sizeof(char));
-  struct iphdr* ip;
-  
-  /* Extract IP header */
-  ip = (struct iphdr*) buffer;
+int inspect_packet(struct sniffer* sniffer, const char* packet, size_t length,
+                   const struct packet_meta* meta, struct packet_view* view) {
+  struct match_report report;
+  struct flow_key key;
+  enum packet_checksum checksum = meta->checksum;
+  enum packet_verdict verdict;
+  const uint8_t* datagram;
+  uint64_t now = (uint64_t) meta->ts.tv_sec * 1000000000ull + meta->ts.tv_nsec;
+
+  if (sniffer->writer)
+    write_packet(sniffer->writer, &meta->ts, meta->interface, packet, length,
+                 meta->wire_length);
+
+  if (sniffer->store)
+    store_packet(sniffer->store, now, packet, length, meta->wire_length);
+
+  if (sniffer->recorder)
+    record_packet(sniffer->recorder, now, packet, length, meta->wire_length);
+
+  if (sniffer->publisher)
+    publish_packet(sniffer->publisher, now, packet, length, meta->wire_length);
+
+  /* Sketches see every IPv4 packet, fragments included */
+  if (sniffer->sketch && length >= sizeof(struct iphdr) && 
+      ((const struct iphdr*) packet)->version == 4) {
+    const struct iphdr* ip = (const struct iphdr*) packet;
+
+    update_sketch(sniffer->sketch, ip->saddr, ip->daddr, ntohs(ip->tot_len));
+  }
+
+  /* Rate cap was spent on fragments, datagram is only sampled by flow */
+  if (sniffer->reasm && is_fragment((const uint8_t*) packet, length)) {
+    if (!reassemble(sniffer->reasm, (const uint8_t*) packet, length, now, &datagram, &length))
+      return 0;
+    packet = (const char*) datagram;
+    checksum = CHECKSUM_UNKNOWN;
+    if (!sample_packet(sniffer->pipeline ? &sniffer->pipeline->sampler : &sniffer->sampler,
+                       datagram, length, now))
+      return 0;
+  }
+
+  /* Skip everything that is not a complete IPv4 UDP packet */
+  if (dissect_packet(view, packet, length, LAYER_IP) == -1)
+    return 0;
+  if (view->network != ETHERTYPE_IP || view->proto != IPPROTO_UDP || !view->transport.data) {
+    count_protocol(&sniffer->stats, view);
+    return 0;
+  }
+
+  /* Corrupt packets are counted in their flow, if it exists, and dropped */
+  if (sniffer->config.verify) {
+    if (checksum != CHECKSUM_UNKNOWN)
+      sniffer->stats.offloaded++;
+    if ((verdict = verify_packet(view, checksum)) != VERDICT_VALID) {
+      if (verdict == VERDICT_BAD_IP)
+        sniffer->stats.ip_errors++;
+      else
+        sniffer->stats.udp_errors++;
+      if (sniffer->flows) {
+        fill_flow_key(view, &key);
+        count_flow_error(sniffer->flows, &key);
+      }
+      return 0;
+    }
+  }
+
+  sniffer->stats.packets++;
+  sniffer->stats.bytes += view->payload.length;
+
+  if (sniffer->histogram) {
+    if (sniffer->histogram_last)
+      record_histogram(sniffer->histogram, 
+                       now > sniffer->histogram_last ? now - sniffer->histogram_last : 0);
+    if (now > sniffer->histogram_last)
+      sniffer->histogram_last = now;
+  }
+
+  if (sniffer->matcher) {
+    report.sniffer = sniffer;
+    report.view = view;
+    report.count = 0;
+    scan_payload(sniffer->matcher, view->payload.data, view->payload.length, 
+                 report_match, &report);
+    if (report.count)
+      sniffer->stats.matches++;
+  }
+
+  if (sniffer->flows || sniffer->latency)
+    fill_flow_key(view, &key);
+
+  if (sniffer->latency)
+    track_latency(sniffer->latency, &key, now);
+
+  if (sniffer->flows) {
+    update_flow(sniffer->flows, &key, view->payload.length, now);
+    return 0;
+  }
+
+  return 1;
+}
+
+/*
+ * process_packet - used to handle packet read in place from
+ * capture buffer. Packets of flows that are not sampled and
+ * packets over rate cap are dropped before anything else.
+ * Without pipeline packet is inspected and its payload
+ * printed to buffer of sniffer, capture loops flush it after
+ * every batch or block. With pipeline packet is copied and
+ * handed to parse stage, on input of merge it is copied and
+ * queued for merge instead.
+ * @sniffer - pointer to an object of sniffer struct
+ * @packet - pointer to IP header
+ * @length - amount of captured bytes starting from IP header
+ * @meta - capture metadata of packet
+ */
+void process_packet(struct sniffer* sniffer, const char* packet, size_t length,
+                    const struct packet_meta* meta) {
+  struct packet_view view;
+  uint64_t now = (uint64_t) meta->ts.tv_sec * 1000000000ull + meta->ts.tv_nsec;
+
+  /* Read by parse stage to age flows of replay */
+  if (now > sniffer->latest)
+    __atomic_store_n(&sniffer->latest, now, __ATOMIC_RELAXED);
+
+  /* Flows sampled out in kernel never get here, fragments are decided once complete */
+  if (!sample_packet(&sniffer->sampler, (const uint8_t*) packet, length, now))
+    return;
+
+  if (sniffer->merge_queue) {
+    queue_packet(sniffer->merge_queue, packet, length, meta);
+    return;
+  }
+
+  if (sniffer->pipeline) {
+    submit_packet(sniffer->pipeline, packet, length, meta);
+    return;
+  }
+
+  if (inspect_packet(sniffer, packet, length, meta, &view))
+    print_payload(&sniffer->output, meta, merge_input_name(sniffer, meta),
+                  view.payload.data, view.payload.length);
+}
+
+/*
+ * print_capture_stats - used to log statistics of one
+ * capture socket. With merge reports packets of every input
+ * and how many left merge out of order. In ring mode reports
+ * frames dropped by kernel because ring was full, in raw and
+ * link modes reports average batch fill, in replay mode
+ * reports throughput of pipeline, in XDP mode reports how
+ * program runs and frames lost in kernel.
+ * @sniffer - pointer to an object of sniffer struct
+ * @name - name printed in front of statistics
+ */
+static void print_capture_stats(struct sniffer* sniffer, const char* name) {
+  struct batch* batch = &sniffer->batch;
+  struct sniffer_stats* stats = &sniffer->stats;
+  char summary[LOG_LINE_SIZE / 2];
+
+  if (sniffer->merge) {
+    log_merge(sniffer->merge, name);
+  }
+  else if (sniffer->config.mode == CAPTURE_FILE) {
+    struct replay* replay = &sniffer->replay;
+    double elapsed = replay->elapsed > 0 ? replay->elapsed : 1e-9;
+
+    log_message(LOG_LEVEL_INFO, "%s: %lu packets (%lu skipped), %lu UDP processed in %.3f s, "
+                "%.0f pps, %.1f MB/s\n",
+                name,
+                (unsigned long) replay->packets,
+                (unsigned long) replay->skipped,
+                (unsigned long) sniffer->stats.packets,
+                replay->elapsed,
+                replay->packets / elapsed,
+                replay->bytes / elapsed / 1e6);
+  }
+  else if (sniffer->config.mode == CAPTURE_RAW || sniffer->config.mode == CAPTURE_LINK) {
+    double fill = batch->calls ? (double) batch->packets / batch->calls : 0.0;
+    
+    log_message(LOG_LEVEL_INFO, "%s: %lu packets in %lu calls, "
+                "average batch fill %.2f/%u (%.1f%%)\n",
+                name,
+                (unsigned long) batch->packets,
+                (unsigned long) batch->calls,
+                fill, batch->size, 100.0 * fill / batch->size);
+  }
+  else if (sniffer->config.mode == CAPTURE_XDP) {
+    update_xsk_stats(sniffer);
+    log_message(LOG_LEVEL_INFO, "%s: %lu frames in %s %s mode, %lu dropped (rx ring full), "
+                "%lu fill ring empty, %lu UDP processed\n",
+                name,
+                (unsigned long) sniffer->xsk.packets,
+                sniffer->xsk.native ? "native" : "generic",
+                sniffer->xsk.zerocopy ? "zero-copy" : "copy",
+                (unsigned long) sniffer->xsk.stats.rx_ring_full,
+                (unsigned long) sniffer->xsk.stats.rx_fill_ring_empty_descs,
+                (unsigned long) sniffer->stats.packets);
+  }
+  else {
+    update_ring_stats(sniffer);
+    log_message(LOG_LEVEL_INFO, "%s: %lu packets, %lu dropped (ring full), %lu queue freezes, "
+                "%lu UDP processed\n",
+                name,
+                (unsigned long) sniffer->ring.packets,
+                (unsigned long) sniffer->ring.drops,
+                (unsigned long) sniffer->ring.freezes,
+                (unsigned long) sniffer->stats.packets);
+  }
+
+  if (sniffer->config.mode == CAPTURE_LINK && batch->other)
+    log_message(LOG_LEVEL_INFO, "%s: %lu frames without IPv4 or IPv6\n",
+                name, (unsigned long) batch->other);
+
+  if (sniffer->reasm && sniffer->reasm->fragments)
+    log_message(LOG_LEVEL_INFO, "%s: %lu fragments, %lu datagrams reassembled, %lu timed out, "
+                "%lu evicted (pool full), %lu overlaps, %lu invalid\n",
+                name,
+                (unsigned long) sniffer->reasm->fragments,
+                (unsigned long) sniffer->reasm->datagrams,
+                (unsigned long) sniffer->reasm->timeouts,
+                (unsigned long) sniffer->reasm->evicted,
+                (unsigned long) sniffer->reasm->overlaps,
+                (unsigned long) sniffer->reasm->invalid);
+
+  /* Flows sampled out by kernel filter are not counted */
+  if (sniffer->sampler.rate > 1 || sniffer->sampler.pps)
+    log_message(LOG_LEVEL_INFO, "%s: %lu packets sampled out in user space, %lu over rate cap\n",
+                name,
+                (unsigned long) sniffer->sampler.sampled,
+                (unsigned long) sniffer->sampler.limited);
+
+  if (sniffer->pipeline)
+    log_pipeline(sniffer->pipeline, name);
+
+  if (sniffer->histogram) {
+    format_histogram(sniffer->histogram, "gaps", summary, sizeof(summary));
+    log_message(LOG_LEVEL_INFO, "%s: %s\n", name, summary);
+  }
+
+  if (sniffer->sketch)
+    log_sketch(sniffer->sketch, sniffer->id);
+
+  if (sniffer->latency) {
+    log_message(LOG_LEVEL_INFO, "%s: %lu responses timed, %lu unmatched, %lu repeated requests, "
+                "%lu evicted (table full), %lu to untracked endpoints\n",
+                name,
+                (unsigned long) sniffer->latency->responses,
+                (unsigned long) sniffer->latency->unmatched,
+                (unsigned long) sniffer->latency->repeated,
+                (unsigned long) sniffer->latency->evicted,
+                (unsigned long) sniffer->latency->overflow);
+    log_latency(sniffer->latency, sniffer->id);
+  }
+
+  if (stats->tcp + stats->icmp + stats->udp6 + stats->fragments + stats->other)
+    log_message(LOG_LEVEL_INFO, "%s: other protocols not processed: %lu TCP, %lu ICMP, "
+                "%lu IPv6 UDP, %lu fragments, %lu other (%lu IPv6 packets)\n",
+                name,
+                (unsigned long) stats->tcp,
+                (unsigned long) stats->icmp,
+                (unsigned long) stats->udp6,
+                (unsigned long) stats->fragments,
+                (unsigned long) stats->other,
+                (unsigned long) stats->ipv6);
+
+  if (sniffer->config.verify)
+    log_message(LOG_LEVEL_INFO, "%s: %lu bad IP header checksums, %lu bad UDP checksums, "
+                "%lu UDP checksums not summed\n",
+                name,
+                (unsigned long) stats->ip_errors,
+                (unsigned long) stats->udp_errors,
+                (unsigned long) stats->offloaded);
+
+  if (sniffer->matcher)
+    log_message(LOG_LEVEL_INFO, "%s: %lu packets matched signatures\n",
+                name, (unsigned long) sniffer->stats.matches);
+
+  if (sniffer->writer)
+    log_message(LOG_LEVEL_INFO, "%s: %lu packets written to %lu files, %lu dropped (writer busy)\n",
+                name,
+                (unsigned long) sniffer->writer->packets,
+                (unsigned long) sniffer->writer->files,
+                (unsigned long) sniffer->writer->dropped);
+
+  if (sniffer->recorder)
+    log_message(LOG_LEVEL_INFO, "%s: %lu packets recorded, %lu dropped (snapshot busy), "
+                "%lu snapshots, %lu triggers ignored\n",
+                name,
+                (unsigned long) sniffer->recorder->packets,
+                (unsigned long) sniffer->recorder->dropped,
+                (unsigned long) sniffer->recorder->snapshots,
+                (unsigned long) sniffer->recorder->ignored);
+
+  if (sniffer->publisher)
+    log_message(LOG_LEVEL_INFO, "%s: %lu packets published to %s, %lu cut to slot\n",
+                name,
+                (unsigned long) sniffer->publisher->head,
+                sniffer->publisher->name,
+                (unsigned long) sniffer->publisher->truncated);
+
+  if (sniffer->store)
+    log_message(LOG_LEVEL_INFO, "%s: %lu packets stored in %lu sealed segments, "
+                "%lu dropped (store busy)\n",
+                name,
+                (unsigned long) sniffer->store->packets,
+                (unsigned long) sniffer->store->segments,
+                (unsigned long) sniffer->store->dropped);
+}
+
+/*
+ * print_sniffer_stats - used to log capture statistics,
+ * per worker and in total in worker mode, per input
+ * and of merged stream with merge.
+ * @sniffer - pointer to an object of sniffer struct
+ */
+void print_sniffer_stats(struct sniffer* sniffer) {
+  uint64_t packets = 0, drops = 0;
+  char name[32];
+  unsigned int i;
+
+  /* Statistics follow payloads of all workers */
+  flush_log();
+
+  /* Every input reports its socket or file before merged stream */
+  if (sniffer->merge) {
+    for (i = 0; i < sniffer->merge->count; i++) {
+      snprintf(name, sizeof(name), "Input %u stats", i);
+      print_capture_stats(&sniffer->merge->inputs[i], name);
+    }
+  }
+
+  if (!sniffer->workers) {
+    print_capture_stats(sniffer, "Sniffer stats");
+    return;
+  }
+
+  for (i = 0; i < sniffer->worker_count; i++) {
+    snprintf(name, sizeof(name), "Worker %u stats", i);
+    print_capture_stats(&sniffer->workers[i], name);
+    packets += sniffer->workers[i].ring.packets;
+    drops += sniffer->workers[i].ring.drops;
+  }
+
+  log_message(LOG_LEVEL_INFO, "Sniffer stats: %lu packets, %lu dropped (ring full) in %u workers\n",
+              (unsigned long) packets, (unsigned long) drops, sniffer->worker_count);
+}
+
+/*
+ * destroy_sniffer - used to close capture socket of sniffer
+ * and free its buffers, but not sniffer itself. Last flow
+ * snapshot is written and remaining flows are exported
+ * before flow table is freed.
+ * @sniffer - pointer to an object of sniffer struct
+ */
+void destroy_sniffer(struct sniffer* sniffer) {
+  uint64_t now;
+
+  if (sniffer->pipeline)
+    free_pipeline(sniffer->pipeline);
+
+  if (sniffer->writer)
+    free_writer(sniffer->writer);
+
+  if (sniffer->store)
+    free_store(sniffer->store);
+
+  if (sniffer->recorder)
+    free_recorder(sniffer->recorder);
+
+  if (sniffer->publisher)
+    free_publisher(sniffer->publisher);
+
+  /* Flows left in table end with capture */
+  if (sniffer->flows) {
+    now = sniffer_clock(sniffer);
+    expire_flows(sniffer->flows, now, sniffer->flows->capacity);
+    if (sniffer->flow_dumper)
+      free_flow_dumper(sniffer->flow_dumper, sniffer->flows);
+    log_sniffer_flows(sniffer);
+    if (sniffer->exporter) {
+      export_flows(sniffer->flows, now);
+      flush_exporter(sniffer->exporter, now);
+      log_message(LOG_LEVEL_INFO, "Export %u: %lu flow records in %lu messages, %lu not sent\n",
+                  sniffer->id,
+                  (unsigned long) sniffer->exporter->exported,
+                  (unsigned long) sniffer->exporter->messages,
+                  (unsigned long) sniffer->exporter->errors);
+      free_exporter(sniffer->exporter);
+    }
+    free_flow_table(sniffer->flows);
+  }
+
+  if (sniffer->reasm)
+    free_reassembly(sniffer->reasm);
+
+  free(sniffer->histogram);
+
+  if (sniffer->latency)
+    free_latency(sniffer->latency);
 
-  /* Calculate IP header length */
-  iphdr_length = ip->ihl * 4;
+  if (sniffer->sketch)
+    free_sketch(sniffer->sketch);
 
-  /* Get payload */
-  ptr = buffer + iphdr_length + sizeof(struct udphdr);
-   
-  /* Copy payload */
-  strncpy(payload, ptr, strlen(ptr));
+  if (sniffer->workers)
+    free_workers(sniffer);
+  else if (sniffer->merge)
+    free_merge(sniffer);
+  else if (sniffer->config.mode == CAPTURE_RING)
+    free_ring(sniffer);
+  else if (sniffer->config.mode == CAPTURE_FILE)
+    free_replay(sniffer);
+  else if (sniffer->config.mode == CAPTURE_XDP)
+    free_xsk(sniffer);
+  else
+    free_batch(sniffer);
 
-  return payload;  
+  if (sniffer->raw_socket != -1)
+    close(sniffer->raw_socket);
 }
 
 /*
  * free_sniffer - used to free allocated memory
- * for sniffer object.
+ * for sniffer object and matcher shared by workers.
  * @sniffer - pointer to an object of sniffer struct
  */
 void free_sniffer(struct sniffer* sniffer) {
-  close(sniffer->raw_socket);
+  destroy_sniffer(sniffer);
+  if (sniffer->matcher)
+    free_matcher(sniffer->matcher);
   free(sniffer);
 }
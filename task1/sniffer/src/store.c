@@ -0,0 +1,543 @@
+#include "../headers/store.h"
+#include "../../common/headers/common.h"
+#include <fcntl.h>
+#include <errno.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <netinet/in.h>
+
+/*
+ * write_all - used to write whole buffer to file.
+ * @fd - file descriptor
+ * @data - bytes to write
+ * @length - amount of bytes
+ *
+ * Return: 0 if successful, -1 otherwise
+ */
+static int write_all(int fd, const void* data, size_t length) {
+  const uint8_t* ptr = (const uint8_t*) data;
+  ssize_t result;
+
+  while (length > 0) {
+    result = write(fd, ptr, length);
+    if (result == -1 && errno == EINTR)
+      continue;
+    if (result == -1)
+      return -1;
+    ptr += result;
+    length -= result;
+  }
+
+  return 0;
+}
+
+/*
+ * find_sequence - used to continue numbering after segments
+ * of this worker left by previous runs, so they are never
+ * overwritten.
+ * @store - pointer to an object of store struct
+ *
+ * Return: first free sequence number
+ */
+static unsigned int find_sequence(const struct store* store) {
+  struct dirent* entry;
+  unsigned int id, sequence, next = 0;
+  DIR* dir = opendir(store->dir);
+
+  if (!dir)
+    print_error("opendir");
+
+  while ((entry = readdir(dir))) {
+    if (sscanf(entry->d_name, SEGMENT_PREFIX "-%u-%u", &id, &sequence) == 2 &&
+        id == store->id && sequence >= next)
+      next = sequence + 1;
+  }
+
+  closedir(dir);
+  return next;
+}
+
+/*
+ * open_segment - used by store thread to start next segment.
+ * @store - pointer to an object of store struct
+ */
+static void open_segment(struct store* store) {
+  char path[PATH_MAX + 8];
+
+  /* Cut name could overwrite another segment */
+  if (snprintf(store->path, sizeof(store->path), "%s/" SEGMENT_PREFIX "-%u-%05u",
+               store->dir, store->id, store->sequence++) >= (int) sizeof(store->path)) {
+    errno = ENAMETOOLONG;
+    print_error(store->dir);
+  }
+
+  snprintf(path, sizeof(path), "%s" SEGMENT_RECORDS, store->path);
+  store->record_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (store->record_fd == -1)
+    print_error("open");
+
+  snprintf(path, sizeof(path), "%s" SEGMENT_DATA, store->path);
+  store->data_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (store->data_fd == -1)
+    print_error("open");
+
+  store->written = 0;
+  store->data_written = 0;
+}
+
+/*
+ * index_times - used by store thread to extend time index
+ * with records about to be appended.
+ * @store - pointer to an object of store struct
+ * @records - records in capture order
+ * @count - amount of records
+ */
+static void index_times(struct store* store, const struct segment_record* records,
+                        unsigned int count) {
+  struct segment_block* block;
+  uint32_t index;
+  unsigned int i;
+
+  for (i = 0; i < count; i++) {
+    index = store->written + i;
+    if (index / SEGMENT_STRIDE >= store->block_capacity) {
+      store->block_capacity = store->block_capacity ? store->block_capacity * 2 : 64;
+      store->blocks = (struct segment_block*) realloc(store->blocks,
+                        store->block_capacity * sizeof(struct segment_block));
+      if (!store->blocks)
+        print_error("realloc");
+    }
+
+    block = &store->blocks[index / SEGMENT_STRIDE];
+    if (index % SEGMENT_STRIDE == 0) {
+      block->first = records[i].timestamp;
+      block->last = records[i].timestamp;
+    }
+    else if (records[i].timestamp < block->first) {
+      block->first = records[i].timestamp;
+    }
+    else if (records[i].timestamp > block->last) {
+      block->last = records[i].timestamp;
+    }
+  }
+}
+
+/*
+ * compare_postings - used to sort records of segment by
+ * flow and then by position.
+ * @a - pointer to first entry
+ * @b - pointer to second entry
+ *
+ * Return: negative, zero or positive like memcmp
+ */
+static int compare_postings(const void* a, const void* b) {
+  const struct segment_flow* x = (const struct segment_flow*) a;
+  const struct segment_flow* y = (const struct segment_flow*) b;
+  int result = compare_segment_flows(x, y);
+
+  if (result)
+    return result;
+  return x->first < y->first ? -1 : x->first > y->first;
+}
+
+/*
+ * write_index - used by store thread to build flow index from
+ * records of finished segment and write it with time index.
+ * Index is written under temporary name and renamed, so
+ * readers never see partial index.
+ * @store - pointer to an object of store struct
+ */
+static void write_index(struct store* store) {
+  char path[PATH_MAX + 8], tmp[PATH_MAX + 16];
+  struct segment_header header;
+  struct segment_flow* flows;
+  const struct segment_record* records;
+  uint32_t* postings;
+  uint32_t i, count = store->written;
+  unsigned int blocks = (count + SEGMENT_STRIDE - 1) / SEGMENT_STRIDE;
+  int fd;
+
+  snprintf(path, sizeof(path), "%s" SEGMENT_RECORDS, store->path);
+  fd = open(path, O_RDONLY);
+  if (fd == -1)
+    print_error("open");
+  records = (const struct segment_record*) mmap(NULL, count * sizeof(struct segment_record),
+                                                PROT_READ, MAP_PRIVATE, fd, 0);
+  if (records == MAP_FAILED)
+    print_error("mmap");
+  close(fd);
+
+  flows = (struct segment_flow*) malloc(count * sizeof(struct segment_flow));
+  postings = (uint32_t*) malloc(count * sizeof(uint32_t));
+  if (!flows || !postings)
+    print_error("malloc");
+
+  /* Sort record numbers by flow, then merge runs into flows */
+  for (i = 0; i < count; i++) {
+    memset(&flows[i], 0, sizeof(flows[i]));
+    flows[i].src = records[i].src;
+    flows[i].dst = records[i].dst;
+    flows[i].sport = records[i].sport;
+    flows[i].dport = records[i].dport;
+    flows[i].proto = records[i].proto;
+    flows[i].first = i;
+  }
+  munmap((void*) records, count * sizeof(struct segment_record));
+  qsort(flows, count, sizeof(struct segment_flow), compare_postings);
+
+  memset(&header, 0, sizeof(header));
+  for (i = 0; i < count; i++) {
+    postings[i] = flows[i].first;
+    if (header.flows && compare_segment_flows(&flows[header.flows - 1], &flows[i]) == 0) {
+      flows[header.flows - 1].count++;
+      continue;
+    }
+    flows[header.flows] = flows[i];
+    flows[header.flows].first = i;
+    flows[header.flows].count = 1;
+    header.flows++;
+  }
+
+  header.magic = SEGMENT_MAGIC;
+  header.version = SEGMENT_VERSION;
+  header.stride = SEGMENT_STRIDE;
+  header.records = count;
+  header.blocks = blocks;
+  header.data_length = store->data_written;
+  header.first = store->blocks[0].first;
+  header.last = store->blocks[0].last;
+  for (i = 1; i < blocks; i++) {
+    if (store->blocks[i].first < header.first)
+      header.first = store->blocks[i].first;
+    if (store->blocks[i].last > header.last)
+      header.last = store->blocks[i].last;
+  }
+
+  snprintf(path, sizeof(path), "%s" SEGMENT_INDEX, store->path);
+  snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+  fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd == -1)
+    print_error("open");
+  if (write_all(fd, &header, sizeof(header)) == -1 ||
+      write_all(fd, store->blocks, blocks * sizeof(struct segment_block)) == -1 ||
+      write_all(fd, flows, header.flows * sizeof(struct segment_flow)) == -1 ||
+      write_all(fd, postings, count * sizeof(uint32_t)) == -1)
+    print_error("write");
+  close(fd);
+  if (rename(tmp, path) == -1)
+    print_error("rename");
+
+  free(flows);
+  free(postings);
+}
+
+/*
+ * seal_segment - used by store thread to close files of
+ * current segment and index it.
+ * @store - pointer to an object of store struct
+ */
+static void seal_segment(struct store* store) {
+  close(store->record_fd);
+  close(store->data_fd);
+  store->record_fd = -1;
+  store->data_fd = -1;
+
+  write_index(store);
+  store->segments++;
+}
+
+/*
+ * store_main - used as thread routine of store. Appends
+ * full buffers to segment in order and returns them to pool.
+ * Segment left open when store stops is sealed too.
+ * @arg - pointer to an object of store struct
+ *
+ * Return: NULL
+ */
+static void* store_main(void* arg) {
+  struct store* store = (struct store*) arg;
+  struct store_buffer* buffer;
+
+  while (1) {
+    pthread_mutex_lock(&store->lock);
+    while (store->full_count == 0 && !store->stop)
+      pthread_cond_wait(&store->full_cond, &store->lock);
+
+    if (store->full_count == 0) {
+      pthread_mutex_unlock(&store->lock);
+      break;
+    }
+
+    buffer = store->full_queue[store->full_head];
+    store->full_head = (store->full_head + 1) % STORE_BUFFERS;
+    store->full_count--;
+    pthread_mutex_unlock(&store->lock);
+
+    /* Append bytes before records, so readers of open segment never see record without them */
+    if (buffer->count > 0) {
+      if (store->record_fd == -1)
+        open_segment(store);
+      index_times(store, buffer->records, buffer->count);
+      if (write_all(store->data_fd, buffer->data, buffer->length) == -1 ||
+          write_all(store->record_fd, buffer->records,
+                    buffer->count * sizeof(struct segment_record)) == -1)
+        print_error("write");
+      store->written += buffer->count;
+      store->data_written += buffer->length;
+    }
+
+    if (buffer->seal && store->record_fd != -1)
+      seal_segment(store);
+
+    /* Return buffer to pool */
+    buffer->count = 0;
+    buffer->length = 0;
+    buffer->seal = 0;
+    pthread_mutex_lock(&store->lock);
+    store->free_list[store->free_count++] = buffer;
+    pthread_mutex_unlock(&store->lock);
+  }
+
+  if (store->record_fd != -1)
+    seal_segment(store);
+  return NULL;
+}
+
+/*
+ * create_store - used to create packet store and start
+ * its thread. Directory is created if it does not exist.
+ * @dir - directory of segments
+ * @id - index of the worker
+ * @snaplen - maximum bytes stored per packet
+ * @segment_size - seal segment after this many data bytes
+ * @segment_time - seal segment after this many seconds, 0 to disable
+ *
+ * Return: pointer to an object of store struct
+ */
+struct store* create_store(const char* dir, unsigned int id, uint32_t snaplen,
+                           uint64_t segment_size, unsigned int segment_time) {
+  struct store* store;
+  unsigned int i;
+  int result;
+
+  store = (struct store*) calloc(1, sizeof(struct store));
+  if (!store)
+    print_error("calloc");
+
+  if (mkdir(dir, 0755) == -1 && errno != EEXIST)
+    print_error("mkdir");
+
+  if (snprintf(store->dir, sizeof(store->dir), "%s", dir) >= (int) sizeof(store->dir)) {
+    fprintf(stderr, "%s: store directory is too long\n", dir);
+    exit(EXIT_FAILURE);
+  }
+  store->id = id;
+  store->snaplen = snaplen;
+  store->segment_size = segment_size;
+  store->segment_time = segment_time;
+  store->record_fd = -1;
+  store->data_fd = -1;
+  store->sequence = find_sequence(store);
+
+  /* Allocate buffer pool */
+  for (i = 0; i < STORE_BUFFERS; i++) {
+    store->buffers[i].records = (struct segment_record*) malloc(
+        STORE_BUFFER_RECORDS * sizeof(struct segment_record));
+    store->buffers[i].data = (uint8_t*) malloc(STORE_BUFFER_SIZE);
+    if (!store->buffers[i].records || !store->buffers[i].data)
+      print_error("malloc");
+    store->free_list[i] = &store->buffers[i];
+  }
+  store->free_count = STORE_BUFFERS;
+
+  /* Capture thread starts with first buffer */
+  store->current = store->free_list[--store->free_count];
+  store->segment_started = 0;
+  store->last_submit = time(NULL);
+
+  pthread_mutex_init(&store->lock, NULL);
+  pthread_cond_init(&store->full_cond, NULL);
+
+  result = pthread_create(&store->thread, NULL, store_main, store);
+  if (result != 0) {
+    errno = result;
+    print_error("pthread_create");
+  }
+
+  return store;
+}
+
+/*
+ * take_buffer - used by capture thread to get free buffer
+ * when it has none. Never waits.
+ * @store - pointer to an object of store struct
+ */
+static void take_buffer(struct store* store) {
+  pthread_mutex_lock(&store->lock);
+  if (store->free_count)
+    store->current = store->free_list[--store->free_count];
+  pthread_mutex_unlock(&store->lock);
+}
+
+/*
+ * submit_buffer - used by capture thread to hand current buffer
+ * to store thread and take free one. Never waits: without
+ * free buffer current stays NULL and packets are dropped.
+ * @store - pointer to an object of store struct
+ * @seal - seal segment after this buffer
+ */
+static void submit_buffer(struct store* store, int seal) {
+  unsigned int tail;
+
+  pthread_mutex_lock(&store->lock);
+  if (store->current) {
+    store->current->seal = seal;
+    tail = (store->full_head + store->full_count) % STORE_BUFFERS;
+    store->full_queue[tail] = store->current;
+    store->full_count++;
+    pthread_cond_signal(&store->full_cond);
+  }
+
+  store->current = store->free_count ? store->free_list[--store->free_count] : NULL;
+  pthread_mutex_unlock(&store->lock);
+
+  store->last_submit = time(NULL);
+}
+
+/*
+ * start_segment - used by capture thread to finish current
+ * segment at record boundary. Seal travels with a buffer, so
+ * without one segment keeps growing until a buffer is free,
+ * otherwise offsets of both threads would disagree.
+ * @store - pointer to an object of store struct
+ * @now - current time in seconds
+ *
+ * Return: 0 if segment was finished, -1 otherwise
+ */
+static int start_segment(struct store* store, time_t now) {
+  if (!store->current)
+    take_buffer(store);
+  if (!store->current)
+    return -1;
+
+  submit_buffer(store, 1);
+  store->segment_records = 0;
+  store->segment_bytes = 0;
+  store->segment_started = now;
+  return 0;
+}
+
+/*
+ * store_packet - used to append packet record and its bytes
+ * to current buffer. Called on capture thread, only copies
+ * memory. 5-tuple is read from IPv4 header for flow index.
+ * @store - pointer to an object of store struct
+ * @timestamp - capture time of packet in ns
+ * @data - packet starting from IP header
+ * @length - amount of captured bytes
+ * @wire_length - original length of packet
+ */
+void store_packet(struct store* store, uint64_t timestamp, const void* data,
+                  uint32_t length, uint32_t wire_length) {
+  uint32_t caplen = length < store->snaplen ? length : store->snaplen;
+  const struct iphdr* ip = (const struct iphdr*) data;
+  const uint16_t* ports;
+  struct segment_record* record;
+  time_t now = timestamp / 1000000000ull;
+
+  /* Sealing by time follows capture clock, as in replay */
+  if (!store->segment_started)
+    store->segment_started = now;
+
+  /* Seal before record that would not fit */
+  if (store->segment_records > 0 &&
+      (store->segment_records >= STORE_SEGMENT_RECORDS ||
+       store->segment_bytes + caplen > store->segment_size ||
+       (store->segment_time && now - store->segment_started >= store->segment_time)))
+    start_segment(store, now);
+
+  /* Take new buffer when current one is full */
+  if (store->current && (store->current->count == STORE_BUFFER_RECORDS ||
+                         store->current->length + caplen > STORE_BUFFER_SIZE))
+    submit_buffer(store, 0);
+  if (!store->current)
+    take_buffer(store);
+  if (!store->current || store->segment_bytes + caplen > UINT32_MAX) {
+    store->dropped++;
+    return;
+  }
+
+  record = &store->current->records[store->current->count++];
+  memset(record, 0, sizeof(*record));
+  record->timestamp = timestamp;
+  record->offset = store->segment_bytes;
+  record->caplen = caplen;
+  record->wire_length = wire_length < 65535 ? wire_length : 65535;
+
+  if (length >= sizeof(struct iphdr) && ip->version == 4) {
+    record->src = ip->saddr;
+    record->dst = ip->daddr;
+    record->proto = ip->protocol;
+
+    /* Ports are only in first fragment */
+    ports = (const uint16_t*) ((const uint8_t*) data + ip->ihl * 4);
+    if ((ip->protocol == IPPROTO_UDP || ip->protocol == IPPROTO_TCP) &&
+        (ntohs(ip->frag_off) & IP_OFFMASK) == 0 && length >= ip->ihl * 4u + 4) {
+      record->sport = ports[0];
+      record->dport = ports[1];
+    }
+  }
+
+  memcpy(store->current->data + store->current->length, data, caplen);
+  store->current->length += caplen;
+  store->segment_bytes += caplen;
+  store->segment_records++;
+  store->packets++;
+}
+
+/*
+ * tick_store - used by capture loop when it is idle or
+ * between batches. Hands partly filled buffer to store
+ * thread once per flush interval and seals segment by time
+ * even when no packets arrive. Sealing uses capture clock
+ * of packets, flush uses wall clock.
+ * @store - pointer to an object of store struct
+ * @now - current capture time in seconds
+ */
+void tick_store(struct store* store, time_t now) {
+  if (store->segment_time && now - store->segment_started >= store->segment_time &&
+      store->segment_records > 0 && start_segment(store, now) == 0)
+    return;
+
+  if (store->current && store->current->count > 0 &&
+      time(NULL) - store->last_submit >= STORE_FLUSH_INTERVAL)
+    submit_buffer(store, 0);
+}
+
+/*
+ * free_store - used to write remaining records, seal last
+ * segment, wait for store thread and free store.
+ * @store - pointer to an object of store struct
+ */
+void free_store(struct store* store) {
+  unsigned int i;
+
+  submit_buffer(store, 1);
+
+  pthread_mutex_lock(&store->lock);
+  store->stop = 1;
+  pthread_cond_signal(&store->full_cond);
+  pthread_mutex_unlock(&store->lock);
+  pthread_join(store->thread, NULL);
+
+  pthread_mutex_destroy(&store->lock);
+  pthread_cond_destroy(&store->full_cond);
+
+  for (i = 0; i < STORE_BUFFERS; i++) {
+    free(store->buffers[i].records);
+    free(store->buffers[i].data);
+  }
+  free(store->blocks);
+  free(store);
+}
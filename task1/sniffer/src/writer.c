@@ -0,0 +1,582 @@
+#include "../headers/writer.h"
+#include "../headers/pcap.h"
+#include "../../common/headers/common.h"
+#include <fcntl.h>
+#include <errno.h>
+#include <zlib.h>
+
+/*
+ * interface_size - used to get size of pcapng interface
+ * description block with name.
+ * @name - name of interface
+ *
+ * Return: size of block in bytes
+ */
+static size_t interface_size(const char* name) {
+  return sizeof(struct pcapng_header) - 28 + 4 + ((strlen(name) + 3) & ~(size_t) 3);
+}
+
+/*
+ * header_size - used to get size of file header. Merged
+ * inputs are described by own block each in pcapng.
+ * @writer - pointer to an object of capture_writer struct
+ *
+ * Return: size of header in bytes
+ */
+static size_t header_size(const struct capture_writer* writer) {
+  size_t size = 28;
+  unsigned int i;
+
+  if (writer->format != FORMAT_PCAPNG)
+    return sizeof(struct pcap_header);
+  if (writer->interface_count == 0)
+    return sizeof(struct pcapng_header);
+
+  for (i = 0; i < writer->interface_count; i++)
+    size += interface_size(writer->interfaces[i]);
+  return size;
+}
+
+/*
+ * record_size - used to get size of record on disk.
+ * @format - file format
+ * @caplen - amount of stored packet bytes
+ *
+ * Return: size of record in bytes
+ */
+static size_t record_size(enum capture_format format, uint32_t caplen) {
+  if (format == FORMAT_PCAPNG)
+    return sizeof(struct pcapng_epb) + ((caplen + 3) & ~3u) + sizeof(uint32_t);
+  return sizeof(struct pcap_record) + caplen;
+}
+
+/*
+ * write_all - used to write whole buffer to file.
+ * @fd - file descriptor
+ * @data - bytes to write
+ * @length - amount of bytes
+ *
+ * Return: 0 if successful, -1 otherwise
+ */
+static int write_all(int fd, const void* data, size_t length) {
+  const uint8_t* ptr = (const uint8_t*) data;
+  ssize_t result;
+
+  while (length > 0) {
+    result = write(fd, ptr, length);
+    if (result == -1 && errno == EINTR)
+      continue;
+    if (result == -1)
+      return -1;
+    ptr += result;
+    length -= result;
+  }
+
+  return 0;
+}
+
+/*
+ * write_interface - used by writer thread to describe merged
+ * input in pcapng, so its packets keep their interface.
+ * @writer - pointer to an object of capture_writer struct
+ * @name - name of interface or capture file
+ */
+static void write_interface(struct capture_writer* writer, const char* name) {
+  uint8_t block[sizeof(struct pcapng_header) + PATH_MAX];
+  struct pcapng_block header;
+  uint16_t linktype = LINKTYPE_RAW;
+  uint16_t option[2];
+  uint32_t end = 0;
+  size_t offset;
+
+  header.type = PCAPNG_IDB;
+  header.length = interface_size(name);
+  memset(block, 0, header.length);
+  memcpy(block, &header, sizeof(header));
+  memcpy(block + 8, &linktype, 2);
+  memcpy(block + 12, &writer->snaplen, 4);
+  offset = 16;
+
+  option[0] = PCAPNG_IF_NAME;
+  option[1] = strlen(name);
+  memcpy(block + offset, option, 4);
+  memcpy(block + offset + 4, name, option[1]);
+  offset += 4 + ((option[1] + 3) & ~3u);
+
+  /* Timestamps are in ns, as in single interface header */
+  option[0] = PCAPNG_IF_TSRESOL;
+  option[1] = 1;
+  memcpy(block + offset, option, 4);
+  block[offset + 4] = 9;
+  offset += 8;
+
+  memcpy(block + offset, &end, 4);
+  memcpy(block + offset + 4, &header.length, 4);
+
+  if (write_all(writer->fd, block, header.length) == -1)
+    print_error("write");
+}
+
+/*
+ * open_file - used by writer thread to open next file
+ * and write its header.
+ * @writer - pointer to an object of capture_writer struct
+ */
+static void open_file(struct capture_writer* writer) {
+  struct pcap_header pcap;
+  struct pcapng_header pcapng;
+  unsigned int i;
+
+  /* Cut name could overwrite another file */
+  if (snprintf(writer->path, sizeof(writer->path), "%s-%u-%05u.%s",
+               writer->prefix, writer->id, writer->sequence++,
+               writer->format == FORMAT_PCAPNG ? "pcapng" : "pcap") >=
+      (int) sizeof(writer->path)) {
+    errno = ENAMETOOLONG;
+    print_error(writer->prefix);
+  }
+
+  writer->fd = open(writer->path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (writer->fd == -1)
+    print_error("open");
+
+  if (writer->format == FORMAT_PCAPNG) {
+    memset(&pcapng, 0, sizeof(pcapng));
+    pcapng.shb_type = PCAPNG_SHB;
+    pcapng.shb_length = 28;
+    pcapng.byte_order = PCAPNG_BYTE_ORDER;
+    pcapng.version_major = 1;
+    pcapng.version_minor = 0;
+    pcapng.section_length = -1;
+    pcapng.shb_length_end = 28;
+    pcapng.idb_type = PCAPNG_IDB;
+    pcapng.idb_length = sizeof(pcapng) - 28;
+    pcapng.linktype = LINKTYPE_RAW;
+    pcapng.snaplen = writer->snaplen;
+    pcapng.tsresol_code = PCAPNG_IF_TSRESOL;
+    pcapng.tsresol_length = 1;
+    pcapng.tsresol = 9;
+    pcapng.idb_length_end = sizeof(pcapng) - 28;
+
+    /* Merged inputs replace single unnamed interface */
+    if (write_all(writer->fd, &pcapng, writer->interface_count ? 28 : sizeof(pcapng)) == -1)
+      print_error("write");
+    for (i = 0; i < writer->interface_count; i++)
+      write_interface(writer, writer->interfaces[i]);
+  }
+  else {
+    pcap.magic = PCAP_MAGIC_NSEC;
+    pcap.version_major = 2;
+    pcap.version_minor = 4;
+    pcap.thiszone = 0;
+    pcap.sigfigs = 0;
+    pcap.snaplen = writer->snaplen;
+    pcap.linktype = LINKTYPE_RAW;
+    if (write_all(writer->fd, &pcap, sizeof(pcap)) == -1)
+      print_error("write");
+  }
+
+  writer->files++;
+}
+
+/*
+ * close_file - used by writer thread to close current file
+ * and queue it for compression.
+ * @writer - pointer to an object of capture_writer struct
+ */
+static void close_file(struct capture_writer* writer) {
+  unsigned int tail;
+
+  close(writer->fd);
+  writer->fd = -1;
+
+  if (!writer->compress)
+    return;
+
+  pthread_mutex_lock(&writer->lock);
+  if (writer->pending_count == WRITER_MAX_PENDING) {
+    fprintf(stderr, "writer: compression backlog full, leaving %s\n", writer->path);
+  }
+  else {
+    tail = (writer->pending_head + writer->pending_count) % WRITER_MAX_PENDING;
+    strcpy(writer->pending[tail], writer->path);
+    writer->pending_count++;
+    pthread_cond_signal(&writer->pending_cond);
+  }
+  pthread_mutex_unlock(&writer->lock);
+}
+
+/*
+ * writer_main - used as thread routine of writer. Writes
+ * full buffers in order and returns them to pool.
+ * @arg - pointer to an object of capture_writer struct
+ *
+ * Return: NULL
+ */
+static void* writer_main(void* arg) {
+  struct capture_writer* writer = (struct capture_writer*) arg;
+  struct writer_buffer* buffer;
+
+  while (1) {
+    pthread_mutex_lock(&writer->lock);
+    while (writer->full_count == 0 && !writer->stop)
+      pthread_cond_wait(&writer->full_cond, &writer->lock);
+
+    if (writer->full_count == 0) {
+      pthread_mutex_unlock(&writer->lock);
+      break;
+    }
+
+    buffer = writer->full_queue[writer->full_head];
+    writer->full_head = (writer->full_head + 1) % WRITER_BUFFERS;
+    writer->full_count--;
+    pthread_mutex_unlock(&writer->lock);
+
+    /* Write records, opening file on first data */
+    if (buffer->length > 0) {
+      if (writer->fd == -1)
+        open_file(writer);
+      if (write_all(writer->fd, buffer->data, buffer->length) == -1)
+        print_error("write");
+    }
+
+    if (buffer->rotate && writer->fd != -1)
+      close_file(writer);
+
+    /* Return buffer to pool */
+    buffer->length = 0;
+    buffer->rotate = 0;
+    pthread_mutex_lock(&writer->lock);
+    writer->free_list[writer->free_count++] = buffer;
+    pthread_mutex_unlock(&writer->lock);
+  }
+
+  if (writer->fd != -1)
+    close_file(writer);
+  return NULL;
+}
+
+/*
+ * compress_file - used to gzip closed file next to it
+ * and remove original.
+ * @path - path to the file
+ */
+static void compress_file(const char* path) {
+  char gz_path[PATH_MAX + 4];
+  char chunk[BUFFER_SIZE];
+  gzFile gz;
+  ssize_t length;
+  int fd;
+
+  fd = open(path, O_RDONLY);
+  if (fd == -1) {
+    perror(path);
+    return;
+  }
+
+  snprintf(gz_path, sizeof(gz_path), "%s.gz", path);
+  gz = gzopen(gz_path, "wb6");
+  if (!gz) {
+    perror(gz_path);
+    close(fd);
+    return;
+  }
+
+  while ((length = read(fd, chunk, sizeof(chunk))) > 0) {
+    if (gzwrite(gz, chunk, length) != length) {
+      fprintf(stderr, "writer: gzwrite failed for %s\n", gz_path);
+      break;
+    }
+  }
+
+  close(fd);
+  if (gzclose(gz) == Z_OK && length == 0)
+    unlink(path);
+}
+
+/*
+ * compressor_main - used as thread routine of compressor.
+ * Compresses closed files until writer is stopped and
+ * backlog is empty.
+ * @arg - pointer to an object of capture_writer struct
+ *
+ * Return: NULL
+ */
+static void* compressor_main(void* arg) {
+  struct capture_writer* writer = (struct capture_writer*) arg;
+  char path[PATH_MAX];
+
+  while (1) {
+    pthread_mutex_lock(&writer->lock);
+    while (writer->pending_count == 0 && writer->stop < 2)
+      pthread_cond_wait(&writer->pending_cond, &writer->lock);
+
+    if (writer->pending_count == 0) {
+      pthread_mutex_unlock(&writer->lock);
+      break;
+    }
+
+    strcpy(path, writer->pending[writer->pending_head]);
+    writer->pending_head = (writer->pending_head + 1) % WRITER_MAX_PENDING;
+    writer->pending_count--;
+    pthread_mutex_unlock(&writer->lock);
+
+    compress_file(path);
+  }
+
+  return NULL;
+}
+
+/*
+ * create_writer - used to create capture writer and start
+ * its writer and compressor threads.
+ * @prefix - prefix of file names
+ * @id - index of the worker
+ * @format - file format
+ * @snaplen - maximum bytes stored per packet
+ * @rotate_size - rotate after this many bytes, 0 to disable
+ * @rotate_time - rotate after this many seconds, 0 to disable
+ * @compress - compress closed files
+ * @interfaces - names of merged inputs, NULL for one unnamed
+ * @interface_count - amount of merged inputs, 0 for one unnamed
+ *
+ * Return: pointer to an object of capture_writer struct
+ */
+struct capture_writer* create_writer(const char* prefix, unsigned int id,
+                                     enum capture_format format, uint32_t snaplen,
+                                     uint64_t rotate_size, unsigned int rotate_time,
+                                     int compress, const char* const* interfaces,
+                                     unsigned int interface_count) {
+  struct capture_writer* writer;
+  unsigned int i;
+  int result;
+
+  writer = (struct capture_writer*) calloc(1, sizeof(struct capture_writer));
+  if (!writer)
+    print_error("calloc");
+
+  if (snprintf(writer->prefix, sizeof(writer->prefix), "%s", prefix) >=
+      (int) sizeof(writer->prefix)) {
+    fprintf(stderr, "%s: capture file prefix is too long\n", prefix);
+    exit(EXIT_FAILURE);
+  }
+  writer->id = id;
+  writer->format = format;
+  writer->snaplen = snaplen;
+  writer->rotate_size = rotate_size;
+  writer->rotate_time = rotate_time;
+  writer->compress = compress;
+  writer->interfaces = interfaces;
+  writer->interface_count = interface_count;
+  writer->header_length = header_size(writer);
+  writer->fd = -1;
+
+  /* Allocate aligned buffer pool */
+  for (i = 0; i < WRITER_BUFFERS; i++) {
+    if (posix_memalign((void**) &writer->buffers[i].data, WRITER_ALIGNMENT,
+                       WRITER_BUFFER_SIZE) != 0)
+      print_error("posix_memalign");
+    writer->free_list[i] = &writer->buffers[i];
+  }
+  writer->free_count = WRITER_BUFFERS;
+
+  /* Capture thread starts with first buffer */
+  writer->current = writer->free_list[--writer->free_count];
+  writer->file_bytes = writer->header_length;
+  writer->file_started = 0;
+  writer->last_submit = time(NULL);
+
+  pthread_mutex_init(&writer->lock, NULL);
+  pthread_cond_init(&writer->full_cond, NULL);
+  pthread_cond_init(&writer->pending_cond, NULL);
+
+  result = pthread_create(&writer->thread, NULL, writer_main, writer);
+  if (result == 0 && compress)
+    result = pthread_create(&writer->compressor, NULL, compressor_main, writer);
+  if (result != 0) {
+    errno = result;
+    print_error("pthread_create");
+  }
+
+  return writer;
+}
+
+/*
+ * take_buffer - used by capture thread to get free buffer
+ * when it has none. Never waits.
+ * @writer - pointer to an object of capture_writer struct
+ */
+static void take_buffer(struct capture_writer* writer) {
+  pthread_mutex_lock(&writer->lock);
+  if (writer->free_count)
+    writer->current = writer->free_list[--writer->free_count];
+  pthread_mutex_unlock(&writer->lock);
+}
+
+/*
+ * submit_buffer - used by capture thread to hand current buffer
+ * to writer thread and take free one. Never waits: without
+ * free buffer current stays NULL and packets are dropped.
+ * @writer - pointer to an object of capture_writer struct
+ * @rotate - close file after this buffer
+ */
+static void submit_buffer(struct capture_writer* writer, int rotate) {
+  unsigned int tail;
+
+  pthread_mutex_lock(&writer->lock);
+  if (writer->current) {
+    writer->current->rotate = rotate;
+    tail = (writer->full_head + writer->full_count) % WRITER_BUFFERS;
+    writer->full_queue[tail] = writer->current;
+    writer->full_count++;
+    pthread_cond_signal(&writer->full_cond);
+  }
+
+  writer->current = writer->free_count ? writer->free_list[--writer->free_count] : NULL;
+  pthread_mutex_unlock(&writer->lock);
+
+  writer->last_submit = time(NULL);
+}
+
+/*
+ * rotate_file - used by capture thread to finish current
+ * file at record boundary. Rotation travels with a buffer,
+ * so without one file keeps growing until a buffer is free.
+ * @writer - pointer to an object of capture_writer struct
+ * @now - current time in seconds
+ */
+static void rotate_file(struct capture_writer* writer, time_t now) {
+  if (!writer->current)
+    take_buffer(writer);
+  if (!writer->current)
+    return;
+
+  submit_buffer(writer, 1);
+  writer->file_bytes = writer->header_length;
+  writer->file_started = now;
+}
+
+/*
+ * write_packet - used to append packet record to current
+ * buffer. Called on capture thread, only copies memory.
+ * @writer - pointer to an object of capture_writer struct
+ * @ts - capture time of packet
+ * @interface - index of merged input, kept in pcapng only
+ * @data - packet starting from IP header
+ * @length - amount of captured bytes
+ * @wire_length - original length of packet
+ */
+void write_packet(struct capture_writer* writer, const struct timespec* ts,
+                  unsigned int interface, const void* data, uint32_t length,
+                  uint32_t wire_length) {
+  uint32_t caplen = length < writer->snaplen ? length : writer->snaplen;
+  size_t size = record_size(writer->format, caplen);
+  struct pcap_record* record;
+  struct pcapng_epb* epb;
+  uint64_t nsec;
+  uint8_t* ptr;
+
+  /* Rotation by time follows capture clock, as in replay */
+  if (!writer->file_started)
+    writer->file_started = ts->tv_sec;
+
+  /* Rotate before record that would not fit */
+  if ((writer->rotate_size && writer->file_bytes + size > writer->rotate_size &&
+       writer->file_bytes > writer->header_length) ||
+      (writer->rotate_time && ts->tv_sec - writer->file_started >= writer->rotate_time))
+    rotate_file(writer, ts->tv_sec);
+
+  /* Take new buffer when current one is full */
+  if (writer->current && writer->current->length + size > WRITER_BUFFER_SIZE)
+    submit_buffer(writer, 0);
+  if (!writer->current)
+    take_buffer(writer);
+  if (!writer->current || size > WRITER_BUFFER_SIZE) {
+    writer->dropped++;
+    return;
+  }
+
+  ptr = writer->current->data + writer->current->length;
+  if (writer->format == FORMAT_PCAPNG) {
+    nsec = (uint64_t) ts->tv_sec * 1000000000ull + ts->tv_nsec;
+    epb = (struct pcapng_epb*) ptr;
+    epb->type = PCAPNG_EPB;
+    epb->length = size;
+    epb->interface = interface;
+    epb->ts_high = nsec >> 32;
+    epb->ts_low = (uint32_t) nsec;
+    epb->caplen = caplen;
+    epb->len = wire_length;
+    memcpy(ptr + sizeof(*epb), data, caplen);
+    memset(ptr + sizeof(*epb) + caplen, 0, ((caplen + 3) & ~3u) - caplen);
+    memcpy(ptr + size - sizeof(uint32_t), &epb->length, sizeof(uint32_t));
+  }
+  else {
+    record = (struct pcap_record*) ptr;
+    record->ts_sec = ts->tv_sec;
+    record->ts_nsec = ts->tv_nsec;
+    record->caplen = caplen;
+    record->len = wire_length;
+    memcpy(ptr + sizeof(*record), data, caplen);
+  }
+
+  writer->current->length += size;
+  writer->file_bytes += size;
+  writer->packets++;
+}
+
+/*
+ * tick_writer - used by capture loop when it is idle or
+ * between batches. Hands partly filled buffer to writer
+ * thread once per flush interval and rotates file by time
+ * even when no packets arrive. Rotation uses capture clock
+ * of packets, flush uses wall clock.
+ * @writer - pointer to an object of capture_writer struct
+ * @now - current capture time in seconds
+ */
+void tick_writer(struct capture_writer* writer, time_t now) {
+  if (writer->rotate_time && now - writer->file_started >= writer->rotate_time &&
+      writer->file_bytes > writer->header_length) {
+    rotate_file(writer, now);
+    return;
+  }
+
+  if (writer->current && writer->current->length > 0 &&
+      time(NULL) - writer->last_submit >= WRITER_FLUSH_INTERVAL)
+    submit_buffer(writer, 0);
+}
+
+/*
+ * free_writer - used to write remaining records, wait for
+ * writer and compressor threads and free writer.
+ * @writer - pointer to an object of capture_writer struct
+ */
+void free_writer(struct capture_writer* writer) {
+  unsigned int i;
+
+  /* Last buffer closes file */
+  submit_buffer(writer, 1);
+
+  pthread_mutex_lock(&writer->lock);
+  writer->stop = 1;
+  pthread_cond_signal(&writer->full_cond);
+  pthread_mutex_unlock(&writer->lock);
+  pthread_join(writer->thread, NULL);
+
+  /* Compressor stops once backlog is empty */
+  if (writer->compress) {
+    pthread_mutex_lock(&writer->lock);
+    writer->stop = 2;
+    pthread_cond_signal(&writer->pending_cond);
+    pthread_mutex_unlock(&writer->lock);
+    pthread_join(writer->compressor, NULL);
+  }
+
+  pthread_mutex_destroy(&writer->lock);
+  pthread_cond_destroy(&writer->full_cond);
+  pthread_cond_destroy(&writer->pending_cond);
+
+  for (i = 0; i < WRITER_BUFFERS; i++)
+    free(writer->buffers[i].data);
+  free(writer);
+}
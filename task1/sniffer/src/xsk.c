@@ -0,0 +1,365 @@
+#include "../headers/sniffer.h"
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/bpf.h>
+#include <linux/if_link.h>
+
+/* Single eBPF instruction */
+#define INSN(code, dst, src, off, imm) \
+  ((struct bpf_insn) {(code), (dst), (src), (off), (imm)})
+
+/*
+ * sys_bpf - used to call bpf syscall, which has no
+ * wrapper in libc.
+ * @cmd - bpf command
+ * @attr - pointer to command attributes
+ *
+ * Return: result of syscall
+ */
+static int sys_bpf(int cmd, union bpf_attr* attr) {
+  return syscall(__NR_bpf, cmd, attr, sizeof(*attr));
+}
+
+/*
+ * load_program - used to create XSKMAP and load XDP program
+ * that redirects untagged IPv4 UDP frames to socket of their
+ * queue. Frames of queues without socket and everything else
+ * are passed to kernel stack. Verifier log is printed if
+ * program is rejected.
+ * @xsk - pointer to an object of xsk struct
+ */
+static void load_program(struct xsk* xsk) {
+  static char log[XSK_LOG_SIZE];
+  union bpf_attr attr;
+  struct bpf_insn insns[] = {
+    /* r2 = data, r3 = data_end */
+    INSN(BPF_LDX | BPF_MEM | BPF_W, 2, 1, offsetof(struct xdp_md, data), 0),
+    INSN(BPF_LDX | BPF_MEM | BPF_W, 3, 1, offsetof(struct xdp_md, data_end), 0),
+
+    /* Ethernet and IPv4 headers must be in frame */
+    INSN(BPF_ALU64 | BPF_MOV | BPF_X, 4, 2, 0, 0),
+    INSN(BPF_ALU64 | BPF_ADD | BPF_K, 4, 0, 0, sizeof(struct ethhdr) + sizeof(struct iphdr)),
+    INSN(BPF_JMP | BPF_JGT | BPF_X, 4, 3, 10, 0),
+
+    /* Ethertype IPv4 and protocol UDP */
+    INSN(BPF_LDX | BPF_MEM | BPF_H, 4, 2, offsetof(struct ethhdr, h_proto), 0),
+    INSN(BPF_JMP | BPF_JNE | BPF_K, 4, 0, 8, htons(ETH_P_IP)),
+    INSN(BPF_LDX | BPF_MEM | BPF_B, 4, 2, sizeof(struct ethhdr) + offsetof(struct iphdr, protocol), 0),
+    INSN(BPF_JMP | BPF_JNE | BPF_K, 4, 0, 6, IPPROTO_UDP),
+
+    /* return bpf_redirect_map(map, rx_queue_index, XDP_PASS) */
+    INSN(BPF_LDX | BPF_MEM | BPF_W, 2, 1, offsetof(struct xdp_md, rx_queue_index), 0),
+    INSN(BPF_LD | BPF_IMM | BPF_DW, 1, BPF_PSEUDO_MAP_FD, 0, xsk->map_fd),
+    INSN(0, 0, 0, 0, 0),
+    INSN(BPF_ALU64 | BPF_MOV | BPF_K, 3, 0, 0, XDP_PASS),
+    INSN(BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_redirect_map),
+    INSN(BPF_JMP | BPF_EXIT, 0, 0, 0, 0),
+
+    /* return XDP_PASS */
+    INSN(BPF_ALU64 | BPF_MOV | BPF_K, 0, 0, 0, XDP_PASS),
+    INSN(BPF_JMP | BPF_EXIT, 0, 0, 0, 0)
+  };
+
+  memset(&attr, 0, sizeof(attr));
+  attr.map_type = BPF_MAP_TYPE_XSKMAP;
+  attr.key_size = sizeof(uint32_t);
+  attr.value_size = sizeof(uint32_t);
+  attr.max_entries = xsk->queue + 1;
+  xsk->map_fd = sys_bpf(BPF_MAP_CREATE, &attr);
+  if (xsk->map_fd == -1)
+    print_error("bpf BPF_MAP_CREATE");
+
+  insns[10].imm = xsk->map_fd;
+
+  memset(&attr, 0, sizeof(attr));
+  attr.prog_type = BPF_PROG_TYPE_XDP;
+  attr.insns = (uint64_t) (uintptr_t) insns;
+  attr.insn_cnt = sizeof(insns) / sizeof(insns[0]);
+  attr.license = (uint64_t) (uintptr_t) "GPL";
+  attr.log_buf = (uint64_t) (uintptr_t) log;
+  attr.log_size = sizeof(log);
+  attr.log_level = 1;
+  xsk->prog_fd = sys_bpf(BPF_PROG_LOAD, &attr);
+  if (xsk->prog_fd == -1) {
+    fprintf(stderr, "%s", log);
+    print_error("bpf BPF_PROG_LOAD");
+  }
+}
+
+/*
+ * register_socket - used to put socket into XSKMAP slot of
+ * its queue, before program starts redirecting frames.
+ * @xsk - pointer to an object of xsk struct
+ * @fd - AF_XDP socket
+ */
+static void register_socket(struct xsk* xsk, int fd) {
+  union bpf_attr attr;
+  uint32_t key = xsk->queue;
+  uint32_t value = fd;
+
+  memset(&attr, 0, sizeof(attr));
+  attr.map_fd = xsk->map_fd;
+  attr.key = (uint64_t) (uintptr_t) &key;
+  attr.value = (uint64_t) (uintptr_t) &value;
+  if (sys_bpf(BPF_MAP_UPDATE_ELEM, &attr) == -1)
+    print_error("bpf BPF_MAP_UPDATE_ELEM");
+}
+
+/*
+ * attach_program - used to attach XDP program to interface
+ * through BPF link, so it is detached when sniffer exits.
+ * Native mode is tried first, generic mode works with any
+ * driver.
+ * @xsk - pointer to an object of xsk struct
+ */
+static void attach_program(struct xsk* xsk) {
+  union bpf_attr attr;
+
+  memset(&attr, 0, sizeof(attr));
+  attr.link_create.prog_fd = xsk->prog_fd;
+  attr.link_create.target_ifindex = xsk->ifindex;
+  attr.link_create.attach_type = BPF_XDP;
+  attr.link_create.flags = XDP_FLAGS_DRV_MODE;
+  xsk->link_fd = sys_bpf(BPF_LINK_CREATE, &attr);
+  xsk->native = xsk->link_fd != -1;
+
+  if (xsk->link_fd == -1) {
+    attr.link_create.flags = XDP_FLAGS_SKB_MODE;
+    xsk->link_fd = sys_bpf(BPF_LINK_CREATE, &attr);
+  }
+  if (xsk->link_fd == -1)
+    print_error("bpf BPF_LINK_CREATE");
+}
+
+/*
+ * map_queue - used to map ring of socket into process
+ * memory. Size of ring must already be set.
+ * @fd - AF_XDP socket
+ * @queue - pointer to an object of xsk_queue struct
+ * @offsets - offsets of ring fields in mapped memory
+ * @entry_size - size of one entry
+ * @pgoff - offset of ring for mmap
+ */
+static void map_queue(int fd, struct xsk_queue* queue, const struct xdp_ring_offset* offsets,
+                      size_t entry_size, off_t pgoff) {
+  uint8_t* map;
+
+  queue->map_size = offsets->desc + queue->size * entry_size;
+  map = mmap(NULL, queue->map_size, PROT_READ | PROT_WRITE,
+             MAP_SHARED | MAP_POPULATE, fd, pgoff);
+  if (map == MAP_FAILED)
+    print_error("mmap xsk ring");
+
+  queue->map = map;
+  queue->producer = (uint32_t*) (map + offsets->producer);
+  queue->consumer = (uint32_t*) (map + offsets->consumer);
+  queue->flags = (uint32_t*) (map + offsets->flags);
+  queue->entries = map + offsets->desc;
+}
+
+/*
+ * create_xsk - used to create AF_XDP socket on queue of
+ * interface from config, register UMEM, map its rings and
+ * attach XDP program. Zero-copy bind is tried first and
+ * falls back to copy mode. All frames start in fill ring.
+ * @sniffer - pointer to an object of sniffer struct
+ */
+void create_xsk(struct sniffer* sniffer) {
+  struct xsk* xsk = &sniffer->xsk;
+  struct xdp_umem_reg reg;
+  struct xdp_mmap_offsets offsets;
+  struct sockaddr_xdp sxdp;
+  socklen_t length = sizeof(offsets);
+  uint32_t size = XSK_FRAME_COUNT;
+  uint64_t* addrs;
+  uint32_t i;
+  int fd;
+
+  memset(xsk, 0, sizeof(struct xsk));
+  xsk->map_fd = -1;
+  xsk->prog_fd = -1;
+  xsk->link_fd = -1;
+  xsk->queue = sniffer->config.queue;
+  xsk->ifindex = if_nametoindex(sniffer->config.interface);
+  if (xsk->ifindex == 0)
+    print_error(sniffer->config.interface);
+
+  sniffer->raw_socket = socket(AF_XDP, SOCK_RAW, 0);
+  if (sniffer->raw_socket == -1)
+    print_error("socket");
+  fd = sniffer->raw_socket;
+
+  /* Register frames of UMEM */
+  xsk->umem_size = (size_t) XSK_FRAME_COUNT * XSK_FRAME_SIZE;
+  xsk->umem = mmap(NULL, xsk->umem_size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+  if (xsk->umem == MAP_FAILED)
+    print_error("mmap umem");
+
+  memset(&reg, 0, sizeof(reg));
+  reg.addr = (uint64_t) (uintptr_t) xsk->umem;
+  reg.len = xsk->umem_size;
+  reg.chunk_size = XSK_FRAME_SIZE;
+  reg.headroom = 0;
+  if (setsockopt(fd, SOL_XDP, XDP_UMEM_REG, &reg, sizeof(reg)) == -1)
+    print_error("setsockopt XDP_UMEM_REG");
+
+  /* Every ring fits all frames, so returning frame never waits */
+  if (setsockopt(fd, SOL_XDP, XDP_UMEM_FILL_RING, &size, sizeof(size)) == -1 ||
+      setsockopt(fd, SOL_XDP, XDP_UMEM_COMPLETION_RING, &size, sizeof(size)) == -1 ||
+      setsockopt(fd, SOL_XDP, XDP_RX_RING, &size, sizeof(size)) == -1)
+    print_error("setsockopt xsk ring size");
+
+  if (getsockopt(fd, SOL_XDP, XDP_MMAP_OFFSETS, &offsets, &length) == -1)
+    print_error("getsockopt XDP_MMAP_OFFSETS");
+
+  xsk->rx.size = size;
+  xsk->fill.size = size;
+  xsk->completion.size = size;
+  map_queue(fd, &xsk->rx, &offsets.rx,
+            sizeof(struct xdp_desc), XDP_PGOFF_RX_RING);
+  map_queue(fd, &xsk->fill, &offsets.fr,
+            sizeof(uint64_t), XDP_UMEM_PGOFF_FILL_RING);
+  map_queue(fd, &xsk->completion, &offsets.cr,
+            sizeof(uint64_t), XDP_UMEM_PGOFF_COMPLETION_RING);
+
+  /* Hand all frames to kernel */
+  addrs = (uint64_t*) xsk->fill.entries;
+  for (i = 0; i < XSK_FRAME_COUNT; i++)
+    addrs[i] = (uint64_t) i * XSK_FRAME_SIZE;
+  __atomic_store_n(xsk->fill.producer, XSK_FRAME_COUNT, __ATOMIC_RELEASE);
+
+  memset(&sxdp, 0, sizeof(sxdp));
+  sxdp.sxdp_family = AF_XDP;
+  sxdp.sxdp_ifindex = xsk->ifindex;
+  sxdp.sxdp_queue_id = xsk->queue;
+  sxdp.sxdp_flags = XDP_ZEROCOPY | XDP_USE_NEED_WAKEUP;
+  xsk->zerocopy = bind(fd, (struct sockaddr*) &sxdp, sizeof(sxdp)) == 0;
+  if (!xsk->zerocopy) {
+    sxdp.sxdp_flags = XDP_COPY | XDP_USE_NEED_WAKEUP;
+    if (bind(fd, (struct sockaddr*) &sxdp, sizeof(sxdp)) == -1)
+      print_error("bind");
+  }
+
+  load_program(xsk);
+
+  register_socket(xsk, fd);
+  attach_program(xsk);
+}
+
+/*
+ * run_xsk - used to sniff frames from rx ring of AF_XDP
+ * socket. Frames are processed in place in UMEM and their
+ * frames are returned through fill ring after every batch.
+ * Kernel is woken up only when it asks for it.
+ * @sniffer - pointer to an object of sniffer struct
+ */
+void run_xsk(struct sniffer* sniffer) {
+  struct xsk* xsk = &sniffer->xsk;
+  struct xdp_desc* descs = (struct xdp_desc*) xsk->rx.entries;
+  uint64_t* addrs = (uint64_t*) xsk->fill.entries;
+  uint32_t mask = xsk->rx.size - 1;
+  uint32_t consumer, producer, fill, count, i;
+  struct packet_meta meta;
+  struct packet_view view;
+  struct pollfd pfd;
+
+  pfd.fd = sniffer->raw_socket;
+  pfd.events = POLLIN;
+  pfd.revents = 0;
+
+  /* XDP metadata carries no checksum state */
+  meta.checksum = CHECKSUM_UNKNOWN;
+  meta.interface = 0;
+
+  while (sniffer->running) {
+    consumer = *xsk->rx.consumer;
+    producer = __atomic_load_n(xsk->rx.producer, __ATOMIC_ACQUIRE);
+
+    /* Wait until kernel fills rx ring */
+    if (producer == consumer) {
+      flush_sniffer(sniffer);
+      if (poll(&pfd, 1, XSK_POLL_TIMEOUT) == -1 && errno != EINTR)
+        print_error("poll");
+      continue;
+    }
+
+    count = producer - consumer;
+    if (count > XSK_BATCH)
+      count = XSK_BATCH;
+
+    /* AF_XDP has no per-frame timestamp, batch is stamped on arrival */
+    clock_gettime(CLOCK_REALTIME, &meta.ts);
+    fill = *xsk->fill.producer;
+
+    for (i = 0; i < count; i++) {
+      struct xdp_desc* desc = &descs[(consumer + i) & mask];
+
+      if (parse_link(&view, xsk->umem + desc->addr, desc->len) == ETHERTYPE_IP) {
+        memcpy(meta.vlan_tci, view.vlan_tci, sizeof(meta.vlan_tci));
+        meta.vlan_count = view.vlan_count;
+        meta.wire_length = view.payload.length;
+        process_packet(sniffer, (const char*) view.payload.data,
+                       view.payload.length, &meta);
+      }
+
+      /* Recycle frame, fill ring always has room for it */
+      addrs[(fill + i) & (xsk->fill.size - 1)] = desc->addr & ~(uint64_t) (XSK_FRAME_SIZE - 1);
+    }
+
+    xsk->packets += count;
+    __atomic_store_n(xsk->rx.consumer, consumer + count, __ATOMIC_RELEASE);
+    __atomic_store_n(xsk->fill.producer, fill + count, __ATOMIC_RELEASE);
+
+    if (__atomic_load_n(xsk->fill.flags, __ATOMIC_RELAXED) & XDP_RING_NEED_WAKEUP)
+      recvfrom(sniffer->raw_socket, NULL, 0, MSG_DONTWAIT, NULL, NULL);
+
+    flush_sniffer(sniffer);
+  }
+}
+
+/*
+ * update_xsk_stats - used to read socket statistics from
+ * kernel. Counters are cumulative.
+ * @sniffer - pointer to an object of sniffer struct
+ */
+void update_xsk_stats(struct sniffer* sniffer) {
+  socklen_t length = sizeof(sniffer->xsk.stats);
+
+  if (getsockopt(sniffer->raw_socket, SOL_XDP, XDP_STATISTICS,
+                 &sniffer->xsk.stats, &length) == -1)
+    print_error("getsockopt XDP_STATISTICS");
+}
+
+/*
+ * free_xsk - used to detach XDP program and unmap rings
+ * and UMEM. Socket itself is closed by sniffer.
+ * @sniffer - pointer to an object of sniffer struct
+ */
+void free_xsk(struct sniffer* sniffer) {
+  struct xsk* xsk = &sniffer->xsk;
+  struct xsk_queue* queues[] = {&xsk->rx, &xsk->fill, &xsk->completion};
+  unsigned int i;
+
+  if (xsk->link_fd != -1)
+    close(xsk->link_fd);
+  if (xsk->prog_fd != -1)
+    close(xsk->prog_fd);
+  if (xsk->map_fd != -1)
+    close(xsk->map_fd);
+
+  for (i = 0; i < sizeof(queues) / sizeof(queues[0]); i++) {
+    if (queues[i]->map)
+      munmap(queues[i]->map, queues[i]->map_size);
+    queues[i]->map = NULL;
+  }
+
+  if (xsk->umem && xsk->umem != MAP_FAILED)
+    munmap(xsk->umem, xsk->umem_size);
+
+  xsk->umem = NULL;
+  xsk->link_fd = -1;
+  xsk->prog_fd = -1;
+  xsk->map_fd = -1;
+}
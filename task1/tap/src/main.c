@@ -0,0 +1,161 @@
+#include "../../common/headers/common.h"
+#include "../../common/headers/packet.h"
+#include "../../common/headers/shmring.h"
+#include <getopt.h>
+#include <signal.h>
+#include <errno.h>
+
+#define TAP_MAX_RINGS 64
+#define TAP_IDLE_US 100
+
+static volatile sig_atomic_t running = 1;
+
+void handle_signal(int signal);
+
+void print_packet(const struct shm_packet* packet, const uint8_t* data);
+
+void usage(const char* name);
+
+int main(int argc, char** argv) {
+  static struct option options[] = {
+    {"count", no_argument, NULL, 'c'},
+    {"verbose", no_argument, NULL, 'v'},
+    {"help", no_argument, NULL, 'h'},
+    {NULL, 0, NULL, 0}
+  };
+  struct shm_reader* readers[TAP_MAX_RINGS];
+  struct shm_packet packet;
+  struct sigaction action;
+  static uint8_t data[BUFFER_SIZE];
+  uint64_t total = 0;
+  int count = 0, verbose = 0, rings, open_rings, busy, result, opt, i;
+
+  while ((opt = getopt_long(argc, argv, "cvh", options, NULL)) != -1) {
+    switch (opt) {
+      case 'c':
+        count = 1;
+        break;
+      case 'v':
+        verbose = 1;
+        break;
+      default:
+        usage(argv[0]);
+    }
+  }
+
+  rings = argc - optind;
+  if (rings < 1 || rings > TAP_MAX_RINGS)
+    usage(argv[0]);
+
+  for (i = 0; i < rings; i++) {
+    readers[i] = open_shm_reader(argv[optind + i]);
+    if (!readers[i]) {
+      perror(argv[optind + i]);
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  /* Stop on Ctrl+C without restarting blocked calls */
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = handle_signal;
+  sigemptyset(&action.sa_mask);
+  sigaction(SIGINT, &action, NULL);
+  sigaction(SIGTERM, &action, NULL);
+
+  /* Rings are polled in turn until all publishers stop */
+  open_rings = rings;
+  while (running && open_rings > 0) {
+    busy = 0;
+    open_rings = 0;
+    for (i = 0; i < rings; i++) {
+      while ((result = read_shm_packet(readers[i], &packet, data, sizeof(data))) == 1) {
+        busy = 1;
+        total++;
+        if (!count)
+          print_packet(&packet, data);
+      }
+      if (result == 0)
+        open_rings++;
+    }
+    if (!busy)
+      usleep(TAP_IDLE_US);
+  }
+
+  if (count)
+    printf("%lu\n", (unsigned long) total);
+
+  for (i = 0; i < rings; i++) {
+    if (verbose)
+      fprintf(stderr, "%s: %lu packets read, %lu lost (overrun)\n", argv[optind + i],
+              (unsigned long) readers[i]->packets, (unsigned long) readers[i]->lost);
+    close_shm_reader(readers[i]);
+  }
+
+  exit(EXIT_SUCCESS);
+}
+
+void handle_signal(int signal) {
+  (void) signal;
+  running = 0;
+}
+
+/*
+ * print_packet - used to print one line summary of packet:
+ * capture time, addresses, ports and lengths.
+ * @packet - metadata of packet
+ * @data - bytes of packet starting from IP header
+ */
+void print_packet(const struct shm_packet* packet, const uint8_t* data) {
+  char src[INET6_ADDRSTRLEN], dst[INET6_ADDRSTRLEN];
+  struct packet_view view;
+  unsigned int sport = 0, dport = 0;
+  int family;
+
+  if (dissect_packet(&view, data, packet->caplen, LAYER_IP) == -1) {
+    printf("%lu.%09lu unknown %u/%u\n",
+           (unsigned long) (packet->timestamp / 1000000000ull),
+           (unsigned long) (packet->timestamp % 1000000000ull),
+           packet->caplen, packet->wire_length);
+    return;
+  }
+
+  if (view.network == ETHERTYPE_IP) {
+    family = AF_INET;
+    inet_ntop(family, &view_ip(&view)->saddr, src, sizeof(src));
+    inet_ntop(family, &view_ip(&view)->daddr, dst, sizeof(dst));
+  }
+  else {
+    family = AF_INET6;
+    inet_ntop(family, &view_ip6(&view)->ip6_src, src, sizeof(src));
+    inet_ntop(family, &view_ip6(&view)->ip6_dst, dst, sizeof(dst));
+  }
+
+  if (view.transport.data && view.proto == IPPROTO_UDP) {
+    sport = ntohs(view_udp(&view)->source);
+    dport = ntohs(view_udp(&view)->dest);
+  }
+  else if (view.transport.data && view.proto == IPPROTO_TCP) {
+    sport = ntohs(view_tcp(&view)->source);
+    dport = ntohs(view_tcp(&view)->dest);
+  }
+
+  printf("%lu.%09lu %s:%u -> %s:%u proto %u %u/%u\n",
+         (unsigned long) (packet->timestamp / 1000000000ull),
+         (unsigned long) (packet->timestamp % 1000000000ull),
+         src, sport, dst, dport, view.proto, packet->caplen, packet->wire_length);
+}
+
+/*
+ * usage - used to print help message and exit.
+ * @name - name of the executable
+ */
+void usage(const char* name) {
+  fprintf(stderr,
+          "Usage: %s [options] NAME...\n"
+          "Print packets published by sniffer --publish into shared-memory rings,\n"
+          "e.g. /sniffer-0. Many readers may read the same ring at once.\n"
+          "  -c, --count                print only amount of packets read\n"
+          "  -v, --verbose              print packets read and lost per ring\n",
+          name);
+  exit(EXIT_FAILURE);
+}
@@ -2,6 +2,8 @@
 #define CLIENT_H
 
 #include "../../common/headers/common.h"
+#include "../../common/headers/log.h"
+#include "../../common/headers/packet.h"
 #include <netinet/udp.h>
 #include <netinet/ip.h>
 
@@ -15,6 +17,12 @@ struct client {
   
   /* Server file descriptor*/
   int sfd;
+
+  /* Index of loopback interface */
+  int loopback;
+
+  /* Buffer for received packets */
+  char packet[PACKET_SIZE];
 };
 
 struct client* create_client(const char* ip, const int port);
@@ -25,9 +33,7 @@ void process_input(struct client* client);
 
 void send_message(struct client* client, char message[BUFFER_SIZE]);
 
-char* recv_response(struct client* client);
-
-char* extract_payload(char* buffer);
+int recv_response(struct client* client, struct packet_view* view);
 
 void close_connection(struct client* client);
 
@@ -2,6 +2,7 @@
 #include <netinet/in.h>
 #include <netinet/udp.h>
 #include <string.h>
+#include <net/if.h>
 
 /*
  * create_client - used to create an object of
@@ -11,6 +12,7 @@
  * Return: pointer to an object of client struct
  */
 struct client* create_client(const char* ip, const int port) {
+  int enable = 1;
   struct client* client = (struct client*) malloc(sizeof(struct client));
   if (!client)
     print_error("malloc");
@@ -24,6 +26,11 @@ struct client* create_client(const char* ip, const int port) {
   if (client->sfd == -1)
     print_error("socket");
 
+  /* Receiving interface tells looped back packets */
+  if (setsockopt(client->sfd, IPPROTO_IP, IP_PKTINFO, &enable, sizeof(enable)) == -1)
+    print_error("setsockopt IP_PKTINFO");
+  client->loopback = if_nametoindex("lo");
+
   return client;
 }
 
@@ -49,10 +56,17 @@ void run_client(struct client* client) {
  */
 void process_input(struct client* client) {
   char buffer[BUFFER_SIZE];
+  char serv_ip[INET_ADDRSTRLEN];
+  struct packet_view view;
+
+  inet_ntop(AF_INET, &client->serv.sin_addr, serv_ip, sizeof(serv_ip));
 
   /* Wait for user input */
   while (1) {
+    /* Prompt goes after everything logged so far */
+    flush_log();
     printf("Enter message: ");
+    fflush(stdout);
     
     /* Read user input */
     if (fgets(buffer, sizeof(buffer), stdin) == NULL)
@@ -63,25 +77,17 @@ void process_input(struct client* client) {
     send_message(client, buffer);
     
     /* Receive answer */
-    char* message = recv_response(client);
-      
-    if (message == NULL) {
+    if (recv_response(client, &view) == -1) {
       close_connection(client);
       break;
     }
-    
-    /* Extract payload */
-    char* payload = extract_payload(message);
 
     /* Log response */
-    printf("CLIENT: Received response from %s:%d : %s\n",
-           inet_ntoa(client->serv.sin_addr),
-           ntohs(client->serv.sin_port),
-           payload);
-    
-    /* Free allocated memory */
-    free(message);
-    free(payload);
+    log_message(LOG_LEVEL_INFO, "CLIENT: Received response from %s:%d : %.*s\n",
+                serv_ip,
+                ntohs(client->serv.sin_port),
+                (int) view.payload.length,
+                (const char*) view.payload.data);
   }
 }
 
@@ -92,6 +98,7 @@ void process_input(struct client* client) {
  */
 void send_message(struct client* client, char message[BUFFER_SIZE]) {
   ssize_t bytes_send;
+  char serv_ip[INET_ADDRSTRLEN];
   int length = sizeof(struct udphdr) + strlen(message);
   char buffer[length];
   struct udphdr header; 
@@ -115,81 +122,74 @@ void send_message(struct client* client, char message[BUFFER_SIZE]) {
   if (bytes_send == -1)
     print_error("sendto");
 
-  printf("CLIENT: Send message to %s:%d: %s\n", 
-         inet_ntoa(client->serv.sin_addr), 
-         ntohs(client->serv.sin_port), 
-         message);
+  inet_ntop(AF_INET, &client->serv.sin_addr, serv_ip, sizeof(serv_ip));
+  log_message(LOG_LEVEL_INFO, "CLIENT: Send message to %s:%d: %s\n", 
+              serv_ip,
+              ntohs(client->serv.sin_port), 
+              message);
 }
 
 /*
- * recv_message - used to receive message from server.
- * Allocates memory for buffer which should be freed manually.
+ * recv_response - used to receive response from server.
+ * Packet is received into client buffer and parsed in place,
+ * view stays valid until next call. Responses with bad
+ * checksum are dropped, UDP checksum of packets looped back
+ * is not filled and is not verified.
+ * @client - pointer to an object of client struct
+ * @view - pointer to view filled with parsed response
  *
- * Return: string (message) if successful, NULL if connection terminated
+ * Return: 0 if successful, -1 if connection terminated
  */
-char* recv_response(struct client* client) {
-     
+int recv_response(struct client* client, struct packet_view* view) {
+  char control[CMSG_SPACE(sizeof(struct in_pktinfo))];
+  enum packet_checksum checksum;
+  struct in_pktinfo info;
+  struct cmsghdr* cmsg;
+  struct msghdr msg;
+  struct iovec iov;
   ssize_t bytes_read;
-  socklen_t serv_len;
-  struct sockaddr_in addr; 
-  char* buffer = (char*) malloc(BUFFER_SIZE * sizeof(char));
-   
-  serv_len = sizeof(addr);
+
+  iov.iov_base = client->packet;
+  iov.iov_len = PACKET_SIZE;
   
   while (1) {
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
     /* Receive message from server */ 
-    bytes_read = recvfrom(client->sfd, buffer, BUFFER_SIZE, 0, 
-                          (struct sockaddr*) &addr, &serv_len);
+    bytes_read = recvmsg(client->sfd, &msg, 0);
 
     if (bytes_read == -1)
-      print_error("recvfrom");
+      print_error("recvmsg");
     else if (bytes_read == 0)
-      return NULL;
+      return -1;
     
-    struct iphdr* ip = (struct iphdr*) buffer;
-    struct udphdr* udp = (struct udphdr*) (buffer + ip->ihl * 4);
+    /* Skip malformed packets */
+    if (parse_packet(view, client->packet, bytes_read, LAYER_IP) == -1)
+      continue;
 
     /* Message from server */
-    if (ip->saddr == client->serv.sin_addr.s_addr &&
-    udp->source == client->serv.sin_port) {
-      break;
+    if (view_ip(view)->saddr == client->serv.sin_addr.s_addr &&
+    view_udp(view)->source == client->serv.sin_port) {
+      checksum = CHECKSUM_UNKNOWN;
+      for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level == IPPROTO_IP && cmsg->cmsg_type == IP_PKTINFO) {
+          memcpy(&info, CMSG_DATA(cmsg), sizeof(info));
+          if (info.ipi_ifindex == client->loopback)
+            checksum = CHECKSUM_PARTIAL;
+        }
+      }
+
+      if (verify_packet(view, checksum) == VERDICT_VALID)
+        break;
+      log_message(LOG_LEVEL_WARN, "CLIENT: Dropped response with bad checksum\n");
     }
   }
   
-  /* Truncate buffer */
-  buffer[bytes_read] = '\0';
-
-  return buffer;
-}
-
-/*
- * extract_payload - used to extract payload
- * from UDP packet. Skips IP header and UDP header
- * by calculation their length. Allocates memory
- * for payload (must be free manually).
- * @buffer - pointer to UDP packet
- *
- * Return: pointer to buffer with payload
- */
-char* extract_payload(char* buffer) {
-  int iphdr_length, size;
-  char* ptr;
-  char* payload = (char*) malloc(BUFFER_SIZE * sizeof(char));
-  struct iphdr* ip;
-  
-  /* Extract IP header */
-  ip = (struct iphdr*) buffer;
-
-  /* Calculate IP header length */
-  iphdr_length = ip->ihl * 4;
-  
-  /* Get payload */
-  ptr = buffer + iphdr_length + sizeof(struct udphdr);
-   
-  /* Copy payload */
-  strncpy(payload, ptr, strlen(ptr));
-
-  return payload;  
+  return 0;
 }
 
 /*
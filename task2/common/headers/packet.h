@@ -0,0 +1,197 @@
+#ifndef PACKET_H
+#define PACKET_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <netinet/ip.h>
+#include <netinet/ip6.h>
+#include <netinet/udp.h>
+#include <netinet/tcp.h>
+#include <netinet/ip_icmp.h>
+#include <netinet/icmp6.h>
+#include <net/ethernet.h>
+#include <linux/if_packet.h>
+
+#define PACKET_MAX_VLANS 2
+
+/* Size of next header dispatch tables, one entry per protocol number */
+#define PACKET_PROTOCOLS 256
+
+/* Tag protocol identifiers of 802.1Q and 802.1ad (QinQ) */
+#define ETHERTYPE_8021Q 0x8100
+#define ETHERTYPE_8021AD 0x88a8
+
+/*
+ * Used to describe part of captured packet. Points
+ * into capture buffer, nothing is copied or allocated.
+ */
+struct packet_slice {
+  /* Start of the layer, NULL if layer is absent */
+  const uint8_t* data;
+
+  /* Length of the layer in bytes */
+  size_t length;
+};
+
+/*
+ * Used as zero-copy view of Ethernet/IP packet. Network
+ * layer is IPv4 or IPv6, transport layer is TCP, UDP,
+ * ICMP or ICMPv6. Every slice is checked against captured
+ * length, so it is safe to read whole slice.
+ */
+struct packet_view {
+  /* Ethernet header including VLAN tags */
+  struct packet_slice eth;
+
+  /* VLAN TCIs, outer tag first */
+  uint16_t vlan_tci[PACKET_MAX_VLANS];
+  unsigned int vlan_count;
+
+  /* EtherType of network layer, ETHERTYPE_IP or ETHERTYPE_IPV6 */
+  uint16_t network;
+
+  /* Protocol after IP header and IPv6 extension headers */
+  uint8_t proto;
+
+  /* Set for fragments, only the first one has transport header */
+  uint8_t fragment;
+
+  /* Set when capture is shorter than length in headers, or it is unknown */
+  uint8_t truncated;
+
+  /* IPv4 header including options or IPv6 fixed header */
+  struct packet_slice ip;
+
+  /* Unfolded one's complement sum of IPv4 header, 0 for IPv6 */
+  uint64_t ip_sum;
+
+  /* IPv6 extension headers, empty for IPv4 */
+  struct packet_slice ext;
+
+  /* TCP, UDP, ICMP or ICMPv6 header */
+  struct packet_slice transport;
+
+  /* Payload of last decoded layer, may contain NUL bytes */
+  struct packet_slice payload;
+};
+
+/* First layer present in captured buffer */
+enum packet_layer {
+  LAYER_ETH,
+  LAYER_IP
+};
+
+int parse_link(struct packet_view* view, const void* data, size_t length);
+
+/* Checksum state of received packet reported by kernel */
+enum packet_checksum {
+  /* Nothing is known, checksums are verified */
+  CHECKSUM_UNKNOWN,
+
+  /* Transport checksum was verified by NIC or kernel */
+  CHECKSUM_VALID,
+
+  /* Packet was sent by this host, transport checksum is not filled yet */
+  CHECKSUM_PARTIAL,
+
+  /* Packet was read from capture file, which keeps no checksum state */
+  CHECKSUM_REPLAYED
+};
+
+/* Result of checksum verification */
+enum packet_verdict {
+  VERDICT_VALID,
+  VERDICT_BAD_IP,
+  VERDICT_BAD_TRANSPORT
+};
+
+/*
+ * checksum_state - used to get checksum state of packet
+ * from its status in packet socket. Checksums of own
+ * packets are not filled yet when they are looped back.
+ * @status - tp_status of ring frame or auxiliary data
+ *
+ * Return: checksum state of packet
+ */
+static inline enum packet_checksum checksum_state(uint32_t status) {
+  if (status & TP_STATUS_CSUMNOTREADY)
+    return CHECKSUM_PARTIAL;
+  if (status & TP_STATUS_CSUM_VALID)
+    return CHECKSUM_VALID;
+  return CHECKSUM_UNKNOWN;
+}
+
+uint64_t checksum_add(const void* data, size_t length, uint64_t sum);
+
+uint16_t checksum_fold(uint64_t sum);
+
+enum packet_verdict verify_packet(const struct packet_view* view, 
+                                  enum packet_checksum state);
+
+int dissect_packet(struct packet_view* view, const void* data, size_t length,
+                   enum packet_layer first);
+
+int parse_packet(struct packet_view* view, const void* data, size_t length, 
+                 enum packet_layer first);
+
+/*
+ * view_ip - used to get IP header of parsed packet.
+ * @view - pointer to an object of packet_view struct
+ *
+ * Return: pointer to IP header
+ */
+static inline const struct iphdr* view_ip(const struct packet_view* view) {
+  return (const struct iphdr*) view->ip.data;
+}
+
+/*
+ * view_ip6 - used to get IPv6 header of parsed packet.
+ * @view - pointer to an object of packet_view struct
+ *
+ * Return: pointer to IPv6 header
+ */
+static inline const struct ip6_hdr* view_ip6(const struct packet_view* view) {
+  return (const struct ip6_hdr*) view->ip.data;
+}
+
+/*
+ * view_udp - used to get UDP header of parsed packet.
+ * @view - pointer to an object of packet_view struct
+ *
+ * Return: pointer to UDP header
+ */
+static inline const struct udphdr* view_udp(const struct packet_view* view) {
+  return (const struct udphdr*) view->transport.data;
+}
+
+/*
+ * view_tcp - used to get TCP header of parsed packet.
+ * @view - pointer to an object of packet_view struct
+ *
+ * Return: pointer to TCP header
+ */
+static inline const struct tcphdr* view_tcp(const struct packet_view* view) {
+  return (const struct tcphdr*) view->transport.data;
+}
+
+/*
+ * view_icmp - used to get ICMP header of parsed packet.
+ * @view - pointer to an object of packet_view struct
+ *
+ * Return: pointer to ICMP header
+ */
+static inline const struct icmphdr* view_icmp(const struct packet_view* view) {
+  return (const struct icmphdr*) view->transport.data;
+}
+
+/*
+ * view_icmp6 - used to get ICMPv6 header of parsed packet.
+ * @view - pointer to an object of packet_view struct
+ *
+ * Return: pointer to ICMPv6 header
+ */
+static inline const struct icmp6_hdr* view_icmp6(const struct packet_view* view) {
+  return (const struct icmp6_hdr*) view->transport.data;
+}
+
+#endif // !PACKET_H
@@ -2,6 +2,8 @@
 #define CLIENT_H
 
 #include "../../common/headers/common.h"
+#include "../../common/headers/log.h"
+#include "../../common/headers/packet.h"
 #include <netinet/udp.h>
 #include <netinet/ip.h>
 
@@ -15,6 +17,12 @@ struct client {
   
   /* Server file descriptor*/
   int sfd;
+
+  /* Index of loopback interface */
+  int loopback;
+
+  /* Buffer for received packets */
+  char packet[PACKET_SIZE];
 };
 
 struct client* create_client(const char* ip, const int port);
@@ -25,14 +33,12 @@ void process_input(struct client* client);
 
 void send_message(struct client* client, char message[BUFFER_SIZE]);
 
-char* recv_response(struct client* client);
+int recv_response(struct client* client, struct packet_view* view);
 
 void init_iphdr(struct client* client, struct iphdr* ip);
 
 void init_udphdr(struct client* client, struct udphdr* udp, ssize_t length);
 
-char* extract_payload(char* buffer);
-
 void close_connection(struct client* client);
 
 void free_client(struct client* client);
@@ -14,6 +14,7 @@
 
 #define CLIENTS_AMOUNT 5
 #define BUFFER_SIZE 128
+#define PACKET_SIZE 65536
 #define SERVER_IP "127.0.0.1" 
 #define SERVER_PORT 8080
 #define CLIENT_PORT 7777
@@ -2,6 +2,7 @@
 #define SERVER_H
 
 #include "../../common/headers/common.h"
+#include "../../common/headers/log.h"
 
 /**
  * Used to create server on inet adress family (AF_INET) with
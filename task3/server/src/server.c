@@ -37,19 +37,22 @@ struct server* create_server(const char* ip, const int port) {
 void run_server(struct server* server) {
   struct sockaddr_in client;
   socklen_t client_size = sizeof(client);
+  char ip[INET_ADDRSTRLEN];
 
   /* Bind Endpoint to socket */
   if (bind(server->sfd, (struct sockaddr*) &server->serv, sizeof(server->serv)) == -1)
     print_error("bind");
     
-  printf("SERVER: Server %s:%d started\n", inet_ntoa(server->serv.sin_addr), ntohs(server->serv.sin_port));
+  inet_ntop(AF_INET, &server->serv.sin_addr, ip, sizeof(ip));
+  log_message(LOG_LEVEL_INFO, "SERVER: Server %s:%d started\n", ip, ntohs(server->serv.sin_port));
 
   /* Wait for data */
   while (1) {
     char* buffer = recv_message(server, &client);
     char* reply = edit_message(buffer);
     
-    printf("SERVER: Received message from %s:%d: %s\n", inet_ntoa(client.sin_addr), ntohs(client.sin_port), buffer);
+    inet_ntop(AF_INET, &client.sin_addr, ip, sizeof(ip));
+    log_message(LOG_LEVEL_INFO, "SERVER: Received message from %s:%d: %s\n", ip, ntohs(client.sin_port), buffer);
     send_message(server, &client, reply);
 
     free(buffer);
@@ -66,13 +69,15 @@ void run_server(struct server* server) {
 void send_message(struct server* server, struct sockaddr_in* client, char buffer[BUFFER_SIZE]) {
   ssize_t bytes_send;
   socklen_t client_len = sizeof(*client);
+  char ip[INET_ADDRSTRLEN];
 
   bytes_send = sendto(server->sfd, buffer, strlen(buffer), 0, (struct sockaddr*) client, client_len);
 
   if (bytes_send == -1)
     print_error("sendto");
   
-  printf("SERVER: Send message to %s:%d: %s\n", inet_ntoa(client->sin_addr), ntohs(client->sin_port), buffer);
+  inet_ntop(AF_INET, &client->sin_addr, ip, sizeof(ip));
+  log_message(LOG_LEVEL_INFO, "SERVER: Send message to %s:%d: %s\n", ip, ntohs(client->sin_port), buffer);
 }
 
 /*
@@ -2,6 +2,8 @@
 #define CLIENT_H
 
 #include "../../common/headers/common.h"
+#include "../../common/headers/log.h"
+#include "../../common/headers/packet.h"
 #include <net/ethernet.h>
 #include <netinet/udp.h>
 #include <netinet/ip.h>
@@ -21,6 +23,9 @@ struct client {
 
   /* Server file descriptor*/
   int sfd;
+
+  /* Buffer for received frames */
+  char packet[PACKET_SIZE];
 };
 
 struct client* create_client(const char* ip, const int port, 
@@ -32,7 +37,7 @@ void process_input(struct client* client);
 
 void send_message(struct client* client, char message[BUFFER_SIZE]);
 
-char* recv_response(struct client* client);
+int recv_response(struct client* client, struct packet_view* view);
 
 void init_iphdr(struct iphdr* ip, char message[BUFFER_SIZE], 
                 const char* client_ip, const char* server_ip);
@@ -34,6 +34,10 @@ struct client* create_client(const char* ip, const int port, const char mac[MAC_
   if (client->sfd == -1)
     print_error("socket");
 
+  /* Checksum state of every frame is passed as auxiliary data */
+  if (setsockopt(client->sfd, SOL_PACKET, PACKET_AUXDATA, &flag, sizeof(flag)) == -1)
+    print_error("setsockopt PACKET_AUXDATA");
+
   return client;
 }
 
@@ -57,9 +61,12 @@ void process_input(struct client* client) {
 
   /* Wait for user input */
   while (1) {
-    char* message;
+    struct packet_view view;
 
+    /* Prompt goes after everything logged so far */
+    flush_log();
     printf("Enter message: ");
+    fflush(stdout);
     
     /* Read user input */
     if (fgets(buffer, sizeof(buffer), stdin) == NULL)
@@ -69,26 +76,23 @@ void process_input(struct client* client) {
     /* Send user message */
     send_message(client, buffer);
   
-    printf("CLIENT: Send message to %s:%d: %s\n", 
-         client->serv_ip, 
-         client->serv_port, 
-         buffer);
+    log_message(LOG_LEVEL_INFO, "CLIENT: Send message to %s:%d: %s\n", 
+                client->serv_ip, 
+                client->serv_port, 
+                buffer);
    
     /* Receive answer */
-    message = recv_response(client);
-    if (message == NULL) {
+    if (recv_response(client, &view) == -1) {
       close_connection(client);
       break;
     }
     
     /* Log response */
-    printf("CLIENT: Received response from %s:%d : %s\n",
-           client->serv_ip,
-           client->serv_port,
-           message);
-
-    /* Free allocated memory */
-    free(message);
+    log_message(LOG_LEVEL_INFO, "CLIENT: Received response from %s:%d : %.*s\n",
+                client->serv_ip,
+                client->serv_port,
+                (int) view.payload.length,
+                (const char*) view.payload.data);
   }
 }
 
@@ -193,52 +197,68 @@ void init_etherhdr(struct ether_header* ether, uint8_t shost[MAC_SIZE],
   memcpy(ether->ether_dhost, dhost, MAC_SIZE);
 }
 /*
- * recv_message - used to receive message from server.
- * Allocates memory for buffer which should be freed manually.
+ * recv_response - used to receive response from server.
+ * Frame is received into client buffer and parsed in place,
+ * view stays valid until next call. Responses with bad
+ * checksum are dropped unless kernel reports checksum
+ * verified or not filled yet.
+ * @client - pointer to an object of client struct
+ * @view - pointer to view filled with parsed response
  *
- * Return: string (message) if successful, NULL if connection terminated
+ * Return: 0 if successful, -1 if connection terminated
  */
-char* recv_response(struct client* client) {
-     
-  ssize_t bytes_read;
-  socklen_t serv_len;
+int recv_response(struct client* client, struct packet_view* view) {
+  char control[CMSG_SPACE(sizeof(struct tpacket_auxdata))];
+  enum packet_checksum checksum;
+  struct tpacket_auxdata aux;
   struct sockaddr_ll addr; 
-  char* packet = (char*) malloc(BUFFER_SIZE * sizeof(char));
-  char* buffer = (char*) malloc(BUFFER_SIZE * sizeof(char));
+  struct cmsghdr* cmsg;
+  struct msghdr msg;
+  struct iovec iov;
+  ssize_t bytes_read;
 
-  serv_len = sizeof(addr);
+  iov.iov_base = client->packet;
+  iov.iov_len = PACKET_SIZE;
   
   while (1) {
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_name = &addr;
+    msg.msg_namelen = sizeof(addr);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
     /* Receive message from server */ 
-    bytes_read = recvfrom(client->sfd, packet, BUFFER_SIZE, 0, 
-                          (struct sockaddr*) &addr, &serv_len);
+    bytes_read = recvmsg(client->sfd, &msg, 0);
 
     if (bytes_read == -1)
-      print_error("recvfrom");
+      print_error("recvmsg");
     else if (bytes_read == 0)
-      return NULL;
+      return -1;
     
-    /* Extract headers */
-    struct ethhdr* ether = (struct ethhdr*) packet; 
-    struct iphdr* ip = (struct iphdr*) (packet + sizeof(struct ethhdr));
-    struct udphdr* udp = (struct udphdr*) (packet + sizeof(struct ethhdr) + ip->ihl * 4);
+    /* Skip frames that are not UDP over IPv4 */
+    if (parse_packet(view, client->packet, bytes_read, LAYER_ETH) == -1)
+      continue;
 
     /* Message from server */
-    if (ip->saddr == inet_addr(client->serv_ip) &&
-    udp->source == htons(client->serv_port)) {
-      /* Extract payload */
-      strncpy(buffer, 
-              packet + sizeof(struct ethhdr) + ip->ihl * 4 
-              + sizeof(struct udphdr),
-              BUFFER_SIZE);
-      break;
+    if (view_ip(view)->saddr == inet_addr(client->serv_ip) &&
+    view_udp(view)->source == htons(client->serv_port)) {
+      checksum = CHECKSUM_UNKNOWN;
+      for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_PACKET && cmsg->cmsg_type == PACKET_AUXDATA) {
+          memcpy(&aux, CMSG_DATA(cmsg), sizeof(aux));
+          checksum = checksum_state(aux.tp_status);
+        }
+      }
+
+      if (verify_packet(view, checksum) == VERDICT_VALID)
+        break;
+      log_message(LOG_LEVEL_WARN, "CLIENT: Dropped response with bad checksum\n");
     }
   }
   
-  /* Truncate buffer */
-  packet[bytes_read] = '\0';
-  free(packet);
-  return buffer;
+  return 0;
 }
 
 /*
@@ -1,13 +1,27 @@
 #include "../headers/client.h"
+#include <signal.h>
 
 struct client* client;
 
 void cleanup();
 
+void handle_signal(int signal);
+
 int main(void) {
+  struct sigaction action;
+
+  init_log(STDOUT_FILENO);
   const char mac[MAC_SIZE] = SERVER_MAC; 
   client = create_client(SERVER_IP, SERVER_PORT, mac, CLIENT_IP);
   atexit(cleanup);
+
+  /* Ctrl+C exits normally, so queued log lines are flushed */
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = handle_signal;
+  sigemptyset(&action.sa_mask);
+  sigaction(SIGINT, &action, NULL);
+  sigaction(SIGTERM, &action, NULL);
+
   run_client(client);
   exit(EXIT_SUCCESS);
 }
@@ -16,3 +30,8 @@ void cleanup() {
   close_connection(client);
   free_client(client);
 }
+
+void handle_signal(int signal) {
+  (void) signal;
+  exit(EXIT_SUCCESS);
+}
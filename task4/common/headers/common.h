@@ -17,6 +17,7 @@
 
 #define CLIENTS_AMOUNT 5
 #define BUFFER_SIZE 128
+#define PACKET_SIZE 65536
 #define SERVER_IP "192.168.0.6"
 #define CLIENT_IP "192.168.0.3"
 #define SERVER_MAC {0x08, 0x00, 0x27, 0x71, 0xa1, 0x6e}
@@ -0,0 +1,59 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define LOG_RING_SIZE (1 << 20)
+#define LOG_LINE_SIZE 1024
+#define LOG_FLUSH_INTERVAL 5
+
+/* Severity of log message */
+enum log_level {
+  LOG_LEVEL_DEBUG,
+  LOG_LEVEL_INFO,
+  LOG_LEVEL_WARN,
+  LOG_LEVEL_ERROR
+};
+
+/*
+ * Used as per-thread buffer of log output. Owning thread
+ * is the only producer and flusher thread the only consumer,
+ * so ring needs no locks. Messages that do not fit are
+ * dropped and counted instead of blocking producer.
+ */
+struct log_ring {
+  /* Bytes of formatted messages */
+  char data[LOG_RING_SIZE];
+
+  /* Total bytes written by producer */
+  uint64_t head;
+
+  /* Total bytes consumed by flusher */
+  uint64_t tail;
+
+  /* Messages dropped because ring was full */
+  uint64_t dropped;
+
+  /* Next ring in list of all rings */
+  struct log_ring* next;
+};
+
+void init_log(int fd);
+
+void set_log_level(enum log_level level);
+
+int parse_log_level(const char* name, enum log_level* level);
+
+void log_message(enum log_level level, const char* format, ...)
+  __attribute__((format(printf, 2, 3)));
+
+void log_write(enum log_level level, const void* data, size_t length);
+
+void flush_log(void);
+
+uint64_t get_log_dropped(void);
+
+void free_log(void);
+
+#endif // !LOG_H
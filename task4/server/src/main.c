@@ -1,12 +1,26 @@
 #include "../headers/server.h"
+#include <signal.h>
 
 struct server* server;
 
 void cleanup();
 
+void handle_signal(int signal);
+
 int main(void) {
+  struct sigaction action;
+
+  init_log(STDOUT_FILENO);
   server = create_server(SERVER_IP, SERVER_PORT);
   atexit(cleanup);
+
+  /* Ctrl+C exits normally, so queued log lines are flushed */
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = handle_signal;
+  sigemptyset(&action.sa_mask);
+  sigaction(SIGINT, &action, NULL);
+  sigaction(SIGTERM, &action, NULL);
+
   run_server(server); 
   exit(EXIT_SUCCESS);
 }
@@ -15,3 +29,8 @@ void cleanup() {
   close_connection(server);
   free_server(server); 
 }
+
+void handle_signal(int signal) {
+  (void) signal;
+  exit(EXIT_SUCCESS);
+}